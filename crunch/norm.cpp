@@ -210,15 +210,18 @@ int Norm::Crunch() {
 
 int Norm::CalcParams() {
   int errcnt = 0;
+  // the reference is loaded and prepared once for all the images
+  CrunchCube ref;
+  ref.ReadFile(refname);
+  if (!ref.data_valid) {
+    printf("norm: error: couldn't load reference image %s, aborting\n",
+           refname.c_str());
+    return (1);
+  }
+  NormTemplate tmpl(&ref);
   for (int i = 0; i < args.size(); i++) {
-    CrunchCube image, ref;
+    CrunchCube image;
     imagename = args[i];
-    ref.ReadFile(refname);
-    if (!ref.data_valid) {
-      printf("norm: error: couldn't load reference image %s, aborting\n",
-             refname.c_str());
-      return (1);
-    }
     image.ReadFile(imagename);
     if (!image.data_valid) {
       printf("norm: error: couldn't load image %s\n", imagename.c_str());
@@ -237,7 +240,7 @@ int Norm::CalcParams() {
       image.SetOrigin(o1, o2, o3);
     }
 
-    dan_sn3d(&ref, &image, affine, dims, transform, MF);
+    dan_sn3d(tmpl, &image, affine, dims, transform, MF);
     printf("norm: Done calculating.\n");
   }
   return errcnt;
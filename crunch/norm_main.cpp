@@ -18,8 +18,11 @@ using namespace std;
 
 #include "vbcrunch.h"
 
-int dan_sn3d(CrunchCube *REF, CrunchCube *IMAGE, Matrix &affine, Matrix &dims,
-             Matrix &transform, Matrix &MF) {
+// the template-side work (smoothing, sampling grids, basis functions)
+// is done once in tmpl and reused for every image normalized to it
+
+int dan_sn3d(NormTemplate &tmpl, CrunchCube *IMAGE, Matrix &affine,
+             Matrix &dims, Matrix &transform, Matrix &MF) {
   CrunchCube *sIMAGE, *sREF;
   Matrix MG;
   RowVector pdesc(13, 1.0), fr(13, 1.0), mean0, p1, prms;
@@ -32,23 +35,23 @@ int dan_sn3d(CrunchCube *REF, CrunchCube *IMAGE, Matrix &affine, Matrix &dims,
 
   // smoothing is in
   sIMAGE = dan_smooth_image(IMAGE, 8, 8, 8);
-  sREF = dan_smooth_image(REF, 8, 8, 8);
+  sREF = tmpl.sREF;
   MF = dan_get_space_image(IMAGE);
-  MG = dan_get_space_image(sREF);
+  MG = tmpl.MG;
 
   // Affine Normalisation
   np = 1;
   mean0 = affp;
   mean0.resize(mean0.length() + 1, 1.0);
 
-  p1 = dan_affsub2(sREF, sIMAGE, MG, MF, 1, 8, mean0, fr, pdesc);
-  p1 = dan_affsub2(sREF, sIMAGE, MG, MF, 1, 4, p1, fr, pdesc);
+  p1 = dan_affsub2(tmpl, sIMAGE, MF, 1, 8, mean0, fr, pdesc);
+  p1 = dan_affsub2(tmpl, sIMAGE, MF, 1, 4, p1, fr, pdesc);
 
   prms = p1;
   prms.resize(12);
   affine = ((MG.inverse() * dan_matrix(prms)) * MF).inverse();
 
-  dan_snbasis_map(sREF, sIMAGE, affine, 4, 5, 4, 8, 8, 0.02);
+  dan_snbasis_map(tmpl, sIMAGE, affine, 4, 5, 4, 8, 8, 0.02);
   transform = ret_m1;
   dims = ret_m2;
   scales = ret_d1;
@@ -68,7 +71,6 @@ int dan_sn3d(CrunchCube *REF, CrunchCube *IMAGE, Matrix &affine, Matrix &dims,
   dims(5, 2) = sIMAGE->voxsize[2];
 
   delete sIMAGE;
-  delete sREF;
   return TRUE;
 }
 
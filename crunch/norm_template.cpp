@@ -0,0 +1,213 @@
+// norm_template.cpp
+// template-side state for spatial normalization
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include "vbcrunch.h"
+
+NormTemplate::NormTemplate(CrunchCube *ref) {
+  sREF = dan_smooth_image(ref, 8, 8, 8);
+  MG = dan_get_space_image(sREF);
+  k1 = k2 = k3 = 0;
+  sd1 = 0.0;
+}
+
+NormTemplate::~NormTemplate() {
+  if (sREF) delete sREF;
+}
+
+// the sampling grid for dan_affsub1() is every skipx'th/skipy'th voxel
+// of each skipz'th plane of the template, in the same (column-major)
+// order the old mask0 used.  the template is sampled at every grid
+// point once here, so that the iterations only have to pick out the
+// points that land inside the image.
+
+const NormTemplate::affgrid &NormTemplate::getgrid(int samp, int hold) {
+  vbforeach(affgrid & g, grids) if (g.samp == samp && g.hold == hold) return g;
+
+  affgrid g;
+  g.samp = samp;
+  g.hold = hold;
+  int skipx = (int)MAX(round(samp / sREF->voxsize[0]), 1);
+  int skipy = (int)MAX(round(samp / sREF->voxsize[1]), 1);
+  g.skipz = (int)MAX(round(samp / sREF->voxsize[2]), 1);
+  for (int j = 1; j <= sREF->dimy; j++) {
+    if (j % skipy) continue;
+    for (int i = 1; i <= sREF->dimx; i++) {
+      if (i % skipx) continue;
+      g.xm.push_back(i);
+      g.ym.push_back(j);
+    }
+  }
+  int n = g.xm.size();
+  vector<double> zm(n);
+  for (int p = 1; p <= sREF->dimz; p += g.skipz) {
+    vector<double> vals(n);
+    fill(zm.begin(), zm.end(), (double)p);
+    if (n)
+      norm_sample_points(sREF, hold, n, &g.xm[0], &g.ym[0], &zm[0], &vals[0]);
+    g.refplanes.push_back(vals);
+  }
+  grids.push_back(g);
+  return grids.back();
+}
+
+// makebasis() sets up the DCT basis functions and their derivatives
+// for the template, along with the regularization terms.  it's a no-op
+// if we already have the requested basis.
+
+void NormTemplate::makebasis(int kk1, int kk2, int kk3, double sd) {
+  if (kk1 == k1 && kk2 == k2 && kk3 == k3 && sd == sd1) return;
+  k1 = kk1;
+  k2 = kk2;
+  k3 = kk3;
+  sd1 = sd;
+
+  //% Scaling is to improve stability.
+  double stabilise = 64.0;
+  basX = dan_dctmtx(sREF->dimx, k1) * stabilise;
+  basY = dan_dctmtx(sREF->dimy, k2) * stabilise;
+  basZ = dan_dctmtx(sREF->dimz, k3) * stabilise;
+  dbasX = dan_dctmtxdiff(sREF->dimx, k1) * stabilise;
+  dbasY = dan_dctmtxdiff(sREF->dimy, k2) * stabilise;
+  dbasZ = dan_dctmtxdiff(sREF->dimz, k3) * stabilise;
+
+  // IC0 is kron(1,1,dd1)+kron(1,dd2,1)+kron(dd3,1,1), computed directly
+  // rather than through temporary kron products.  it's repeated for
+  // each of the three deformation fields, followed by zeros for the
+  // intensity parameters.
+  int nk = k1 * k2 * k3;
+  double icscale = pow(sd1, -2) * pow(stabilise, 6) /
+                   (3.0 * ((double)(sREF->dimx * sREF->dimy * sREF->dimz) /
+                           (double)(nk - 1)));
+  IC.resize(3 * nk + 4);
+  IC.fill(0.0);
+  for (int z = 0; z < k3; z++) {
+    double dd3 = pow((PI * z) / sREF->dimz, 2);
+    for (int y = 0; y < k2; y++) {
+      double dd2 = pow((PI * y) / sREF->dimy, 2);
+      for (int x = 0; x < k1; x++) {
+        double dd1 = pow((PI * x) / sREF->dimx, 2);
+        int ind = x + k1 * (y + k2 * z);
+        double val = (dd1 + dd2 + dd3) * icscale;
+        IC(ind) = IC(ind + nk) = IC(ind + 2 * nk) = val;
+      }
+    }
+  }
+}
+
+// norm_sample_points() samples map at n points.  trilinear sampling
+// (hold==1) works directly on the raw arrays and doesn't touch any
+// octave objects, so it's safe to call from worker threads.  anything
+// else goes through dan_sample_vol(), and should only be called from
+// the main thread.
+
+template <class T>
+static void sample_trilinear(T *vol, int dimx, int dimy, int dimz,
+                             double scale, int n, const double *x,
+                             const double *y, const double *z, double *out) {
+  int dim1xdim2 = dimx * dimy;
+  vol -= (1 + dimx * (1 + dimy));
+  for (int i = 0; i < n; i++) {
+    double xi = x[i], yi = y[i], zi = z[i];
+    if (!(zi >= 1 - TINY && zi <= dimz + TINY && yi >= 1 - TINY &&
+          yi <= dimy + TINY && xi >= 1 - TINY && xi <= dimx + TINY)) {
+      out[i] = 0.0;
+      continue;
+    }
+    int off1, off2, offx, offy, offz, xcoord, ycoord, zcoord;
+    xcoord = (int)floor(xi);
+    double dx1 = xi - xcoord, dx2 = 1.0 - dx1;
+    ycoord = (int)floor(yi);
+    double dy1 = yi - ycoord, dy2 = 1.0 - dy1;
+    zcoord = (int)floor(zi);
+    double dz1 = zi - zcoord, dz2 = 1.0 - dz1;
+
+    xcoord = (xcoord < 1) ? ((offx = 0), 1)
+                          : ((offx = (xcoord >= dimx) ? 0 : 1), xcoord);
+    ycoord = (ycoord < 1) ? ((offy = 0), 1)
+                          : ((offy = (ycoord >= dimy) ? 0 : dimx), ycoord);
+    zcoord = (zcoord < 1)
+                 ? ((offz = 0), 1)
+                 : ((offz = (zcoord >= dimz) ? 0 : dim1xdim2), zcoord);
+
+    off1 = xcoord + dimx * (ycoord + dimy * zcoord);
+    double k222 = vol[off1];
+    double k122 = vol[off1 + offx];
+    off2 = off1 + offy;
+    double k212 = vol[off2];
+    double k112 = vol[off2 + offx];
+    off1 += offz;
+    double k221 = vol[off1];
+    double k121 = vol[off1 + offx];
+    off2 = off1 + offy;
+    double k211 = vol[off2];
+    double k111 = vol[off2 + offx];
+
+    out[i] =
+        scale *
+        (((k222 * dx2 + k122 * dx1) * dy2 + (k212 * dx2 + k112 * dx1) * dy1) *
+             dz2 +
+         ((k221 * dx2 + k121 * dx1) * dy2 + (k211 * dx2 + k111 * dx1) * dy1) *
+             dz1);
+  }
+}
+
+void norm_sample_points(CrunchCube *map, int hold, int n, const double *x,
+                        const double *y, const double *z, double *out) {
+  double scale = map->scl_slope;
+  if (scale == 0.0) scale = 1.0;
+  if (abs(hold) == 1) {
+    int dx = map->dimx, dy = map->dimy, dz = map->dimz;
+    switch (map->datatype) {
+      case vb_byte:
+        sample_trilinear((unsigned char *)map->data, dx, dy, dz, scale, n, x,
+                         y, z, out);
+        return;
+      case vb_short:
+        sample_trilinear((int16 *)map->data, dx, dy, dz, scale, n, x, y, z,
+                         out);
+        return;
+      case vb_long:
+        sample_trilinear((int32 *)map->data, dx, dy, dz, scale, n, x, y, z,
+                         out);
+        return;
+      case vb_float:
+        sample_trilinear((float *)map->data, dx, dy, dz, scale, n, x, y, z,
+                         out);
+        return;
+      case vb_double:
+        sample_trilinear((double *)map->data, dx, dy, dz, scale, n, x, y, z,
+                         out);
+        return;
+    }
+  }
+  RowVector xx(n), yy(n), zz(n);
+  for (int i = 0; i < n; i++) {
+    xx(i) = x[i];
+    yy(i) = y[i];
+    zz(i) = z[i];
+  }
+  Matrix res = dan_sample_vol(map, xx, yy, zz, hold);
+  for (int i = 0; i < n; i++) out[i] = res(i, 0);
+}
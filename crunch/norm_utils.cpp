@@ -24,47 +24,117 @@ void add_elements(Matrix &mat, const RowVector &locs,
 // spm_affsub1.m 1.1 John Ashburner FIL 96/07/08
 // function [alpha, beta, chi2] = spm_affsub1(REF,IMAGE,MG,MF,Hold,samp,P)
 
-int dan_affsub1(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
-                const Matrix &MF, int Hold, int samp, const RowVector &P) {
+// the template side (sampling grid and template values) comes from
+// the NormTemplate.  the planes are split across threads, each of
+// which accumulates its own alpha/beta/chi2 from blocks of rows of the
+// design matrix, without touching any octave objects.
+
+// rows of the design matrix accumulated at a time
+#define AFFBLOCK 64
+
+class affpartial {
+ public:
+  double alpha[13 * 13];
+  double beta[13];
+  double chi2;
+  int n;
+};
+
+static void affsub1_planes(CrunchCube *IMAGE,
+                           const NormTemplate::affgrid *grid,
+                           const double *mat, int hold, double scale,
+                           int first, int step, affpartial *part) {
+  int n0 = grid->xm.size();
+  vector<double> xm(n0), ym(n0), ref(n0), x1(n0), y1(n0), z1(n0), xs(n0);
+  vector<double> F(n0), dx(n0), dy(n0), dz(n0);
+  double rows[AFFBLOCK][13];
+
+  memset(part, 0, sizeof(affpartial));
+  for (size_t k = first; k < grid->refplanes.size(); k += step) {
+    double p = 1 + k * grid->skipz;
+    const vector<double> &refplane = grid->refplanes[k];
+    //% Transformed template coordinates.  Only resample from within the
+    //% volume IMAGE.
+    int nn = 0;
+    for (int i = 0; i < n0; i++) {
+      double xx = grid->xm[i], yy = grid->ym[i];
+      double tx = mat[0] * xx + mat[1] * yy + (mat[2] * p + mat[3]);
+      double ty = mat[4] * xx + mat[5] * yy + (mat[6] * p + mat[7]);
+      double tz = mat[8] * xx + mat[9] * yy + (mat[10] * p + mat[11]);
+      if (tx >= 1 && ty >= 1 && tz >= 1 && tx < (IMAGE->dimx - .01) &&
+          ty < (IMAGE->dimy - .01) && tz < (IMAGE->dimz - .01)) {
+        x1[nn] = tx;
+        y1[nn] = ty;
+        z1[nn] = tz;
+        xm[nn] = xx;
+        ym[nn] = yy;
+        ref[nn] = refplane[i];
+        nn++;
+      }
+    }
+    // Don't waste time on an empty plane.
+    if (nn == 0) continue;
+
+    // Sample image to normalise & get local NEGATIVE derivatives
+    norm_sample_points(IMAGE, hold, nn, &x1[0], &y1[0], &z1[0], &F[0]);
+    for (int i = 0; i < nn; i++) xs[i] = x1[i] + .01;
+    norm_sample_points(IMAGE, hold, nn, &xs[0], &y1[0], &z1[0], &dx[0]);
+    for (int i = 0; i < nn; i++) xs[i] = y1[i] + .01;
+    norm_sample_points(IMAGE, hold, nn, &x1[0], &xs[0], &z1[0], &dy[0]);
+    for (int i = 0; i < nn; i++) xs[i] = z1[i] + .01;
+    norm_sample_points(IMAGE, hold, nn, &x1[0], &y1[0], &xs[0], &dz[0]);
+
+    for (int b = 0; b < nn; b += AFFBLOCK) {
+      int nb = MIN(AFFBLOCK, nn - b);
+      // Generate Design Matrix, a block at a time
+      for (int r = 0; r < nb; r++) {
+        int i = b + r;
+        double ddx = (F[i] - dx[i]) / .01;
+        double ddy = (F[i] - dy[i]) / .01;
+        double ddz = (F[i] - dz[i]) / .01;
+        double *row = rows[r];
+        row[0] = xm[i] * ddx;
+        row[1] = ym[i] * ddx;
+        row[2] = p * ddx;
+        row[3] = ddx;
+        row[4] = xm[i] * ddy;
+        row[5] = ym[i] * ddy;
+        row[6] = p * ddy;
+        row[7] = ddy;
+        row[8] = xm[i] * ddz;
+        row[9] = ym[i] * ddz;
+        row[10] = p * ddz;
+        row[11] = ddz;
+        row[12] = ref[i];
+        double f = F[i] - ref[i] * scale;
+        part->chi2 += f * f;
+        for (int j = 0; j < 13; j++) part->beta[j] += row[j] * f;
+      }
+      //% Most of the work (lower half only, filled in later)
+      for (int j1 = 0; j1 < 13; j1++) {
+        for (int j2 = 0; j2 <= j1; j2++) {
+          double c = 0.0;
+          for (int r = 0; r < nb; r++) c += rows[r][j1] * rows[r][j2];
+          part->alpha[j1 * 13 + j2] += c;
+        }
+      }
+    }
+    part->n += nn;
+  }
+}
+
+int dan_affsub1(NormTemplate &tmpl, CrunchCube *IMAGE, const Matrix &MF,
+                int Hold, int samp, const RowVector &P) {
   Matrix alpha(13, 13, 0.0), beta(13, 1, 0.0), dMdP(13, 13, 0.0);
-  int skipx, skipy, skipz, i, j, n;
-  Matrix X, Y, Mat;
-  Matrix mtmp1, mtmp2, tmp, dFdM, F, dx, dy, dz;
-  RowVector tP, t0, XM, YM, ZM, mask1, X1, Y1, Z1;
+  int i, j, n;
+  Matrix Mat, tmp;
+  RowVector tP, t0;
   double chi2;
 
-  // Coordinates of templates
-  mtmp1.resize(REF->dimx, REF->dimx);
-  mtmp1.fill(0.0);
-  for (i = 0; i < REF->dimx; i++) mtmp1(i, i) = i + 1;
-  mtmp2.resize(REF->dimx, REF->dimy);
-  mtmp2.fill(1.0);
-  X = mtmp1 * mtmp2;
-
-  // these matrices don't really have to be built again
-  mtmp1.resize(REF->dimx, REF->dimy);
-  mtmp1.fill(1.0);
-
-  mtmp2.resize(REF->dimy, REF->dimy);
-  mtmp2.fill(0.0);
-  for (i = 0; i < REF->dimy; i++) mtmp2(i, i) = i + 1;
-  Y = mtmp1 * mtmp2;
-
-  // Sample about every samp mm
-  skipx = (int)MAX(round(samp / REF->voxsize[0]), 1);
-  skipy = (int)MAX(round(samp / REF->voxsize[1]), 1);
-  skipz = (int)MAX(round(samp / REF->voxsize[2]), 1);
-
-  RowVector mask0(0);
-  for (i = 0; i < X.cols() * X.rows(); i++) {
-    double tmp1 = get_element(X, i);
-    double tmp2 = get_element(Y, i);
-    if ((tmp1 / skipx) == (double)((int)(tmp1 / skipx)) &&
-        (tmp2 / skipy) == (double)((int)(tmp2 / skipy)))
-      mask0.resize(mask0.length() + 1, (double)i);
-  }
+  const NormTemplate::affgrid &grid = tmpl.getgrid(samp, Hold);
+  Matrix MGinv = tmpl.MG.inverse();
 
-  Mat = ((MG.inverse() * dan_matrix(P.transpose())) * MF).inverse();
+  Mat = ((MGinv * dan_matrix(P.transpose())) * MF).inverse();
 
   // rate of change of matrix elements with respect to parameters
 
@@ -77,7 +147,7 @@ int dan_affsub1(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
   for (i = 0; i < 12; i++) {
     tP = P;
     tP(i) += 0.01;
-    tmp = ((MG.inverse() * dan_matrix(tP.transpose())) * MF).inverse();
+    tmp = ((MGinv * dan_matrix(tP.transpose())) * MF).inverse();
     tmp.resize(3, 4, 0.0);
     tmp = tmp.transpose();
     for (j = 0; j < dMdP.rows() - 1; j++) {
@@ -88,82 +158,37 @@ int dan_affsub1(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
   for (i = 0; i < dMdP.rows() - 1; i++) dMdP(i, 12) = 0;
   dMdP(i, 12) = 1;
 
+  double mat[12];
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 4; j++) mat[i * 4 + j] = Mat(i, j);
+
+  // only trilinear sampling is safe to do outside the main thread
+  int nthreads = 1;
+  if (abs(Hold) == 1) nthreads = MIN(ncores(), (int)grid.refplanes.size());
+  if (nthreads < 1) nthreads = 1;
+  vector<affpartial> parts(nthreads);
+  if (nthreads == 1)
+    affsub1_planes(IMAGE, &grid, mat, Hold, P(12), 0, 1, &parts[0]);
+  else {
+    boost::thread_group tg;
+    for (i = 0; i < nthreads; i++)
+      tg.create_thread(boost::bind(affsub1_planes, IMAGE, &grid, mat, Hold,
+                                   P(12), i, nthreads, &parts[i]));
+    tg.join_all();
+  }
+
   chi2 = 0;
   n = 0;
-
-  // is p=1 correct, or do i want to start at 0???
-  for (int p = 1; p <= REF->dimz; p += skipz) {
-    XM = index(X, mask0);
-    YM = index(Y, mask0);
-
-    //% Transformed template coordinates.
-    X1 = (Mat(0, 0) * XM) + (Mat(0, 1) * YM) + ((Mat(0, 2) * p) + Mat(0, 3));
-    Y1 = (Mat(1, 0) * XM) + (Mat(1, 1) * YM) + ((Mat(1, 2) * p) + Mat(1, 3));
-    Z1 = (Mat(2, 0) * XM) + (Mat(2, 1) * YM) + ((Mat(2, 2) * p) + Mat(2, 3));
-    //% Only resample from within the volume IMAGE.
-    mask1.resize(0);
-    for (i = 0; i < X1.length(); i++) {
-      if (X1(i) >= 1 && Y1(i) >= 1 && Z1(i) >= 1 &&
-          X1(i) < (IMAGE->dimx - .01) && Y1(i) < (IMAGE->dimy - .01) &&
-          Z1(i) < (IMAGE->dimz - .01)) {
-        mask1.resize(mask1.length() + 1, i);
-      }
-    }
-
-    // Don't waste time on an empty plane.
-    if (mask1.length() > 0) {
-      // Only resample from within the volume IMAGE.
-      if (mask1.length() != mask0.length()) {
-        X1 = index(X1, mask1);
-        Y1 = index(Y1, mask1);
-        Z1 = index(Z1, mask1);
-        XM = index(XM, mask1);
-        YM = index(YM, mask1);
-      }
-
-      dFdM.resize(mask1.length(), 13);
-      dFdM.fill(0.0);
-
-      // Sample image to normalise & get local NEGATIVE derivatives
-      F = dan_sample_vol(IMAGE, X1, Y1, Z1, Hold);
-      dx = (F - dan_sample_vol(IMAGE, X1 + .01, Y1, Z1, Hold)) / (.01);
-      dy = (F - dan_sample_vol(IMAGE, X1, Y1 + .01, Z1, Hold)) / (.01);
-      dz = (F - dan_sample_vol(IMAGE, X1, Y1, Z1 + .01, Hold)) / (.01);
-      // Generate Design Matrix
-      for (i = 0; i < dFdM.rows(); i++) {
-        dFdM(i, 0) = XM(i) * dx(i, 0);
-        dFdM(i, 1) = YM(i) * dx(i, 0);
-        dFdM(i, 2) = p * dx(i, 0);
-        dFdM(i, 3) = dx(i, 0);
-        dFdM(i, 4) = XM(i) * dy(i, 0);
-        dFdM(i, 5) = YM(i) * dy(i, 0);
-        dFdM(i, 6) = p * dy(i, 0);
-        dFdM(i, 7) = dy(i, 0);
-        dFdM(i, 8) = XM(i) * dz(i, 0);
-        dFdM(i, 9) = YM(i) * dz(i, 0);
-        dFdM(i, 10) = p * dz(i, 0);
-        dFdM(i, 11) = dz(i, 0);
-      }
-
-      // Sample reference image(s)
-      ZM.resize(mask1.length());
-      ZM.fill((double)p);
-
-      tmp = dan_sample_vol(REF, XM, YM, ZM, Hold);
-      for (i = 0; i < dFdM.rows(); i++) dFdM(i, 12) = tmp(i, 0);
-      for (i = 0; i < F.rows(); i++) F(i, 0) -= tmp(i, 0) * P(12);
-
-      for (i = 0; i < F.rows(); i++)
-        for (j = 0; j < F.cols(); j++) chi2 += pow(F(i, j), 2);
-      n += F.rows() * F.cols();
-
-      //% Most of the work
-      alpha = alpha + dan_atranspa(dFdM);
-
-      beta = beta + (dFdM.transpose() * F);
-      dFdM.resize(0, 0);
+  vbforeach(affpartial & pp, parts) {
+    for (i = 0; i < 13; i++) {
+      beta(i, 0) += pp.beta[i];
+      for (j = 0; j <= i; j++) alpha(i, j) += pp.alpha[i * 13 + j];
     }
+    chi2 += pp.chi2;
+    n += pp.n;
   }
+  for (i = 0; i < 13; i++)
+    for (j = 0; j < i; j++) alpha(j, i) = alpha(i, j);
 
   alpha = (dMdP.transpose() * alpha) * dMdP;
   beta = dMdP.transpose() * beta;
@@ -190,9 +215,9 @@ int dan_affsub1(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
 // spm_affsub2.m 1.4 John Ashburner FIL 96/08/21
 // function P = spm_affsub2(REF,IMAGE,MG,MF,Hold,samp,P,free,pdesc,gorder)
 
-RowVector dan_affsub2(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
-                      const Matrix &MF, int Hold, int samp, RowVector P,
-                      const RowVector &free, const RowVector &pdesc) {
+RowVector dan_affsub2(NormTemplate &tmpl, CrunchCube *IMAGE, const Matrix &MF,
+                      int Hold, int samp, RowVector P, const RowVector &free,
+                      const RowVector &pdesc) {
   double pchi2, bestchi2, ochi2, chi2_t;
   int iter, countdown, i, nf;
   Matrix alpha_t, beta_t, aqqq, mtmp1, mtmp2;
@@ -221,7 +246,7 @@ RowVector dan_affsub2(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
       pp = findnonzero(pdesc);
       ppp = findnonzero(pdesc.transpose() * pdesc);
       vtmp = index(P, pp);
-      dan_affsub1(REF, IMAGE, MG, MF, Hold, samp, vtmp);
+      dan_affsub1(tmpl, IMAGE, MF, Hold, samp, vtmp);
       alpha_t = ret_m1;
       beta_t = ret_m2;
       chi2_t = ret_d1;
@@ -362,11 +387,10 @@ Matrix dan_dctmtxdiff(int N, int K, const RowVector &n) {
 // dan_snbasis.c - completely based on
 // spm_snbasis_map.m 1.5 John Ashburner FIL 96/08/21
 
-int dan_snbasis_map(CrunchCube *REF, CrunchCube *IMAGE, Matrix &Affine, int k1,
-                    int k2, int k3, int iter, int fwhm, double sd1) {
-  Matrix IC0, IC1, IC2;
-  Matrix basX, basY, basZ, dbasX, dbasY, dbasZ, alpha, beta;
-  Matrix dd1, dd2, dd3, T, Transform;
+int dan_snbasis_map(NormTemplate &tmpl, CrunchCube *IMAGE, Matrix &Affine,
+                    int k1, int k2, int k3, int iter, int fwhm, double sd1) {
+  CrunchCube *REF = tmpl.sREF;
+  Matrix alpha, beta, A, T, Transform;
   int i, s1, s2;
   double remainder, var, stabilise;
 
@@ -378,45 +402,11 @@ int dan_snbasis_map(CrunchCube *REF, CrunchCube *IMAGE, Matrix &Affine, int k1,
   k3 = MAX(k3, 1);
   k3 = MIN(k3, (int)REF->dimz);
 
-  //% Scaling is to improve stability.
-  //%-----------------------------------------------------------------------
+  // the basis functions, their derivatives, and the regularization
+  // terms only depend on the template, so they're built once there
   stabilise = 64.0;
-  basX = dan_dctmtx(REF->dimx, k1) * stabilise;
-  basY = dan_dctmtx(REF->dimy, k2) * stabilise;
-  basZ = dan_dctmtx(REF->dimz, k3) * stabilise;
-
-  dbasX = dan_dctmtxdiff(REF->dimx, k1) * stabilise;
-  dbasY = dan_dctmtxdiff(REF->dimy, k2) * stabilise;
-  dbasZ = dan_dctmtxdiff(REF->dimz, k3) * stabilise;
-
-  dd1.resize(k1, 1);
-  for (i = 0; i < k1; i++) dd1(i, 0) = pow(((PI * i) / REF->dimx), 2);
-
-  dd2.resize(k2, 1);
-  for (i = 0; i < k2; i++) dd2(i, 0) = pow(((PI * i) / REF->dimy), 2);
-
-  dd3.resize(k3, 1);
-  for (i = 0; i < k3; i++) dd3(i, 0) = pow(((PI * i) / REF->dimz), 2);
-
-  IC0 = kron(kron(ones(k3, 1), ones(k2, 1)), dd1) +
-        kron(kron(ones(k3, 1), dd2), ones(k1, 1)) +
-        kron(kron(dd3, ones(k2, 1)), ones(k1, 1));
-
-  IC0 = IC0 / (3.0 * ((double)(REF->dimx * REF->dimy * REF->dimz) /
-                      (double)((k1 * k2 * k3) - 1)));
-  IC0 = IC0 * (pow(sd1, -2) * pow(stabilise, 6));
-  IC1 = IC0;
-  IC1 = IC1.stack(IC0);
-  IC1 = IC1.stack(IC0);
-  IC1 = IC1.stack(zeros(4, 1));
-
-  IC2.resize(IC1.rows() * IC1.cols(), IC1.rows() * IC1.cols());
-  IC2.fill(0.0);
-  for (i = 0; i < (IC1.rows() * IC1.cols()); i++) {
-    IC2(i, i) = get_element(IC1, i);
-  }
+  tmpl.makebasis(k1, k2, k3, sd1);
 
-  // IC2 seems to be identical to matlab's output
   // Generate starting estimates.
 
   s1 = 3 * k1 * k2 * k3;
@@ -426,13 +416,16 @@ int dan_snbasis_map(CrunchCube *REF, CrunchCube *IMAGE, Matrix &Affine, int k1,
   T(s1, 0) = 1;
 
   for (i = 0; i < iter; i++) {
-    dan_brainwarp(REF, IMAGE, Affine, basX, basY, basZ, dbasX, dbasY, dbasZ, T,
-                  fwhm);
+    dan_brainwarp(REF, IMAGE, Affine, tmpl.basX, tmpl.basY, tmpl.basZ,
+                  tmpl.dbasX, tmpl.dbasY, tmpl.dbasZ, T, fwhm);
     alpha = ret_m1;
     beta = ret_m2;
     var = ret_d1;
     if (i > -1) {
-      T = backslash(alpha + (IC2 * var), (alpha * T) + beta);
+      // IC2 is diagonal, so just add it in place
+      A = alpha;
+      for (int j = 0; j < A.rows(); j++) A(j, j) += tmpl.IC(j) * var;
+      T = backslash(A, (alpha * T) + beta);
       // T seems to be almost but not quite identical to matlab's output
     } else
       T = T + backslash(alpha, beta);
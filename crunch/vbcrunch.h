@@ -184,24 +184,61 @@ int dan_brainwarp(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &Affine,
                   const Matrix &dBX, const Matrix &dBY, const Matrix &dBZ,
                   const Matrix &T, double fwhm);
 
-int dan_sn3d(CrunchCube *REF, CrunchCube *IMAGE, Matrix &affine, Matrix &dims,
-             Matrix &transform, Matrix &MF);
+// NormTemplate holds everything on the template side of a
+// normalization: the smoothed template, its space, the sampling grids
+// (and template values at the grid points) used by dan_affsub1(), and
+// the DCT basis used by dan_snbasis_map().  all of it depends only on
+// the template, so a batch of subjects normalized to the same template
+// can share one.
+
+class NormTemplate {
+ public:
+  class affgrid {
+   public:
+    int samp, hold;
+    int skipz;
+    vector<double> xm, ym;              // in-plane template coordinates
+    vector<vector<double> > refplanes;  // template values, per sampled plane
+  };
+  NormTemplate(CrunchCube *ref);
+  ~NormTemplate();
+  const affgrid &getgrid(int samp, int hold);
+  void makebasis(int k1, int k2, int k3, double sd1);
+  CrunchCube *sREF;  // smoothed template
+  Matrix MG;         // space of the smoothed template
+  // the current basis, as set by makebasis()
+  int k1, k2, k3;
+  double sd1;
+  Matrix basX, basY, basZ, dbasX, dbasY, dbasZ;
+  ColumnVector IC;  // diagonal of the regularization matrix
+
+ private:
+  list<affgrid> grids;
+  NormTemplate(const NormTemplate &);
+  NormTemplate &operator=(const NormTemplate &);
+};
+
+void norm_sample_points(CrunchCube *map, int hold, int n, const double *x,
+                        const double *y, const double *z, double *out);
+
+int dan_sn3d(NormTemplate &tmpl, CrunchCube *IMAGE, Matrix &affine,
+             Matrix &dims, Matrix &transform, Matrix &MF);
 CrunchCube *dan_write_sn(CrunchCube *VOL, Matrix &Affine, Matrix &Dims,
                          Matrix &Transform, Matrix &MF, Matrix &bb,
                          RowVector &Vox, int Hold, int affdefault = 0);
-int dan_affsub1(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
-                const Matrix &MF, int Hold, int samp, const RowVector &P);
-RowVector dan_affsub2(CrunchCube *REF, CrunchCube *IMAGE, const Matrix &MG,
-                      const Matrix &MF, int Hold, int samp, RowVector P,
-                      const RowVector &free, const RowVector &pdesc);
+int dan_affsub1(NormTemplate &tmpl, CrunchCube *IMAGE, const Matrix &MF,
+                int Hold, int samp, const RowVector &P);
+RowVector dan_affsub2(NormTemplate &tmpl, CrunchCube *IMAGE, const Matrix &MF,
+                      int Hold, int samp, RowVector P, const RowVector &free,
+                      const RowVector &pdesc);
 void atranspa(int m, int n, const Matrix &A, const Matrix &C);
 Matrix dan_atranspa(const Matrix &A);
 Matrix dan_dctmtx(int N, int K);
 Matrix dan_dctmtx(int N, int K, const RowVector &n);
 Matrix dan_dctmtxdiff(int N, int K);
 Matrix dan_dctmtxdiff(int N, int K, const RowVector &n);
-int dan_snbasis_map(CrunchCube *REF, CrunchCube *IMAGE, Matrix &Affine, int k1,
-                    int k2, int k3, int iter, int fwhm, double sd1);
+int dan_snbasis_map(NormTemplate &tmpl, CrunchCube *IMAGE, Matrix &Affine,
+                    int k1, int k2, int k3, int iter, int fwhm, double sd1);
 
 Matrix kron(const Matrix &A, const Matrix &B);
 RowVector dan_span(double from, double to, double increment);
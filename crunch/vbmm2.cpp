@@ -34,6 +34,7 @@ using namespace std;
 #include <string>
 #include "glmutil.h"
 #include "vbio.h"
+#include "vbtrace.h"
 #include "vbutil.h"
 
 void do_print(tokenlist &args);
@@ -340,6 +341,7 @@ void do_compare(tokenlist &args) {
 // xy args: in1 in2 out [col1 col2]
 
 int do_xy(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -xy");
   int c1, c2;
 
   if (args.size() != 3 && args.size() != 5) {
@@ -397,6 +399,7 @@ int do_xy(tokenlist &args) {
 }
 
 int do_xyt(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -xyt");
   int c1, c2;
 
   if (args.size() != 3 && args.size() != 5) {
@@ -451,6 +454,7 @@ int do_xyt(tokenlist &args) {
 }
 
 int do_xyz(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -xyz");
   if (args.size() != 4) {
     printf("vbmm2: usage: vbmm2 -xyz in1 in2 in3 out\n");
     return 5;
@@ -485,6 +489,7 @@ int do_xyz(tokenlist &args) {
 }
 
 int do_reshape(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -reshape");
   if (args.size() != 4) {
     printf("[E] vbmm2: reshape takes four arguments\n");
     return (101);
@@ -536,6 +541,7 @@ int do_reshape(tokenlist &args) {
 }
 
 int do_assemblerows(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -assemblerows");
   vglob vg;
   string outfile;
   if (args.size() > 1) {
@@ -598,6 +604,7 @@ int do_assemblerows(tokenlist &args) {
 }
 
 int do_assemblecols(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -assemblecols");
   vglob vg;
   string outfile;
   if (args.size() > 1) {
@@ -660,6 +667,7 @@ int do_assemblecols(tokenlist &args) {
 }
 
 int do_imxy(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -imxy");
   if (args.size() != 3 && args.size() != 5) {
     printf("[E] vbmm2: usage: vbmm -imxy in1 in2 out\n");
     return (100);
@@ -699,6 +707,7 @@ int do_imxy(tokenlist &args) {
 }
 
 int do_f3(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -f3");
   if (args.size() != 3) {
     printf("[E] vbmm2: usage: vbmm -f3 v kg out\n");
     return (100);
@@ -738,6 +747,7 @@ int do_f3(tokenlist &args) {
 }
 
 int do_invert(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -invert");
   if (args.size() != 2) {
     printf("[E] vbmm2: usage: vbmm -invert in out\n");
     return (100);
@@ -765,6 +775,7 @@ int do_invert(tokenlist &args) {
 // inverse(KGtKG) ## KGt
 
 int do_pinv(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -pinv");
   if (args.size() != 2) {
     printf("[E] vbmm2: usage: vbmm -pinv in out\n");
     return (100);
@@ -788,6 +799,7 @@ int do_pinv(tokenlist &args) {
 // do_pca() calculates the principle components
 
 int do_pca(tokenlist &args) {
+  VBTraceTimer tracer("vbmm2 -pca");
   if (args.size() != 2) {
     printf("[E] vbmm2: usage: vbmm -pca in out\n");
     return (100);
@@ -241,3 +241,90 @@ int receive_file(int s, string fname, int filesize) {
   }
   return 0;
 }
+
+// send_frames() and recv_frames() move a batch of short messages over
+// a stream socket.  each message is prefixed with its length as a
+// 32-bit network-order int.  the sender shuts down its half of the
+// connection when it's done, so the receiver knows it has everything.
+
+int send_frames(int sock, const vector<string> &msgs, float secs) {
+  fd_set ff;
+  struct timeval t_start, t_deadline, t_current, t_timeout;
+  int err;
+
+  string buf;
+  for (size_t i = 0; i < msgs.size(); i++) {
+    uint32 len = htonl(msgs[i].size());
+    buf.append((char *)&len, 4);
+    buf += msgs[i];
+  }
+  gettimeofday(&t_start, NULL);
+  t_deadline.tv_sec = (int)secs;
+  t_deadline.tv_usec = lround(((secs - floor(secs)) * 1000000.0));
+  t_deadline = t_start + t_deadline;
+
+  size_t pos = 0;
+  while (pos < buf.size()) {
+    FD_ZERO(&ff);
+    FD_SET(sock, &ff);
+    gettimeofday(&t_current, NULL);
+    t_timeout = t_deadline - t_current;
+    err = select(sock + 1, NULL, &ff, NULL, &t_timeout);
+    if (err < 1) return 101;
+    err = send(sock, buf.data() + pos, buf.size() - pos, 0);
+    if (err < 0) {
+      if (errno == EAGAIN || errno == EINTR) continue;
+      return 102;
+    }
+    pos += err;
+  }
+  shutdown(sock, SHUT_WR);
+  return 0;
+}
+
+// recv_frames() reads until the sender shuts down, and only fills in
+// msgs if every frame arrived whole
+
+int recv_frames(int sock, vector<string> &msgs, float secs) {
+  fd_set ff;
+  struct timeval t_start, t_deadline, t_current, t_timeout;
+  int err;
+  char tmp[F_BUFSIZE];
+
+  msgs.clear();
+  gettimeofday(&t_start, NULL);
+  t_deadline.tv_sec = (int)secs;
+  t_deadline.tv_usec = lround(((secs - floor(secs)) * 1000000.0));
+  t_deadline = t_start + t_deadline;
+
+  string buf;
+  while (1) {
+    FD_ZERO(&ff);
+    FD_SET(sock, &ff);
+    gettimeofday(&t_current, NULL);
+    t_timeout = t_deadline - t_current;
+    err = select(sock + 1, &ff, NULL, NULL, &t_timeout);
+    if (err < 1) return 101;
+    err = recv(sock, tmp, F_BUFSIZE, 0);
+    if (err < 0) {
+      if (errno == EAGAIN || errno == EINTR) continue;
+      return 102;
+    }
+    if (err == 0) break;
+    buf.append(tmp, err);
+  }
+  vector<string> newmsgs;
+  size_t pos = 0;
+  while (pos < buf.size()) {
+    if (buf.size() - pos < 4) return 103;
+    uint32 len;
+    memcpy(&len, buf.data() + pos, 4);
+    len = ntohl(len);
+    pos += 4;
+    if (buf.size() - pos < len) return 103;
+    newmsgs.push_back(buf.substr(pos, len));
+    pos += len;
+  }
+  msgs.swap(newmsgs);
+  return 0;
+}
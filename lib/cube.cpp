@@ -28,8 +28,230 @@ using namespace std;
 
 #include <fstream>
 #include "vbio.h"
+#include "vbtrace.h"
 #include "vbutil.h"
 
+// kernels for the whole-volume operations, run through vbdispatch()
+// so that each loop is over the raw typed buffer
+
+namespace {
+
+// cube-on-cube arithmetic is done in the cube's own type, scalar
+// arithmetic in double, as the old per-voxel versions did
+struct cubeadd {
+  template <class T>
+  static T apply(T a, T b) {
+    return a + b;
+  }
+};
+struct cubesub {
+  template <class T>
+  static T apply(T a, T b) {
+    return a - b;
+  }
+};
+struct cubemul {
+  template <class T>
+  static T apply(T a, T b) {
+    return a * b;
+  }
+};
+struct cubediv {
+  template <class T>
+  static T apply(T a, T b) {
+    return a / b;
+  }
+};
+
+template <class Op>
+class cubecubekernel {
+ public:
+  cubecubekernel(Cube &aa, const Cube &bb) : a(aa), b(bb) {}
+  template <class T1, class T2>
+  void run() {
+    T1 *p = (T1 *)a.data;
+    const T2 *q = (const T2 *)b.data;
+    uint32 n = a.dimx * a.dimy * a.dimz;
+    for (uint32 i = 0; i < n; i++) p[i] = Op::apply(p[i], (T1)q[i]);
+  }
+
+ private:
+  Cube &a;
+  const Cube &b;
+};
+
+template <class Op>
+class cubenumkernel {
+ public:
+  cubenumkernel(Cube &cc, double nn) : cb(cc), num(nn) {}
+  template <class T>
+  void run() {
+    T *p = (T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    for (uint32 i = 0; i < n; i++) p[i] = (T)Op::apply((double)p[i], num);
+  }
+
+ private:
+  Cube &cb;
+  double num;
+};
+
+// tests for zeroing voxels, for thresh() and friends
+struct atmost {
+  static bool test(double v, double x) { return v <= x; }
+};
+struct absatmost {
+  static bool test(double v, double x) { return fabs(v) <= x; }
+};
+struct atleast {
+  static bool test(double v, double x) { return v >= x; }
+};
+struct nonfinite {
+  static bool test(double v, double) { return !finite(v); }
+};
+
+template <class Pred>
+class zeroifkernel {
+ public:
+  zeroifkernel(Cube &cc, double vv) : cb(cc), val(vv) {}
+  template <class T>
+  void run() {
+    T *p = (T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    for (uint32 i = 0; i < n; i++)
+      if (Pred::test((double)p[i], val)) p[i] = 0;
+  }
+
+ private:
+  Cube &cb;
+  double val;
+};
+
+class fillkernel {
+ public:
+  fillkernel(Cube &cc, double vv, bool nz) : cb(cc), val(vv), f_nonzero(nz) {}
+  template <class T>
+  void run() {
+    T *p = (T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    // quantize() has always truncated, operator=() rounded
+    if (f_nonzero) {
+      T v = (T)val;
+      for (uint32 i = 0; i < n; i++)
+        if (p[i]) p[i] = v;
+    } else
+      fill(p, p + n, vbconvert<T>(val));
+  }
+
+ private:
+  Cube &cb;
+  double val;
+  bool f_nonzero;
+};
+
+class abskernel {
+ public:
+  abskernel(Cube &cc) : cb(cc) {}
+  template <class T>
+  void run() {
+    T *p = (T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    for (uint32 i = 0; i < n; i++) p[i] = (T)fabs((double)p[i]);
+  }
+
+ private:
+  Cube &cb;
+};
+
+class invertkernel {
+ public:
+  invertkernel(Cube &cc) : cb(cc) {}
+  template <class T>
+  void run() {
+    T *p = (T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    for (uint32 i = 0; i < n; i++) p[i] = (p[i] ? 0 : 1);
+  }
+
+ private:
+  Cube &cb;
+};
+
+// zero everything outside the mask, or with f_union set, set
+// everything inside it to 1
+class maskkernel {
+ public:
+  maskkernel(Cube &cc, const Cube &mm, bool un) : cb(cc), m(mm), f_union(un) {}
+  template <class T1, class T2>
+  void run() {
+    T1 *p = (T1 *)cb.data;
+    const T2 *q = (const T2 *)m.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    if (f_union) {
+      for (uint32 i = 0; i < n; i++)
+        if (q[i]) p[i] = 1;
+    } else {
+      for (uint32 i = 0; i < n; i++)
+        if (!q[i]) p[i] = 0;
+    }
+  }
+
+ private:
+  Cube &cb;
+  const Cube &m;
+  bool f_union;
+};
+
+class minmaxkernel {
+ public:
+  minmaxkernel(const Cube &cc) : cb(cc) {
+    minval = maxval = 0.0;
+    nonfinites = 0;
+  }
+  template <class T>
+  void run() {
+    const T *p = (const T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    if (n == 0) return;
+    double lo = p[0], hi = p[0];
+    int32 bad = 0;
+    for (uint32 i = 0; i < n; i++) {
+      double v = p[i];
+      if (!finite(v)) {
+        bad++;
+        continue;
+      }
+      if (v > hi) hi = v;
+      if (v < lo) lo = v;
+    }
+    minval = lo;
+    maxval = hi;
+    nonfinites = bad;
+  }
+  double minval, maxval;
+  int32 nonfinites;
+
+ private:
+  const Cube &cb;
+};
+
+class countkernel {
+ public:
+  countkernel(const Cube &cc) : cnt(0), cb(cc) {}
+  template <class T>
+  void run() {
+    const T *p = (const T *)cb.data;
+    uint32 n = cb.dimx * cb.dimy * cb.dimz;
+    for (uint32 i = 0; i < n; i++) cnt += (p[i] != 0);
+  }
+  uint32 cnt;
+
+ private:
+  const Cube &cb;
+};
+
+}  // namespace
+
 Cube::Cube() {
   data = (unsigned char *)NULL;
   init();
@@ -115,6 +337,7 @@ int Cube::ReadFile(const string &fname) {
 }
 
 int Cube::ReadHeader(const string &fname) {
+  VBTraceTimer tracer("Cube::ReadHeader");
   if (fname.size() == 0) return 104;
   // preserve dimensions across init just in case (e.g., for mricro roi files)
   int tmpx = dimx;
@@ -176,6 +399,7 @@ int Cube::ReadHeader(const string &fname) {
 }
 
 int Cube::ReadData(const string &fname) {
+  VBTraceTimer tracer("Cube::ReadData");
   filename = fname;
   data_valid = 0;
   int err;
@@ -256,6 +480,7 @@ int Cube::ReadLabels() {
 }
 
 int Cube::WriteFile(const string fname) {
+  VBTraceTimer tracer("Cube::WriteFile");
   VBFF original;
   // save the original format, then null it
   original = fileformat;
@@ -476,25 +701,9 @@ Cube &Cube::operator+=(const Cube &cb) {
     zero();
     return *this;
   }
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) + cb.getValue<unsigned char>(i));
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) + cb.getValue<int16>(i));
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) + cb.getValue<int32>(i));
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) + cb.getValue<float>(i));
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) + cb.getValue<double>(i));
-        break;
-    }
-  }
+  if (!data || !cb.data) return *this;
+  cubecubekernel<cubeadd> kernel(*this, cb);
+  vbdispatch(datatype, cb.datatype, kernel);
   return *this;
 }
 
@@ -503,25 +712,9 @@ Cube &Cube::operator-=(const Cube &cb) {
     zero();
     return *this;
   }
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) - cb.getValue<unsigned char>(i));
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) - cb.getValue<int16>(i));
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) - cb.getValue<int32>(i));
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) - cb.getValue<float>(i));
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) - cb.getValue<double>(i));
-        break;
-    }
-  }
+  if (!data || !cb.data) return *this;
+  cubecubekernel<cubesub> kernel(*this, cb);
+  vbdispatch(datatype, cb.datatype, kernel);
   return *this;
 }
 
@@ -530,25 +723,9 @@ Cube &Cube::operator*=(const Cube &cb) {
     zero();
     return *this;
   }
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) * cb.getValue<unsigned char>(i));
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) * cb.getValue<int16>(i));
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) * cb.getValue<int32>(i));
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) * cb.getValue<float>(i));
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) * cb.getValue<double>(i));
-        break;
-    }
-  }
+  if (!data || !cb.data) return *this;
+  cubecubekernel<cubemul> kernel(*this, cb);
+  vbdispatch(datatype, cb.datatype, kernel);
   return *this;
 }
 
@@ -557,130 +734,44 @@ Cube &Cube::operator/=(const Cube &cb) {
     zero();
     return *this;
   }
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) / cb.getValue<unsigned char>(i));
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) / cb.getValue<int16>(i));
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) / cb.getValue<int32>(i));
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) / cb.getValue<float>(i));
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) / cb.getValue<double>(i));
-        break;
-    }
-  }
+  if (!data || !cb.data) return *this;
+  cubecubekernel<cubediv> kernel(*this, cb);
+  vbdispatch(datatype, cb.datatype, kernel);
   return *this;
 }
 
-// FIXME the following 4 need to be templatized
-
 Cube &Cube::operator+=(double num) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) + num);
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) + num);
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) + num);
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) + num);
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) + num);
-        break;
-    }
-  }
+  if (!data) return *this;
+  cubenumkernel<cubeadd> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Cube &Cube::operator-=(double num) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) - num);
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) - num);
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) - num);
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) - num);
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) - num);
-        break;
-    }
-  }
+  if (!data) return *this;
+  cubenumkernel<cubesub> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Cube &Cube::operator*=(double num) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) * num);
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) * num);
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) * num);
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) * num);
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) * num);
-        break;
-    }
-  }
+  if (!data) return *this;
+  cubenumkernel<cubemul> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Cube &Cube::operator/=(double num) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    switch (datatype) {
-      case vb_byte:
-        setValue(i, getValue<unsigned char>(i) / num);
-        break;
-      case vb_short:
-        setValue(i, getValue<int16>(i) / num);
-        break;
-      case vb_long:
-        setValue(i, getValue<int32>(i) / num);
-        break;
-      case vb_float:
-        setValue(i, getValue<float>(i) / num);
-        break;
-      case vb_double:
-        setValue(i, getValue<double>(i) / num);
-        break;
-    }
-  }
+  if (!data) return *this;
+  cubenumkernel<cubediv> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Cube &Cube::operator=(double num) {
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        SetValue(i, j, k, num);
-      }
-    }
-  }
+  if (!data) return *this;
+  fillkernel kernel(*this, num, 0);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
@@ -848,58 +939,39 @@ void Cube::leftify() { zero(((dimx + 1) / 2), dimx - 1, 0, 0, 0, 0); }
 void Cube::rightify() { zero(0, ((dimx + 1) / 2) - 1, 0, 0, 0, 0); }
 
 void Cube::thresh(double val) {
-  double thisval;
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        thisval = GetValue(i, j, k);
-        if (thisval <= val) SetValue(i, j, k, 0.0);
-      }
-    }
-  }
+  if (!data) return;
+  zeroifkernel<atmost> kernel(*this, val);
+  vbdispatch(datatype, kernel);
 }
 
 void Cube::threshabs(double val) {
-  double thisval;
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        thisval = GetValue(i, j, k);
-        if (fabs(thisval) <= val) SetValue(i, j, k, 0.0);
-      }
-    }
-  }
+  if (!data) return;
+  zeroifkernel<absatmost> kernel(*this, val);
+  vbdispatch(datatype, kernel);
 }
 
 void Cube::cutoff(double val) {
-  double thisval;
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        thisval = GetValue(i, j, k);
-        if (thisval >= val) SetValue(i, j, k, 0.0);
-      }
-    }
-  }
+  if (!data) return;
+  zeroifkernel<atleast> kernel(*this, val);
+  vbdispatch(datatype, kernel);
 }
 
 void Cube::quantize(double num) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    if (testValue(i)) setValue(i, num);
-  }
-  return;
+  if (!data) return;
+  fillkernel kernel(*this, num, 1);
+  vbdispatch(datatype, kernel);
 }
 
 void Cube::abs() {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    setValue(i, fabs(getValue(i)));
-  }
-  return;
+  if (!data) return;
+  abskernel kernel(*this);
+  vbdispatch(datatype, kernel);
 }
 
 void Cube::applymask(Cube &m) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    if (!(m.testValue(i))) setValue(i, 0);
+  if (data && m.data) {
+    maskkernel kernel(*this, m, 0);
+    vbdispatch(datatype, m.datatype, kernel);
   }
   minval = 1;
   maxval = 0;
@@ -907,28 +979,23 @@ void Cube::applymask(Cube &m) {
 }
 
 void Cube::invert() {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    if (testValue(i))
-      setValue(i, 0);
-    else
-      setValue(i, 1);
-  }
-  return;
+  if (!data) return;
+  invertkernel kernel(*this);
+  vbdispatch(datatype, kernel);
 }
 
 void Cube::intersect(Cube &cb) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    if (!cb.testValue(i)) setValue(i, 0);
-  }
-  return;
+  if (!data || !cb.data) return;
+  maskkernel kernel(*this, cb, 0);
+  vbdispatch(datatype, cb.datatype, kernel);
 }
 
 // FIXME make sure the following does the right thing
 
 void Cube::unionmask(Cube &cb) {
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    if (cb.testValue(i)) setValue(i, 1);
-  }
+  if (!data || !cb.data) return;
+  maskkernel kernel(*this, cb, 1);
+  vbdispatch(datatype, cb.datatype, kernel);
 }
 
 int Cube::is_surface(int x, int y, int z) {
@@ -944,13 +1011,10 @@ int Cube::is_surface(int x, int y, int z) {
 }
 
 void Cube::removenans() {
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        if (!(finite(GetValue(i, j, k)))) SetValue(i, j, k, 0.0);
-      }
-    }
-  }
+  // only the floating point types can hold nans
+  if (!data || (datatype != vb_float && datatype != vb_double)) return;
+  zeroifkernel<nonfinite> kernel(*this, 0.0);
+  vbdispatch(datatype, kernel);
 }
 
 double Cube::get_maximum() {
@@ -971,17 +1035,11 @@ int32 Cube::get_nonfinites() {
 void Cube::calcminmax() {
   nonfinites = minval = maxval = 0;
   if (!data) return;
-  minval = maxval = GetValue(0, 0, 0);
-  double thisval;
-  for (int i = 0; i < dimx * dimy * dimz; i++) {
-    thisval = getValue<double>(i);
-    if (!(finite(thisval))) {
-      nonfinites++;
-      continue;
-    }
-    if (thisval > maxval) maxval = thisval;
-    if (thisval < minval) minval = thisval;
-  }
+  minmaxkernel kernel(*this);
+  vbdispatch(datatype, kernel);
+  minval = kernel.minval;
+  maxval = kernel.maxval;
+  nonfinites = kernel.nonfinites;
 }
 
 string Cube::header2string() {
@@ -1037,48 +1095,47 @@ string Cube::header2string() {
 
 void Cube::string2header(string &hdr) {
   string dtype;
-  tokenlist args, wholeline;
-  wholeline.SetSeparator("\n");
-
+  tokenview args, wholeline("\n");
+  // both tokenviews point into hdr, nothing gets copied unless we keep
+  // it.  whole lines aren't subject to quotes or comments.
+  wholeline.SetQuoteChars("");
+  wholeline.SetCommentChars("");
   wholeline.ParseLine(hdr);
 
   for (size_t i = 0; i < wholeline.size(); i++) {
-    args.ParseLine(wholeline[i]);
+    args.ParseLine(wholeline.ptr(i), wholeline.len(i));
 
-    if (args[0] == "VoxDims(XYZ):" && args.size() > 3) {
-      dimx = strtol(args[1]);
-      dimy = strtol(args[2]);
-      dimz = strtol(args[3]);
-    } else if (args[0] == "DataType:" && args.size() > 1)
+    if (args.is(0, "VoxDims(XYZ):") && args.size() > 3) {
+      dimx = args.num(1);
+      dimy = args.num(2);
+      dimz = args.num(3);
+    } else if (args.is(0, "DataType:") && args.size() > 1)
       dtype = args[1];
-    else if (args[0] == "VoxSizes(XYZ):" && args.size() > 3) {
-      voxsize[0] = strtod(args[1]);
-      voxsize[1] = strtod(args[2]);
-      voxsize[2] = strtod(args[3]);
-    } else if (args[0] == "Origin(XYZ):" && args.size() > 3) {
-      origin[0] = strtol(args[1]);
-      origin[1] = strtol(args[2]);
-      origin[2] = strtol(args[3]);
-    } else if (args[0] == "Byteorder:" && args.size() > 1) {
-      if (args[1] == "lsbfirst")
+    else if (args.is(0, "VoxSizes(XYZ):") && args.size() > 3) {
+      voxsize[0] = args.dbl(1);
+      voxsize[1] = args.dbl(2);
+      voxsize[2] = args.dbl(3);
+    } else if (args.is(0, "Origin(XYZ):") && args.size() > 3) {
+      origin[0] = args.num(1);
+      origin[1] = args.num(2);
+      origin[2] = args.num(3);
+    } else if (args.is(0, "Byteorder:") && args.size() > 1) {
+      if (args.is(1, "lsbfirst"))
         filebyteorder = ENDIAN_LITTLE;
       else
         filebyteorder = ENDIAN_BIG;
       continue;
-    } else if (args[0] == "Orientation:" && args.size() > 1)
+    } else if (args.is(0, "Orientation:") && args.size() > 1)
       orient = args[1];
-    else if (args[0] == "scl_slope:")
-      scl_slope = strtod(args[1]);
-    else if (args[0] == "scl_inter:")
-      scl_inter = strtod(args[1]);
-    else if (args[0] == "vb_maskspec:" && args.size() > 5) {
-      addMaskSpec(strtol(args[1]), strtol(args[2]), strtol(args[3]),
-                  strtol(args[4]), args[5]);
-    } else {
-      string tmp = wholeline[i];
-      stripchars(tmp, "\n");
-      header.push_back(tmp);
-    }
+    else if (args.is(0, "scl_slope:"))
+      scl_slope = args.dbl(1);
+    else if (args.is(0, "scl_inter:"))
+      scl_inter = args.dbl(1);
+    else if (args.is(0, "vb_maskspec:") && args.size() > 5) {
+      addMaskSpec(args.num(1), args.num(2), args.num(3), args.num(4),
+                  args[5]);
+    } else
+      header.push_back(wholeline[i]);
   }
   parsedatatype(dtype, datatype, datasize);
   voxels = dimx * dimy * dimz;
@@ -1087,10 +1144,9 @@ void Cube::string2header(string &hdr) {
 
 uint32 Cube::count() {
   if (!data) return 0;
-  uint32 cnt = 0;
-  for (int i = 0; i < dimx * dimy * dimz; i++)
-    if (testValue(i)) cnt++;
-  return cnt;
+  countkernel kernel(*this);
+  vbdispatch(datatype, kernel);
+  return kernel.cnt;
 }
 
 void Cube::guessorigin() {
@@ -37,6 +37,7 @@ using namespace std;
 #include <zlib.h>
 #include <sstream>
 #include "vbio.h"
+#include "vbtrace.h"
 #include "vbutil.h"
 
 extern "C" {
@@ -67,23 +68,21 @@ VBFF cub1_vbff()
 }
 
 vf_status cub1_test(unsigned char *buf, int bufsize, string) {
-  tokenlist args;
-  args.SetSeparator("\n");
+  tokenview args("\n");
   if (bufsize < 40) return vf_no;
-  args.ParseLine((char *)buf);
-  if (args[0] != "VB98" || args[1] != "CUB1") return vf_no;
+  args.ParseLine((char *)buf, bufsize, 2);
+  if (!args.is(0, "VB98") || !args.is(1, "CUB1")) return vf_no;
   return vf_yes;
 }
 
 int cub1_read_head(Cube *cb) {
   gzFile fp;
   char line[STRINGLEN];
-  tokenlist args;
 
-  fp = gzopen(cb->filename.c_str(), "r");
+  fp = vbt_gzopen(cb->filename.c_str(), "r");
   if (!fp) return (100);
   cb->header.clear();
-  if (gzread(fp, line, 10) != 10) {
+  if (vbt_gzread(fp, line, 10) != 10) {
     gzclose(fp);
     return (150);
   }
@@ -109,15 +108,15 @@ int cub1_read_head(Cube *cb) {
 int cub1_read_data(Cube *cb) {
   gzFile fp;
 
-  fp = gzopen(cb->filename.c_str(), "r");
+  fp = vbt_gzopen(cb->filename.c_str(), "r");
   if (!fp) return (100);
-  gzseek(fp, cb->offset, SEEK_SET);
+  vbt_gzseek(fp, cb->offset, SEEK_SET);
   cb->SetVolume(cb->dimx, cb->dimy, cb->dimz, cb->datatype);
   if (!cb->data_valid) {
     gzclose(fp);
     return 154;
   }
-  int cnt = gzread(fp, cb->data, cb->datasize * cb->voxels);
+  int cnt = vbt_gzread(fp, cb->data, cb->datasize * cb->voxels);
   gzclose(fp);
   if (cnt != cb->voxels * cb->datasize) return (155);
   if (my_endian() != cb->filebyteorder)
@@ -165,7 +164,7 @@ int cub1_write(Cube *cb) {
   int cnt, towrite = cb->datasize * cb->voxels;
   zfp.write(hdr.c_str(), hdr.size());
   cnt = zfp.write(cb->data, towrite);
-  zfp.close();
+  bool f_closed = zfp.close();
   // scale/swap it back
   if (my_endian() != cb->filebyteorder) cb->byteswap();
   if (cb->f_scaled) {
@@ -175,7 +174,7 @@ int cub1_write(Cube *cb) {
     *cb *= cb->scl_slope;
     *cb += cb->scl_inter;
   }
-  if (cnt != towrite) {
+  if (cnt != towrite || !f_closed) {
     unlink(tmpfname.c_str());
     return (102);
   }
@@ -94,8 +94,7 @@ VBFF mtx_vbff()
 int mat1_read_head(VBMatrix *mat) {
   mat->clear();
   char line[STRINGLEN];
-  string keyword;
-  tokenlist args;
+  tokenview args;
 
   mat->matfile = fopen(mat->filename.c_str(), "r");
   if (!mat->matfile) return (101);
@@ -103,24 +102,20 @@ int mat1_read_head(VBMatrix *mat) {
     if (line[0] == 12) break;
     stripchars(line, "\n");
     args.ParseLine(line);
-    keyword = args[0];
-    // discard trailing colons
-    if (keyword[keyword.size() - 1] == ':')
-      keyword.replace(keyword.size() - 1, 1, "");
     // parse known headers
-    if (equali(keyword, "voxdims(xy)") && args.size() > 2) {
-      mat->m = strtol(args[2]);
-      mat->n = strtol(args[1]);
+    if (args.iskey("voxdims(xy)") && args.size() > 2) {
+      mat->m = args.num(2);
+      mat->n = args.num(1);
       continue;
     }
-    if (equali(keyword, "byteorder") && args.size() > 1) {
-      if (equali(args[1], "msbfirst"))
+    if (args.iskey("byteorder") && args.size() > 1) {
+      if (args.isi(1, "msbfirst"))
         mat->filebyteorder = ENDIAN_BIG;
-      else if (equali(args[1], "lsbfirst"))
+      else if (args.isi(1, "lsbfirst"))
         mat->filebyteorder = ENDIAN_LITTLE;
       continue;
     }
-    if (equali(keyword, "datatype") && args.size() > 1) {
+    if (args.iskey("datatype") && args.size() > 1) {
       parsedatatype(args[1], mat->datatype, mat->datasize);
       continue;
     }
@@ -223,10 +218,9 @@ int mat1_write(VBMatrix *mat) {
 
 vf_status mat1_test(unsigned char *buf, int bufsize, string) {
   if (bufsize < 20) return vf_no;
-  tokenlist args;
-  args.SetSeparator("\n");
-  args.ParseLine((char *)buf);
-  if (args[0] != "VB98" || args[1] != "MAT1") return vf_no;
+  tokenview args("\n");
+  args.ParseLine((char *)buf, bufsize, 2);
+  if (!args.is(0, "VB98") || !args.is(1, "MAT1")) return vf_no;
   return vf_yes;
 }
 
@@ -65,26 +65,25 @@ VBFF ref1_vbff()
 }
 
 vf_status ref1_test(unsigned char *buf, int bufsize, string fname) {
-  tokenlist args;
-  tokenlist line;
-  args.SetSeparator("\n");
+  tokenview args("\n");
+  tokenview line;
   args.SetQuoteChars("");
   if (bufsize < 2) return vf_no;
-  args.ParseLine((char *)buf);
-  args.DeleteLast();  // don't try to parse partial lines
+  args.ParseLine((char *)buf, bufsize);
   int goodlines = 0;
-  for (size_t i = 0; i < args.size(); i++) {
+  // size()-1 because we don't try to parse partial lines
+  for (size_t i = 0; i + 1 < args.size(); i++) {
     // skip comments
-    if (args[i][0] == ';' || args[i][0] == '#') continue;
+    if (*args.ptr(i) == ';' || *args.ptr(i) == '#') continue;
     // skip VB98/REF1 header
-    if (i == 0 && args[0] == "VB98") {
-      if (args.size() < 2) return vf_no;
-      if (args[1] != "REF1") return vf_no;
+    if (i == 0 && args.is(0, "VB98")) {
+      if (args.size() < 3) return vf_no;
+      if (!args.is(1, "REF1")) return vf_no;
       i++;
       continue;
     }
     // anything else, make sure it's either blank or parseable as a double
-    line.ParseLine(args[i]);
+    line.ParseLine(args.ptr(i), args.len(i));
     if (line.size() == 0) continue;
     if (line.size() != 1) return vf_no;
     if (strtodx(line[0]).first) return vf_no;
@@ -117,20 +116,31 @@ int ref1_read(VB_Vector *vec) {
   char linex[STRINGLEN];
   size_t allocation, len;
   double *dd = NULL, *olddata = NULL;
+  tokenview line;
+  line.SetCommentChars("");
+  line.SetQuoteChars("");
 
   vec->clear();
   len = allocation = 0;
 
   if ((fp = fopen(vec->getFileName().c_str(), "r")) == 0) return (105);
   while (fgets(linex, STRINGLEN, fp)) {
-    string line = xstripwhitespace(linex);
-    if (line.empty()) continue;
-    if (strchr(";#%", line[0])) {
-      vec->header.push_back(xstripwhitespace(line.substr(1)));
+    if (line.ParseLine(linex) == 0) continue;
+    if (strchr(";#%", *line.ptr(0))) {
+      vec->header.push_back(xstripwhitespace(line.Tail(0).substr(1)));
       continue;
     }
-    pair<bool, double> res = strtodx(line);
-    if (res.first) {
+    // one number per line, and nothing else.  strtod() is much faster
+    // than strtodx(), but it also takes nan, inf, and hex, so anything
+    // strtodx() would refuse (ref1_test uses it) is refused here too.
+    char *endp;
+    if (line.size() != 1 ||
+        strspn(line.ptr(0), "0123456789+-.eE") != line.len(0)) {
+      fclose(fp);
+      return 112;
+    }
+    double val = strtod(line.ptr(0), &endp);
+    if (endp != line.ptr(0) + line.len(0) || fabs(val) == HUGE_VAL) {
       fclose(fp);
       return 112;
     }
@@ -145,7 +155,7 @@ int ref1_read(VB_Vector *vec) {
         olddata = NULL;
       }
     }
-    dd[len++] = res.second;
+    dd[len++] = val;
   }
   fclose(fp);
   vec->resize(len);
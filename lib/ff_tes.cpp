@@ -35,10 +35,70 @@
 #include <zlib.h>
 #include <sstream>
 #include "vbio.h"
+#include "vbtrace.h"
 
 using namespace std;
 using boost::format;
 
+// tes1_headerstring() builds the text part of a tes1 header, through
+// the formfeed.  the mask and data follow it directly.
+
+string tes1_headerstring(Tes &ts) {
+  string hdr, buf;
+  hdr += "VB98\nTES1\n";
+  hdr += "DataType: ";
+  switch (ts.f_scaled ? ts.altdatatype : ts.datatype) {
+    case (vb_byte):
+      hdr += "Byte\n";
+      break;
+    case (vb_short):
+      hdr += "Integer\n";
+      break;
+    case (vb_long):
+      hdr += "Long\n";
+      break;
+    case (vb_float):
+      hdr += "Float\n";
+      break;
+    case (vb_double):
+      hdr += "Double\n";
+      break;
+    default:
+      hdr += "Integer\n";
+      break;
+  }
+  buf = (format("VoxDims(TXYZ): %d %d %d %d\n") % ts.dimt % ts.dimx % ts.dimy %
+         ts.dimz)
+            .str();
+  hdr += buf;
+  if ((ts.voxsize[0] + ts.voxsize[1] + ts.voxsize[2]) > 0.0) {
+    buf = (format("VoxSizes(XYZ): %.4f %.4f %.4f\n") % ts.voxsize[0] %
+           ts.voxsize[1] % ts.voxsize[2])
+              .str();
+    hdr += buf;
+  }
+  buf = (format("TR(msecs): %.4f\n") % ts.voxsize[3]).str();
+  hdr += buf;
+  if ((ts.origin[0] + ts.origin[1] + ts.origin[2]) > 0) {  // FIXME could be bad
+    buf = (format("Origin(XYZ): %d %d %d\n") % ts.origin[0] % ts.origin[1] %
+           ts.origin[2])
+              .str();
+    hdr += buf;
+  }
+  if (ts.filebyteorder == ENDIAN_BIG)
+    hdr += "Byteorder: msbfirst\n";
+  else
+    hdr += "Byteorder: lsbfirst\n";
+  hdr += "Orientation: " + ts.orient + "\n";
+  if (ts.f_scaled) {
+    hdr += "scl_slope: " + strnum(ts.scl_slope) + "\n";
+    hdr += "scl_inter: " + strnum(ts.scl_inter) + "\n";
+  }
+  for (int i = 0; i < (int)ts.header.size(); i++) hdr += ts.header[i] + "\n";
+  hdr += "\x0c\n";
+  return hdr;
+}
+
 extern "C" {
 
 vf_status tes1_test(unsigned char *buf, int bufsize, string filename);
@@ -73,18 +133,15 @@ VBFF tes1_vbff()
 }
 
 vf_status tes1_test(unsigned char *buf, int bufsize, string) {
-  tokenlist args;
-  args.SetSeparator("\n");
+  tokenview args("\n");
   if (bufsize < 40) return vf_no;
-  args.ParseLine((char *)buf);
-  if (args[0] != "VB98" || args[1] != "TES1") return vf_no;
+  args.ParseLine((char *)buf, bufsize, 2);
+  if (!args.is(0, "VB98") || !args.is(1, "TES1")) return vf_no;
   return vf_yes;
 }
 
 int tes1_read_ts(Tes &ts, int x, int y, int z) {
   gzFile fp;
-  string keyword;
-  tokenlist args;
   int cnt;
 
   if (!ts.header_valid)  // the header includes the mask
@@ -97,11 +154,11 @@ int tes1_read_ts(Tes &ts, int x, int y, int z) {
     return (0);  // no error!
   }
 
-  fp = gzopen(ts.GetFileName().c_str(), "r");
+  fp = vbt_gzopen(ts.GetFileName().c_str(), "r");
   if (!fp) return (100);
 
   // skip the header and mask
-  gzseek(fp, ts.offset, SEEK_SET);
+  vbt_gzseek(fp, ts.offset, SEEK_SET);
 
   // figure out how many time series to skip over
   int maskposition = ts.voxelposition(x, y, z);
@@ -109,10 +166,10 @@ int tes1_read_ts(Tes &ts, int x, int y, int z) {
   for (int i = 0; i < maskposition; i++) {
     if (ts.mask[i]) includedseries++;
   }
-  gzseek(fp, includedseries * ts.dimt * ts.datasize, SEEK_CUR);
+  vbt_gzseek(fp, includedseries * ts.dimt * ts.datasize, SEEK_CUR);
 
   unsigned char tmpdata[ts.datasize * ts.dimt];
-  cnt = gzread(fp, tmpdata, ts.datasize * ts.dimt);
+  cnt = vbt_gzread(fp, tmpdata, ts.datasize * ts.dimt);
   gzclose(fp);
   if (cnt != ts.dimt * ts.datasize) return 101;
 
@@ -133,8 +190,6 @@ int tes1_read_ts(Tes &ts, int x, int y, int z) {
 
 int tes1_read_vol(Tes &ts, Cube &cb, int t) {
   gzFile fp;
-  string keyword;
-  tokenlist args;
   int cnt;
 
   // Tes::ReadHeader should already have read the header, which
@@ -142,11 +197,11 @@ int tes1_read_vol(Tes &ts, Cube &cb, int t) {
   if (!ts.header_valid) return (100);
   if (t < 0 || t > ts.dimt - 1) return 101;
 
-  fp = gzopen(ts.GetFileName().c_str(), "r");
+  fp = vbt_gzopen(ts.GetFileName().c_str(), "r");
   if (!fp) return (100);
 
   // skip the header and mask and advance to our image position
-  gzseek(fp, ts.offset + (t * ts.datasize), SEEK_SET);
+  vbt_gzseek(fp, ts.offset + (t * ts.datasize), SEEK_SET);
 
   cb.SetVolume(ts.dimx, ts.dimy, ts.dimz, ts.datatype);
   if (!cb.data) return 102;
@@ -155,12 +210,12 @@ int tes1_read_vol(Tes &ts, Cube &cb, int t) {
     for (int j = 0; j < ts.dimy; j++) {
       for (int i = 0; i < ts.dimx; i++) {
         if (ts.mask[index]) {
-          cnt = gzread(fp, cb.data + (ts.datasize * index), ts.datasize);
+          cnt = vbt_gzread(fp, cb.data + (ts.datasize * index), ts.datasize);
           if (cnt != ts.datasize) {
             gzclose(fp);
             return 103;
           }
-          gzseek(fp, ts.datasize * (ts.dimt - 1), SEEK_CUR);
+          vbt_gzseek(fp, ts.datasize * (ts.dimt - 1), SEEK_CUR);
         }
         index++;
       }
@@ -185,63 +240,9 @@ int tes1_write(Tes *mytes) {
                      time(NULL) % xfilename(fname))
                         .str();
   mytes->Remask();
-  string hdr;
-  string buf;
-  hdr += "VB98\nTES1\n";
-  hdr += "DataType: ";
-  switch (mytes->f_scaled ? mytes->altdatatype : mytes->datatype) {
-    case (vb_byte):
-      hdr += "Byte\n";
-      break;
-    case (vb_short):
-      hdr += "Integer\n";
-      break;
-    case (vb_long):
-      hdr += "Long\n";
-      break;
-    case (vb_float):
-      hdr += "Float\n";
-      break;
-    case (vb_double):
-      hdr += "Double\n";
-      break;
-    default:
-      hdr += "Integer\n";
-      break;
-  }
-  buf = (format("VoxDims(TXYZ): %d %d %d %d\n") % mytes->dimt % mytes->dimx %
-         mytes->dimy % mytes->dimz)
-            .str();
-  hdr += buf;
-  if ((mytes->voxsize[0] + mytes->voxsize[1] + mytes->voxsize[2]) > 0.0) {
-    buf = (format("VoxSizes(XYZ): %.4f %.4f %.4f\n") % mytes->voxsize[0] %
-           mytes->voxsize[1] % mytes->voxsize[2])
-              .str();
-    hdr += buf;
-  }
-  buf = (format("TR(msecs): %.4f\n") % mytes->voxsize[3]).str();
-  hdr += buf;
-  if ((mytes->origin[0] + mytes->origin[1] + mytes->origin[2]) >
-      0) {  // FIXME could be bad
-    buf = (format("Origin(XYZ): %d %d %d\n") % mytes->origin[0] %
-           mytes->origin[1] % mytes->origin[2])
-              .str();
-    hdr += buf;
-  }
   // force big-endian
   mytes->filebyteorder = ENDIAN_BIG;
-  if (mytes->filebyteorder == ENDIAN_BIG)
-    hdr += "Byteorder: msbfirst\n";
-  else
-    hdr += "Byteorder: lsbfirst\n";
-  hdr += "Orientation: " + mytes->orient + "\n";
-  if (mytes->f_scaled) {
-    hdr += "scl_slope: " + strnum(mytes->scl_slope) + "\n";
-    hdr += "scl_inter: " + strnum(mytes->scl_inter) + "\n";
-  }
-  for (int i = 0; i < (int)mytes->header.size(); i++)
-    hdr += mytes->header[i] + "\n";
-  hdr += "\x0c\n";
+  string hdr = tes1_headerstring(*mytes);
 
   zfile zfp;
   zfp.open(tmpfname, "w");
@@ -278,24 +279,26 @@ int tes1_write(Tes *mytes) {
     *mytes *= mytes->scl_slope;
     *mytes += mytes->scl_inter;
   }
-  zfp.close();
+  if (!zfp.close()) {
+    unlink(tmpfname.c_str());
+    return (102);
+  }
   if (rename(tmpfname.c_str(), fname.c_str())) return (103);
   return (0);  // no error!
 }
 
 int tes1_read_head(Tes *mytes) {
   gzFile fp;
-  string keyword;
   char line[STRINGLEN];
-  tokenlist args;
+  tokenview args;
 
   mytes->header_valid = 0;
-  fp = gzopen(mytes->GetFileName().c_str(), "r");
+  fp = vbt_gzopen(mytes->GetFileName().c_str(), "r");
   if (!fp) {
     return (100);
   }
   mytes->header.clear();
-  if (gzread(fp, line, 10) != 10) {
+  if (vbt_gzread(fp, line, 10) != 10) {
     gzclose(fp);
     return (100);
   }
@@ -307,55 +310,51 @@ int tes1_read_head(Tes *mytes) {
     if (line[0] == 12) break;
     stripchars(line, "\n");
     args.ParseLine(line);
-    keyword = args[0];
-    // discard trailing colons
-    if (keyword[keyword.size() - 1] == ':')
-      keyword.replace(keyword.size() - 1, 1, "");
     // parse known headers
-    if (equali(keyword, "voxdims(txyz)") && args.size() > 4) {
-      mytes->dimt = strtol(args[1]);
-      mytes->dimx = strtol(args[2]);
-      mytes->dimy = strtol(args[3]);
-      mytes->dimz = strtol(args[4]);
+    if (args.iskey("voxdims(txyz)") && args.size() > 4) {
+      mytes->dimt = args.num(1);
+      mytes->dimx = args.num(2);
+      mytes->dimy = args.num(3);
+      mytes->dimz = args.num(4);
       continue;
     }
-    if (equali(keyword, "datatype") && args.size() > 1) {
+    if (args.iskey("datatype") && args.size() > 1) {
       parsedatatype(args[1], mytes->datatype, mytes->datasize);
       continue;
     }
-    if (equali(keyword, "voxsizes(xyz)") && args.size() > 3) {
-      mytes->voxsize[0] = strtod(args[1]);
-      mytes->voxsize[1] = strtod(args[2]);
-      mytes->voxsize[2] = strtod(args[3]);
+    if (args.iskey("voxsizes(xyz)") && args.size() > 3) {
+      mytes->voxsize[0] = args.dbl(1);
+      mytes->voxsize[1] = args.dbl(2);
+      mytes->voxsize[2] = args.dbl(3);
       continue;
     }
-    if (equali(keyword, "tr(msecs)") && args.size() > 1) {
-      mytes->voxsize[3] = strtod(args[1]);
+    if (args.iskey("tr(msecs)") && args.size() > 1) {
+      mytes->voxsize[3] = args.dbl(1);
       continue;
     }
-    if (equali(keyword, "origin(xyz)") && args.size() > 3) {
-      mytes->origin[0] = strtol(args[1]);
-      mytes->origin[1] = strtol(args[2]);
-      mytes->origin[2] = strtol(args[3]);
+    if (args.iskey("origin(xyz)") && args.size() > 3) {
+      mytes->origin[0] = args.num(1);
+      mytes->origin[1] = args.num(2);
+      mytes->origin[2] = args.num(3);
       continue;
     }
-    if (equali(keyword, "byteorder") && args.size() > 1) {
-      if (equali(args[1], "msbfirst"))
+    if (args.iskey("byteorder") && args.size() > 1) {
+      if (args.isi(1, "msbfirst"))
         mytes->filebyteorder = ENDIAN_BIG;
-      else if (equali(args[1], "lsbfirst"))
+      else if (args.isi(1, "lsbfirst"))
         mytes->filebyteorder = ENDIAN_LITTLE;
       continue;
     }
-    if (equali(keyword, "orientation") && args.size() > 1) {
+    if (args.iskey("orientation") && args.size() > 1) {
       mytes->orient = args[1];
       continue;
     }
-    if (equali(keyword, "scl_slope") && args.size() > 1) {
-      mytes->scl_slope = strtod(args[1]);
+    if (args.iskey("scl_slope") && args.size() > 1) {
+      mytes->scl_slope = args.dbl(1);
       continue;
     }
-    if (equali(keyword, "scl_inter") && args.size() > 1) {
-      mytes->scl_inter = strtod(args[1]);
+    if (args.iskey("scl_inter") && args.size() > 1) {
+      mytes->scl_inter = args.dbl(1);
       continue;
     }
     mytes->AddHeader(line);
@@ -391,7 +390,7 @@ int tes1_read_head(Tes *mytes) {
     return 110;
   }
 
-  int cnt = gzread(fp, mytes->mask, mytes->voxels);
+  int cnt = vbt_gzread(fp, mytes->mask, mytes->voxels);
   if (cnt < mytes->voxels) {
     gzclose(fp);
     return (100);
@@ -406,14 +405,12 @@ int tes1_read_head(Tes *mytes) {
 
 int tes1_read_data(Tes *mytes, int start, int count) {
   gzFile fp;
-  string keyword;
-  tokenlist args;
   int cnt;
 
   if (!mytes->header_valid) return 101;
   if (mytes->InitData()) return 102;
 
-  fp = gzopen(mytes->GetFileName().c_str(), "r");
+  fp = vbt_gzopen(mytes->GetFileName().c_str(), "r");
   if (!fp) return (102);
 
   // honor volume range
@@ -427,22 +424,22 @@ int tes1_read_data(Tes *mytes, int start, int count) {
 
   // seek to the beginning of the data -- note that header_valid
   // implies the mask is correct and the data array exists
-  gzseek(fp, mytes->offset, SEEK_SET);
+  vbt_gzseek(fp, mytes->offset, SEEK_SET);
 
   mytes->realvoxels = 0;
   for (int i = 0; i < mytes->dimx * mytes->dimy * mytes->dimz; i++) {
     if (mytes->mask[i] == 0) continue;
     mytes->buildvoxel(i);  // make sure memory is allocated for that voxel
     // skip omitted initial volumes
-    if (start > 0) gzseek(fp, start * mytes->datasize, SEEK_CUR);
+    if (start > 0) vbt_gzseek(fp, start * mytes->datasize, SEEK_CUR);
     // read time series data
-    cnt = gzread(fp, mytes->data[i], mytes->datasize * mytes->dimt);
+    cnt = vbt_gzread(fp, mytes->data[i], mytes->datasize * mytes->dimt);
     if (cnt != mytes->datasize * mytes->dimt) {
       mytes->data_valid = 0;
       break;
     }
     // skip omitted end volumes
-    if (endskip > 0) gzseek(fp, endskip * mytes->datasize, SEEK_CUR);
+    if (endskip > 0) vbt_gzseek(fp, endskip * mytes->datasize, SEEK_CUR);
   }
   gzclose(fp);
   if (my_endian() != mytes->filebyteorder) mytes->byteswap();
@@ -273,7 +273,15 @@ int GLMInfo::calc_stat_cube() {
 int GLMInfo::calc_t() {
   statval = 0.0;
   if (contrast.contrast.size() != gMatrix.n) return 101;
-  double fact = calcfact();
+  return calc_t(calcfact());
+}
+
+// calc_t() with c'(G'G)^-1c already in hand, for callers that have a
+// cheaper way to get it than calcfact()
+
+int GLMInfo::calc_t(double fact) {
+  statval = 0.0;
+  if (contrast.contrast.size() != gMatrix.n) return 101;
   double error = betas[betas.getLength() - 1];
   // printf("error: %.10f    beta: %.10f   fact %.10f\n",error,betas[0],fact);
   error = sqrt(error * fact);
@@ -0,0 +1,186 @@
+// glmcache.cpp
+// process-wide cache for the design-side files of a GLM
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include "glmutil.h"
+#include "vbtrace.h"
+
+// the cache is a list of entries, most recently used first, plus an
+// index into the list by key.  the key is the kind of object (m for
+// matrix, v for vector, t for 4D header) followed by the filename, so
+// that the same file can't be confused for two different things.
+// every lookup stats the file, and an entry whose mtime or size has
+// changed is reloaded.  the cached objects are const, so callers can
+// keep using them after we've dropped the lock (or even after the
+// entry has been evicted).
+
+namespace {
+
+class cacheentry {
+ public:
+  string key;
+  time_t mtime;
+  off_t size;
+  shared_ptr<const void> obj;
+};
+
+typedef list<cacheentry> entrylist;
+
+boost::mutex cachelock;
+entrylist entries;
+map<string, entrylist::iterator> entryindex;
+size_t cachecapacity = 64;
+uint64 cachehits = 0, cachemisses = 0;
+
+// drop entries from the tail until we're within capacity -- caller
+// must hold cachelock
+void trimcache() {
+  while (entries.size() > cachecapacity) {
+    entryindex.erase(entries.back().key);
+    entries.pop_back();
+  }
+}
+
+shared_ptr<const void> loadmatrix(const string &fname) {
+  shared_ptr<VBMatrix> mat(new VBMatrix);
+  if (mat->ReadFile(fname) || !mat->m) return shared_ptr<const void>();
+  return mat;
+}
+
+shared_ptr<const void> loadvector(const string &fname) {
+  shared_ptr<VB_Vector> vec(new VB_Vector);
+  if (vec->ReadFile(fname) || vec->size() == 0)
+    return shared_ptr<const void>();
+  return vec;
+}
+
+shared_ptr<const void> loadheader(const string &fname) {
+  shared_ptr<Tes> ts(new Tes);
+  if (ts->ReadHeader(fname) || !ts->header_valid)
+    return shared_ptr<const void>();
+  return ts;
+}
+
+shared_ptr<const void> fetch(char kind, const string &fname,
+                             shared_ptr<const void> (*loader)(const string &)) {
+  string key = kind + fname;
+  struct stat st;
+  if (stat(fname.c_str(), &st)) {
+    // file is gone (or was never there), make sure we don't keep it
+    boost::mutex::scoped_lock lk(cachelock);
+    map<string, entrylist::iterator>::iterator ii = entryindex.find(key);
+    if (ii != entryindex.end()) {
+      entries.erase(ii->second);
+      entryindex.erase(ii);
+    }
+    return shared_ptr<const void>();
+  }
+  {
+    boost::mutex::scoped_lock lk(cachelock);
+    map<string, entrylist::iterator>::iterator ii = entryindex.find(key);
+    if (ii != entryindex.end()) {
+      if (ii->second->mtime == st.st_mtime && ii->second->size == st.st_size) {
+        entries.splice(entries.begin(), entries, ii->second);
+        cachehits++;
+        return entries.front().obj;
+      }
+      entries.erase(ii->second);
+      entryindex.erase(ii);
+    }
+    cachemisses++;
+  }
+  // load without the lock, so that readers of other entries aren't
+  // held up by the disk.  if two threads race to load the same file,
+  // the second one to finish just replaces the first.
+  shared_ptr<const void> obj = loader(fname);
+  if (!obj) return obj;
+  boost::mutex::scoped_lock lk(cachelock);
+  map<string, entrylist::iterator>::iterator ii = entryindex.find(key);
+  if (ii != entryindex.end()) {
+    entries.erase(ii->second);
+    entryindex.erase(ii);
+  }
+  cacheentry ce;
+  ce.key = key;
+  ce.mtime = st.st_mtime;
+  ce.size = st.st_size;
+  ce.obj = obj;
+  entries.push_front(ce);
+  entryindex[key] = entries.begin();
+  trimcache();
+  return obj;
+}
+
+}  // namespace
+
+shared_ptr<const VBMatrix> GLMCache::getMatrix(const string &fname) {
+  return static_pointer_cast<const VBMatrix>(fetch('m', fname, loadmatrix));
+}
+
+shared_ptr<const VB_Vector> GLMCache::getVector(const string &fname) {
+  return static_pointer_cast<const VB_Vector>(fetch('v', fname, loadvector));
+}
+
+shared_ptr<const Tes> GLMCache::getHeader(const string &fname) {
+  return static_pointer_cast<const Tes>(fetch('t', fname, loadheader));
+}
+
+// readTimeSeries() uses the cached header (including the mask, for
+// tes1 files) so that only the voxel's own data comes off the disk.
+// the local Tes mirrors the cached one rather than copying it.
+
+int GLMCache::readTimeSeries(const string &fname, int x, int y, int z,
+                             VB_Vector &ts) {
+  VBTraceTimer tracer("GLMCache::readTimeSeries");
+  shared_ptr<const Tes> hdr = getHeader(fname);
+  if (!hdr) return 101;
+  if (!hdr->fileformat.read_ts_4D) return 102;
+  Tes mytes;
+  mytes.copytes(*hdr, 1);
+  int err = mytes.fileformat.read_ts_4D(mytes, x, y, z);
+  if (err) return err;
+  ts = mytes.timeseries;
+  return 0;
+}
+
+void GLMCache::setCapacity(size_t n) {
+  boost::mutex::scoped_lock lk(cachelock);
+  cachecapacity = n;
+  trimcache();
+}
+
+void GLMCache::flush() {
+  boost::mutex::scoped_lock lk(cachelock);
+  entries.clear();
+  entryindex.clear();
+}
+
+void GLMCache::stats(uint64 &hits, uint64 &misses, size_t &count) {
+  boost::mutex::scoped_lock lk(cachelock);
+  hits = cachehits;
+  misses = cachemisses;
+  count = entries.size();
+}
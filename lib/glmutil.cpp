@@ -2093,16 +2093,15 @@ void GLMInfo::initthresh() {
   thresh.vsize[0] = paramtes.voxsize[0];
   thresh.vsize[1] = paramtes.voxsize[1];
   thresh.vsize[2] = paramtes.voxsize[2];
-  VB_Vector se, traces;
+  shared_ptr<const VB_Vector> se = GLMCache::getVector(sename);
+  shared_ptr<const VB_Vector> traces = GLMCache::getVector(tracesname);
   double effdf = 0.0;
-  se.ReadFile(sename);
-  if (se.size() == 3)
-    thresh.fwhm = (se[0] + se[1] + se[2]) / 3.0;
+  if (se && se->size() == 3)
+    thresh.fwhm = ((*se)[0] + (*se)[1] + (*se)[2]) / 3.0;
   else
     thresh.fwhm = 0.0;
   thresh.pValPeak = 0.05;
-  traces.ReadFile(tracesname);
-  if (traces.size() == 3) effdf = traces[2];
+  if (traces && traces->size() == 3) effdf = (*traces)[2];
   if (contrast.scale[0] == 'f') {
     int nz = 0;
     for (size_t i = 0; i < contrast.contrast.size(); i++)
@@ -2121,47 +2120,54 @@ VB_Vector GLMInfo::getCovariate(int x, int y, int z, int paramindex,
   VB_Vector covar;
   string prmname = xsetextension(stemname, "prm");
   string kgname = xsetextension(stemname, "KG");
-  VBMatrix KG;
 
-  int errs = 0;
-  int ntimepoints;
-  // load KG
-  KG.ReadFile(kgname);
-  ntimepoints = KG.m;
-  // if not valid, return the empty covariate
-  if (!KG.valid()) return covar;
+  // load KG -- if not available, return the empty covariate
+  shared_ptr<const VBMatrix> KG = GLMCache::getMatrix(kgname);
+  if (!KG) return covar;
+  int ntimepoints = KG->m;
   // fill the covariate with the right row of the KG matrix
   covar.resize(ntimepoints);
-  for (int i = 0; i < ntimepoints; i++) covar.setElement(i, KG(i, paramindex));
+  for (int i = 0; i < ntimepoints; i++)
+    covar.setElement(i, (*KG)(i, paramindex));
   // if scaled, get the beta
   if (scaledflag) {
-    Tes prm;
-    if (prm.ReadHeader(prmname)) errs++;
-    if (prm.ReadTimeSeries(prmname, x, y, z)) errs++;
-    if ((int)(prm.timeseries.getLength()) <= paramindex) errs++;
-    if (errs == 0) covar *= prm.timeseries[paramindex];
+    VB_Vector prm;
+    if (GLMCache::readTimeSeries(prmname, x, y, z, prm) == 0 &&
+        (int)prm.getLength() > paramindex)
+      covar *= prm[paramindex];
   }
   return covar;
 }
 
-int GLMInfo::filterTS(VB_Vector &signal) {
+// loadexokernel() makes sure exoFilt is loaded (from exoname) and its
+// fft is in realExokernel/imagExokernel, with the DC term forced to 1
+
+int GLMInfo::loadexokernel(const string &exoname) {
   if (!(exoFilt.getLength())) {
-    string exoname = xsetextension(stemname, "ExoFilt");
-    exoFilt.ReadFile(exoname);
-    if (!(exoFilt.getLength())) return 101;
+    shared_ptr<const VB_Vector> exo = GLMCache::getVector(exoname);
+    if (!exo) return 101;
+    exoFilt = *exo;
   }
-  VB_Vector exo_real(exoFilt.getLength());
-  VB_Vector exo_imag(exoFilt.getLength());
+  if (realExokernel.size() == exoFilt.size() &&
+      imagExokernel.size() == exoFilt.size())
+    return 0;
+  realExokernel.resize(exoFilt.getLength());
+  imagExokernel.resize(exoFilt.getLength());
+  exoFilt.fft(realExokernel, imagExokernel);
+  realExokernel[0] = 1.0;
+  imagExokernel[0] = 0.0;
+  return 0;
+}
+
+int GLMInfo::filterTS(VB_Vector &signal) {
+  if (loadexokernel(xsetextension(stemname, "ExoFilt"))) return 101;
   VB_Vector sig_real(signal.getLength());
   VB_Vector sig_imag(signal.getLength());
   VB_Vector prod_real(signal.getLength());
   VB_Vector prod_imag(signal.getLength());
-  exoFilt.fft(exo_real, exo_imag);
-  exo_real[0] = 1.0;
-  exo_imag[0] = 0.0;
   signal.fft(sig_real, sig_imag);
-  VB_Vector::compMult(sig_real, sig_imag, exo_real, exo_imag, prod_real,
-                      prod_imag);
+  VB_Vector::compMult(sig_real, sig_imag, realExokernel, imagExokernel,
+                      prod_real, prod_imag);
   VB_Vector::complexIFFTReal(prod_real, prod_imag, signal);
   return 0;
 }
@@ -2170,22 +2176,23 @@ int GLMInfo::makeF1() {
   // see if F1 is already populated
   if (f1Matrix.m) return 0;
   // see if it's on disk
-  string f1name = xsetextension(stemname, "F1");
-  f1Matrix.ReadFile(f1name);
-  if (f1Matrix.m) return 0;
+  shared_ptr<const VBMatrix> mat =
+      GLMCache::getMatrix(xsetextension(stemname, "F1"));
+  if (mat) {
+    f1Matrix = *mat;
+    return 0;
+  }
   // see if we can load a KG to pinv
-  string kgname = xsetextension(stemname, "KG");
-  VBMatrix kg;
-  kg.ReadFile(kgname);
-  if (kg.m) {
-    f1Matrix.init(kg.n, kg.m);
-    if (pinv(kg, f1Matrix)) return 2;
+  mat = GLMCache::getMatrix(xsetextension(stemname, "KG"));
+  if (mat) {
+    f1Matrix.init(mat->n, mat->m);
+    if (pinv(*mat, f1Matrix)) return 2;
     return 0;
   }
   // see if we have or can load a G matrix to pinv
   if (!gMatrix.m) {
-    string gname = xsetextension(stemname, "G");
-    gMatrix.ReadFile(gname);
+    mat = GLMCache::getMatrix(xsetextension(stemname, "G"));
+    if (mat) gMatrix = *mat;
   }
   if (gMatrix.m) {
     f1Matrix.init(gMatrix.n, gMatrix.m);
@@ -2200,14 +2207,11 @@ int GLMInfo::makeF1() {
 // betas.  the time series should already have been filtered.
 
 int GLMInfo::adjustTS(VB_Vector &signal) {
-  string kgname = xsetextension(stemname, "KG");
-  string gname = xsetextension(stemname, "G");
-  VBMatrix KG;
-
   if (makeF1()) return 190;
-  KG.ReadFile(kgname);
-  if (!KG.m) KG.ReadFile(gname);
-  if (!KG.m) return 191;
+  shared_ptr<const VBMatrix> KG =
+      GLMCache::getMatrix(xsetextension(stemname, "KG"));
+  if (!KG) KG = GLMCache::getMatrix(xsetextension(stemname, "G"));
+  if (!KG) return 191;
 
   // grab betas, kg, and g matrix figure out which covariates are not
   // of interest, scale them, and subtract them from the signal.  note
@@ -2216,6 +2220,8 @@ int GLMInfo::adjustTS(VB_Vector &signal) {
   // for convenience
   int ntimepoints = f1Matrix.n;
   int nvars = f1Matrix.m;
+  if ((int)signal.getLength() != ntimepoints || (int)KG->m != ntimepoints)
+    return 192;
   // calculate betas
   VB_Vector betas(nvars);
   for (int i = 0; i < nvars; i++) {
@@ -2226,10 +2232,9 @@ int GLMInfo::adjustTS(VB_Vector &signal) {
   }
 
   for (size_t i = 0; i < nointerestlist.size(); i++) {
-    VB_Vector tmp(ntimepoints);
+    int col = nointerestlist[i];
     for (int j = 0; j < ntimepoints; j++)
-      tmp.setElement(j, KG(j, nointerestlist[i]) * betas[nointerestlist[i]]);
-    signal -= tmp;
+      signal[j] -= (*KG)(j, col) * betas[col];
   }
   return 0;
 }
@@ -2266,31 +2271,29 @@ VB_Vector GLMInfo::getResid(int x, int y, int z, uint32 flags) {
 }
 
 VB_Vector GLMInfo::getResid(VBRegion &rr, uint32 flags) {
+  VB_Vector signal = getRegionTS(rr, flags);
+  if (signal.size() == 0) return signal;
+  return getResid(signal);
+}
+
+// this version is for callers that already have the region's time
+// series in hand
+
+VB_Vector GLMInfo::getResid(VB_Vector signal) {
   VB_Vector resid;
-  if (rMatrix.m == 0) rMatrix.ReadFile(xsetextension(stemname, "R"));
-  //   if (!paramtes.data_valid)
-  //     paramtes.ReadFile(xsetextension(stemname,"prm"));
-  if (exoFilt.size() == 0) exoFilt.ReadFile(xsetextension(stemname, "ExoFilt"));
-  if (rMatrix.m == 0 || exoFilt.size() == 0) return resid;
+  if (rMatrix.m == 0) {
+    shared_ptr<const VBMatrix> rmat =
+        GLMCache::getMatrix(xsetextension(stemname, "R"));
+    if (rmat) rMatrix = *rmat;
+  }
+  if (rMatrix.m == 0 || loadexokernel(xsetextension(stemname, "ExoFilt")))
+    return resid;
 
-  // assemble signal vector
-  VB_Vector signal = getRegionTS(rr, flags);
   int ntimepoints = signal.getLength();
+  if (ntimepoints != (int)rMatrix.n) return resid;
 
   // filter signal matrix
-  VB_Vector exo_real(exoFilt.getLength());
-  VB_Vector exo_imag(exoFilt.getLength());
-  VB_Vector sig_real(signal.getLength());
-  VB_Vector sig_imag(signal.getLength());
-  VB_Vector prod_real(signal.getLength());
-  VB_Vector prod_imag(signal.getLength());
-  exoFilt.fft(exo_real, exo_imag);
-  exo_real[0] = 1.0;
-  exo_imag[0] = 0.0;
-  signal.fft(sig_real, sig_imag);
-  VB_Vector::compMult(sig_real, sig_imag, exo_real, exo_imag, prod_real,
-                      prod_imag);
-  VB_Vector::complexIFFTReal(prod_real, prod_imag, signal);
+  filterTS(signal);
 
   // premult KX (filtered data) by residual forming matrix R
   resid.resize(ntimepoints);
@@ -29,6 +29,7 @@
 #ifndef GLMUTILS_H
 #define GLMUTILS_H
 
+#include <memory>
 #include "statthreshold.h"
 #include "vbio.h"
 #include "vbjobspec.h"
@@ -96,6 +97,43 @@ class TASpec {
 
 vector<TASpec> parseTAFile(string fname);
 
+// GLMCache holds the design-side files of a GLM (G, KG, F1, R,
+// ExoFilt, traces, and the prm/res headers) in memory, shared across
+// every GLMInfo in the process, so that per-voxel queries don't go
+// back to the disk.  entries are reloaded if the file's mtime or size
+// changes, and dropped least-recently-used beyond the capacity.  safe
+// for concurrent readers.
+
+class GLMCache {
+ public:
+  static shared_ptr<const VBMatrix> getMatrix(const string &fname);
+  static shared_ptr<const VB_Vector> getVector(const string &fname);
+  static shared_ptr<const Tes> getHeader(const string &fname);
+  static int readTimeSeries(const string &fname, int x, int y, int z,
+                            VB_Vector &ts);
+  static void setCapacity(size_t n);
+  static void flush();
+  static void stats(uint64 &hits, uint64 &misses, size_t &count);
+};
+
+// VRData holds everything a volume regression needs, read once by
+// VolumeRegressLoad() and laid out voxel by voxel, so that
+// VolumeRegressRun() can be called for as many permutations as we
+// like without going back to the disk.
+
+class VRData {
+ public:
+  int dimx, dimy, dimz;
+  uint32 orderg, rankg;
+  vector<int> xs, ys, zs;  // the voxels we're regressing
+  VBMatrix fixedg;         // G, minus the columns that vary by voxel
+  vector<int> volcols;     // G columns that come from volume IVs
+  vector<double> ivdata;   // voxel x volcols x orderg
+  vector<double> dvdata;   // voxel x orderg, if the DV is a volume
+  VB_Vector dvvec;         // otherwise the DV
+  void clear();
+};
+
 class GLMInfo {
  public:
   string stemname;         // stem name for glm files
@@ -131,6 +169,8 @@ class GLMInfo {
   Tes residtes;
   Cube statcube;  // most recently calculated stat cube
   Cube rawcube;   // raw stat cube, e.g., t values from which p vals derived
+  vector<Cube> statcubes, rawcubes;  // one per contrast, by VolumeRegressRun()
+  VRData vrdata;                     // loaded by VolumeRegressLoad()
   Cube mask;      // combined mask for GLM
 
   // public methods
@@ -145,6 +185,7 @@ class GLMInfo {
   // int makeKG();                            // get or build KG
 
   VB_Vector getResid(VBRegion &rr, uint32 flags);
+  VB_Vector getResid(VB_Vector signal);
   VB_Vector getResid(int x, int y, int z, uint32 flags);
   VB_Vector getCovariate(int x, int y, int z, int paramindex, int scaledflag);
   // NOT YET IMPLEMENTED
@@ -181,12 +222,17 @@ class GLMInfo {
   int TesRegress(int part, int nparts, uint32 flags = 0);
   int VolumeRegress(Cube mask, int part, int nparts, vector<string> ivnames,
                     string dvname, vector<VBMatrix> &ivmats);
+  int VolumeRegressLoad(Cube mask, int part, int nparts,
+                        vector<string> ivnames, string dvname,
+                        vector<VBMatrix> &ivmats);
+  int VolumeRegressRun(vector<VBContrast> &clist);
   int calcbetas_nocor(VB_Vector &signal);
   int calcbetas(VB_Vector &signal);
 
   // timeseries stats
   int calc_stat();
   int calc_t();
+  int calc_t(double fact);
   int calc_f();
   int calc_pct();
   int calc_beta();
@@ -215,6 +261,13 @@ class GLMInfo {
   void print();
 
  private:
+  // fft of exofilt into real/imagExokernel
+  int loadexokernel(const string &exoname);
+  // per-voxel pieces of VolumeRegressRun()
+  void vrsetcols(size_t v);
+  void vrsignal(size_t v, VB_Vector &signal);
+  void vrsave(size_t v);
+  int vrbatch(vector<VBContrast> &clist, VB_Vector &signal);
 };
 
 // Functions for reading a condition function with strings (based on
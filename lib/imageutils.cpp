@@ -54,42 +54,26 @@ int smoothCube_m(Cube &cube, Cube &mask, double s0, double s1, double s2) {
   return 0;
 }
 
-int smoothCube(Cube &cube, double s0, double s1, double s2, bool f_correct) {
-  int i;
-  double xsum, ysum, zsum;
-  short x1, y1, z1;
-
-  if (s0 < 1) s0 = 1;
-  if (s1 < 1) s1 = 1;
-  if (s2 < 1) s2 = 1;
-  s0 = s0 / sqrt(8.0 * log(2.0));
-  s1 = s1 / sqrt(8.0 * log(2.0));
-  s2 = s2 / sqrt(8.0 * log(2.0));
-  x1 = lround(6.0 * s0);
-  y1 = lround(6.0 * s1);
-  z1 = lround(6.0 * s2);
-
-  VB_Vector x((2 * x1) + 1);
-  VB_Vector y((2 * y1) + 1);
-  VB_Vector z((2 * z1) + 1);
-
-  for (i = -x1; i <= x1; i++) x(i + x1) = i;
-  for (i = -y1; i <= y1; i++) y(i + y1) = i;
-  for (i = -z1; i <= z1; i++) z(i + z1) = i;
-  for (i = 0; i < (int)x.getLength(); i++)
-    x(i) = exp(-pow(x(i), 2) / (2 * pow(s0, 2)));
-  for (i = 0; i < (int)y.getLength(); i++)
-    y(i) = exp(-pow(y(i), 2) / (2 * pow(s1, 2)));
-  for (i = 0; i < (int)z.getLength(); i++)
-    z(i) = exp(-pow(z(i), 2) / (2 * pow(s2, 2)));
-
-  xsum = x.getVectorSum();
-  ysum = y.getVectorSum();
-  zsum = z.getVectorSum();
-  for (i = 0; i < (int)x.getLength(); i++) x(i) /= xsum;
-  for (i = 0; i < (int)y.getLength(); i++) y(i) /= ysum;
-  for (i = 0; i < (int)z.getLength(); i++) z(i) /= zsum;
+// the normalized 1D gaussian that smoothCube() uses for a fwhm in
+// voxels
+
+static void gausskernel(double fwhm, VB_Vector &kern) {
+  if (fwhm < 1) fwhm = 1;
+  double s = fwhm / sqrt(8.0 * log(2.0));
+  short x1 = lround(6.0 * s);
+  kern.resize((2 * x1) + 1);
+  for (int i = -x1; i <= x1; i++) kern(i + x1) = i;
+  for (int i = 0; i < (int)kern.getLength(); i++)
+    kern(i) = exp(-pow(kern(i), 2) / (2 * pow(s, 2)));
+  double sum = kern.getVectorSum();
+  for (int i = 0; i < (int)kern.getLength(); i++) kern(i) /= sum;
+}
 
+int smoothCube(Cube &cube, double s0, double s1, double s2, bool f_correct) {
+  VB_Vector x, y, z;
+  gausskernel(s0, x);
+  gausskernel(s1, y);
+  gausskernel(s2, z);
   if (f_correct)
     conv3dx(cube, x, y, z);
   else
@@ -211,6 +195,75 @@ void conv3dx(Cube &cube, VB_Vector &kx, VB_Vector &ky, VB_Vector &kz) {
   }
 }
 
+VBSmoothKernel::VBSmoothKernel() { dimx = dimy = dimz = 0; }
+
+void VBSmoothKernel::init(int xx, int yy, int zz, double s0, double s1,
+                          double s2, bool f_correct) {
+  dimx = xx;
+  dimy = yy;
+  dimz = zz;
+  initaxis(ax[0], dimx, s0, f_correct);
+  initaxis(ax[1], dimy, s1, f_correct);
+  initaxis(ax[2], dimz, s2, f_correct);
+}
+
+// output i of a line is the sum over inputs j of in[j]*kernel[i+pad-j],
+// added up in increasing j as VB_Vector::convolve() does.  with
+// f_correct it's divided by the sum of the weights that fell inside
+// the line, as in convolvex().
+
+void VBSmoothKernel::initaxis(axis &ax, int dim, double fwhm,
+                              bool f_correct) {
+  VB_Vector kern;
+  gausskernel(fwhm, kern);
+  ax.dim = dim;
+  ax.pad = kern.size() / 2;
+  ax.kernel.resize(kern.size());
+  for (size_t i = 0; i < kern.size(); i++) ax.kernel[i] = kern[i];
+  ax.mass.assign(dim, 0.0);
+  if (!f_correct) return;
+  int klen = ax.kernel.size();
+  for (int i = 0; i < dim; i++) {
+    double mass = 0.0;
+    for (int j = max(0, i + ax.pad - klen + 1); j <= min(dim - 1, i + ax.pad);
+         j++)
+      mass += ax.kernel[i + ax.pad - j];
+    if (mass > FLT_MIN) ax.mass[i] = mass;
+  }
+}
+
+// smooth n1*n2 lines of ax.dim values each, spaced stride apart
+
+void VBSmoothKernel::pass(float *data, const axis &ax, int stride, int s1,
+                          int n1, int s2, int n2) const {
+  int klen = ax.kernel.size();
+  vector<double> in(ax.dim);
+  for (int a = 0; a < n1; a++) {
+    for (int b = 0; b < n2; b++) {
+      float *line = data + a * s1 + b * s2;
+      for (int i = 0; i < ax.dim; i++) in[i] = line[i * stride];
+      for (int i = 0; i < ax.dim; i++) {
+        double sum = 0.0;
+        for (int j = max(0, i + ax.pad - klen + 1);
+             j <= min(ax.dim - 1, i + ax.pad); j++)
+          sum += in[j] * ax.kernel[i + ax.pad - j];
+        if (ax.mass[i] > 0.0) sum /= ax.mass[i];
+        line[i * stride] = sum;
+      }
+    }
+  }
+}
+
+// z, then x, then y, the same order as conv3d()
+
+void VBSmoothKernel::apply(float *data) const {
+  if (dimx < 1 || dimy < 1 || dimz < 1) return;
+  int sy = dimx, sz = dimx * dimy;
+  pass(data, ax[2], sz, 1, dimx, sy, dimy);
+  pass(data, ax[0], 1, sy, dimy, sz, dimz);
+  pass(data, ax[1], sy, 1, dimx, sz, dimz);
+}
+
 // the following function is for online SNR mapping mostly -- for
 // off-line we should tend to use ReadTimeSeries, in case of really
 // large tes files
@@ -1193,9 +1246,129 @@ int Resample::NNResampleCube(const Cube &mycube, Cube &newcube) {
   return 0;  // no error
 }
 
-int Resample::SincResampleCube(const Cube &mycube, Cube &newcube) {
-  int i, j, k;
+// the resample is always axis-aligned, so the sinc weights for each
+// output row, column, and slice can be worked out once up front (see
+// sincaxis below) rather than once per voxel.  the sum is separable,
+// so each source slice is collapsed in x and then y just once, and
+// those partial sums are reused for every output slice that needs
+// them.  the additions are done in the same order as resample_sinc(),
+// so the results are the same.  output slices are split across
+// threads.
+
+namespace {
+
+class sincaxis {
+ public:
+  vector<int> first;   // first source voxel (1-indexed), per output voxel
+  vector<int> count;   // number of weights
+  vector<int> offset;  // offset into weights
+  vector<char> valid;  // is the coordinate inside the volume at all?
+  vector<double> weights;
+  void init(double start, double step, int n, int dim, int nn);
+};
+
+void sincaxis::init(double start, double step, int n, int dim, int nn) {
+  double table[255], *tpend;
+  int d1;
+  first.resize(n);
+  count.resize(n);
+  offset.resize(n);
+  valid.resize(n);
+  weights.clear();
+  for (int i = 0; i < n; i++) {
+    double coord = start + (step * i) + 1;  // +1 because we 1-index
+    valid[i] = (coord >= 1 - TINY && coord <= dim + TINY);
+    first[i] = 1;
+    count[i] = 0;
+    offset[i] = weights.size();
+    // outside the volume, make_lookup() can hand back an empty (even
+    // backwards) range, and the output voxel is zero anyway
+    if (!valid[i]) continue;
+    make_lookup(coord, nn, dim, &d1, table, &tpend);
+    if (tpend < table) continue;
+    first[i] = d1;
+    count[i] = tpend - table + 1;
+    weights.insert(weights.end(), table, table + count[i]);
+  }
+}
+
+// the source slice z (1-indexed) collapsed in x and y, i.e. dat2 in
+// resample_sinc() for every output x,y
+
+template <class T>
+void sinc_collapse(const Cube &src, int z, const sincaxis &ax,
+                   const sincaxis &ay, vector<double> &rows,
+                   vector<double> &out) {
+  int nx = ax.first.size(), ny = ay.first.size();
+  T *slice = (T *)src.data + (size_t)src.dimx * src.dimy * (z - 1);
+  rows.resize((size_t)nx * src.dimy);
+  for (int y = 0; y < src.dimy; y++) {
+    T *row = slice + (size_t)y * src.dimx;
+    for (int i = 0; i < nx; i++) {
+      double dat3 = 0.0;
+      T *dp3 = row + ax.first[i] - 1;
+      const double *tp3 = ax.weights.data() + ax.offset[i];
+      for (int t = 0; t < ax.count[i]; t++) dat3 += dp3[t] * tp3[t];
+      rows[(size_t)y * nx + i] = dat3;
+    }
+  }
+  out.resize((size_t)nx * ny);
+  for (int j = 0; j < ny; j++) {
+    for (int i = 0; i < nx; i++) {
+      double dat2 = 0.0;
+      const double *tp2 = ay.weights.data() + ay.offset[j];
+      for (int t = 0; t < ay.count[j]; t++)
+        dat2 += rows[(size_t)(ay.first[j] - 1 + t) * nx + i] * tp2[t];
+      out[(size_t)j * nx + i] = dat2;
+    }
+  }
+}
 
+template <class T>
+void sinc_slices(const Cube *src, Cube *dst, const sincaxis *ax,
+                 const sincaxis *ay, const sincaxis *az, int k1, int k2) {
+  int nx = ax->first.size(), ny = ay->first.size();
+  map<int, vector<double> > collapsed;
+  vector<double> rows;
+  for (int k = k1; k < k2; k++) {
+    if (!az->valid[k]) {
+      for (int j = 0; j < ny; j++)
+        for (int i = 0; i < nx; i++) dst->SetValue(i, j, k, 0.0);
+      continue;
+    }
+    int zfirst = az->first[k], zlast = zfirst + az->count[k] - 1;
+    // drop the source slices this output slice doesn't need
+    map<int, vector<double> >::iterator cc = collapsed.begin();
+    while (cc != collapsed.end()) {
+      if (cc->first < zfirst || cc->first > zlast)
+        collapsed.erase(cc++);
+      else
+        ++cc;
+    }
+    for (int z = zfirst; z <= zlast; z++)
+      if (!collapsed.count(z))
+        sinc_collapse<T>(*src, z, *ax, *ay, rows, collapsed[z]);
+    const double *tp1 = az->weights.data() + az->offset[k];
+    vector<const double *> zslices;
+    for (int z = zfirst; z <= zlast; z++) zslices.push_back(collapsed[z].data());
+    for (int j = 0; j < ny; j++) {
+      for (int i = 0; i < nx; i++) {
+        if (!ax->valid[i] || !ay->valid[j]) {
+          dst->SetValue(i, j, k, 0.0);
+          continue;
+        }
+        double dat = 0.0;
+        for (int t = 0; t < az->count[k]; t++)
+          dat += zslices[t][(size_t)j * nx + i] * tp1[t];
+        dst->SetValue(i, j, k, dat);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int Resample::SincResampleCube(const Cube &mycube, Cube &newcube) {
   newcube.SetVolume(nx, ny, nz, mycube.datatype);
   newcube.voxsize[0] = fabs(xstep * mycube.voxsize[0]);
   newcube.voxsize[1] = fabs(ystep * mycube.voxsize[1]);
@@ -1205,41 +1378,46 @@ int Resample::SincResampleCube(const Cube &mycube, Cube &newcube) {
   newcube.origin[2] = lround((mycube.origin[2] - z1) / zstep);
   AdjustCornerAndOrigin(newcube);
 
-  VB_Vector c1(1), c2(1), c3(1), out(1);
+  sincaxis ax, ay, az;
+  ax.init(x1, xstep, nx, mycube.dimx, 5);
+  ay.init(y1, ystep, ny, mycube.dimy, 5);
+  az.init(z1, zstep, nz, mycube.dimz, 5);
 
-  for (k = 0; k < nz; k++) {
-    for (i = 0; i < nx; i++) {
-      for (j = 0; j < ny; j++) {
-        c1(0) = x1 + (xstep * i) + 1;  // +1 because the algorithm 1-indexes
-        c2(0) = y1 + (ystep * j) + 1;
-        c3(0) = z1 + (zstep * k) + 1;
-        switch (mycube.datatype) {
-          case vb_byte:
-            resample_sinc(1, (unsigned char *)mycube.data, out, c1, c2, c3,
-                          mycube.dimx, mycube.dimy, mycube.dimz, 5, 0.0, 1.0);
-            break;
-          case vb_short:
-            resample_sinc(1, (int16 *)mycube.data, out, c1, c2, c3, mycube.dimx,
-                          mycube.dimy, mycube.dimz, 5, 0.0, 1.0);
-            break;
-          case vb_long:
-            resample_sinc(1, (int32 *)mycube.data, out, c1, c2, c3, mycube.dimx,
-                          mycube.dimy, mycube.dimz, 5, 0.0, 1.0);
-            break;
-          case vb_float:
-            resample_sinc(1, (float *)mycube.data, out, c1, c2, c3, mycube.dimx,
-                          mycube.dimy, mycube.dimz, 5, 0.0, 1.0);
-            break;
-          case vb_double:
-            resample_sinc(1, (double *)mycube.data, out, c1, c2, c3,
-                          mycube.dimx, mycube.dimy, mycube.dimz, 5, 0.0, 1.0);
-            break;
-        }
-        newcube.SetValue(i, j, k, out(0));
-      }
-    }
+  void (*slicefn)(const Cube *, Cube *, const sincaxis *, const sincaxis *,
+                  const sincaxis *, int, int);
+  switch (mycube.datatype) {
+    case vb_byte:
+      slicefn = sinc_slices<unsigned char>;
+      break;
+    case vb_short:
+      slicefn = sinc_slices<int16>;
+      break;
+    case vb_long:
+      slicefn = sinc_slices<int32>;
+      break;
+    case vb_float:
+      slicefn = sinc_slices<float>;
+      break;
+    case vb_double:
+      slicefn = sinc_slices<double>;
+      break;
+    default:
+      return 101;
   }
 
+  // contiguous runs of slices, so that each thread can reuse its
+  // collapsed source slices
+  int nthreads = min(ncores(), nz);
+  if (nthreads < 2) {
+    slicefn(&mycube, &newcube, &ax, &ay, &az, 0, nz);
+    return 0;
+  }
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(boost::bind(slicefn, &mycube, &newcube, &ax, &ay, &az,
+                                 (nz * t) / nthreads,
+                                 (nz * (t + 1)) / nthreads));
+  tg.join_all();
   return 0;  // no error
 }
 
@@ -1249,7 +1427,7 @@ void resample_sinc(int m, T *vol, VB_Vector &out, const VB_Vector &x,
                    int dimz, int nn, double background, double scale) {
   int i, dim1xdim2 = dimx * dimy;
   int dx1, dy1, dz1;
-  static double tablex[255], tabley[255], tablez[255];
+  double tablex[255], tabley[255], tablez[255];
 
   vol -= (1 + dimx * (1 + dimy));
   for (i = 0; i < m; i++) {
@@ -37,6 +37,60 @@ int maskKernel(Cube &kernel, Cube &mask, int x, int y, int z);
 double getKernelAverage(Cube &cube, Cube &kernel, int x, int y, int z);
 int smooth3D(Cube &cube, Cube &mask, Cube &rawkernel);
 
+// VBSmoothKernel is smoothCube() with the kernels and (for f_correct)
+// the edge normalization worked out once, for smoothing many float
+// volumes of the same size.  the results are the same as smoothCube()
+// on a vb_float cube.
+
+class VBSmoothKernel {
+ public:
+  VBSmoothKernel();
+  void init(int dimx, int dimy, int dimz, double s0, double s1, double s2,
+            bool f_correct = 0);
+  void apply(float *data) const;  // one volume, x fastest
+
+ private:
+  struct axis {
+    int dim, pad;
+    vector<double> kernel;
+    vector<double> mass;  // for each output, 0 for no normalization
+  };
+  void initaxis(axis &ax, int dim, double fwhm, bool f_correct);
+  void pass(float *data, const axis &ax, int stride, int s1, int n1, int s2,
+            int n2) const;
+  int dimx, dimy, dimz;
+  axis ax[3];
+};
+
+// VBNoiseGen makes volumes of gaussian (or uniform) noise, smoothed as
+// smoothCube() would with f_correct if a fwhm is given.  the draws
+// come from a counter-based generator keyed on the seed and the
+// volume number, so a volume can be made on its own, on any thread,
+// and always comes out the same for a given seed.
+
+class VBNoiseGen {
+ public:
+  VBNoiseGen();
+  void init(int dimx, int dimy, int dimz, double fwhm = 0.0);
+  void setGaussian(double mean, double variance);
+  void setUniform(double low, double range);
+  // the unsmoothed draws for volume t
+  void draws(uint32 t, size_t n, double *out) const;
+  // a whole (smoothed) volume
+  void volume(uint32 t, float *out) const;
+  // fill a vb_float tes with noise plus base (if given), in parallel
+  int fill(Tes &ts, const Cube *base = NULL, int nthreads = 0) const;
+  uint64 seed;
+
+ private:
+  void fillworker(Tes &ts, const float *base, uint32 first,
+                  uint32 last) const;
+  int dimx, dimy, dimz;
+  bool f_smooth, f_uniform;
+  double mean, sd, low, range;
+  VBSmoothKernel smoother;
+};
+
 // resample-related
 class Resample {
  private:
@@ -27,6 +27,7 @@
 
 #include "makestatcub.h"
 #include "imageutils.h"
+#include "stats.h"
 
 int makeStatCub(Cube& cube, string& matrixStemName, VBContrast& contrast,
                 VB_Vector& pseudoT, Tes& tes) {
@@ -746,52 +747,62 @@ vector<fdrstat> calc_multi_fdr_thresh(Cube& statcube, Cube& pcube, Cube& mask,
 
 vector<fdrstat> calc_multi_fdr_thresh(Cube& statcube, Cube& pcube, Cube& mask,
                                       vector<double> qs) {
-  vector<VBVoxel> plist;
-  int i, j, k;
-  double pvalue = 0.0;
-  VBVoxel voxel;
-  vector<fdrstat> fdrstats;
-
-  vbforeach(double qval, qs) fdrstats.push_back(fdrstat(qval));
-  for (i = 0; i < pcube.dimx; i++) {
-    for (j = 0; j < pcube.dimy; j++) {
-      for (k = 0; k < pcube.dimz; k++) {
-        if (mask.data && !(mask.GetValue(i, j, k))) continue;
-        pvalue = pcube.GetValue(i, j, k);
-        voxel.val = fabs(pvalue);
-        voxel.x = i;
-        voxel.y = j;
-        voxel.z = k;
-        plist.push_back(voxel);
-      }
-    }
-  }
-  if (plist.size() == 0) return fdrstats;
-  sort(plist.begin(), plist.end(), vcompare);
-  // go through, testing P(i)<=(i/V)(q/cv)
-  // cv=1, so our factor to multiply i by is just q/V
-  vbforeach(fdrstat & ff, fdrstats) {
-    ff.maxind = -1;
-    ff.qv = ff.q / plist.size();
-    ff.low = plist[0].val;
-    ff.high = plist[plist.size() - 1].val;
-    ff.nvoxels = plist.size();
-  }
-  // int maxind=-1;
-  // double qv=q/plist.size();
-  double vv;
-  for (i = 0; i < (int)plist.size(); i++) {
-    vv = plist[i].val;
-    vbforeach(fdrstat & ff, fdrstats) {
-      if (vv <= (double)(i + 1) * ff.qv) ff.maxind = i;
+  vector<Cube*> statcubes(1, &statcube), pcubes(1, &pcube);
+  return calc_multi_fdr_thresh(statcubes, pcubes, mask, qs)[0];
+}
+
+static void fdr_maps(vector<Cube*>* statcubes, vector<Cube*>* pcubes,
+                     Cube* mask, vector<double>* qs,
+                     vector<vector<fdrstat> >* results, int first, int step,
+                     int sortthreads) {
+  vector<float> pvals;
+  vector<uint32> indices;
+  vector<int> ranks;
+  for (size_t m = first; m < pcubes->size(); m += step) {
+    // maps whose dims don't match their stat map or the mask are
+    // rejected (left with no results) rather than indexed blindly
+    if (!(*pcubes)[m]->dimsequal(*(*statcubes)[m])) continue;
+    if (mask->data && !(*pcubes)[m]->dimsequal(*mask)) continue;
+    vector<fdrstat>& fdrstats = (*results)[m];
+    vbforeach(double qval, *qs) fdrstats.push_back(fdrstat(qval));
+    fdr_pvalues(*(*pcubes)[m], *mask, pvals, indices);
+    if (pvals.size() == 0) continue;
+    fdr_sort(pvals, indices, sortthreads);
+    fdr_ranks(pvals, *qs, ranks);
+    for (size_t i = 0; i < fdrstats.size(); i++) {
+      fdrstat& ff = fdrstats[i];
+      ff.maxind = ranks[i];
+      ff.qv = ff.q / pvals.size();
+      ff.low = pvals[0];
+      ff.high = pvals[pvals.size() - 1];
+      ff.nvoxels = pvals.size();
+      if (ff.maxind >= 0)
+        ff.statval =
+            fabs((*statcubes)[m]->getValue<double>(indices[ff.maxind]));
+      else
+        ff.statval = 0;
     }
   }
-  vbforeach(fdrstat & ff, fdrstats) {
-    if (ff.maxind >= 0)
-      ff.statval = fabs(statcube.GetValue(
-          plist[ff.maxind].x, plist[ff.maxind].y, plist[ff.maxind].z));
-    else
-      ff.statval = 0;
-  }
-  return fdrstats;
+}
+
+// the multi-map version does each map in one thread, so a whole group
+// of maps can be done at once.  with just one map, the sort gets the
+// threads instead.
+
+vector<vector<fdrstat> > calc_multi_fdr_thresh(vector<Cube*>& statcubes,
+                                               vector<Cube*>& pcubes,
+                                               Cube& mask, vector<double> qs) {
+  vector<vector<fdrstat> > results(pcubes.size());
+  if (statcubes.size() != pcubes.size()) return results;
+  int nthreads = min(ncores(), (int)pcubes.size());
+  if (nthreads < 2) {
+    fdr_maps(&statcubes, &pcubes, &mask, &qs, &results, 0, 1, 0);
+    return results;
+  }
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(boost::bind(fdr_maps, &statcubes, &pcubes, &mask, &qs,
+                                 &results, t, nthreads, 1));
+  tg.join_all();
+  return results;
 }
@@ -115,3 +115,6 @@ vector<fdrstat> calc_multi_fdr_thresh(Cube& statcube, Cube& pcube, Cube& mask,
                                       double q = 0.0);
 vector<fdrstat> calc_multi_fdr_thresh(Cube& statcube, Cube& pcube, Cube& mask,
                                       vector<double> qs);
+vector<vector<fdrstat> > calc_multi_fdr_thresh(vector<Cube*>& statcubes,
+                                               vector<Cube*>& pcubes,
+                                               Cube& mask, vector<double> qs);
@@ -46,6 +46,7 @@ using namespace std;
 #include <unistd.h>
 #include <string>
 #include "vbio.h"
+#include "vbtrace.h"
 #include "vbutil.h"
 
 #include "vb_vector.h"
@@ -261,7 +262,7 @@ int VBMatrix::set(uint32 r, uint32 c, double val) {
   return 0;
 }
 
-double VBMatrix::operator()(uint32 r, uint32 c) {
+double VBMatrix::operator()(uint32 r, uint32 c) const {
   if (r > m - 1 || c > n - 1) return 0.0;  // shouldn't happen
   return *(rowdata + (n * r) + c);
 }
@@ -308,6 +309,7 @@ VBMatrix &VBMatrix::operator-=(const VBMatrix &mat) {
 }
 
 VBMatrix &VBMatrix::operator*=(VBMatrix &mat) {
+  VBTraceTimer tracer("VBMatrix multiply");
   int r = (this->transposed ? this->cols : this->rows);
   int c = (mat.transposed ? mat.rows : mat.cols);
   VBMatrix ret(r, c);
@@ -322,6 +324,7 @@ VBMatrix &VBMatrix::operator*=(VBMatrix &mat) {
 // premultiply operator
 
 VBMatrix &VBMatrix::operator^=(VBMatrix &mat) {
+  VBTraceTimer tracer("VBMatrix multiply");
   int r = (mat.transposed ? mat.cols : mat.rows);
   int c = (this->transposed ? this->rows : this->cols);
   VBMatrix ret(r, c);
@@ -361,6 +364,7 @@ double VBMatrix::trace() {
 }
 
 int VBMatrix::WriteFile(const string fname) {
+  VBTraceTimer tracer("VBMatrix::WriteFile");
   VBFF original;
   // save the original format, then null it
   original = fileformat;
@@ -390,6 +394,7 @@ int VBMatrix::ReadFile(const string &fname, uint32 r1, uint32 rn, uint32 c1,
 }
 
 int VBMatrix::ReadHeader(const string &fname) {
+  VBTraceTimer tracer("VBMatrix::ReadHeader");
   if (fname.size() == 0) return 104;
   init();
   filename = fname;
@@ -405,6 +410,7 @@ int VBMatrix::ReadHeader(const string &fname) {
 
 int VBMatrix::ReadData(const string &fname, uint32 r1, uint32 rn, uint32 c1,
                        uint32 cn) {
+  VBTraceTimer tracer("VBMatrix::ReadData");
   filename = fname;
   int err = 0;
   if (rows == 0 && cols == 0) {
@@ -418,6 +424,7 @@ int VBMatrix::ReadData(const string &fname, uint32 r1, uint32 rn, uint32 c1,
 // NON-MEMBER FUNCTIONS DEALING WITH MATRICES
 
 int invert(const VBMatrix &src, VBMatrix &dest) {
+  VBTraceTimer tracer("invert");
   if (src.m != src.n) throw "invert: matrix must be square";
   gsl_matrix *tmp1 = gsl_matrix_alloc(src.m, src.n);
   if (!tmp1) throw "invert: couldn't allocate matrix";
@@ -444,6 +451,7 @@ int invert(const VBMatrix &src, VBMatrix &dest) {
 }
 
 int pinv(const VBMatrix &src, VBMatrix &dest) {
+  VBTraceTimer tracer("pinv");
   dest.zero();
   gsl_matrix *tmp1 = gsl_matrix_calloc(src.n, src.n);
   if (!tmp1) throw "invert: couldn't allocate matrix";
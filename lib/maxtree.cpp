@@ -0,0 +1,200 @@
+// maxtree.cpp
+// component tree for fast cluster-size filtering of stat maps
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include "vbio.h"
+
+namespace {
+
+class leveldesc {
+ public:
+  const vector<double> *vals;
+  const vector<uint32> *vox;
+  // decreasing value, ties in voxel order
+  bool operator()(uint32 a, uint32 b) const {
+    if ((*vals)[a] != (*vals)[b]) return (*vals)[a] > (*vals)[b];
+    return (*vox)[a] < (*vox)[b];
+  }
+};
+
+int32 findroot(vector<int32> &zpar, int32 p) {
+  int32 r = p;
+  while (zpar[r] != r) r = zpar[r];
+  while (zpar[p] != r) {
+    int32 next = zpar[p];
+    zpar[p] = r;
+    p = next;
+  }
+  return r;
+}
+
+}  // namespace
+
+VBMaxTree::VBMaxTree() { clear(); }
+
+void VBMaxTree::clear() {
+  sign = 1;
+  key = 0;
+  f_built = 0;
+  dimx = dimy = dimz = 0;
+  vox.clear();
+  level.clear();
+  parent.clear();
+  area.clear();
+  start.clear();
+  order.clear();
+  nodes.clear();
+}
+
+bool VBMaxTree::matches(uint64 k, int sgn) const {
+  return f_built && sgn == sign && k == key;
+}
+
+// build() is the usual union-find construction: voxels are added from
+// the highest value down, and each one becomes the parent of the
+// (roots of the) already-added neighbors it touches.  afterwards each
+// voxel's parent is pointed at the canonical node of its flat zone,
+// which is always the last of the zone to have been added.
+
+int VBMaxTree::build(Cube &cb, int sgn, uint64 k) {
+  clear();
+  if (!cb.data) return 101;
+  sign = sgn;
+  key = k;
+  f_built = 1;
+  dimx = cb.dimx;
+  dimy = cb.dimy;
+  dimz = cb.dimz;
+  uint32 nvox = dimx * dimy * dimz;
+  vector<uint32> allvox;
+  vector<double> vals;
+  for (uint32 i = 0; i < nvox; i++) {
+    double val = cb.getValue<double>(i);
+    if (sign < 0)
+      val = -val;
+    else if (sign == 0)
+      val = fabs(val);
+    if (!(val >= DBL_MIN) || !isfinite(val)) continue;
+    allvox.push_back(i);
+    vals.push_back(val);
+  }
+  uint32 m = allvox.size();
+  vector<uint32> sorted(m);
+  for (uint32 i = 0; i < m; i++) sorted[i] = i;
+  leveldesc ld;
+  ld.vals = &vals;
+  ld.vox = &allvox;
+  sort(sorted.begin(), sorted.end(), ld);
+  vox.resize(m);
+  level.resize(m);
+  vector<int32> pos(nvox, -1);
+  for (uint32 i = 0; i < m; i++) {
+    vox[i] = allvox[sorted[i]];
+    level[i] = vals[sorted[i]];
+    pos[vox[i]] = i;
+  }
+  vector<uint32>().swap(allvox);
+  vector<double>().swap(vals);
+  vector<uint32>().swap(sorted);
+
+  parent.resize(m);
+  vector<int32> zpar(m);
+  int32 dxy = dimx * dimy;
+  for (uint32 i = 0; i < m; i++) {
+    parent[i] = zpar[i] = i;
+    int32 x = vox[i] % dimx, y = (vox[i] / dimx) % dimy, z = vox[i] / dxy;
+    for (int32 k = max(z - 1, 0); k <= min(z + 1, dimz - 1); k++) {
+      for (int32 j = max(y - 1, 0); j <= min(y + 1, dimy - 1); j++) {
+        for (int32 h = max(x - 1, 0); h <= min(x + 1, dimx - 1); h++) {
+          int32 q = pos[h + j * dimx + k * dxy];
+          if (q < 0 || q >= (int32)i) continue;  // not added yet
+          int32 r = findroot(zpar, q);
+          if (r == (int32)i) continue;
+          parent[r] = i;
+          zpar[r] = i;
+        }
+      }
+    }
+  }
+  // parents always come later, so going backwards canonicalizes the
+  // parent before its children look at it
+  for (int32 i = m - 1; i >= 0; i--) {
+    int32 q = parent[i];
+    if (level[parent[q]] == level[q]) parent[i] = parent[q];
+  }
+  area.assign(m, 1);
+  for (uint32 i = 0; i < m; i++)
+    if (parent[i] != (int32)i) area[parent[i]] += area[i];
+
+  // lay the voxels out so that each subtree is a contiguous run of
+  // order, parents first.  zpar is reused as each node's cursor.
+  start.resize(m);
+  order.resize(m);
+  uint32 rootcursor = 0;
+  for (int32 i = m - 1; i >= 0; i--) {
+    int32 q = parent[i];
+    if (q == i) {
+      start[i] = rootcursor;
+      rootcursor += area[i];
+    } else {
+      start[i] = zpar[q];
+      zpar[q] += area[i];
+    }
+    order[start[i]] = vox[i];
+    zpar[i] = start[i] + 1;
+  }
+  for (uint32 i = 0; i < m; i++)
+    if (parent[i] == (int32)i || level[parent[i]] != level[i])
+      nodes.push_back(i);
+  return 0;
+}
+
+// mark() sets to 1 every voxel of out that's in a cluster of at least
+// minsize voxels above thresh.  the work is proportional to the
+// number of voxels above thresh, not the size of the volume.
+
+int VBMaxTree::mark(double thresh, uint32 minsize, Cube &out) const {
+  if (thresh < 0.0) return 101;
+  if (out.dimx != dimx || out.dimy != dimy || out.dimz != dimz) return 102;
+  for (uint32 i = 0; i < nodes.size(); i++) {
+    uint32 n = nodes[i];
+    if (!above(n, thresh)) break;
+    if (!clustertop(n, thresh) || area[n] < minsize) continue;
+    for (uint32 k = start[n]; k < start[n] + area[n]; k++)
+      out.setValue<int32>(order[k], 1);
+  }
+  return 0;
+}
+
+uint32 VBMaxTree::countclusters(double thresh, uint32 minsize) const {
+  uint32 cnt = 0;
+  for (uint32 i = 0; i < nodes.size(); i++) {
+    uint32 n = nodes[i];
+    if (!above(n, thresh)) break;
+    if (clustertop(n, thresh) && area[n] >= minsize) cnt++;
+  }
+  return cnt;
+}
@@ -37,6 +37,7 @@ using namespace std;
 #include <zlib.h>
 #include <sstream>
 #include "vbio.h"
+#include "vbtrace.h"
 #include "vbutil.h"
 
 #define NIFTI_MIN_OFFSET_BOGUS 348
@@ -62,8 +63,8 @@ int nifti_read_header(string fname, NIFTI_header *xhdr, VBImage *vol) {
   VB_byteorder bo = my_endian();
   gzFile fp;
   bool f_swap = 0;
-  if (!(fp = gzopen(fname.c_str(), "r"))) return (100);
-  int cnt = gzread(fp, hdr, sizeof(NIFTI_header));
+  if (!(fp = vbt_gzopen(fname.c_str(), "r"))) return (100);
+  int cnt = vbt_gzread(fp, hdr, sizeof(NIFTI_header));
   if (cnt != sizeof(NIFTI_header)) {
     gzclose(fp);
     return (101);
@@ -93,20 +94,20 @@ int nifti_read_header(string fname, NIFTI_header *xhdr, VBImage *vol) {
   } n11ext;
   if (vol && gztell(fp) == 348 && hdr->vox_offset >= 352) {
     uint8 exts[4];
-    cnt = gzread(fp, exts, 4);
+    cnt = vbt_gzread(fp, exts, 4);
     if (cnt == 4 && exts[0] != 0) {
-      while (gzread(fp, &n11ext, 8) == 8) {
+      while (vbt_gzread(fp, &n11ext, 8) == 8) {
         // swap if needed
         if (f_swap) swap(&n11ext.esize), swap(&n11ext.ecode);
         // is it voxbo ecode?
         if (n11ext.esize == 0 && n11ext.ecode == 0) break;  // test for sentinel
         if (n11ext.ecode != NIFTI_ECODE_VOXBO) {
-          gzseek(fp, n11ext.esize, SEEK_CUR);
+          vbt_gzseek(fp, n11ext.esize, SEEK_CUR);
           continue;
         }
         // copy to voxbo header
         char buf[n11ext.esize + 1];
-        if (gzread(fp, buf, n11ext.esize) != (int)n11ext.esize) {
+        if (vbt_gzread(fp, buf, n11ext.esize) != (int)n11ext.esize) {
           gzclose(fp);
           return 104;
         }
@@ -440,11 +441,11 @@ int nifti_write_3D(string fname, Cube &im) {
   size_t sz = im.dimx * im.dimy * im.dimz * im.datasize;
   zfp.seek(offset, SEEK_SET);
   cnt = zfp.write(im.data, sz);
-  zfp.close();
   if (cnt != sz) {
     zfp.close_and_unlink();
     return 103;
   }
+  bool f_closed = zfp.close();
   // re-swap/scale, we may still need the data!
   if (im.f_scaled) {
     if (im.altdatatype == vb_byte || im.altdatatype == vb_short ||
@@ -454,26 +455,22 @@ int nifti_write_3D(string fname, Cube &im) {
     im += im.scl_inter;
   }
   if (im.filebyteorder != my_endian()) im.byteswap();
+  if (!f_closed) {
+    unlink(tmpfname.c_str());
+    return 103;
+  }
   if (rename(tmpfname.c_str(), fname.c_str())) return (103);
   return 0;
 }
 
-int nifti_write_4D(string fname, Tes &im) {
-  // tmpfname must preserve extension
-  string tmpfname = (format("%s/tmp_%d_%d_%s") % xdirname(fname) % getpid() %
-                     time(NULL) % xfilename(fname))
-                        .str();
+// nifti_write_4D_header() writes the header (and sentinel) for a 4D
+// file and leaves zfp at the start of the data.  it doesn't touch the
+// data, so it works for a tes that only has a header.
+
+int nifti_write_4D_header(zfile &zfp, Tes &im) {
   NIFTI_header hdr;
   size_t offset = NIFTI_MIN_OFFSET;
   bool f_ext = 0;
-  // un-scale if needed
-  if (im.f_scaled) {
-    im -= im.scl_inter;
-    im /= im.scl_slope;
-    if (im.altdatatype == vb_byte || im.altdatatype == vb_short ||
-        im.altdatatype == vb_long)
-      im.convert_type(im.altdatatype);
-  }
   // copy stuff that's the same for 3D and 4D
   voxbo2nifti_header(im, hdr);
   // now set some 4D-specific stuff
@@ -495,43 +492,55 @@ int nifti_write_4D(string fname, Tes &im) {
   }
   hdr.vox_offset = offset;
   // swap if needed
-  if (im.filebyteorder != my_endian()) {
-    nifti_swap_header(hdr);
-    im.byteswap();
-  }
-  // open file, write out the header
-  zfile zfp;  // zfp takes care of compression
-  zfp.open(tmpfname, "w");
-  if (!zfp) return 101;
+  if (im.filebyteorder != my_endian()) nifti_swap_header(hdr);
   size_t cnt;
   cnt = zfp.write(&hdr, sizeof(NIFTI_header));
-  if (cnt != sizeof(NIFTI_header)) {
-    zfp.close_and_unlink();
-    return 102;
-  }
+  if (cnt != sizeof(NIFTI_header)) return 102;
   // write voxbo nifti extension
   if (f_ext && im.header.size()) {
     zfp.write("X\0\0\0", 4);
     uint32 ecode = NIFTI_ECODE_VOXBO;
     uint32 esize;
-    string buf;
-    for (size_t i = 0; i < im.header.size(); i++) buf += im.header[i] + '\n';
     esize = buf.size();
     if (im.filebyteorder != my_endian()) swap(&ecode), swap(&esize);
     cnt = zfp.write(&esize, 4);
     cnt += zfp.write(&ecode, 4);
     cnt += zfp.write(buf.c_str(), buf.size());
-    if (cnt != buf.size() + 8) {
-      zfp.close_and_unlink();
-      return 102;
-    }
+    if (cnt != buf.size() + 8) return 102;
     // write the sentinel
     zfp.write("\0\0\0\0", 4);
   } else
     zfp.write("\0\0\0\0", 4);
+  zfp.seek(offset, SEEK_SET);
+  return 0;
+}
+
+int nifti_write_4D(string fname, Tes &im) {
+  // tmpfname must preserve extension
+  string tmpfname = (format("%s/tmp_%d_%d_%s") % xdirname(fname) % getpid() %
+                     time(NULL) % xfilename(fname))
+                        .str();
+  // un-scale if needed
+  if (im.f_scaled) {
+    im -= im.scl_inter;
+    im /= im.scl_slope;
+    if (im.altdatatype == vb_byte || im.altdatatype == vb_short ||
+        im.altdatatype == vb_long)
+      im.convert_type(im.altdatatype);
+  }
+  // swap if needed
+  if (im.filebyteorder != my_endian()) im.byteswap();
+  // open file, write out the header
+  zfile zfp;  // zfp takes care of compression
+  zfp.open(tmpfname, "w");
+  if (!zfp) return 101;
+  if (nifti_write_4D_header(zfp, im)) {
+    zfp.close_and_unlink();
+    return 102;
+  }
   // write out the data
+  size_t cnt;
   size_t sz = im.dimx * im.dimy * im.dimz * im.datasize;
-  zfp.seek(offset, SEEK_SET);
   for (int i = 0; i < im.dimt; i++) {
     Cube cb = im[i];
     cnt = zfp.write(cb.data, sz);
@@ -540,7 +549,7 @@ int nifti_write_4D(string fname, Tes &im) {
       return 103;
     }
   }
-  zfp.close();
+  bool f_closed = zfp.close();
   // re-scale/swap back, we may still need the data!
   if (im.f_scaled) {
     if (im.altdatatype == vb_byte || im.altdatatype == vb_short ||
@@ -550,6 +559,10 @@ int nifti_write_4D(string fname, Tes &im) {
     im += im.scl_inter;
   }
   if (im.filebyteorder != my_endian()) im.byteswap();
+  if (!f_closed) {
+    unlink(tmpfname.c_str());
+    return 103;
+  }
   if (rename(tmpfname.c_str(), fname.c_str())) return (103);
   return 0;
 }
@@ -566,14 +579,14 @@ int nifti_read_3D_data(Cube &im) {
     return 105;
   }
   if (!im.data) return 101;
-  gzFile fp = gzopen(fname.c_str(), "r");
+  gzFile fp = vbt_gzopen(fname.c_str(), "r");
   if (!fp) {
     delete[] im.data;
     im.data = (unsigned char *)NULL;
     im.data_valid = 0;
     return (119);
   }
-  if (gzseek(fp, im.offset, SEEK_SET) == -1) {
+  if (vbt_gzseek(fp, im.offset, SEEK_SET) == -1) {
     gzclose(fp);
     delete[] im.data;
     im.data = (unsigned char *)NULL;
@@ -581,7 +594,7 @@ int nifti_read_3D_data(Cube &im) {
     return (120);
   }
   size_t bytelen = im.dimx * im.dimy * im.dimz;
-  size_t cnt = gzread(fp, im.data, im.datasize * bytelen);
+  size_t cnt = vbt_gzread(fp, im.data, im.datasize * bytelen);
   gzclose(fp);
   if (cnt != bytelen * im.datasize) {
     delete[] im.data;
@@ -610,12 +623,12 @@ int nifti_read_4D_data(Tes &im, int start, int count) {
     return 105;
   }
   if (!im.data) return 101;
-  gzFile fp = gzopen(fname.c_str(), "r");
+  gzFile fp = vbt_gzopen(fname.c_str(), "r");
   if (!fp) {
     im.invalidate();
     return (119);
   }
-  if (gzseek(fp, im.offset, SEEK_SET) == -1) {
+  if (vbt_gzseek(fp, im.offset, SEEK_SET) == -1) {
     gzclose(fp);
     im.invalidate();
     return (120);
@@ -633,13 +646,13 @@ int nifti_read_4D_data(Tes &im, int start, int count) {
   size_t bytelen = im.dimx * im.dimy * im.dimz;
   Cube cb(im.dimx, im.dimy, im.dimz, im.datatype);
   // skip the omitted volumes
-  if (gzseek(fp, cb.datasize * bytelen * start, SEEK_CUR) == -1) {
+  if (vbt_gzseek(fp, cb.datasize * bytelen * start, SEEK_CUR) == -1) {
     gzclose(fp);
     im.invalidate();
     return 121;
   }
   for (int i = 0; i < im.dimt; i++) {
-    size_t cnt = gzread(fp, cb.data, cb.datasize * bytelen);
+    size_t cnt = vbt_gzread(fp, cb.data, cb.datasize * bytelen);
     if (cnt != bytelen * cb.datasize) {
       gzclose(fp);
       im.invalidate();
@@ -670,9 +683,9 @@ int nifti_read_ts(Tes &im, int x, int y, int z) {
       z > im.dimz - 1)
     return 101;
   // cb.SetVolume(im.dimx,im.dimy,im.dimz,im.datatype);
-  gzFile fp = gzopen(fname.c_str(), "r");
+  gzFile fp = vbt_gzopen(fname.c_str(), "r");
   if (!fp) return (119);
-  if (gzseek(fp, im.offset, SEEK_SET) == -1) {
+  if (vbt_gzseek(fp, im.offset, SEEK_SET) == -1) {
     gzclose(fp);
     return (120);
   }
@@ -681,7 +694,7 @@ int nifti_read_ts(Tes &im, int x, int y, int z) {
   int bytelen = im.dimx * im.dimy * im.dimz;
 
   // skip to the voxel of interest in the first volume
-  if (gzseek(fp, im.voxelposition(x, y, z) * im.datasize, SEEK_CUR) == -1) {
+  if (vbt_gzseek(fp, im.voxelposition(x, y, z) * im.datasize, SEEK_CUR) == -1) {
     gzclose(fp);
     im.invalidate();
     return 121;
@@ -689,14 +702,14 @@ int nifti_read_ts(Tes &im, int x, int y, int z) {
   unsigned char tmpdata[im.datasize * im.dimt];
   int index = 0;
   for (int i = 0; i < im.dimt; i++) {
-    size_t cnt = gzread(fp, tmpdata + index, im.datasize);
+    size_t cnt = vbt_gzread(fp, tmpdata + index, im.datasize);
     if (cnt != (size_t)im.datasize) {
       gzclose(fp);
       im.invalidate();
       return 110;
     }
     index += im.datasize;
-    gzseek(fp, (bytelen - 1) * im.datasize, SEEK_CUR);
+    vbt_gzseek(fp, (bytelen - 1) * im.datasize, SEEK_CUR);
   }
   gzclose(fp);
   if (my_endian() != im.filebyteorder) swapn(tmpdata, im.datasize, im.dimt);
@@ -718,12 +731,12 @@ int nifti_read_vol(Tes &im, Cube &cb, int t) {
   if (xgetextension(fname) == "hdr") fname = xsetextension(fname, "img");
   if (t < 0 || t > im.dimt - 1) return 101;
   cb.SetVolume(im.dimx, im.dimy, im.dimz, im.datatype);
-  gzFile fp = gzopen(fname.c_str(), "r");
+  gzFile fp = vbt_gzopen(fname.c_str(), "r");
   if (!fp) {
     cb.invalidate();
     return (119);
   }
-  if (gzseek(fp, im.offset, SEEK_SET) == -1) {
+  if (vbt_gzseek(fp, im.offset, SEEK_SET) == -1) {
     gzclose(fp);
     cb.invalidate();
     return (120);
@@ -732,12 +745,12 @@ int nifti_read_vol(Tes &im, Cube &cb, int t) {
   // skip t volumes
   int bytelen = im.dimx * im.dimy * im.dimz;
   // skip the omitted volumes
-  if (gzseek(fp, cb.datasize * bytelen * t, SEEK_CUR) == -1) {
+  if (vbt_gzseek(fp, cb.datasize * bytelen * t, SEEK_CUR) == -1) {
     gzclose(fp);
     im.invalidate();
     return 121;
   }
-  int cnt = gzread(fp, cb.data, cb.datasize * bytelen);
+  int cnt = vbt_gzread(fp, cb.data, cb.datasize * bytelen);
   if (cnt != bytelen * cb.datasize) {
     gzclose(fp);
     im.invalidate();
@@ -49,6 +49,7 @@ int nifti_read_header(string fname, NIFTI_header *xhdr, VBImage *vol);
 void nifti_from_VB_datatype(NIFTI_header &hdr, const VB_datatype datatype);
 int nifti_write_3D(string fname, Cube &cb);
 int nifti_write_4D(string fname, Tes &im);
+int nifti_write_4D_header(zfile &zfp, Tes &im);
 int nifti_read_3D_data(Cube &cb);
 int nifti_read_4D_data(Tes &ts, int start = -1, int count = -1);
 void nifti_swap_header(NIFTI_header &hdr);
@@ -0,0 +1,150 @@
+// noisegen.cpp
+// reproducible, parallel volumes of smoothed noise
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "imageutils.h"
+#include "vbutil.h"
+
+namespace {
+
+// splitmix64's output function.  fed a key plus a multiple of the
+// golden ratio for each counter value, it makes a perfectly good
+// counter-based generator for our purposes.
+inline uint64 mix64(uint64 z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// uniform on (0,1), never exactly 0 so we can take its log
+inline double uniform(uint64 key, uint64 ctr) {
+  uint64 bits = mix64(key + ctr * 0x9e3779b97f4a7c15ULL);
+  return ((bits >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+}  // namespace
+
+VBNoiseGen::VBNoiseGen() {
+  seed = 0;
+  dimx = dimy = dimz = 0;
+  f_smooth = f_uniform = 0;
+  mean = low = 0.0;
+  sd = range = 1.0;
+}
+
+void VBNoiseGen::init(int xx, int yy, int zz, double fwhm) {
+  dimx = xx;
+  dimy = yy;
+  dimz = zz;
+  f_smooth = (fwhm != 0.0);
+  if (f_smooth) smoother.init(dimx, dimy, dimz, fwhm, fwhm, fwhm, 1);
+}
+
+void VBNoiseGen::setGaussian(double mu, double variance) {
+  f_uniform = 0;
+  mean = mu;
+  sd = sqrt(abs(variance));
+}
+
+void VBNoiseGen::setUniform(double lo, double rng) {
+  f_uniform = 1;
+  low = lo;
+  range = rng;
+}
+
+// each volume gets its own key, and draw i uses counter i (uniform) or
+// the pair of counters for i/2 (box-muller gaussian)
+
+void VBNoiseGen::draws(uint32 t, size_t n, double *out) const {
+  uint64 key = mix64(mix64(seed) + t);
+  if (f_uniform) {
+    for (size_t i = 0; i < n; i++) out[i] = low + range * uniform(key, i);
+    return;
+  }
+  for (size_t i = 0; i < n; i += 2) {
+    double r = sd * sqrt(-2.0 * log(uniform(key, i)));
+    double theta = 2.0 * M_PI * uniform(key, i + 1);
+    out[i] = mean + r * cos(theta);
+    if (i + 1 < n) out[i + 1] = mean + r * sin(theta);
+  }
+}
+
+void VBNoiseGen::volume(uint32 t, float *out) const {
+  size_t n = (size_t)dimx * dimy * dimz;
+  vector<double> vals(n);
+  draws(t, n, &vals[0]);
+  for (size_t i = 0; i < n; i++) out[i] = vals[i];
+  if (f_smooth) smoother.apply(out);
+}
+
+// each thread takes a contiguous run of volumes, so that threads only
+// share the cache lines where their runs meet
+
+int VBNoiseGen::fill(Tes &ts, const Cube *base, int nthreads) const {
+  if (!ts.data || ts.datatype != vb_float) return 101;
+  if (ts.dimx != dimx || ts.dimy != dimy || ts.dimz != dimz) return 102;
+  Cube fbase;
+  if (base) {
+    if (base->dimx != dimx || base->dimy != dimy || base->dimz != dimz)
+      return 103;
+    fbase = *base;
+    if (fbase.datatype != vb_float) fbase.convert_type(vb_float);
+  }
+  uint32 nvox = dimx * dimy * dimz;
+  for (uint32 v = 0; v < nvox; v++) ts.buildvoxel(v);
+  const float *bp = (base ? (float *)fbase.data : NULL);
+  if (nthreads < 1) nthreads = ncores();
+  if (nthreads > ts.dimt) nthreads = ts.dimt;
+  if (nthreads < 2) {
+    fillworker(ts, bp, 0, ts.dimt);
+    return 0;
+  }
+  uint32 per = (ts.dimt + nthreads - 1) / nthreads;
+  boost::thread_group tg;
+  for (int i = 0; i < nthreads; i++) {
+    uint32 first = i * per;
+    uint32 last = min(first + per, (uint32)ts.dimt);
+    if (first >= last) break;
+    tg.create_thread(boost::bind(&VBNoiseGen::fillworker, this,
+                                 boost::ref(ts), bp, first, last));
+  }
+  tg.join_all();
+  return 0;
+}
+
+void VBNoiseGen::fillworker(Tes &ts, const float *base, uint32 first,
+                            uint32 last) const {
+  uint32 nvox = dimx * dimy * dimz;
+  vector<float> vol(nvox);
+  for (uint32 t = first; t < last; t++) {
+    volume(t, &vol[0]);
+    if (base)
+      for (uint32 v = 0; v < nvox; v++) vol[v] = vol[v] + base[v];
+    for (uint32 v = 0; v < nvox; v++) ((float *)ts.data[v])[t] = vol[v];
+  }
+}
@@ -0,0 +1,304 @@
+// qastats.cpp
+// global signal, power spectrum, and snr for a run in one pass
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <fstream>
+#include "vbio.h"
+
+namespace {
+
+// how many series each thread hands to the fft at once
+const size_t FFTBATCH = 64;
+
+template <class T>
+void copyseries(const unsigned char *src, int n, double *dest) {
+  const T *vals = (const T *)src;
+  for (int i = 0; i < n; i++) dest[i] = vals[i];
+}
+
+void getseries(const unsigned char *src, VB_datatype dt, int n,
+               double *dest) {
+  switch (dt) {
+    case vb_byte:
+      copyseries<unsigned char>(src, n, dest);
+      break;
+    case vb_short:
+      copyseries<int16>(src, n, dest);
+      break;
+    case vb_long:
+      copyseries<int32>(src, n, dest);
+      break;
+    case vb_float:
+      copyseries<float>(src, n, dest);
+      break;
+    case vb_double:
+      copyseries<double>(src, n, dest);
+      break;
+  }
+}
+
+// add the power spectra of count de-meaned series to ps.  fftBatch()
+// gives us the halfcomplex layout, scaled by 1/n as fft() is, and the
+// spectrum is symmetric, so each pair of terms counts twice.
+void addpower(const vector<double> &hc, size_t n, size_t count,
+              vector<double> &ps) {
+  size_t half = n / 2;
+  bool even = (half * 2 == n);
+  for (size_t c = 0; c < count; c++) {
+    const double *h = &hc[c * n];
+    ps[0] += h[0] * h[0];
+    for (size_t k = 1; k <= half; k++) {
+      if (k == half && even) {
+        ps[k] += h[n - 1] * h[n - 1];
+        continue;
+      }
+      double p = h[2 * k - 1] * h[2 * k - 1] + h[2 * k] * h[2 * k];
+      ps[k] += p;
+      ps[n - k] += p;
+    }
+  }
+}
+
+}  // namespace
+
+VBQAStats::VBQAStats() {
+  bufsize = (size_t)256 * 1024 * 1024;
+  spikesd = 3.5;
+  lowthresh = 0.001;
+  clear();
+}
+
+void VBQAStats::clear() {
+  filename = "";
+  nvoxels = 0;
+  gs.clear();
+  ps.clear();
+  snr.invalidate();
+  gsmean = gssd = meansnr = 0.0;
+  spikes.clear();
+  lowvals.clear();
+  parts.clear();
+}
+
+// the file version never has more than about bufsize bytes of the
+// run in memory.  scaled data come through raw, so we scale them
+// ourselves.
+
+int VBQAStats::run(const string &fname, int nthreads) {
+  clear();
+  filename = fname;
+  VBTesStream st;
+  st.bufsize = bufsize;
+  if (st.addInput(fname)) return 101;
+  st.addVolumes(0);
+  if (st.startRead()) return 102;
+  Tes &hdr = st.output();
+  int err = start(hdr, nthreads);
+  if (err) return err;
+  f_scaled = hdr.f_scaled;
+  slope = hdr.scl_slope;
+  inter = hdr.scl_inter;
+  uint32 nvox = hdr.dimx * hdr.dimy * hdr.dimz;
+  int ds = hdr.datasize;
+  size_t slab = bufsize / ((size_t)ds * dimt);
+  if (slab < 1) slab = 1;
+  if (slab > nvox) slab = nvox;
+  vector<unsigned char> buf(slab * dimt * ds);
+  vector<const unsigned char *> series;
+  for (uint32 v0 = 0; v0 < nvox; v0 += slab) {
+    uint32 v1 = min((size_t)v0 + slab, (size_t)nvox);
+    series.assign(v1 - v0, NULL);
+    bool f_any = 0;
+    for (uint32 v = v0; v < v1; v++) {
+      if (!st.hasData(v)) continue;
+      series[v - v0] = &buf[(size_t)(v - v0) * dimt * ds];
+      f_any = 1;
+    }
+    if (!f_any) continue;
+    if (st.readSeries(v0, v1, &buf[0])) return 104;
+    runslab(series, v0);
+  }
+  return finish();
+}
+
+// a run that's already loaded is just one big slab
+
+int VBQAStats::run(Tes &ts, int nthreads) {
+  clear();
+  filename = ts.filename;
+  if (!ts.data) return 101;
+  int err = start(ts, nthreads);
+  if (err) return err;
+  // data in memory have already been scaled
+  f_scaled = 0;
+  uint32 nvox = ts.dimx * ts.dimy * ts.dimz;
+  vector<const unsigned char *> series(nvox);
+  for (uint32 v = 0; v < nvox; v++) series[v] = ts.data[v];
+  runslab(series, 0);
+  return finish();
+}
+
+int VBQAStats::start(Tes &hdr, int nthreads) {
+  // need at least 2 points for a variance
+  if (hdr.dimt < 2) return 103;
+  datatype = hdr.datatype;
+  dimt = hdr.dimt;
+  snr.SetVolume(hdr.dimx, hdr.dimy, hdr.dimz, vb_double);
+  if (!snr.data) return 103;
+  for (int i = 0; i < 3; i++) {
+    snr.voxsize[i] = hdr.voxsize[i];
+    snr.origin[i] = hdr.origin[i];
+  }
+  if (nthreads < 1) nthreads = ncores();
+  if (nthreads < 1) nthreads = 1;
+  parts.resize(nthreads);
+  for (int t = 0; t < nthreads; t++) {
+    parts[t].gs.assign(dimt, 0.0);
+    parts[t].ps.assign(dimt, 0.0);
+    parts[t].snrsum = 0.0;
+    parts[t].count = 0;
+  }
+  return 0;
+}
+
+void VBQAStats::runslab(const vector<const unsigned char *> &series,
+                        uint32 v0) {
+  int nthreads = parts.size();
+  if (nthreads > (int)series.size()) nthreads = series.size();
+  if (nthreads < 2) {
+    slabworker(series, v0, 0);
+    return;
+  }
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(boost::bind(&VBQAStats::slabworker, this,
+                                 boost::cref(series), v0, t));
+  tg.join_all();
+}
+
+// each thread takes a contiguous run of the slab's voxels, so that no
+// two threads write the same part of the snr cube.  the de-meaned
+// series are collected up and handed to the fft FFTBATCH at a time.
+
+void VBQAStats::slabworker(const vector<const unsigned char *> &series,
+                           uint32 v0, int thread) {
+  int nthreads = min(parts.size(), series.size());
+  size_t per = (series.size() + nthreads - 1) / nthreads;
+  size_t first = thread * per;
+  size_t last = min(first + per, series.size());
+  accum &acc = parts[thread];
+  size_t n = dimt;
+  vector<double> batch(FFTBATCH * n), hc(FFTBATCH * n);
+  size_t nbatch = 0;
+  for (size_t i = first; i < last; i++) {
+    if (!series[i]) continue;
+    double *x = &batch[nbatch * n];
+    getseries(series[i], datatype, n, x);
+    if (f_scaled)
+      for (size_t j = 0; j < n; j++) x[j] = x[j] * slope + inter;
+    double mean = 0.0;
+    for (size_t j = 0; j < n; j++) mean += x[j];
+    mean /= n;
+    double var = 0.0;
+    for (size_t j = 0; j < n; j++) {
+      x[j] -= mean;
+      var += x[j] * x[j];
+      acc.gs[j] += x[j];
+    }
+    var /= n - 1;
+    // SNRMap() has always divided by the square of the variance
+    double val = 0.0;
+    if (var * var >= .000000001) val = mean / (var * var);
+    snr.setValue<double>(v0 + i, val);
+    acc.snrsum += val;
+    acc.count++;
+    if (++nbatch == FFTBATCH) {
+      VB_Vector::fftBatch(&batch[0], n, nbatch, &hc[0], NULL,
+                          vb_fft_halfcomplex);
+      addpower(hc, n, nbatch, acc.ps);
+      nbatch = 0;
+    }
+  }
+  if (nbatch) {
+    VB_Vector::fftBatch(&batch[0], n, nbatch, &hc[0], NULL,
+                        vb_fft_halfcomplex);
+    addpower(hc, n, nbatch, acc.ps);
+  }
+}
+
+// finish() adds up the threads' sums and does vbqa's checks on the
+// global signal
+
+int VBQAStats::finish() {
+  gs.resize(dimt);
+  ps.resize(dimt);
+  gs.zero();
+  ps.zero();
+  double snrsum = 0.0;
+  for (size_t t = 0; t < parts.size(); t++) {
+    for (int j = 0; j < dimt; j++) {
+      gs[j] += parts[t].gs[j];
+      ps[j] += parts[t].ps[j];
+    }
+    snrsum += parts[t].snrsum;
+    nvoxels += parts[t].count;
+  }
+  parts.clear();
+  if (nvoxels == 0) return 105;
+  gs /= nvoxels;
+  ps /= nvoxels;
+  meansnr = snrsum / nvoxels;
+  gsmean = gs.getVectorMean();
+  gssd = sqrt(gs.getVariance());
+  for (int j = 0; j < dimt; j++) {
+    if (fabs(gs[j] - gsmean) > spikesd * gssd) spikes.push_back(j);
+    if (fabs(gs[j]) < lowthresh) lowvals.push_back(j);
+  }
+  return 0;
+}
+
+int VBQAStats::writeSummary(const string &fname) {
+  if (nvoxels == 0) return 101;
+  ofstream ofile(fname.c_str());
+  if (!ofile) return 102;
+  ofile << ";VB98\n;TXT1\n;\n; qa summary for " << filename << "\n;   on "
+        << timedate() << "\n;\n\n";
+  ofile << "voxels: " << nvoxels << endl;
+  ofile << "timepoints: " << gs.size() << endl;
+  ofile << "gs_mean: " << gsmean << endl;
+  ofile << "gs_sd: " << gssd << endl;
+  ofile << "mean_snr: " << meansnr << endl;
+  ofile << "spikes(" << spikesd << "sd):";
+  vbforeach(int j, spikes) ofile << " " << j;
+  ofile << endl;
+  ofile << "lowvals(" << lowthresh << "):";
+  vbforeach(int j, lowvals) ofile << " " << j;
+  ofile << endl;
+  if (!ofile.good()) return 102;
+  return 0;
+}
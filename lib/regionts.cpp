@@ -0,0 +1,251 @@
+// regionts.cpp
+// time series extraction for many regions at once
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "vbio.h"
+
+namespace {
+
+template <class T>
+void copyseries(const unsigned char *src, int n, double *dest) {
+  const T *vals = (const T *)src;
+  for (int i = 0; i < n; i++) dest[i] = vals[i];
+}
+
+// getseries() copies one voxel's time series straight out of the
+// tes, without going through the tes's own timeseries member, so that
+// it can be called from several threads at once
+void getseries(const Tes &ts, int index, VB_Vector &out) {
+  double *dest = out.begin();
+  const unsigned char *src = ts.data[index];
+  if (!src) {
+    out.zero();
+    return;
+  }
+  switch (ts.datatype) {
+    case vb_byte:
+      copyseries<unsigned char>(src, ts.dimt, dest);
+      break;
+    case vb_short:
+      copyseries<int16>(src, ts.dimt, dest);
+      break;
+    case vb_long:
+      copyseries<int32>(src, ts.dimt, dest);
+      break;
+    case vb_float:
+      copyseries<float>(src, ts.dimt, dest);
+      break;
+    case vb_double:
+      copyseries<double>(src, ts.dimt, dest);
+      break;
+  }
+}
+
+// past this many voxels in all, it's cheaper to read whole runs than to
+// seek to each voxel (the same cutoff getRegionTS() always used)
+const size_t maxseekvoxels = 10;
+
+}  // namespace
+
+int VBRegionTS::addRegion(VBRegion &rr) {
+  if (rr.size() == 0) return 101;
+  vector<VBVoxel> vlist;
+  for (VI myvox = rr.begin(); myvox != rr.end(); myvox++)
+    vlist.push_back(myvox->second);
+  regions.push_back(vlist);
+  return 0;
+}
+
+int VBRegionTS::addRegions(vector<VBRegion> &rlist) {
+  vbforeach(VBRegion & rr, rlist) if (addRegion(rr)) return 101;
+  return 0;
+}
+
+int VBRegionTS::extractMeans(vector<string> &teslist, uint32 flags,
+                             VBMatrix &means, int nthreads) {
+  return run(&teslist, NULL, flags, &means, NULL, nthreads);
+}
+
+int VBRegionTS::extractMeans(Tes &ts, uint32 flags, VBMatrix &means,
+                             int nthreads) {
+  return run(NULL, &ts, flags, &means, NULL, nthreads);
+}
+
+int VBRegionTS::extractSeries(vector<string> &teslist, uint32 flags,
+                              vector<VBMatrix> &series, int nthreads) {
+  return run(&teslist, NULL, flags, NULL, &series, nthreads);
+}
+
+int VBRegionTS::extractSeries(Tes &ts, uint32 flags, vector<VBMatrix> &series,
+                              int nthreads) {
+  return run(NULL, &ts, flags, NULL, &series, nthreads);
+}
+
+// every voxel of every region has to be inside the run, and for files
+// on disk in its mask, as getRegionTS() has always required.  voxels
+// outside the mask of a tes that's already loaded just count as zeros.
+
+int VBRegionTS::checkrun(Tes &ts, bool f_mask) {
+  if (!ts.data || ts.dimt < 1) return 103;
+  for (size_t r = 0; r < regions.size(); r++) {
+    vbforeach(VBVoxel & v, regions[r]) {
+      if (!ts.inbounds(v.x, v.y, v.z)) return 104;
+      if (f_mask && !ts.GetMaskValue(v.x, v.y, v.z)) return 105;
+    }
+  }
+  return 0;
+}
+
+// run() reads the headers first so that the output can be sized, then
+// reads each run in one go and hands the regions out to the threads.
+
+int VBRegionTS::run(vector<string> *teslist, Tes *loaded, uint32 flags,
+                    VBMatrix *means, vector<VBMatrix> *series, int nthreads) {
+  if (regions.empty()) return 101;
+  uint32 total = 0;
+  if (loaded)
+    total = loaded->dimt;
+  else {
+    for (size_t i = 0; i < teslist->size(); i++) {
+      Tes hdr;
+      if (hdr.ReadHeader((*teslist)[i])) return 102;
+      total += hdr.dimt;
+    }
+  }
+  if (total == 0) return 102;
+  if (means && (means->m != total || means->n != regions.size()))
+    means->resize(total, regions.size());
+  if (series) {
+    series->resize(regions.size());
+    for (size_t r = 0; r < regions.size(); r++) {
+      VBMatrix &mm = (*series)[r];
+      if (mm.m != total || mm.n != regions[r].size())
+        mm.resize(total, regions[r].size());
+    }
+  }
+  if (nthreads < 1) nthreads = ncores();
+  if (nthreads > (int)regions.size()) nthreads = regions.size();
+  size_t nvoxels = 0;
+  for (size_t r = 0; r < regions.size(); r++) nvoxels += regions[r].size();
+
+  uint32 row = 0;
+  size_t nruns = (loaded ? 1 : teslist->size());
+  for (size_t i = 0; i < nruns; i++) {
+    Tes tmp;
+    Tes *ts = loaded;
+    if (!ts && nvoxels <= maxseekvoxels) {
+      if (tmp.ReadHeader((*teslist)[i])) return 103;
+      if (row + tmp.dimt > total) return 103;
+      int err = seekrun(tmp, row, flags, means, series);
+      if (err) return err;
+      row += tmp.dimt;
+      continue;
+    }
+    if (!ts) {
+      if (tmp.ReadFile((*teslist)[i])) return 103;
+      ts = &tmp;
+    }
+    // the headers might have lied
+    if (row + ts->dimt > total) return 103;
+    int err = checkrun(*ts, !loaded);
+    if (err) return err;
+    if (nthreads < 2)
+      runworker(*ts, row, flags, means, series, 0, 1);
+    else {
+      boost::thread_group tg;
+      for (int t = 0; t < nthreads; t++)
+        tg.create_thread(boost::bind(&VBRegionTS::runworker, this,
+                                     boost::ref(*ts), row, flags, means,
+                                     series, t, nthreads));
+      tg.join_all();
+    }
+    row += ts->dimt;
+  }
+  if (row != total) return 103;
+  return 0;
+}
+
+// seekrun() reads each voxel's series on its own, for small regions.
+// as with getTS(), there's no mask check, a masked-out voxel is just
+// zeros.
+
+int VBRegionTS::seekrun(Tes &ts, uint32 row, uint32 flags, VBMatrix *means,
+                        vector<VBMatrix> *series) {
+  VB_Vector sum(ts.dimt);
+  for (size_t r = 0; r < regions.size(); r++) {
+    sum.zero();
+    for (size_t j = 0; j < regions[r].size(); j++) {
+      VBVoxel &v = regions[r][j];
+      if (!ts.inbounds(v.x, v.y, v.z)) return 104;
+      if (ts.ReadTimeSeries(ts.GetFileName(), v.x, v.y, v.z)) return 103;
+      if ((int)ts.timeseries.size() != ts.dimt) return 103;
+      store(r, j, row, ts.timeseries, flags, sum, series);
+    }
+    if (means) {
+      double n = regions[r].size();
+      for (int t = 0; t < ts.dimt; t++) means->set(row + t, r, sum[t] / n);
+    }
+  }
+  return 0;
+}
+
+// store() scales/detrends one voxel's series for one run, and adds it
+// to the region's sum and (if wanted) its column of the series matrix
+
+void VBRegionTS::store(uint32 r, uint32 j, uint32 row, VB_Vector &vv,
+                       uint32 flags, VB_Vector &sum,
+                       vector<VBMatrix> *series) {
+  if (flags & MEANSCALE) vv.meanNormalize();
+  if (flags & DETREND) vv.removeDrift();
+  if (series) {
+    VBMatrix &mm = (*series)[r];
+    for (size_t t = 0; t < vv.size(); t++) mm.set(row + t, j, vv[t]);
+  }
+  sum += vv;
+}
+
+// each thread takes every nthreads'th region, so no two threads write
+// the same column
+
+void VBRegionTS::runworker(Tes &ts, uint32 row, uint32 flags,
+                           VBMatrix *means, vector<VBMatrix> *series,
+                           int thread, int nthreads) {
+  VB_Vector vv(ts.dimt), sum(ts.dimt);
+  for (size_t r = thread; r < regions.size(); r += nthreads) {
+    sum.zero();
+    for (size_t j = 0; j < regions[r].size(); j++) {
+      VBVoxel &v = regions[r][j];
+      getseries(ts, ts.voxelposition(v.x, v.y, v.z), vv);
+      store(r, j, row, vv, flags, sum, series);
+    }
+    if (means) {
+      double n = regions[r].size();
+      for (int t = 0; t < ts.dimt; t++) means->set(row + t, r, sum[t] / n);
+    }
+  }
+}
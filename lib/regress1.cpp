@@ -33,9 +33,70 @@
 using namespace std;
 
 #include "glmutil.h"
+#include "vbtrace.h"
 
 using namespace std;
 
+namespace {
+
+// how many voxels' normal equations vrbatch() packs up at once
+const size_t VRBATCH = 256;
+
+double dotprod(const double *x, const double *y, int n) {
+  double s = 0.0;
+  for (int i = 0; i < n; i++) s += x[i] * y[i];
+  return s;
+}
+
+// in-place cholesky of the symmetric p x p matrix a (row-major), the
+// factor ends up in the lower triangle.  returns nonzero if a pivot
+// is lost to rounding, i.e., a is (nearly) singular.
+
+int cholesky(double *a, int p) {
+  for (int j = 0; j < p; j++) {
+    double *aj = a + j * p;
+    double d = aj[j];
+    for (int k = 0; k < j; k++) d -= aj[k] * aj[k];
+    if (!(d > aj[j] * 1e-12)) return 1;
+    d = sqrt(d);
+    aj[j] = d;
+    for (int i = j + 1; i < p; i++) {
+      double *ai = a + i * p;
+      double s = ai[j];
+      for (int k = 0; k < j; k++) s -= ai[k] * aj[k];
+      ai[j] = s / d;
+    }
+  }
+  return 0;
+}
+
+// solve LL'x=b in place, given the factor from cholesky()
+
+void cholsolve(const double *l, int p, double *b) {
+  for (int i = 0; i < p; i++) {
+    for (int k = 0; k < i; k++) b[i] -= l[i * p + k] * b[k];
+    b[i] /= l[i * p + i];
+  }
+  for (int i = p - 1; i >= 0; i--) {
+    for (int k = i + 1; k < p; k++) b[i] -= l[k * p + i] * b[k];
+    b[i] /= l[i * p + i];
+  }
+}
+
+// c'(LL')^-1c, which is |L^-1c|^2.  c is overwritten.
+
+double cholquad(const double *l, int p, double *c) {
+  double s = 0.0;
+  for (int i = 0; i < p; i++) {
+    for (int k = 0; k < i; k++) c[i] -= l[i * p + k] * c[k];
+    c[i] /= l[i * p + i];
+    s += c[i] * c[i];
+  }
+  return s;
+}
+
+}  // namespace
+
 class VBCovar {
  public:
   Tes tesdata;
@@ -43,15 +104,13 @@ class VBCovar {
   int dependent;
 };
 
-void buildg(VBMatrix &G, int x, int y, int z, uint32 rankg, uint32 orderg,
-            vector<VBCovar> &covs);
-
 // new regress function that just does the regression and returns the
 // results.  if there's no f1 matrix, first we try to load it, then we
 // try to calculate it from g.  in the autocorrelated case, r and
 // exofilt are loaded if not available.
 
 int GLMInfo::Regress(VB_Vector &timeseries) {
+  VBTraceTimer tracer("GLMInfo::Regress");
   if (gMatrix.m == 0) {
     gMatrix.ReadFile(stemname + ".G");
     if (!gMatrix.m) return 200;
@@ -68,21 +127,11 @@ int GLMInfo::Regress(VB_Vector &timeseries) {
       rMatrix.ReadFile(stemname + ".R");
       if (!rMatrix.m) return 202;
     }
-    if (exoFilt.getLength() == 0) {
-      exoFilt.ReadFile(stemname + ".ExoFilt");
-      if (exoFilt.getLength() == 0) return 203;
-    }
+    if (loadexokernel(stemname + ".ExoFilt")) return 203;
     if (traceRV.getLength() == 0) {
       traceRV.ReadFile(stemname + ".traces");
       if (traceRV.getLength() == 0) return 204;
     }
-    if (realExokernel.size() == 0 || imagExokernel.size() == 0) {
-      realExokernel.resize(exoFilt.getLength());
-      imagExokernel.resize(exoFilt.getLength());
-      exoFilt.fft(realExokernel, imagExokernel);
-      realExokernel[0] = 1.0;
-      imagExokernel[0] = 0.0;
-    }
   }
   // do the regression
   if (glmflags & AUTOCOR)
@@ -94,6 +143,7 @@ int GLMInfo::Regress(VB_Vector &timeseries) {
 }
 
 int GLMInfo::RegressIndependent(VB_Vector &timeseries) {
+  VBTraceTimer tracer("GLMInfo::RegressIndependent");
   // if F1 matrix is not set, pinv the G matrix
   if (f1Matrix.m == 0) {
     f1Matrix.init(gMatrix.n, gMatrix.m);
@@ -184,11 +234,39 @@ int GLMInfo::VecRegress(vector<string> ivnames, string dvname) {
 
 // the idea of volumeregress() is to build our set of covariates out
 // of volume sets (dirs of cub files) or vectors (same vec for each
-// voxel).
+// voxel).  the data are loaded once, and then each permutation is run
+// against the copy in memory (see vbvolregress).
 
 int GLMInfo::VolumeRegress(Cube mask, int part, int nparts,
                            vector<string> ivnames, string dvname,
                            vector<VBMatrix> &ivmats) {
+  int err = VolumeRegressLoad(mask, part, nparts, ivnames, dvname, ivmats);
+  if (err) return err;
+  vector<VBContrast> clist(1, contrast);
+  if ((err = VolumeRegressRun(clist))) return err;
+  statcube = statcubes[0];
+  rawcube = rawcubes[0];
+  return 0;
+}
+
+void VRData::clear() {
+  dimx = dimy = dimz = 0;
+  orderg = rankg = 0;
+  xs.clear();
+  ys.clear();
+  zs.clear();
+  fixedg.clear();
+  volcols.clear();
+  ivdata.clear();
+  dvdata.clear();
+  dvvec.clear();
+}
+
+int GLMInfo::VolumeRegressLoad(Cube mask, int part, int nparts,
+                               vector<string> ivnames, string dvname,
+                               vector<VBMatrix> &ivmats) {
+  VBTraceTimer tracer("GLMInfo::VolumeRegressLoad");
+  vrdata.clear();
   if (mask.datatype != vb_byte) return 137;
   // m=rows=orderg=number of observations
   // n=cols=rankg=number of variables
@@ -251,7 +329,6 @@ int GLMInfo::VolumeRegress(Cube mask, int part, int nparts,
 
   // iterate across covariates, grabbing what we need
   vector<VBCovar> covs;
-  int volumeivcount = 0;  // number of ivs that are volume data
   int matind = 0;
 
   for (int i = 0; i < (int)ivnames.size(); i++) {
@@ -282,7 +359,6 @@ int GLMInfo::VolumeRegress(Cube mask, int part, int nparts,
         }
         if (cc.tesdata.dimt != (int)orderg) return 127;
         cc.tesdata.intersect(mask);
-        volumeivcount++;
       } else if (cc.vecdata.size()) {
         if (cc.vecdata.size() != orderg) return 128;
       } else {
@@ -292,6 +368,59 @@ int GLMInfo::VolumeRegress(Cube mask, int part, int nparts,
     }
   }
 
+  // the fixed part of G, and which columns vary by voxel
+  VRData &vr = vrdata;
+  vr.dimx = dimx;
+  vr.dimy = dimy;
+  vr.dimz = dimz;
+  vr.orderg = orderg;
+  vr.rankg = rankg;
+  vr.fixedg.init(orderg, rankg);
+  for (int i = 0; i < (int)covs.size(); i++) {
+    if (covs[i].tesdata.data)
+      vr.volcols.push_back(i);
+    else
+      vr.fixedg.SetColumn(i, covs[i].vecdata);
+  }
+
+  // copy the time series for the voxels we're doing out of the teses,
+  // voxel by voxel, and let the teses go
+  index = 0;
+  for (int k = 0; k < dimz; k++) {
+    for (int j = 0; j < dimy; j++) {
+      for (int i = 0; i < dimx; i++) {
+        if (mask.testValueUnsafe<char>(index++)) {
+          vr.xs.push_back(i);
+          vr.ys.push_back(j);
+          vr.zs.push_back(k);
+        }
+      }
+    }
+  }
+  size_t nvox = vr.xs.size();
+  vr.ivdata.resize(nvox * vr.volcols.size() * orderg);
+  double *iv = vr.ivdata.empty() ? NULL : &vr.ivdata[0];
+  for (size_t v = 0; v < nvox; v++) {
+    vbforeach(int col, vr.volcols) {
+      Tes &ts = covs[col].tesdata;
+      ts.GetTimeSeries(vr.xs[v], vr.ys[v], vr.zs[v]);
+      for (uint32 t = 0; t < orderg; t++) *iv++ = ts.timeseries[t];
+    }
+  }
+  if (depvar.tesdata.data) {
+    vr.dvdata.resize(nvox * orderg);
+    VB_Vector signal;
+    for (size_t v = 0; v < nvox; v++) {
+      depvar.tesdata.GetTimeSeries(vr.xs[v], vr.ys[v], vr.zs[v]);
+      signal = depvar.tesdata.timeseries;
+      if (glmflags & MEANSCALE) signal.meanNormalize();
+      if (glmflags & DETREND) signal.removeDrift();
+      for (uint32 t = 0; t < orderg; t++)
+        vr.dvdata[v * orderg + t] = signal[t];
+    }
+  } else
+    vr.dvvec = depvar.vecdata;
+
   interestlist.clear();
   keeperlist.clear();
   for (int i = 0; i < (int)ivnames.size(); i++) {
@@ -303,75 +432,230 @@ int GLMInfo::VolumeRegress(Cube mask, int part, int nparts,
          orderg, rankg);
   paramtes.init(dimx, dimy, dimz, betacount + 1, vb_float);
   residtes.init(dimx, dimy, dimz, orderg, vb_float);
-  statcube.init(dimx, dimy, dimz, vb_float);
-  rawcube.init(dimx, dimy, dimz, vb_float);
+  return 0;
+}
 
-  // NOW FINALLY WE CAN DO SOME REGRESSION
-  VB_Vector signal;
-  if (depvar.vecdata.size()) {
-    signal = depvar.vecdata;
+// VolumeRegressRun() regresses every voxel loaded by
+// VolumeRegressLoad() under the current permutation.  the betas and
+// residuals don't depend on the contrast, so each voxel is regressed
+// once and then we compute the stat for every contrast in clist,
+// into statcubes and rawcubes.  contrast is left as the last one.
+
+int GLMInfo::VolumeRegressRun(vector<VBContrast> &clist) {
+  VBTraceTimer tracer("GLMInfo::VolumeRegressRun");
+  VRData &vr = vrdata;
+  if (vr.orderg == 0) return 101;
+  if (clist.empty()) return 102;
+  vbtrace_count(vbt_voxels, vr.xs.size());
+  statcubes.resize(clist.size());
+  rawcubes.resize(clist.size());
+  for (size_t c = 0; c < clist.size(); c++) {
+    statcubes[c].init(vr.dimx, vr.dimy, vr.dimz, vb_float);
+    rawcubes[c].init(vr.dimx, vr.dimy, vr.dimz, vb_float);
+  }
+  contrast = clist[0];
+  // the fixed columns are the same for every voxel
+  gMatrix = vr.fixedg;
+  VB_Vector signal(vr.orderg);
+  if (vr.dvdata.empty()) {
+    signal = vr.dvvec;
     permute_if_needed(signal);
   }
-  index = 0;
-  for (int k = 0; k < dimz; k++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int i = 0; i < dimx; i++) {
-        if (mask.testValueUnsafe<char>(index)) {
-          buildg(gMatrix, i, j, k, orderg, rankg, covs);
-          if (depvar.tesdata.data) {
-            depvar.tesdata.GetTimeSeries(i, j, k);
-            signal = depvar.tesdata.timeseries;
-            if (glmflags & MEANSCALE) signal.meanNormalize();
-            if (glmflags & DETREND) signal.removeDrift();
-            permute_if_needed(signal);
-          }
-          // force F1 (pinv(G)) to be recalculated if need be
-          if (volumeivcount > 0) f1Matrix.clear();
-          int err = RegressIndependent(signal);
-          if (err) return 131;
-          // bang the params into paramtes
-          for (int m = 0; m < (int)keeperlist.size(); m++)
-            paramtes.SetValue(i, j, k, m, betas[keeperlist[m]]);
-          // FIXME need setValue<float> versions for tes::setvalue
-          if (!(glmflags & EXCLUDEERROR))
-            paramtes.SetValue(i, j, k, paramtes.dimt - 1,
-                              betas[betas.getLength() - 1]);
-          // bang the resids info residtes
-          for (uint32 ind = 0; ind < orderg; ind++)
-            residtes.SetValue(i, j, k, ind, residuals[ind]);
-          // FIXME print percent done occasionally
-          calc_stat();
-          statcube.SetValue(i, j, k, statval);
-          rawcube.SetValue(i, j, k, rawval);
-        }
-        index++;
-      }
+  // with a volume covariate the design changes at every voxel.  the
+  // batched solver covers t-derived stats from a model without
+  // autocorrelation, anything else goes through pinv() voxel by voxel.
+  bool f_batch = vr.volcols.size() > 0;
+  if (f3Matrix.m == 0) f3Matrix.ReadFile(stemname + ".F3");
+  if (f3Matrix.m) f_batch = 0;
+  vbforeach(VBContrast &cc, clist) {
+    string myscale = xstripwhitespace(vb_tolower(cc.scale));
+    if (myscale.empty() || myscale[0] != 't') f_batch = 0;
+  }
+  if (f_batch) return vrbatch(clist, signal);
+  for (size_t v = 0; v < vr.xs.size(); v++) {
+    vrsetcols(v);
+    vrsignal(v, signal);
+    // force F1 (pinv(G)) to be recalculated if need be
+    if (vr.volcols.size()) f1Matrix.clear();
+    int err = RegressIndependent(signal);
+    if (err) return 131;
+    vrsave(v);
+    // FIXME print percent done occasionally
+    for (size_t c = 0; c < clist.size(); c++) {
+      if (clist.size() > 1) contrast = clist[c];
+      calc_stat();
+      statcubes[c].SetValue(vr.xs[v], vr.ys[v], vr.zs[v], statval);
+      rawcubes[c].SetValue(vr.xs[v], vr.ys[v], vr.zs[v], rawval);
     }
   }
   return 0;
 }
 
-void buildg(VBMatrix &G, int x, int y, int z, uint32 rankg, uint32 orderg,
-            vector<VBCovar> &covs) {
-  // needinit just tells us if the G matrix already had data in it
-  int needinit = 0;
-  if (G.m != rankg || G.n != orderg) {
-    G.init(rankg, orderg);
-    needinit = 1;
+// copy voxel v's volume covariates into gMatrix
+
+void GLMInfo::vrsetcols(size_t v) {
+  VRData &vr = vrdata;
+  const double *iv = &vr.ivdata[v * vr.volcols.size() * vr.orderg];
+  vbforeach(int col, vr.volcols) {
+    for (uint32 t = 0; t < vr.orderg; t++) gMatrix.set(t, col, *iv++);
   }
-  for (int i = 0; i < (int)covs.size(); i++) {
-    // if this variable has tes data, it varies spatially and needs to be set
-    if (covs[i].tesdata.data) {
-      covs[i].tesdata.GetTimeSeries(x, y, z);
-      G.SetColumn(i, covs[i].tesdata.timeseries);
+}
+
+// voxel v's (permuted) dv, unless it's shared and already in signal
+
+void GLMInfo::vrsignal(size_t v, VB_Vector &signal) {
+  VRData &vr = vrdata;
+  if (vr.dvdata.empty()) return;
+  signal.resize(vr.orderg);
+  for (uint32 t = 0; t < vr.orderg; t++)
+    signal[t] = vr.dvdata[v * vr.orderg + t];
+  permute_if_needed(signal);
+}
+
+// bang the params and resids for voxel v into paramtes and residtes
+
+void GLMInfo::vrsave(size_t v) {
+  int i = vrdata.xs[v], j = vrdata.ys[v], k = vrdata.zs[v];
+  for (int m = 0; m < (int)keeperlist.size(); m++)
+    paramtes.SetValue(i, j, k, m, betas[keeperlist[m]]);
+  // FIXME need setValue<float> versions for tes::setvalue
+  if (!(glmflags & EXCLUDEERROR))
+    paramtes.SetValue(i, j, k, paramtes.dimt - 1,
+                      betas[betas.getLength() - 1]);
+  for (uint32 ind = 0; ind < vrdata.orderg; ind++)
+    residtes.SetValue(i, j, k, ind, residuals[ind]);
+}
+
+// vrbatch() solves the normal equations (G'G)b=G'y for VRBATCH voxels
+// at a time.  the fixed-by-fixed block of G'G (and G'y for the fixed
+// columns, if the dv is shared) is computed once, so each voxel only
+// needs the dot products that involve its own covariates.  the p x p
+// systems are packed together and cholesky-factored, and the same
+// factor gives c'(G'G)^-1c for the t stats.  a voxel whose G'G isn't
+// comfortably positive definite goes through pinv() as before.
+
+int GLMInfo::vrbatch(vector<VBContrast> &clist, VB_Vector &signal) {
+  VRData &vr = vrdata;
+  const int n = vr.orderg, p = vr.rankg;
+  const size_t nvol = vr.volcols.size(), nvox = vr.xs.size();
+  const bool f_shared = vr.dvdata.empty();
+  vector<char> isvol(p, 0);
+  vbforeach(int col, vr.volcols) isvol[col] = 1;
+  vector<int> fixedcols;
+  for (int c = 0; c < p; c++)
+    if (!isvol[c]) fixedcols.push_back(c);
+  const size_t nfix = fixedcols.size();
+  // fixed columns, one after another
+  vector<double> fx(nfix * n);
+  for (size_t f = 0; f < nfix; f++)
+    for (int t = 0; t < n; t++) fx[f * n + t] = vr.fixedg(t, fixedcols[f]);
+  vector<double> ff(nfix * nfix), fy(nfix);
+  for (size_t f1 = 0; f1 < nfix; f1++) {
+    for (size_t f2 = 0; f2 <= f1; f2++)
+      ff[f1 * nfix + f2] = ff[f2 * nfix + f1] =
+          dotprod(&fx[f1 * n], &fx[f2 * n], n);
+  }
+  if (f_shared) {
+    for (size_t f = 0; f < nfix; f++)
+      for (int t = 0; t < n; t++) fy[f] += fx[f * n + t] * signal[t];
+  }
+  // the contrasts that match the design, and which need convert_t()
+  vector<char> c_ok(clist.size()), c_conv(clist.size());
+  for (size_t c = 0; c < clist.size(); c++) {
+    c_ok[c] = (clist[c].contrast.size() == (size_t)p);
+    c_conv[c] = (xstripwhitespace(vb_tolower(clist[c].scale)) != "t");
+  }
+  vector<double> a(VRBATCH * p * p), b(VRBATCH * p), ys(VRBATCH * n);
+  vector<char> bad(VRBATCH);
+  vector<double> z(p);
+  for (size_t v0 = 0; v0 < nvox; v0 += VRBATCH) {
+    size_t cnt = min(VRBATCH, nvox - v0);
+    // pack up the batch's systems
+    for (size_t q = 0; q < cnt; q++) {
+      double *y = &ys[q * n];
+      double *aq = &a[q * p * p], *bq = &b[q * p];
+      vrsignal(v0 + q, signal);
+      for (int t = 0; t < n; t++) y[t] = signal[t];
+      for (size_t f1 = 0; f1 < nfix; f1++) {
+        for (size_t f2 = 0; f2 < nfix; f2++)
+          aq[fixedcols[f1] * p + fixedcols[f2]] = ff[f1 * nfix + f2];
+        bq[fixedcols[f1]] = f_shared ? fy[f1] : dotprod(&fx[f1 * n], y, n);
+      }
+      const double *iv = &vr.ivdata[(v0 + q) * nvol * n];
+      for (size_t c1 = 0; c1 < nvol; c1++) {
+        int col = vr.volcols[c1];
+        const double *x = iv + c1 * n;
+        for (size_t f = 0; f < nfix; f++)
+          aq[col * p + fixedcols[f]] = aq[fixedcols[f] * p + col] =
+              dotprod(x, &fx[f * n], n);
+        for (size_t c2 = 0; c2 <= c1; c2++)
+          aq[col * p + vr.volcols[c2]] = aq[vr.volcols[c2] * p + col] =
+              dotprod(x, iv + c2 * n, n);
+        bq[col] = dotprod(x, y, n);
+      }
+    }
+    // factor and solve them all
+    for (size_t q = 0; q < cnt; q++) {
+      bad[q] = cholesky(&a[q * p * p], p);
+      if (!bad[q]) cholsolve(&a[q * p * p], p, &b[q * p]);
+    }
+    // residuals, stats, and output
+    for (size_t q = 0; q < cnt; q++) {
+      size_t v = v0 + q;
+      const double *y = &ys[q * n];
+      if (bad[q]) {
+        vrsetcols(v);
+        signal.resize(n);
+        for (int t = 0; t < n; t++) signal[t] = y[t];
+        f1Matrix.clear();
+        if (RegressIndependent(signal)) return 131;
+      } else {
+        const double *bq = &b[q * p];
+        const double *iv = &vr.ivdata[v * nvol * n];
+        betas.resize(p + 1);
+        residuals.resize(n);
+        for (int c = 0; c < p; c++) betas[c] = bq[c];
+        for (int t = 0; t < n; t++) residuals[t] = y[t];
+        for (size_t f = 0; f < nfix; f++) {
+          double bb = bq[fixedcols[f]];
+          for (int t = 0; t < n; t++) residuals[t] -= fx[f * n + t] * bb;
+        }
+        for (size_t c = 0; c < nvol; c++) {
+          double bb = bq[vr.volcols[c]];
+          for (int t = 0; t < n; t++) residuals[t] -= iv[c * n + t] * bb;
+        }
+        betas[p] = residuals.euclideanProduct(residuals) / (n - p);
+      }
+      vrsave(v);
+      for (size_t c = 0; c < clist.size(); c++) {
+        if (clist.size() > 1) contrast = clist[c];
+        if (bad[q]) {
+          calc_stat();
+        } else {
+          double fact = 0.0;
+          if (c_ok[c]) {
+            for (int i = 0; i < p; i++) z[i] = clist[c].contrast[i];
+            fact = cholquad(&a[q * p * p], p, &z[0]);
+          }
+          if (calc_t(fact) == 0 && c_conv[c]) {
+            // convert_t() gets the effective df from the first voxel's G
+            if (effdf < 0) vrsetcols(v);
+            convert_t();
+          }
+        }
+        statcubes[c].SetValue(vr.xs[v], vr.ys[v], vr.zs[v], statval);
+        rawcubes[c].SetValue(vr.xs[v], vr.ys[v], vr.zs[v], rawval);
+      }
     }
-    // otherwise we only need to set it the first time through
-    else if (needinit)
-      G.SetColumn(i, covs[i].vecdata);
   }
+  // leave gMatrix as the per-voxel path does, with F1 to be recomputed
+  if (nvox) vrsetcols(nvox - 1);
+  f1Matrix.clear();
+  return 0;
 }
 
 int GLMInfo::TesRegress(int part, int nparts, uint32 flags) {
+  VBTraceTimer tracer("GLMInfo::TesRegress");
   if (teslist.size() == 0) return 55;
   tesgroup.resize(teslist.size());
   int dimx = 0, dimy = 0, dimz = 0, dimt = 0;
@@ -464,6 +748,7 @@ int GLMInfo::TesRegress(int part, int nparts, uint32 flags) {
     zz = zs[i];
     // load the time series
     VB_Vector signal;
+    signal.reserve(dimt);
     for (m = 0; m < (int)tesgroup.size(); m++) {
       tesgroup[m].ReadTimeSeries(tesgroup[m].GetFileName(), xx, yy, zz);
       if (flags & MEANSCALE) tesgroup[m].timeseries.meanNormalize();
@@ -475,11 +760,12 @@ int GLMInfo::TesRegress(int part, int nparts, uint32 flags) {
       gMatrix.SetColumn(dependentindex, signal);
       f1Matrix.clear();
     } else {
-      dependentvar = signal;
+      dependentvar = std::move(signal);
       permute_if_needed(dependentvar);
     }
     int err = Regress(dependentvar);
     if (err) return err;
+    vbtrace_count(vbt_voxels);
     // bang the params into paramtes
     for (m = 0; m < (int)keeperlist.size(); m++)
       paramtes.SetValue(xx, yy, zz, m, betas[keeperlist[m]]);
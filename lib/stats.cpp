@@ -101,61 +101,69 @@ tval calc_welchs(VB_Vector &v1, VB_Vector &v2) {
   return tval(t, df);
 }
 
-x2val calc_chisquared(bitmask groups, bitmask deficit, bool yatesflag) {
-  x2val res;
-  if (groups.size() != deficit.size()) return res;
-  double a = 0, b = 0, c = 0, d = 0;
+// count the cells of the 2x2 table for two bitmasks
+
+static void count_cells(const bitmask &groups, const bitmask &deficit, int &a,
+                        int &b, int &c, int &d) {
+  a = b = c = d = 0;
   for (size_t i = 0; i < groups.size(); i++) {
     if (groups[i]) {
       if (deficit[i])
-        a += 1.0;
+        a++;
       else
-        b += 1.0;
+        b++;
     } else {
       if (deficit[i])
-        c += 1.0;
+        c++;
       else
-        d += 1.0;
+        d++;
     }
   }
+}
+
+x2val calc_chisquared(const bitmask &groups, const bitmask &deficit,
+                      bool yatesflag) {
+  x2val res;
+  if (groups.size() != deficit.size()) return res;
+  int a, b, c, d;
+  count_cells(groups, deficit, a, b, c, d);
+  return calc_chisquared(a, b, c, d, yatesflag);
+}
+
+x2val calc_chisquared(int ia, int ib, int ic, int id, bool yatesflag) {
+  x2val res;
+  double a = ia, b = ib, c = ic, d = id;
+  double N = a + b + c + d;
   double x2 = ((a * d) - (b * c));
   if (yatesflag) {
-    double N = a + b + c + d;
     x2 = fabs(x2) - (N / 2.0);
     x2 *= x2 * N;
     x2 /= (a + b) * (c + d) * (a + c) * (b + d);
   } else {
-    x2 *= x2 * (groups.size());
+    x2 *= x2 * N;
     x2 /= (a + b) * (c + d) * (a + c) * (b + d);
   }
   res.x2 = x2;
   res.df = 1;
   res.p = gsl_cdf_chisq_Q(x2, 1) / 2.0;
-  res.c00 = d;
-  res.c01 = c;
-  res.c10 = b;
-  res.c11 = a;
+  res.c00 = id;
+  res.c01 = ic;
+  res.c10 = ib;
+  res.c11 = ia;
   return res;
 }
 
-x2val calc_fisher(bitmask groups, bitmask deficit) {
+x2val calc_fisher(const bitmask &groups, const bitmask &deficit) {
   x2val res;
   res.p = -1;
   if (groups.size() != deficit.size()) return res;
-  double a = 0, b = 0, c = 0, d = 0;
-  for (size_t i = 0; i < groups.size(); i++) {
-    if (groups[i]) {
-      if (deficit[i])
-        a += 1.0;
-      else
-        b += 1.0;
-    } else {
-      if (deficit[i])
-        c += 1.0;
-      else
-        d += 1.0;
-    }
-  }
+  int a, b, c, d;
+  count_cells(groups, deficit, a, b, c, d);
+  return calc_fisher(a, b, c, d);
+}
+
+x2val calc_fisher(int a, int b, int c, int d) {
+  x2val res;
   res.x2 = 0;
   res.df = 1;
   res.c00 = d;
@@ -174,7 +182,7 @@ x2val calc_fisher(bitmask groups, bitmask deficit) {
   double fisher = gsl_sf_fact(a + b) * gsl_sf_fact(c + d) * gsl_sf_fact(a + c) *
                   gsl_sf_fact(b + d);
   fisher /= gsl_sf_fact(a) * gsl_sf_fact(b) * gsl_sf_fact(c) * gsl_sf_fact(d) *
-            gsl_sf_fact(groups.size());
+            gsl_sf_fact(a + b + c + d);
   cout << fisher << endl;
 
   res.p = gsl_cdf_hypergeometric_Q(res.c11, res.c10 + res.c11,
@@ -201,50 +209,199 @@ void t_to_p_z(tval &res, bool twotailed) {
   res.z = zval;
 }
 
-VBVoxel find_fdr_thresh(Tes &vol, double q) {
-  vector<VBVoxel> plist;
-  int i, j, k;
-  double pvalue = 0.0;
-  VBVoxel voxel;
+// FDR
+
+// fdr_pvalues() makes one pass over the map.  the mask is only used
+// if it has data, and a mask that doesn't match the map's dimensions
+// gets you nothing at all.
 
-  for (i = 0; i < vol.dimx; i++) {
-    for (j = 0; j < vol.dimy; j++) {
-      for (k = 0; k < vol.dimz; k++) {
-        if (!vol.VoxelStored(i, j, k)) continue;
-        pvalue = vol.GetValue(i, j, k, 0);
-        if (pvalue < DBL_MIN) {
-          // cout << "shouldn't happen " << i << " " << j << " " << k << endl;
-          // cout << DBL_MIN << " " << pvalue << endl;
-        }
-        voxel.val = fabs(pvalue);  // why abs?  p<0 should never happen
-        voxel.x = i;
-        voxel.y = j;
-        voxel.z = k;
-        plist.push_back(voxel);
+template <class T>
+static void fdr_extract(const T *pdata, const Cube &mask, int n,
+                        vector<float> &pvals, vector<uint32> &indices) {
+  for (int i = 0; i < n; i++) {
+    if (mask.data && !mask.testValue(i)) continue;
+    pvals.push_back(fabs((double)pdata[i]));
+    indices.push_back(i);
+  }
+}
+
+void fdr_pvalues(const Cube &pcube, const Cube &mask, vector<float> &pvals,
+                 vector<uint32> &indices) {
+  int n = pcube.dimx * pcube.dimy * pcube.dimz;
+  pvals.clear();
+  indices.clear();
+  if (!pcube.data) return;
+  if (mask.data && !pcube.dimsequal(mask)) return;
+  pvals.reserve(n);
+  indices.reserve(n);
+  switch (pcube.datatype) {
+    case vb_byte:
+      fdr_extract((unsigned char *)pcube.data, mask, n, pvals, indices);
+      break;
+    case vb_short:
+      fdr_extract((int16 *)pcube.data, mask, n, pvals, indices);
+      break;
+    case vb_long:
+      fdr_extract((int32 *)pcube.data, mask, n, pvals, indices);
+      break;
+    case vb_float:
+      fdr_extract((float *)pcube.data, mask, n, pvals, indices);
+      break;
+    case vb_double:
+      fdr_extract((double *)pcube.data, mask, n, pvals, indices);
+      break;
+  }
+}
+
+// fdr_sort() is an lsd radix sort on the bits of the floats, which
+// order the same way as the values since they're all non-negative.
+// each pass is split into chunks: every thread counts its chunk, the
+// counts are turned into per-thread offsets, and then every thread
+// scatters its own chunk, so the sort is stable and the result doesn't
+// depend on the number of threads.
+
+static void fdr_count(const uint32 *keys, size_t first, size_t last, int shift,
+                      size_t *counts) {
+  for (size_t i = first; i < last; i++) counts[(keys[i] >> shift) & 0xff]++;
+}
+
+static void fdr_scatter(const uint32 *keys, const uint32 *vals, size_t first,
+                        size_t last, int shift, size_t *offsets,
+                        uint32 *newkeys, uint32 *newvals) {
+  for (size_t i = first; i < last; i++) {
+    size_t pos = offsets[(keys[i] >> shift) & 0xff]++;
+    newkeys[pos] = keys[i];
+    newvals[pos] = vals[i];
+  }
+}
+
+void fdr_sort(vector<float> &pvals, vector<uint32> &indices, int nthreads) {
+  size_t n = pvals.size();
+  if (n < 2) return;
+  if (nthreads < 1) nthreads = (n < 65536 ? 1 : ncores());
+  vector<uint32> keys(n), keys2(n), vals2(n);
+  memcpy(&keys[0], &pvals[0], n * sizeof(uint32));
+  vector<size_t> bounds(nthreads + 1);
+  for (int t = 0; t <= nthreads; t++) bounds[t] = (n * t) / nthreads;
+  vector<size_t> counts(nthreads * 256);
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    fill(counts.begin(), counts.end(), 0);
+    if (nthreads == 1)
+      fdr_count(&keys[0], 0, n, shift, &counts[0]);
+    else {
+      boost::thread_group tg;
+      for (int t = 0; t < nthreads; t++)
+        tg.create_thread(boost::bind(fdr_count, &keys[0], bounds[t],
+                                     bounds[t + 1], shift, &counts[t * 256]));
+      tg.join_all();
+    }
+    // skip digits that are the same everywhere
+    bool trivial = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t total = 0;
+      for (int t = 0; t < nthreads; t++) total += counts[t * 256 + b];
+      if (total == n) trivial = 1;
+      if (total) break;
+    }
+    if (trivial) continue;
+    size_t pos = 0;
+    for (int b = 0; b < 256; b++) {
+      for (int t = 0; t < nthreads; t++) {
+        size_t cnt = counts[t * 256 + b];
+        counts[t * 256 + b] = pos;
+        pos += cnt;
       }
     }
+    if (nthreads == 1)
+      fdr_scatter(&keys[0], &indices[0], 0, n, shift, &counts[0], &keys2[0],
+                  &vals2[0]);
+    else {
+      boost::thread_group tg;
+      for (int t = 0; t < nthreads; t++)
+        tg.create_thread(boost::bind(fdr_scatter, &keys[0], &indices[0],
+                                     bounds[t], bounds[t + 1], shift,
+                                     &counts[t * 256], &keys2[0], &vals2[0]));
+      tg.join_all();
+    }
+    keys.swap(keys2);
+    indices.swap(vals2);
   }
-  sort(plist.begin(), plist.end(), vcompare);
-  int maxind = -1;
-  // go through, testing P(i)<=(i/V)(q/cv)
-  // cv=1, so our factor to multiply i by is just q/V
-  double qv = q / plist.size();
-  for (i = 0; i < (int)plist.size(); i++) {
-    if (plist[i].val <= (double)(i + 1) * qv) maxind = i;
+  memcpy(&pvals[0], &keys[0], n * sizeof(uint32));
+}
+
+// fdr_ranks() finds the highest rank i (from 0) with P(i)<=(i+1)/V*q
+// for each q.  a larger q can only move the rank up, so taking the qs
+// from largest to smallest, one backward sweep handles all of them.
+
+void fdr_ranks(const vector<float> &sortedp, const vector<double> &qs,
+               vector<int> &ranks) {
+  ranks.assign(qs.size(), -1);
+  vector<pair<double, size_t> > order;
+  for (size_t i = 0; i < qs.size(); i++)
+    order.push_back(pair<double, size_t>(-qs[i], i));
+  sort(order.begin(), order.end());
+  long i = (long)sortedp.size() - 1;
+  for (size_t j = 0; j < order.size(); j++) {
+    double qv = -order[j].first / sortedp.size();
+    while (i >= 0 && !(sortedp[i] <= (double)(i + 1) * qv)) i--;
+    ranks[order[j].second] = i;
   }
-  // printf("[DEBUG] number of voxels: %d\n",(int)plist.size());
-  // printf("[DEBUG]    winning index: %d\n",maxind);
-  // printf("[DEBUG]     lowest value: %.8f\n",plist[0].val);
-  // printf("[DEBUG]    highest value: %.8f\n",plist[plist.size()-1].val);
-  if (maxind >= 0) {
-    plist[maxind].setCool();
-    return plist[maxind];
+}
+
+VBVoxel find_fdr_thresh(Tes &vol, double q) {
+  vector<Tes *> vols;
+  vols.push_back(&vol);
+  return find_fdr_thresh(vols, q)[0];
+}
+
+static void fdr_tes(vector<Tes *> *vols, double q, vector<VBVoxel> *results,
+                    int first, int step, int sortthreads) {
+  Cube cb, mask;
+  vector<float> pvals;
+  vector<uint32> indices;
+  vector<double> qs(1, q);
+  vector<int> ranks;
+  for (size_t i = first; i < vols->size(); i += step) {
+    Tes &vol = *(*vols)[i];
+    VBVoxel &voxel = (*results)[i];
+    if (vol.getCube(0, cb) || vol.ExtractMask(mask)) continue;
+    fdr_pvalues(cb, mask, pvals, indices);
+    if (pvals.empty()) continue;
+    fdr_sort(pvals, indices, sortthreads);
+    fdr_ranks(pvals, qs, ranks);
+    if (ranks[0] < 0) continue;
+    int x, y, z;
+    cb.getXYZ(x, y, z, indices[ranks[0]]);
+    voxel.x = x;
+    voxel.y = y;
+    voxel.z = z;
+    voxel.val = pvals[ranks[0]];
+    voxel.setCool();
   }
+}
+
+// with several maps, each thread takes whole maps; with just one, the
+// sort gets the threads
+
+vector<VBVoxel> find_fdr_thresh(vector<Tes *> &vols, double q) {
+  VBVoxel voxel;
   voxel.x = 0;
   voxel.y = 0;
   voxel.z = 0;
   voxel.val = nan("nan");
-  return voxel;
+  vector<VBVoxel> results(vols.size(), voxel);
+  int nthreads = min(ncores(), (int)vols.size());
+  if (nthreads < 2) {
+    fdr_tes(&vols, q, &results, 0, 1, 0);
+    return results;
+  }
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(
+        boost::bind(fdr_tes, &vols, q, &results, t, nthreads, 1));
+  tg.join_all();
+  return results;
 }
 
 // FIXME the below is a skeleton
@@ -66,9 +66,80 @@ tval calc_ttest(VB_Vector &vec, bitmask &bm);
 tval calc_ttest(VB_Vector &v1, VB_Vector &v2);
 tval calc_welchs(VB_Vector &vec, bitmask &bm);
 tval calc_welchs(VB_Vector &v1, VB_Vector &v2);
-x2val calc_chisquared(bitmask bm1, bitmask bm2, bool yatesflag = 0);
-x2val calc_fisher(bitmask bm1, bitmask bm2);
+x2val calc_chisquared(const bitmask &bm1, const bitmask &bm2,
+                      bool yatesflag = 0);
+x2val calc_fisher(const bitmask &bm1, const bitmask &bm2);
+// the same from the cell counts: a=both, b=bm1 only, c=bm2 only, d=neither
+x2val calc_chisquared(int a, int b, int c, int d, bool yatesflag = 0);
+x2val calc_fisher(int a, int b, int c, int d);
 void t_to_p_z(tval &res, bool twotailed = 0);
 VBVoxel find_fdr_thresh(Tes &vol, double q);
+vector<VBVoxel> find_fdr_thresh(vector<Tes *> &vols, double q);
+
+// the pieces of an fdr calculation: pull the (absolute) p values out
+// of a map into a compact buffer, sort them along with their voxel
+// indices, and find the winning rank for each q (-1 for none)
+void fdr_pvalues(const Cube &pcube, const Cube &mask, vector<float> &pvals,
+                 vector<uint32> &indices);
+void fdr_sort(vector<float> &pvals, vector<uint32> &indices,
+              int nthreads = 0);
+void fdr_ranks(const vector<float> &sortedp, const vector<double> &qs,
+               vector<int> &ranks);
+
+// VLSMEngine does voxel-based lesion-symptom mapping t tests on the
+// unique lesion patterns in a 4D lesion map rather than on voxels.
+// each pattern keeps the list of subjects in its smaller group, and
+// the stat for a given ordering of the scores comes from the group
+// sums and sums of squares, since the totals don't change when the
+// scores are permuted.  set up the lesions first, then the scores.
+//
+// by default only voxels with at least minlesions lesioned and 2 spared
+// subjects are kept, as in vbtmap.  with f_allvoxels set before
+// setLesions(), every voxel is kept, as in the old per-voxel code in
+// vbvlsm: patterns too small for a test get whatever calc_ttest() or
+// calc_welchs() would give them, zero variance gives inf/nan rather
+// than 0, and permute() takes its maxes over all the finite stats, the
+// way Cube::get_maximum() does.
+
+class VLSMEngine {
+ public:
+  VLSMEngine();
+  int setLesions(const Tes &lesions, const Cube &mask, int minlesions = 2);
+  int setScores(const VB_Vector &scores);
+  // stats for each pattern, with the scores in order[] order if provided
+  void calc(vector<tval> &res, const int32 *order = NULL) const;
+  // put a value for each pattern back into its voxels
+  void scatter(const vector<double> &patvals, Cube &out) const;
+  // max stat value for columns first..first+count-1 of an order
+  // permutation matrix, in parallel
+  int permute(const VBMatrix &pmat, uint32 first, uint32 count,
+              vector<double> &maxes, int nthreads = 0) const;
+  // chi-squared (or fisher exact) test of each pattern against a
+  // binary variable, one bit per subject
+  int tables(const bitmask &group, bool f_fisher, bool f_yates,
+             vector<x2val> &res) const;
+  uint32 patterns() const { return lcount.size(); }
+  uint32 voxels() const { return voxelpos.size(); }
+  bool f_welchs;  // welch's t test instead of pooled variance
+  bool f_flip;    // no-lesion minus lesion
+  bool f_z;       // permute() maxes are z scores rather than t values
+  bool f_non1;    // set by setLesions() if values other than 0/1 were found
+  bool f_allvoxels;  // keep every voxel (see above)
+  vector<uint32> voxelpos;      // volume index of each included voxel
+  vector<uint32> voxelpattern;  // pattern of each included voxel
+ private:
+  tval patternstat(uint32 p, const double *sc, const double *sc2) const;
+  void permworker(const VBMatrix &pmat, uint32 first, uint32 count,
+                  int thread, int nthreads, vector<double> &maxes) const;
+  int dimx, dimy, dimz;
+  uint32 nsubjects, nwords;
+  vector<uint64> words;      // packed patterns, nwords each
+  vector<int32> lcount;      // lesioned subjects in each pattern
+  vector<char> complement;   // members are the spared subjects
+  vector<uint32> moffset;    // start of each pattern's members
+  vector<uint32> members;    // smaller group of each pattern
+  vector<double> scores, scores2;  // centered scores and their squares
+  double ssum, sqsum;
+};
 
 #endif  // VBSTATS_H
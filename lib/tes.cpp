@@ -27,8 +27,134 @@
 using namespace std;
 
 #include "vbio.h"
+#include "vbtrace.h"
 #include "vbutil.h"
 
+// kernels for the whole-volume operations, run through vbdispatch()
+// so that each loop is over the raw typed time series
+
+namespace {
+
+// the scalar operators work in double and store with vbconvert(), as
+// GetValue()/SetValue() did
+struct tesadd {
+  static double apply(double a, double b) { return a + b; }
+};
+struct tessub {
+  static double apply(double a, double b) { return a - b; }
+};
+struct tesmul {
+  static double apply(double a, double b) { return a * b; }
+};
+struct tesdiv {
+  static double apply(double a, double b) { return a / b; }
+};
+
+// voxels that aren't stored are all zeros, so they only have to be
+// built if the operation turns zero into something else
+template <class Op>
+class tesnumkernel {
+ public:
+  tesnumkernel(Tes &tt, double nn) : ts(tt), num(nn) {}
+  template <class T>
+  void run() {
+    uint32 nvox = ts.dimx * ts.dimy * ts.dimz;
+    double zeroval = Op::apply(0.0, num);
+    bool f_fill = !(fabs(zeroval) < DBL_MIN);
+    for (uint32 i = 0; i < nvox; i++) {
+      T *p = (T *)ts.data[i];
+      if (!p) {
+        if (!f_fill) continue;
+        p = (T *)ts.buildvoxel(i);
+        fill(p, p + ts.dimt, vbconvert<T>(zeroval));
+        continue;
+      }
+      for (int t = 0; t < ts.dimt; t++)
+        p[t] = vbconvert<T>(Op::apply((double)p[t], num));
+    }
+  }
+
+ private:
+  Tes &ts;
+  double num;
+};
+
+// adds b to a over the region they have in common
+class tesaddkernel {
+ public:
+  tesaddkernel(Tes &aa, const Tes &bb) : a(aa), b(bb) {}
+  template <class T1, class T2>
+  void run() {
+    int x = min(a.dimx, b.dimx), y = min(a.dimy, b.dimy);
+    int z = min(a.dimz, b.dimz), t = min(a.dimt, b.dimt);
+    for (int k = 0; k < z; k++) {
+      for (int j = 0; j < y; j++) {
+        for (int i = 0; i < x; i++) {
+          const T2 *q = (const T2 *)b.data[b.voxelposition(i, j, k)];
+          if (!q) continue;
+          int ind = a.voxelposition(i, j, k);
+          T1 *p = (T1 *)a.data[ind];
+          if (!p) {
+            int l = 0;
+            while (l < t && fabs((double)q[l]) < DBL_MIN) l++;
+            if (l == t) continue;
+            p = (T1 *)a.buildvoxel(ind);
+          }
+          for (int l = 0; l < t; l++)
+            p[l] = vbconvert<T1>((double)p[l] + (double)q[l]);
+        }
+      }
+    }
+  }
+
+ private:
+  Tes &a;
+  const Tes &b;
+};
+
+class tesnankernel {
+ public:
+  tesnankernel(Tes &tt) : ts(tt) {}
+  template <class T>
+  void run() {
+    uint32 nvox = ts.dimx * ts.dimy * ts.dimz;
+    for (uint32 i = 0; i < nvox; i++) {
+      T *p = (T *)ts.data[i];
+      if (!p) continue;
+      for (int t = 0; t < ts.dimt; t++)
+        if (!finite((double)p[t])) p[t] = 0;
+    }
+  }
+
+ private:
+  Tes &ts;
+};
+
+class remaskkernel {
+ public:
+  remaskkernel(Tes &tt) : ts(tt) {}
+  template <class T>
+  void run() {
+    uint32 nvox = ts.dimx * ts.dimy * ts.dimz;
+    for (uint32 i = 0; i < nvox; i++) {
+      const T *p = (const T *)ts.data[i];
+      if (!p) continue;
+      for (int t = 0; t < ts.dimt; t++) {
+        if (fabs((double)p[t]) > DBL_MIN) {
+          ts.mask[i] = 1;
+          ts.realvoxels++;
+          break;
+        }
+      }
+    }
+  }
+
+ private:
+  Tes &ts;
+};
+
+}  // namespace
+
 Tes::Tes() {
   mask = (unsigned char *)NULL;
   data = (unsigned char **)NULL;
@@ -161,6 +287,7 @@ int Tes::ReadFile(const string &fname, int start, int count) {
 }
 
 int Tes::ReadHeader(const string &fname) {
+  VBTraceTimer tracer("Tes::ReadHeader");
   // never call reparse here, because it will end up converting
   // foo.tes:3 to foo.tes, and we'll end up reading it as 4D
   init();
@@ -176,6 +303,7 @@ int Tes::ReadHeader(const string &fname) {
 }
 
 int Tes::ReadData(const string &fname, int start, int count) {
+  VBTraceTimer tracer("Tes::ReadData");
   // never call reparse here, because it will end up converting
   // foo.tes:3 to foo.tes, and we'll end up reading it as 4D
 
@@ -192,6 +320,7 @@ int Tes::ReadData(const string &fname, int start, int count) {
 }
 
 int Tes::ReadTimeSeries(const string &fname, int x, int y, int z) {
+  VBTraceTimer tracer("Tes::ReadTimeSeries");
   int err;
   if (!header_valid) {
     if ((err = ReadHeader(fname))) return err;
@@ -202,6 +331,7 @@ int Tes::ReadTimeSeries(const string &fname, int x, int y, int z) {
 }
 
 int Tes::ReadVolume(const string &fname, int t, Cube &cb) {
+  VBTraceTimer tracer("Tes::ReadVolume");
   int err;
   if (!header_valid) {
     if ((err = ReadHeader(fname))) return err;
@@ -213,6 +343,7 @@ int Tes::ReadVolume(const string &fname, int t, Cube &cb) {
 }
 
 int Tes::WriteFile(const string fname) {
+  VBTraceTimer tracer("Tes::WriteFile");
   VBFF original;
   // save the original format, then null it
   original = fileformat;
@@ -414,26 +545,11 @@ int Tes::getCube(const int index, Cube &c) {
 void Tes::Remask() {
   if (!mask)  // safety first
     return;
-
-  int i, j, k, t, index;
   realvoxels = 0;
-
-  index = 0;
-  for (k = 0; k < dimz; k++) {
-    for (j = 0; j < dimy; j++) {
-      for (i = 0; i < dimx; i++) {
-        mask[index] = 0;
-        for (t = 0; t < dimt; t++) {
-          if (fabs(GetValue(i, j, k, t)) > DBL_MIN) {
-            mask[index] = 1;
-            realvoxels++;
-            break;
-          }
-        }
-        index++;
-      }
-    }
-  }
+  memset(mask, 0, dimx * dimy * dimz);
+  if (!data) return;
+  remaskkernel kernel(*this);
+  vbdispatch(datatype, kernel);
 }
 
 double Tes::GetValue(VBVoxel &v, int t) const {
@@ -746,75 +862,37 @@ void Tes::printbrief(const string &flags) const {
 }
 
 Tes &Tes::operator+=(const Tes &ts) {
-  int x = dimx;
-  int y = dimy;
-  int z = dimz;
-  int t = dimt;
-  if (ts.dimx < x) x = ts.dimx;
-  if (ts.dimy < y) y = ts.dimy;
-  if (ts.dimz < z) z = ts.dimz;
-  if (ts.dimt < t) t = ts.dimt;
-  for (int i = 0; i < x; i++) {
-    for (int j = 0; j < y; j++) {
-      for (int k = 0; k < z; k++) {
-        for (int l = 0; l < t; l++) {
-          SetValue(i, j, k, l, GetValue(i, j, k, l) + ts.GetValue(i, j, k, l));
-        }
-      }
-    }
-  }
+  if (!data || !ts.data) return *this;
+  tesaddkernel kernel(*this, ts);
+  vbdispatch(datatype, ts.datatype, kernel);
   return *this;
 }
 
 Tes &Tes::operator+=(double num) {
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        for (int l = 0; l < dimt; l++) {
-          SetValue(i, j, k, l, GetValue(i, j, k, l) + num);
-        }
-      }
-    }
-  }
+  if (!data) return *this;
+  tesnumkernel<tesadd> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Tes &Tes::operator-=(double num) {
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        for (int l = 0; l < dimt; l++) {
-          SetValue(i, j, k, l, GetValue(i, j, k, l) - num);
-        }
-      }
-    }
-  }
+  if (!data) return *this;
+  tesnumkernel<tessub> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Tes &Tes::operator*=(double num) {
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        for (int l = 0; l < dimt; l++) {
-          SetValue(i, j, k, l, GetValue(i, j, k, l) * num);
-        }
-      }
-    }
-  }
+  if (!data) return *this;
+  tesnumkernel<tesmul> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
 Tes &Tes::operator/=(double num) {
-  for (int i = 0; i < dimx; i++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int k = 0; k < dimz; k++) {
-        for (int l = 0; l < dimt; l++) {
-          SetValue(i, j, k, l, GetValue(i, j, k, l) / num);
-        }
-      }
-    }
-  }
+  if (!data) return *this;
+  tesnumkernel<tesdiv> kernel(*this, num);
+  vbdispatch(datatype, kernel);
   return *this;
 }
 
@@ -839,6 +917,7 @@ Tes &Tes::copytes(const Tes &ts, bool mirrorflag) {
   if (mirrorflag) {
     data = ts.data;
     mask = ts.mask;
+    f_mirrored = 1;
   } else {
     if (ts.data) {
       data = new unsigned char *[dimx * dimy * dimz];
@@ -933,18 +1012,10 @@ void Tes::zerovoxel(int index) {
 void Tes::zerovoxel(int x, int y, int z) { zerovoxel(voxelposition(x, y, z)); }
 
 void Tes::removenans() {
-  int ind = -1;
-  for (int k = 0; k < dimz; k++) {
-    for (int j = 0; j < dimy; j++) {
-      for (int i = 0; i < dimx; i++) {
-        ind++;
-        if (data[ind] == NULL) continue;
-        for (int t = 0; t < dimt; t++) {
-          if (!(finite(GetValue(i, j, k, t)))) SetValue(i, j, k, t, 0.0);
-        }
-      }
-    }
-  }
+  // only the floating point types can hold nans
+  if (!data || (datatype != vb_float && datatype != vb_double)) return;
+  tesnankernel kernel(*this);
+  vbdispatch(datatype, kernel);
 }
 
 void Tes::intersect(Cube &cb) {
@@ -1030,6 +1101,8 @@ VB_Vector getTS(vector<string> &teslist, int x, int y, int z, uint32 flags) {
     }
     if (flags & MEANSCALE) mytes.timeseries.meanNormalize();
     if (flags & DETREND) mytes.timeseries.removeDrift();
+    // assume the rest of the runs are about the same length
+    if (i == 0) signal.reserve(mytes.dimt * teslist.size());
     signal.concatenate(mytes.timeseries);
   }
   return signal;
@@ -1040,88 +1113,24 @@ VB_Vector getTS(vector<string> &teslist, int x, int y, int z, uint32 flags) {
 
 VB_Vector getRegionTS(vector<string> &teslist, VBRegion &rr, uint32 flags) {
   VB_Vector vv;
-  uint64 xx, yy, zz;
   // if we can't get data, return the empty vector
-  if (rr.size() == 0) return vv;
-
-  // read entire tes, then retrieve each ts
-  if (rr.size() > 10) {
-    for (size_t i = 0; i < teslist.size(); i++) {
-      Tes mytes;
-      if (mytes.ReadFile(teslist[i])) {
-        vv.clear();
-        return vv;
-      }
-      VB_Vector tsvv(mytes.dimt);
-      tsvv.zero();  // *=0.0;
-      for (VI myvox = rr.begin(); myvox != rr.end(); myvox++) {
-        rr.getxyz(myvox->first, xx, yy, zz);
-        if (!(mytes.GetMaskValue(xx, yy, zz))) {
-          vv.clear();
-          return vv;
-        }
-        if (mytes.GetTimeSeries(xx, yy, zz)) {
-          vv.clear();
-          return vv;
-        }
-        if (flags & MEANSCALE) mytes.timeseries.meanNormalize();
-        if (flags & DETREND) mytes.timeseries.removeDrift();
-        tsvv += mytes.timeseries;
-      }
-      tsvv /= rr.size();
-      vv.concatenate(tsvv);
-    }
-    return vv;
-  }
-  // read each ts from disk
-  else {
-    // prefetch one just to get the vector started, then zero it
-    vv = getTS(teslist, 0, 0, 0, flags);
-    vv.zero();
-    for (VI myvox = rr.begin(); myvox != rr.end(); myvox++) {
-      rr.getxyz(myvox->first, xx, yy, zz);
-      vv += getTS(teslist, xx, yy, zz, flags);
-    }
-    if (rr.size()) vv /= rr.size();
-    return vv;
-  }
+  VBRegionTS rts;
+  if (rts.addRegion(rr)) return vv;
+  VBMatrix means;
+  if (rts.extractMeans(teslist, flags, means)) return vv;
+  return means.GetColumn(0);
 }
 
 VBMatrix getRegionComponents(vector<string> &teslist, VBRegion &rr,
                              uint32 flags) {
-  Tes tlist[teslist.size()];
   VBMatrix empty;
-  int timepoints = 0;
-  string noname = "";
-  // iterate across teses, reading headers
-  for (int i = 0; i < (int)teslist.size(); i++) {
-    if (tlist[i].ReadHeader(teslist[i])) return empty;
-    timepoints += tlist[i].dimt;
-  }
-  // build matrix
-  VBMatrix components(timepoints, rr.size());
-  int row = 0;
-  uint64 xx, yy, zz;
-
-  // now iterate across teses and regions, grabbing the relevant timeseries
-  for (int i = 0; i < (int)teslist.size(); i++) {
-    int j = 0;
-    for (VI myvox = rr.begin(); myvox != rr.end(); myvox++) {
-      rr.getxyz(myvox->first, xx, yy, zz);
-      if (tlist[i].ReadTimeSeries(noname, xx, yy, zz)) return empty;
-      if (flags & MEANSCALE) tlist[i].timeseries.meanNormalize();
-      if (flags & DETREND) tlist[i].timeseries.removeDrift();
-      for (int m = row; m < row + tlist[i].dimt; m++) {
-        gsl_matrix_set(&components.mview.matrix, m, j,
-                       tlist[i].timeseries[m - row]);
-      }
-    }
-    j++;
-    row += tlist[i].dimt;
-  }
+  VBRegionTS rts;
+  if (rts.addRegion(rr)) return empty;
+  vector<VBMatrix> series;
+  if (rts.extractSeries(teslist, flags, series)) return empty;
   VBMatrix tmp, E;
   VB_Vector lambdas;
-  if (pca(components, lambdas, tmp, E)) return empty;
+  if (pca(series[0], lambdas, tmp, E)) return empty;
   return tmp;
 }
 
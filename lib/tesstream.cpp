@@ -0,0 +1,443 @@
+// tesstream.cpp
+// copy volumes between 4D files without loading whole datasets
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include "vbio.h"
+
+extern "C" {
+#include "nifti.h"
+}
+
+using boost::format;
+
+namespace {
+
+// the test is on the raw bytes, so a -0.0 counts as data
+bool nonzero(const unsigned char *p, int n) {
+  for (int i = 0; i < n; i++)
+    if (p[i]) return 1;
+  return 0;
+}
+
+// tmpfname must preserve extension, as in tes1_write()
+string tmpname(const string &fname) {
+  return (format("%s/tmp_%d_%d_%s") % xdirname(fname) % getpid() %
+          time(NULL) % xfilename(fname))
+      .str();
+}
+
+}  // namespace
+
+VBTesStream::VBTesStream() {
+  bufsize = (size_t)256 * 1024 * 1024;
+  f_merge = 0;
+}
+
+VBTesStream::~VBTesStream() { closeinputs(); }
+
+void VBTesStream::closeinputs() {
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (inputs[i].fp) gzclose(inputs[i].fp);
+    inputs[i].fp = NULL;
+  }
+}
+
+// addInput() only reads the header.  all the inputs have to agree on
+// dimensions, datatype, and scaling, since the data are copied raw.
+// any error here just means the stream can't handle these inputs.
+
+int VBTesStream::addInput(const string &fname) {
+  Tes ts;
+  if (ts.ReadHeader(fname)) return 101;
+  if (inputs.empty()) {
+    hdr = ts;
+    hdr.SetFileName("");
+  } else {
+    if (ts.dimx != hdr.dimx || ts.dimy != hdr.dimy || ts.dimz != hdr.dimz)
+      return 102;
+    if (ts.datatype != hdr.datatype) return 103;
+    if (ts.f_scaled != hdr.f_scaled) return 104;
+    if (ts.f_scaled &&
+        (ts.scl_slope != hdr.scl_slope || ts.scl_inter != hdr.scl_inter))
+      return 104;
+  }
+  input in;
+  in.filename = fname;
+  in.signature = ts.fileformat.getSignature();
+  in.dimt = ts.dimt;
+  in.offset = ts.offset;
+  in.filebyteorder = ts.filebyteorder;
+  in.fp = NULL;
+  in.nextvox = 0;
+  if (in.signature == "tes1")
+    in.mask.assign(ts.mask, ts.mask + ts.voxels);
+  else if (in.signature == "n14d") {
+    if (xgetextension(fname) == "hdr")
+      in.filename = xsetextension(fname, "img");
+  }
+  // anything else comes through ReadVolume(), which would rescale
+  else if (ts.f_scaled)
+    return 105;
+  inputs.push_back(in);
+  return 0;
+}
+
+int VBTesStream::addVolume(uint32 input, uint32 t) {
+  if (input >= inputs.size()) return 101;
+  if (t >= (uint32)inputs[input].dimt) return 102;
+  volumes.push_back(make_pair(input, t));
+  return 0;
+}
+
+int VBTesStream::addVolumes(uint32 input) {
+  if (input >= inputs.size()) return 101;
+  for (int32 t = 0; t < inputs[input].dimt; t++)
+    volumes.push_back(make_pair(input, (uint32)t));
+  return 0;
+}
+
+// write() picks the layout from the output file's format.  tes1 is
+// stored voxel by voxel, so it's written a slab of voxels at a time.
+// nifti is stored volume by volume.  the other writable formats
+// aren't supported, and get 103 so that the caller can fall back to
+// doing it in memory.  110 means the output file couldn't be written,
+// which the in-memory route won't fix.
+
+int VBTesStream::write(const string &fname) {
+  if (inputs.empty()) return 101;
+  if (f_merge) {
+    for (size_t i = 1; i < inputs.size(); i++)
+      if (inputs[i].dimt != inputs[0].dimt) return 102;
+  } else if (volumes.empty())
+    return 101;
+  VBFF ff = findFileFormat(fname, 4);
+  string sig = ff.getSignature();
+  bool f_tes1 = (sig == "tes1" || !ff.write_4D);
+  if (!f_tes1 && sig != "n14d") return 103;
+  int err = plan(f_tes1 || f_merge);
+  if (!err) {
+    if (f_tes1)
+      err = writetes1(fname);
+    else
+      err = writevolumes(fname);
+  }
+  closeinputs();
+  return err;
+}
+
+// startRead() does the same checks and planning as write(), for a
+// caller that wants the data itself.  readSeries() then hands back
+// whole output series, just as they'd be written.
+
+int VBTesStream::startRead() {
+  if (inputs.empty()) return 101;
+  if (f_merge) {
+    for (size_t i = 1; i < inputs.size(); i++)
+      if (inputs[i].dimt != inputs[0].dimt) return 102;
+  } else if (volumes.empty())
+    return 101;
+  closeinputs();
+  return plan(1);
+}
+
+// plan() works out which volumes are needed from each input and, if
+// needed, which inputs have data at each voxel.  that comes from the
+// stored mask when there is one, otherwise it takes a pass over the
+// volumes we'll be using, one at a time.
+
+int VBTesStream::plan(bool f_needmask) {
+  uint32 nvox = hdr.dimx * hdr.dimy * hdr.dimz;
+  int ds = hdr.datasize;
+  tlists.assign(inputs.size(), vector<uint32>());
+  outlists.assign(inputs.size(), vector<uint32>());
+  srcindex.clear();
+  owner.clear();
+  if (f_merge) {
+    for (size_t i = 0; i < inputs.size(); i++)
+      for (int32 t = 0; t < inputs[i].dimt; t++) tlists[i].push_back(t);
+    hdr.dimt = inputs[0].dimt;
+  } else {
+    for (size_t j = 0; j < volumes.size(); j++)
+      tlists[volumes[j].first].push_back(volumes[j].second);
+    for (size_t i = 0; i < inputs.size(); i++) {
+      sort(tlists[i].begin(), tlists[i].end());
+      tlists[i].erase(unique(tlists[i].begin(), tlists[i].end()),
+                      tlists[i].end());
+    }
+    for (size_t j = 0; j < volumes.size(); j++) {
+      vector<uint32> &tl = tlists[volumes[j].first];
+      srcindex.push_back(lower_bound(tl.begin(), tl.end(), volumes[j].second) -
+                         tl.begin());
+      outlists[volumes[j].first].push_back(j);
+    }
+    hdr.dimt = volumes.size();
+  }
+  if (!f_needmask) return 0;
+  owner.assign(nvox, -1);
+  vector<unsigned char> vol;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (tlists[i].empty()) continue;
+    if (inputs[i].mask.size()) {
+      for (uint32 v = 0; v < nvox; v++)
+        if (inputs[i].mask[v]) owner[v] = i;
+      continue;
+    }
+    vol.resize((size_t)nvox * ds);
+    vector<unsigned char> present(nvox, 0);
+    vector<uint32> tl(1);
+    for (size_t k = 0; k < tlists[i].size(); k++) {
+      tl[0] = tlists[i][k];
+      if (readblock(i, 0, nvox, tl, &vol[0])) return 104;
+      for (uint32 v = 0; v < nvox; v++)
+        if (!present[v] && nonzero(&vol[(size_t)v * ds], ds)) present[v] = 1;
+    }
+    for (uint32 v = 0; v < nvox; v++)
+      if (present[v]) owner[v] = i;
+  }
+  return 0;
+}
+
+// writetes1() sizes the slab so that the output series and the
+// largest input block for it fit in bufsize.  the inputs are each read
+// straight through once, except that nifti files have to seek to the
+// slab in each volume.
+
+int VBTesStream::writetes1(const string &fname) {
+  uint32 nvox = hdr.dimx * hdr.dimy * hdr.dimz;
+  int ds = hdr.datasize;
+  size_t dimt = hdr.dimt;
+  hdr.InitMask(0);
+  for (uint32 v = 0; v < nvox; v++) hdr.mask[v] = (owner[v] >= 0);
+  hdr.filebyteorder = ENDIAN_BIG;
+  size_t maxin = 0;
+  for (size_t i = 0; i < tlists.size(); i++)
+    maxin = max(maxin, tlists[i].size());
+  size_t slab = bufsize / (ds * (dimt + maxin));
+  if (slab < 1) slab = 1;
+  if (slab > nvox) slab = nvox;
+
+  string tmpfname = tmpname(fname);
+  zfile zfp;
+  zfp.open(tmpfname, "w");
+  if (!zfp) return 110;
+  string hh = tes1_headerstring(hdr);
+  zfp.write(hh.c_str(), hh.size());
+  zfp.write(hdr.mask, nvox);
+  vector<unsigned char> outbuf(slab * dimt * ds);
+  for (uint32 v0 = 0; v0 < nvox; v0 += slab) {
+    uint32 v1 = min((size_t)v0 + slab, (size_t)nvox);
+    uint32 nmasked = 0;
+    for (uint32 v = v0; v < v1; v++) nmasked += hdr.mask[v];
+    if (!nmasked) continue;
+    if (readSeries(v0, v1, &outbuf[0])) {
+      zfp.close_and_unlink();
+      return 104;
+    }
+    if (my_endian() != ENDIAN_BIG) swapn(&outbuf[0], ds, (v1 - v0) * dimt);
+    for (uint32 v = v0; v < v1; v++) {
+      if (!hdr.mask[v]) continue;
+      if (zfp.write(&outbuf[(v - v0) * dimt * ds], dimt * ds) != dimt * ds) {
+        zfp.close_and_unlink();
+        return 110;
+      }
+    }
+  }
+  if (!zfp.close()) {
+    unlink(tmpfname.c_str());
+    return 110;
+  }
+  if (rename(tmpfname.c_str(), fname.c_str())) return 110;
+  return 0;
+}
+
+// readSeries() fills buf with the series for voxels v0 to v1-1, one
+// after the other, in our own byte order.  voxels that no input has
+// data for come back as zeros.
+
+int VBTesStream::readSeries(uint32 v0, uint32 v1, unsigned char *buf) {
+  if (owner.empty() || v1 > owner.size() || v0 > v1) return 101;
+  int ds = hdr.datasize;
+  size_t dimt = hdr.dimt;
+  memset(buf, 0, (size_t)(v1 - v0) * dimt * ds);
+  for (uint32 i = 0; i < inputs.size(); i++) {
+    size_t nt = tlists[i].size();
+    if (!nt) continue;
+    bool f_used = 0;
+    for (uint32 v = v0; v < v1 && !f_used; v++)
+      if (owner[v] >= 0 && (!f_merge || owner[v] == (int32)i)) f_used = 1;
+    if (!f_used) continue;
+    scratch.resize((size_t)(v1 - v0) * nt * ds);
+    if (readblock(i, v0, v1, tlists[i], &scratch[0])) return 104;
+    for (uint32 v = v0; v < v1; v++) {
+      if (owner[v] < 0) continue;
+      unsigned char *src = &scratch[(size_t)(v - v0) * nt * ds];
+      unsigned char *dest = buf + (size_t)(v - v0) * dimt * ds;
+      if (f_merge) {
+        if (owner[v] == (int32)i) memcpy(dest, src, dimt * ds);
+        continue;
+      }
+      vbforeach(uint32 j, outlists[i])
+          memcpy(dest + j * ds, src + srcindex[j] * ds, ds);
+    }
+  }
+  return 0;
+}
+
+// writevolumes() holds a range of output volumes, plus the matching
+// block from one input at a time.  a tes1 input gets read once for
+// each range.
+
+int VBTesStream::writevolumes(const string &fname) {
+  uint32 nvox = hdr.dimx * hdr.dimy * hdr.dimz;
+  int ds = hdr.datasize;
+  uint32 dimt = hdr.dimt;
+  size_t volbytes = (size_t)nvox * ds;
+  size_t chunk = bufsize / (2 * volbytes);
+  if (chunk < 1) chunk = 1;
+  if (chunk > dimt) chunk = dimt;
+  hdr.filebyteorder = my_endian();
+
+  string tmpfname = tmpname(fname);
+  zfile zfp;
+  zfp.open(tmpfname, "w");
+  if (!zfp) return 110;
+  if (nifti_write_4D_header(zfp, hdr)) {
+    zfp.close_and_unlink();
+    return 110;
+  }
+  vector<unsigned char> outbuf(chunk * volbytes), inbuf(chunk * volbytes);
+  vector<uint32> tl, js;
+  for (uint32 j0 = 0; j0 < dimt; j0 += chunk) {
+    uint32 j1 = min((size_t)j0 + chunk, (size_t)dimt);
+    memset(&outbuf[0], 0, (j1 - j0) * volbytes);
+    for (uint32 i = 0; i < inputs.size(); i++) {
+      tl.clear();
+      js.clear();
+      for (uint32 j = j0; j < j1; j++) {
+        if (f_merge) {
+          tl.push_back(j);
+          js.push_back(j);
+        } else if (volumes[j].first == i) {
+          tl.push_back(volumes[j].second);
+          js.push_back(j);
+        }
+      }
+      if (tl.empty()) continue;
+      if (readblock(i, 0, nvox, tl, &inbuf[0])) {
+        zfp.close_and_unlink();
+        return 104;
+      }
+      size_t nt = tl.size();
+      for (size_t k = 0; k < nt; k++) {
+        unsigned char *dest = &outbuf[(js[k] - j0) * volbytes];
+        for (uint32 v = 0; v < nvox; v++) {
+          if (f_merge && owner[v] != (int32)i) continue;
+          memcpy(dest + (size_t)v * ds, &inbuf[((size_t)v * nt + k) * ds], ds);
+        }
+      }
+    }
+    size_t sz = (j1 - j0) * volbytes;
+    if (zfp.write(&outbuf[0], sz) != sz) {
+      zfp.close_and_unlink();
+      return 110;
+    }
+  }
+  if (!zfp.close()) {
+    unlink(tmpfname.c_str());
+    return 110;
+  }
+  if (rename(tmpfname.c_str(), fname.c_str())) return 110;
+  return 0;
+}
+
+// readblock() gets voxels v0 to v1-1 for the volumes in tl, voxel by
+// voxel (all the volumes for the first voxel, then the next), in our
+// own byte order.  tes1 files stay open between calls, so as long as
+// the slabs come in order each one is only read through once.
+
+int VBTesStream::readblock(uint32 ind, uint32 v0, uint32 v1,
+                           const vector<uint32> &tl, unsigned char *buf) {
+  input &in = inputs[ind];
+  int ds = hdr.datasize;
+  size_t nt = tl.size(), nv = v1 - v0;
+  if (in.signature == "tes1") {
+    if (in.fp && in.nextvox > v0) {
+      gzclose(in.fp);
+      in.fp = NULL;
+    }
+    if (!in.fp) {
+      in.fp = gzopen(in.filename.c_str(), "r");
+      if (!in.fp) return 101;
+      if (gzseek(in.fp, in.offset, SEEK_SET) == -1) return 102;
+      in.nextvox = 0;
+    }
+    size_t serbytes = (size_t)in.dimt * ds;
+    size_t skip = 0;
+    for (uint32 v = in.nextvox; v < v0; v++)
+      if (in.mask[v]) skip++;
+    if (skip && gzseek(in.fp, skip * serbytes, SEEK_CUR) == -1) return 102;
+    vector<unsigned char> series(serbytes);
+    for (uint32 v = v0; v < v1; v++) {
+      unsigned char *dest = buf + (v - v0) * nt * ds;
+      if (!in.mask[v]) {
+        memset(dest, 0, nt * ds);
+        continue;
+      }
+      if (gzread(in.fp, &series[0], serbytes) != (int)serbytes) return 103;
+      for (size_t k = 0; k < nt; k++)
+        memcpy(dest + k * ds, &series[tl[k] * ds], ds);
+    }
+    in.nextvox = v1;
+  } else if (in.signature == "n14d") {
+    if (!in.fp) {
+      in.fp = gzopen(in.filename.c_str(), "r");
+      if (!in.fp) return 101;
+    }
+    size_t nvox = hdr.dimx * hdr.dimy * hdr.dimz;
+    vector<unsigned char> row(nv * ds);
+    for (size_t k = 0; k < nt; k++) {
+      z_off_t pos = in.offset + ((z_off_t)tl[k] * nvox + v0) * ds;
+      if (gzseek(in.fp, pos, SEEK_SET) == -1) return 102;
+      if (gzread(in.fp, &row[0], nv * ds) != (int)(nv * ds)) return 103;
+      for (size_t v = 0; v < nv; v++)
+        memcpy(buf + (v * nt + k) * ds, &row[v * ds], ds);
+    }
+  } else {
+    // already in our byte order
+    Tes ts;
+    Cube cb;
+    if (ts.ReadHeader(in.filename)) return 101;
+    for (size_t k = 0; k < nt; k++) {
+      if (ts.ReadVolume(in.filename, tl[k], cb)) return 103;
+      if (cb.datatype != hdr.datatype) return 103;
+      for (size_t v = 0; v < nv; v++)
+        memcpy(buf + (v * nt + k) * ds, cb.data + (v0 + v) * ds, ds);
+    }
+    return 0;
+  }
+  if (in.filebyteorder != my_endian()) swapn(buf, ds, nv * nt);
+  return 0;
+}
@@ -26,6 +26,10 @@
 
 using namespace std;
 
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <algorithm>
 #include <fstream>
@@ -336,3 +340,142 @@ bool alpha_sorter(const string a, const string b) {
   if (a < b) return 1;
   return 0;
 }
+
+tokenview::tokenview() {
+  SetSeparator(" \t\n\r");
+  SetCommentChars("#");
+  SetQuoteChars("\"'");
+  line = lineend = NULL;
+}
+
+tokenview::tokenview(const string sep) {
+  SetSeparator(sep);
+  SetCommentChars("#");
+  SetQuoteChars("\"'");
+  line = lineend = NULL;
+}
+
+void tokenview::SetSeparator(const string str) { separator = str; }
+
+void tokenview::SetCommentChars(const string str) { commentchars = str; }
+
+// brackets aren't supported here, so open and close are the same
+
+void tokenview::SetQuoteChars(const string str) { quotechars = str; }
+
+size_t tokenview::ParseLine(const string &str) {
+  return ParseLine(str.data(), str.size());
+}
+
+size_t tokenview::ParseLine(const char *buf, size_t len, size_t maxtokens) {
+  starts.clear();
+  ptrs.clear();
+  lens.clear();
+  line = buf;
+  const char *p = buf;
+  const char *end = buf;
+  while ((size_t)(end - buf) < len && *end) end++;
+  lineend = end;
+  while (p < end) {
+    // skip leading separators
+    while (p < end && separator.find(*p) != string::npos) p++;
+    if (p == end) break;
+    const char *start = p, *tok;
+    size_t toklen;
+    // a quoted token runs to the closing quote, as with tokenlist's
+    // terminal quotes
+    if (quotechars.find(*p) != string::npos) {
+      char q = *p++;
+      tok = p;
+      while (p < end && *p != q) p++;
+      toklen = p - tok;
+      if (p < end) p++;
+    } else {
+      tok = p;
+      while (p < end && separator.find(*p) == string::npos) p++;
+      toklen = p - tok;
+    }
+    // as with tokenlist, a comment ends the tokens but not the Tail()
+    starts.push_back(start);
+    if (toklen && commentchars.find(*tok) != string::npos) break;
+    ptrs.push_back(tok);
+    lens.push_back(toklen);
+    if (maxtokens && ptrs.size() == maxtokens) break;
+  }
+  return ptrs.size();
+}
+
+size_t tokenview::size() const { return ptrs.size(); }
+
+const char *tokenview::ptr(size_t index) const {
+  if (index >= ptrs.size()) return "";
+  return ptrs[index];
+}
+
+size_t tokenview::len(size_t index) const {
+  if (index >= lens.size()) return 0;
+  return lens[index];
+}
+
+bool tokenview::is(size_t index, const char *str) const {
+  size_t n = strlen(str);
+  return len(index) == n && strncmp(ptr(index), str, n) == 0;
+}
+
+bool tokenview::isi(size_t index, const char *str) const {
+  size_t n = strlen(str);
+  return len(index) == n && strncasecmp(ptr(index), str, n) == 0;
+}
+
+bool tokenview::iskey(const char *key) const {
+  size_t n = strlen(key);
+  size_t klen = len(0);
+  if (klen && ptr(0)[klen - 1] == ':') klen--;
+  return klen == n && strncasecmp(ptr(0), key, n) == 0;
+}
+
+string tokenview::operator[](size_t index) const {
+  return string(ptr(index), len(index));
+}
+
+// like tokenlist::Tail(), everything from token num on, as it appeared
+// in the line, minus trailing separators
+
+string tokenview::Tail(size_t num) const {
+  if (num >= starts.size()) return "";
+  const char *end = lineend;
+  while (end > starts[num] && separator.find(end[-1]) != string::npos) end--;
+  return string(starts[num], end - starts[num]);
+}
+
+// numbers are short, so we copy them to the stack to get the nul that
+// strtol() and strtod() need.  strtod() also takes nan, inf, and hex,
+// which the stringstream-based strtod() in vbutil refuses, so only
+// plain decimal numbers get that far, and overflow gives 0 as it does
+// there.
+
+int32 tokenview::num(size_t index) const {
+  char buf[64];
+  size_t n = len(index);
+  if (n == 0 || n >= sizeof(buf)) return 0;
+  memcpy(buf, ptr(index), n);
+  buf[n] = '\0';
+  char *endp;
+  errno = 0;
+  long res = ::strtol(buf, &endp, 10);
+  if (*endp || errno || res != (int32)res) return 0;
+  return res;
+}
+
+double tokenview::dbl(size_t index) const {
+  char buf[64];
+  size_t n = len(index);
+  if (n == 0 || n >= sizeof(buf)) return 0;
+  memcpy(buf, ptr(index), n);
+  buf[n] = '\0';
+  if (strspn(buf, "0123456789+-.eE") != n) return 0;
+  char *endp;
+  double res = ::strtod(buf, &endp);
+  if (*endp || fabs(res) == HUGE_VAL) return 0;
+  return res;
+}
@@ -38,6 +38,7 @@ using namespace std;
 
 // for convenience
 typedef uint32_t uint32;
+typedef int32_t int32;
 
 // argument parsing stuff
 
@@ -99,6 +100,46 @@ class tokenlist {
   iterator end();
 };
 
+// tokenview is a cheap read-only tokenizer for the places where we
+// parse a lot of little lines (image headers, job and sequence
+// files).  unlike tokenlist it doesn't copy anything: tokens are
+// pointers into the caller's buffer, which has to stay put and
+// unchanged while the tokenview is in use.  it knows about
+// separators, comment characters, and quotes around whole tokens, and
+// that's it.  strings only get made when you ask for them.
+
+class tokenview {
+ private:
+  const char *line, *lineend;
+  vector<const char *> starts;  // where each token (or comment) starts
+  vector<const char *> ptrs;    // token contents, quotes excluded
+  vector<size_t> lens;
+  string separator, commentchars, quotechars;
+
+ public:
+  tokenview();
+  tokenview(const string sep);
+  void SetSeparator(const string str);
+  void SetCommentChars(const string str);
+  void SetQuoteChars(const string str);
+  // parse up to len chars or to the first nul, and stop after
+  // maxtokens tokens if it's nonzero
+  size_t ParseLine(const char *buf, size_t len = string::npos,
+                   size_t maxtokens = 0);
+  size_t ParseLine(const string &str);
+  size_t size() const;
+  const char *ptr(size_t index) const;  // not nul-terminated!
+  size_t len(size_t index) const;
+  bool is(size_t index, const char *str) const;
+  bool isi(size_t index, const char *str) const;  // case-insensitive
+  // for "Keyword: value" headers: isi(0), ignoring a trailing colon
+  bool iskey(const char *key) const;
+  string operator[](size_t index) const;
+  string Tail(size_t num = 1) const;
+  int32 num(size_t index) const;   // 0 unless the whole token parses
+  double dbl(size_t index) const;  // ditto
+};
+
 bool length_sorter(const string a, const string b);
 bool alpha_sorter(const string a, const string b);
 
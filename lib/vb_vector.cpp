@@ -59,12 +59,67 @@ void VB_Vector::print() {
 void VB_Vector::init(const size_t len) {
   if (this->valid) gsl_vector_free(this->theVector);
   this->valid = false;
+  this->theVector = NULL;
   if (len > 0) {
     this->theVector = gsl_vector_calloc(len);
     if (this->theVector != NULL) this->valid = true;
   }
 }
 
+/*********************************************************************
+ * This is gsl_vector_calloc() with some room to grow. The gsl_vector *
+ * struct is filled in by hand because gsl_vector_alloc_from_block()  *
+ * won't make a vector of length 0 (as reserve() on an empty vector   *
+ * needs) and doesn't take ownership of the block.                    *
+ *********************************************************************/
+gsl_vector *VB_Vector::allocVector(const size_t length, size_t cap) {
+  if (cap < length) cap = length;
+  if (cap == 0) return NULL;
+  gsl_block *b = gsl_block_calloc(cap);
+  if (!b) return NULL;
+  gsl_vector *v = (gsl_vector *)malloc(sizeof(gsl_vector));
+  if (!v) {
+    gsl_block_free(b);
+    return NULL;
+  }
+  v->size = length;
+  v->stride = 1;
+  v->data = b->data;
+  v->block = b;
+  v->owner = 1;
+  return v;
+}
+
+/*********************************************************************
+ * The capacity is whatever's left of the block past the start of our *
+ * data. Vectors that don't own a contiguous block (which we never    *
+ * make ourselves) have no room to grow.                              *
+ *********************************************************************/
+size_t VB_Vector::capacity() const {
+  if (!this->theVector) return 0;
+  if (!this->theVector->block || !this->theVector->owner ||
+      this->theVector->stride != 1)
+    return this->theVector->size;
+  return this->theVector->block->size -
+         (this->theVector->data - this->theVector->block->data);
+}
+
+void VB_Vector::reserve(size_t n) {
+  if (n <= this->capacity()) return;
+  gsl_vector *v = allocVector(this->getLength(), n);
+  try {
+    VB_Vector::vectorNull(v);
+  }  // try
+  catch (GenericExcep &e) {
+    e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
+    return;
+  }  // catch
+  if (v->size) this->GSLVectorMemcpy(v, this->theVector);
+  if (this->valid) gsl_vector_free(this->theVector);
+  this->theVector = v;
+  this->valid = true;
+}
+
 void VB_Vector::init(const bool validFlag, const VB_datatype dType,
                      const string signature) {
   init(validFlag, dType, findFileFormat(signature));
@@ -552,6 +607,25 @@ VB_Vector::VB_Vector(const VB_Vector &V2) {
 
 }  // VB_Vector::VB_Vector(const VB_Vector& V2)
 
+/*********************************************************************
+ * The move constructor takes over V2's gsl_vector, leaving V2 empty. *
+ *********************************************************************/
+VB_Vector::VB_Vector(VB_Vector &&V2) {
+  this->init(V2.valid, V2.dataType, V2.fileFormat);
+  this->fileName = std::move(V2.fileName);
+  this->theVector = V2.theVector;
+  V2.theVector = NULL;
+  V2.valid = false;
+}  // VB_Vector::VB_Vector(VB_Vector&& V2)
+
+void VB_Vector::copyMetadata(const VB_Vector &V) {
+  if (this == (&V)) return;
+  this->dataType = V.dataType;
+  this->fileFormat = V.fileFormat;
+  this->fileName = V.fileName;
+  this->header = V.header;
+}
+
 /*********************************************************************
  * This constructor instantiates a VB_Vector from the input VBVector  *
  * pointer.                                                           *
@@ -1090,18 +1164,6 @@ VB_Vector VB_Vector::operator+(const gsl_vector *V2) const {
 
 }  // VB_Vector VB_Vector::operator+(const gsl_vector *V2) const
 
-/*********************************************************************
- * This overloaded operator returns the vector sum of this instance   *
- * of VB_Vector and the input VB_Vector.                              *
- *********************************************************************/
-VB_Vector VB_Vector::operator+(const VB_Vector &V2) const {
-  /*********************************************************************
-   * Returning ((*this) + V2.theVector).                                *
-   *********************************************************************/
-  return ((*this) + V2.theVector);
-
-}  // VB_Vector VB_Vector::operator+(const VB_Vector& V2) const
-
 /*********************************************************************
  * This overloaded operator returns the vector difference of this     *
  * instance of VB_Vector and the input gsl_vector.                    *
@@ -1155,18 +1217,6 @@ VB_Vector VB_Vector::operator-(const gsl_vector *V2) const {
 
 }  // VB_Vector VB_Vector::operator-(const gsl_vector *V2) const
 
-/*********************************************************************
- * This overloaded operator returns the vector difference of this     *
- * instance of VB_Vector and the input VB_Vector.                     *
- *********************************************************************/
-VB_Vector VB_Vector::operator-(const VB_Vector &V2) const {
-  /*********************************************************************
-   * Returning ((*this) - V2.theVector).                                *
-   *********************************************************************/
-  return ((*this) - V2.theVector);
-
-}  // VB_Vector VB_Vector::operator-(const VB_Vector& V2) const
-
 /*********************************************************************
  * This overloaded operator returns the vector difference of this     *
  * instance of VB_Vector and the input VB_Vector.                     *
@@ -1352,13 +1402,32 @@ const VB_Vector &VB_Vector::operator=(const VB_Vector &V2) {
     return *this;
   }
   this->init(this->valid, V2.dataType, V2.fileFormat);
-  this->init(V2.getLength());
+  // reuse our own storage if it's big enough
+  if (this->valid && this->capacity() >= V2.getLength())
+    this->theVector->size = V2.getLength();
+  else
+    this->init(V2.getLength());
   if (!(this->theVector)) return *this;
   this->fileName = V2.fileName;
   this->GSLVectorMemcpy(this->theVector, V2.theVector);
   return *this;
 }
 
+const VB_Vector &VB_Vector::operator=(VB_Vector &&V2) {
+  if (this == (&V2)) return *this;
+  if (V2.getLength() == 0) {
+    clear();
+    return *this;
+  }
+  if (this->valid) gsl_vector_free(this->theVector);
+  this->init(V2.valid, V2.dataType, V2.fileFormat);
+  this->fileName = std::move(V2.fileName);
+  this->theVector = V2.theVector;
+  V2.theVector = NULL;
+  V2.valid = false;
+  return *this;
+}
+
 const VB_Vector &VB_Vector::zero() {
   gsl_vector_set_zero(this->theVector);
   return *this;
@@ -2189,7 +2258,18 @@ void VB_Vector::resize(size_t newLength) {
    * current size of this instance of VB_Vector is not equal to the     *
    * new desired length, then a resizing is carried out.                *
    *********************************************************************/
-  if (this->theVector == NULL || (this->theVector->size != newLength)) {
+  if (this->theVector != NULL && this->valid && newLength > 0 &&
+      newLength != this->theVector->size && newLength <= this->capacity()) {
+    /*********************************************************************
+     * There's already room, so just change the length and zero out the  *
+     * elements.                                                          *
+     *********************************************************************/
+    this->theVector->size = newLength;
+    memset(this->theVector->data, 0, sizeof(double) * newLength);
+  }  // if
+
+  else if (this->theVector == NULL ||
+           (this->theVector->size != newLength)) {
     /*********************************************************************
      * Calling this->init() to do the resizing. All vector elements will  *
      * be set to zero. try/catch blocks are used to process any exception *
@@ -2606,186 +2686,69 @@ void VB_Vector::concatenate(const gsl_vector &V) {
  *********************************************************************/
 void VB_Vector::concatenate(const gsl_vector *V) {
   /*********************************************************************
-   * If both the vector to be concatenated have positive length:        *
+   * If V is NULL or empty, then we do nothing since there's no point   *
+   * in concatenating an empty vector to this instance of VB_Vector.    *
    *********************************************************************/
-  if ((this->theVector != NULL) && (V != NULL)) {
-    /*********************************************************************
-     * By default, if the memory allocation fails,                        *
-     * then gsl_vector_calloc() will invoke the GSL error handler         *
-     * which calls abort(), creating a core dump. To forgo this behavior, *
-     * the GSL error handler is turned off and the current error handler  *
-     * is stored in VB_Vector::currentGSLErrorHandler. This is            *
-     * accomplished by the call to this->turnOffGSLErrorHandler().        *
-     *********************************************************************/
-    this->turnOffGSLErrorHandler();
-
-    /*********************************************************************
-     * It's possible that the gsl_vector data member of this instance of  *
-     * VB_Vector has the same address as V, i.e., this instance of        *
-     * VB_Vector is being concatenated with itself, which we want to      *
-     * allow. Therefore, two temprary gsl_vector structs are allocated.   *
-     * this->theVector will be copied to tempVec and V will be copied to  *
-     * tempVec2.                                                          *
-     *********************************************************************/
-    gsl_vector *tempVec = gsl_vector_calloc(this->getLength());
-    gsl_vector *tempVec2 = gsl_vector_calloc(V->size);
-
-    /*********************************************************************
-     * We now restore the standard GSL error handler by calling           *
-     * this->restoreGSLErrorHandler().                                    *
-     *********************************************************************/
-    this->restoreGSLErrorHandler();
-
-    /*********************************************************************
-     * Ensuring that tempVec is non-null. If tempVec is null, then the    *
-     * try/catch will handle the exception thrown by                      *
-     * VB_Vector::vectorNull(), which will have an appropriate error      *
-     * message, as given by gsl_strerror().                               *
-     *********************************************************************/
-    try {
-      VB_Vector::vectorNull(tempVec);
-    }  // try
-    catch (GenericExcep &e) {
-      e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
-    }  // catch
-
-    /*********************************************************************
-     * Ensuring that tempVec2 is non-null. If tempVec2 is null, then the  *
-     * try/catch will handle the exception thrown by                      *
-     * VB_Vector::vectorNull(), which will have an appropriate error      *
-     * message, as given by gsl_strerror().                               *
-     *********************************************************************/
-    try {
-      VB_Vector::vectorNull(tempVec2);
-    }  // try
-    catch (GenericExcep &e) {
-      e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
-    }  // catch
-
-    /*********************************************************************
-     * Copying this->theVector to tempVec. If VB_Vector::GSLVectorMemcpy()*
-     * throws an exception (which will have an appropriate error message, *
-     * as determined by gsl_strerror()) then it is be caught here.        *
-     *********************************************************************/
-    try {
-      VB_Vector::GSLVectorMemcpy(tempVec, this->theVector);
-    }  // try
-    catch (GenericExcep &e) {
-      e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
-    }  // catch
-
-    /*********************************************************************
-     * Copying V to tempVec. If VB_Vector::GSLVectorMemcpy() throws an    *
-     * exception (which will have an appropriate error message, as        *
-     * determined by gsl_strerror()) then it is be caught here.           *
-     *********************************************************************/
-    try {
-      VB_Vector::GSLVectorMemcpy(tempVec2, V);
-    }  // try
-    catch (GenericExcep &e) {
-      e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
-    }  // catch
-
-    /*********************************************************************
-     * Resizing this->theVector to (this->theVector->size + V->size). If  *
-     * an exception occurrs, which will have an appropriate error message *
-     * as determined by gsl_strerror(), then it is caught here.           *
-     *********************************************************************/
-    try {
-      this->init(this->getLength() + V->size);
-    }  // try
-    catch (GenericExcep &e) {
-      e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
-    }  // catch
+  if (V == NULL || V->size == 0) return;
 
-    /*********************************************************************
-     * Now assigning the values from tempVec to this instance of          *
-     * VB_Vector.                                                         *
-     *********************************************************************/
-    memcpy(this->theVector->data, tempVec->data,
-           sizeof(double) * tempVec->size);
-
-    /*********************************************************************
-     * Now assigning the values from tempVec2 to this instance of         *
-     * VB_Vector.                                                         *
-     *********************************************************************/
-    memcpy(this->theVector->data + tempVec->size, tempVec2->data,
-           sizeof(double) * tempVec2->size);
-
-    /*********************************************************************
-     * Freeing the memory allocated to tempVec and tempVec2.              *
-     *********************************************************************/
-    gsl_vector_free(tempVec);
-    gsl_vector_free(tempVec2);
-
-  }  // if
-
-  /*********************************************************************
-   * If V is NULL, then we do nothing since there's no point in         *
-   * concatenating an empty vector to this instance of VB_Vector.       *
-   *********************************************************************/
-  else if (V == NULL) {
-  }
+  size_t oldLength = this->getLength();
+  size_t newLength = oldLength + V->size;
 
   /*********************************************************************
-   * If this instance of VB_Vector is empty, i.e., has zero length, or  *
-   * V is empty.                                                        *
+   * If there isn't room to append V in place, a bigger gsl_vector is   *
+   * allocated. When we already have elements, its capacity is at least *
+   * double the old length, so that a run of appends (as when           *
+   * concatenating the runs of a session) only reallocates a few times. *
+   * V is copied before the old vector is freed, since this instance of *
+   * VB_Vector may be being concatenated with itself, which we want to  *
+   * allow.                                                             *
    *********************************************************************/
-  else if (this->theVector == NULL)  // qq Could this->theVector ever be NULL ?
-  {
+  if (newLength > this->capacity()) {
     /*********************************************************************
-     * By default, if the memory allocation fails,                        *
-     * then gsl_vector_calloc() will invoke the GSL error handler         *
-     * which calls abort(), creating a core dump. To forgo this behavior, *
-     * the GSL error handler is turned off and the current error handler  *
-     * is stored in VB_Vector::currentGSLErrorHandler. This is            *
-     * accomplished by the call to this->turnOffGSLErrorHandler().        *
+     * By default, if the memory allocation fails, then                  *
+     * gsl_block_calloc() will invoke the GSL error handler which calls   *
+     * abort(), creating a core dump. To forgo this behavior, the GSL     *
+     * error handler is turned off around the allocation.                 *
      *********************************************************************/
     this->turnOffGSLErrorHandler();
-
-    /*********************************************************************
-     * Allocating sufficient space for this->theVector.                   *
-     *********************************************************************/
-    this->theVector = gsl_vector_calloc(V->size);
-
-    /*********************************************************************
-     * Ensuring that this->theVector is non-null. If this->theVector is   *
-     * NULL, then the try/catch will handle the exception thrown by       *
-     * VB_Vector::vectorNull(), which will have an appropriate error      *
-     * message, as given by gsl_strerror().                               *
-     *********************************************************************/
-    try {
-      VB_Vector::vectorNull(this->theVector);
-    }  // try
-    catch (GenericExcep &e) {
-      e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
-    }  // catch
-
-    /*********************************************************************
-     * We now restore the standard GSL error handler by calling           *
-     * this->restoreGSLErrorHandler().                                    *
-     *********************************************************************/
+    gsl_vector *v = allocVector(newLength, max(newLength, 2 * oldLength));
     this->restoreGSLErrorHandler();
 
     /*********************************************************************
-     * Copying V to tempVec. If VB_Vector::GSLVectorMemcpy() throws an    *
-     * exception (which will have an appropriate error message, as        *
-     * determined by gsl_strerror()) then it is be caught here.           *
+     * Ensuring that v is non-null. If v is null, then the try/catch will *
+     * handle the exception thrown by VB_Vector::vectorNull(), which will *
+     * have an appropriate error message.                                 *
      *********************************************************************/
     try {
-      VB_Vector::GSLVectorMemcpy(this->theVector, V);
+      VB_Vector::vectorNull(v);
     }  // try
     catch (GenericExcep &e) {
       e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
+      return;
     }  // catch
 
-    /*********************************************************************
-     * At this point, we have successfully copied V to this->theVector.   *
-     * Therefore, this->valid is set to true.                             *
-     *********************************************************************/
+    for (size_t i = 0; i < oldLength; i++)
+      v->data[i] = gsl_vector_get(this->theVector, i);
+    for (size_t i = 0; i < V->size; i++)
+      v->data[oldLength + i] = gsl_vector_get(V, i);
+    if (this->valid) gsl_vector_free(this->theVector);
+    this->theVector = v;
     this->valid = true;
+    return;
+  }  // if
 
-  }  // else if
+  /*********************************************************************
+   * Otherwise V goes straight into the spare room at the end. Reading  *
+   * from V can't be clobbered by the writes (even when V is this       *
+   * vector), except when V is itself a view of that spare room, which  *
+   * memmove() takes care of.                                           *
+   *********************************************************************/
+  double *dest = this->theVector->data + oldLength;
+  if (V->stride == 1)
+    memmove(dest, V->data, sizeof(double) * V->size);
+  else
+    for (size_t i = 0; i < V->size; i++) dest[i] = gsl_vector_get(V, i);
+  this->theVector->size = newLength;
 
 }  // void VB_Vector::concatenate(const gsl_vector *V)
 
@@ -3123,63 +3086,29 @@ VB_Vector &VB_Vector::operator>>(size_t i) {
 
 }  // VB_Vector& VB_Vector::operator>>(size_t i)
 
-/*********************************************************************
- * This overloaed operator scales this instance of VB_Vector by the   *
- * input alpha and returns the scaled vector.                         *
- *********************************************************************/
-VB_Vector VB_Vector::operator*(const double alpha) const {
-  /*********************************************************************
-   * A copy is made of this instance of VB_Vector.                      *
-   *********************************************************************/
-  VB_Vector tempVec(this);
-
-  /*********************************************************************
-   * gsl_vector_scale() is called to do the scaling and its             *
-   * return value is passed to VB_Vector::checkGSLStatus(). If the      *
-   * return value is non-zero, then a error occurred with the GSL       *
-   * function. VB_Vector::checkGSLStatus() will then process the error  *
-   * by writing out an appropriate error message and then causing this  *
-   * program to exit.                                                   *
-   *********************************************************************/
-  VB_Vector::checkGSLStatus(gsl_vector_scale(tempVec.theVector, alpha),
-                            __LINE__, __FILE__, __FUNCTION__);
-
-  /*********************************************************************
-   * Now returning the scaled vector.                                   *
-   *********************************************************************/
-  return tempVec;
-
-}  // VB_Vector VB_Vector::operator*(const double alpha) const
+void VB_Vector::meanCenter() { (*this) -= this->getVectorMean(); }
 
 /*********************************************************************
- * This friend function scales the input VB_Vector by the input       *
- * double. This function is implemented to preserve commutativity.    *
+ * Called when the operands of an elementwise expression have         *
+ * different lengths. The message goes out the same way as for the    *
+ * GSL-based operators, and then the GSL error handler gets its say   *
+ * (by default it aborts, as gsl_vector_add() would have). If it's    *
+ * been turned off, the expression just uses the shorter length.      *
  *********************************************************************/
-VB_Vector operator*(const double alpha, const VB_Vector &V) {
-  /*********************************************************************
-   * The copy constructor is used to make a copy of V.                  *
-   *********************************************************************/
-  VB_Vector tempVec(V);
-
-  /*********************************************************************
-   * gsl_vector_scale() is called to do the scaling and its             *
-   * return value is passed to VB_Vector::checkGSLStatus(). If the      *
-   * return value is non-zero, then a error occurred with the GSL       *
-   * function. VB_Vector::checkGSLStatus() will then process the error  *
-   * by writing out an appropriate error message and then causing this  *
-   * program to exit.                                                   *
-   *********************************************************************/
-  VB_Vector::checkGSLStatus(gsl_vector_scale(tempVec.theVector, alpha),
-                            __LINE__, __FILE__, __FUNCTION__);
-  /*********************************************************************
-   * tempVec is scaled by alpha and then returned.                      *
-   *********************************************************************/
-  /*  tempVec.scaleInPlace(alpha);*/
-  return tempVec;
-
-}  // VB_Vector operator*(const double alpha, const VB_Vector& V)
-
-void VB_Vector::meanCenter() { (*this) -= this->getVectorMean(); }
+void vbv_lengtherror(const size_t len1, const size_t len2) {
+  char errorMsg[OPT_STRING_LENGTH];
+  memset(errorMsg, 0, OPT_STRING_LENGTH);
+  sprintf(errorMsg, "Unequal vector lengths: [%d] and [%d].", (int)len1,
+          (int)len2);
+  try {
+    throw GenericExcep(__LINE__, __FILE__, __FUNCTION__, errorMsg);
+  }  // try
+  catch (GenericExcep &e) {
+    e.whatNoExit(__LINE__, __FILE__, __FUNCTION__);
+  }  // catch
+  gsl_error("vectors must have same length", __FILE__, __LINE__,
+            GSL_EBADLEN);
+}
 
 /*********************************************************************
  * This method resets the elements of this instance of VB_Vector from *
@@ -3570,6 +3499,214 @@ void VB_Vector::printMatrix(const gsl_matrix &M) {
   VB_Vector::printMatrix(&M);
 }  // void VB_Vector::printMatrix(const gsl_matrix& M)
 
+/*********************************************************************
+ * FFT plans. GSL's wavetables and workspaces are expensive to build  *
+ * relative to a short transform, so each thread keeps the ones it    *
+ * has used, keyed by length and direction (forward real, or backward *
+ * halfcomplex). Each plan also carries a scratch buffer for one      *
+ * series. Everything here works in GSL's halfcomplex layout, which   *
+ * is unpacked into (or packed from) the layouts described by         *
+ * vb_fftlayout.                                                      *
+ *********************************************************************/
+namespace {
+
+class fftplan {
+ public:
+  fftplan(size_t len, bool inverse);
+  ~fftplan();
+  bool valid() const { return work && (rtable || htable); }
+  int transform(double *data) const;
+  size_t n;
+  bool inv;
+  gsl_fft_real_wavetable *rtable;
+  gsl_fft_halfcomplex_wavetable *htable;
+  gsl_fft_real_workspace *work;
+  vector<double> buf;
+
+ private:
+  fftplan(const fftplan &);
+  void operator=(const fftplan &);
+};
+
+fftplan::fftplan(size_t len, bool inverse) : buf(len) {
+  n = len;
+  inv = inverse;
+  rtable = NULL;
+  htable = NULL;
+  if (inv)
+    htable = gsl_fft_halfcomplex_wavetable_alloc(n);
+  else
+    rtable = gsl_fft_real_wavetable_alloc(n);
+  work = gsl_fft_real_workspace_alloc(n);
+}
+
+fftplan::~fftplan() {
+  if (rtable) gsl_fft_real_wavetable_free(rtable);
+  if (htable) gsl_fft_halfcomplex_wavetable_free(htable);
+  if (work) gsl_fft_real_workspace_free(work);
+}
+
+// forward is unscaled real->halfcomplex, inverse is unscaled
+// halfcomplex->real (gsl's "backward"), both in place
+int fftplan::transform(double *data) const {
+  if (inv) return gsl_fft_halfcomplex_backward(data, 1, n, htable, work);
+  return gsl_fft_real_transform(data, 1, n, rtable, work);
+}
+
+class fftplancache {
+ public:
+  ~fftplancache() { clear(); }
+  fftplan *get(size_t n, bool inverse);
+  void clear();
+  map<pair<size_t, bool>, fftplan *> plans;
+};
+
+// returns NULL if gsl couldn't allocate the plan.  a thread that
+// wanders through lots of lengths just starts over past 32 plans.
+fftplan *fftplancache::get(size_t n, bool inverse) {
+  pair<size_t, bool> key(n, inverse);
+  map<pair<size_t, bool>, fftplan *>::iterator pp = plans.find(key);
+  if (pp != plans.end()) return pp->second;
+  if (plans.size() >= 32) clear();
+  fftplan *plan = new fftplan(n, inverse);
+  if (!plan->valid()) {
+    delete plan;
+    return NULL;
+  }
+  plans[key] = plan;
+  return plan;
+}
+
+void fftplancache::clear() {
+  for (map<pair<size_t, bool>, fftplan *>::iterator pp = plans.begin();
+       pp != plans.end(); pp++)
+    delete pp->second;
+  plans.clear();
+}
+
+thread_local fftplancache fftplans;
+
+// unpack halfcomplex into real and imaginary parts, scaling as we go.
+// imsign lets ifft() get the conjugate for free.  with full set we
+// fill in all n (the top half as the conjugate of the bottom half),
+// otherwise just the n/2+1 non-redundant values.
+void hc_unpack(const double *hc, size_t n, double scale, double imsign,
+               bool full, double *re, double *im) {
+  size_t half = n / 2;
+  bool even = (half * 2 == n);
+  re[0] = hc[0] * scale;
+  im[0] = 0.0;
+  for (size_t k = 1; k <= half; k++) {
+    if (k == half && even) {
+      re[k] = hc[n - 1] * scale;
+      im[k] = 0.0;
+    } else {
+      re[k] = hc[2 * k - 1] * scale;
+      im[k] = hc[2 * k] * scale * imsign;
+    }
+  }
+  if (!full) return;
+  for (size_t k = half + 1; k < n; k++) {
+    re[k] = re[n - k];
+    im[k] = -im[n - k];
+  }
+}
+
+// pack complex values into halfcomplex.  the real part of a backward
+// transform only depends on the hermitian part of its input, so for
+// full input we keep just that, (z[k]+conj(z[n-k]))/2.  r2c input is
+// assumed to be hermitian already.
+void hc_pack(const double *re, const double *im, size_t n, bool full,
+             double *hc) {
+  size_t half = n / 2;
+  bool even = (half * 2 == n);
+  hc[0] = re[0];
+  for (size_t k = 1; k <= half; k++) {
+    if (k == half && even) {
+      hc[n - 1] = re[k];
+    } else if (full) {
+      hc[2 * k - 1] = (re[k] + re[n - k]) * 0.5;
+      hc[2 * k] = (im[k] - im[n - k]) * 0.5;
+    } else {
+      hc[2 * k - 1] = re[k];
+      hc[2 * k] = im[k];
+    }
+  }
+}
+
+}  // namespace
+
+/*********************************************************************
+ * This static method computes the FFTs of count real series of       *
+ * length n, stored end to end in in[]. The transforms are scaled by  *
+ * 1/n, as in fft(). For vb_fft_full and vb_fft_r2c, realPart[] and   *
+ * imagPart[] each get n or n/2+1 values per series; for              *
+ * vb_fft_halfcomplex, realPart[] gets n values per series and        *
+ * imagPart is not used (it can be NULL).                             *
+ *********************************************************************/
+void VB_Vector::fftBatch(const double *in, size_t n, size_t count,
+                         double *realPart, double *imagPart,
+                         vb_fftlayout layout) {
+  if (n == 0 || count == 0) return;
+  fftplan *plan = fftplans.get(n, false);
+  if (!plan) {
+    VB_Vector::createException("Unable to allocate gsl_fft_real_wavetable.",
+                               __LINE__, __FILE__, __FUNCTION__);
+  }  // if
+  const double oneOverSize = 1.0 / n;
+  const size_t outlen = (layout == vb_fft_r2c ? n / 2 + 1 : n);
+  double *buf = &plan->buf[0];
+  for (size_t c = 0; c < count; c++) {
+    memcpy(buf, in + c * n, n * sizeof(double));
+    int status = plan->transform(buf);
+    if (status) {
+      VB_Vector::createException(string(gsl_strerror(status) + string(".")),
+                                 __LINE__, __FILE__, __FUNCTION__);
+    }  // if
+    if (layout == vb_fft_halfcomplex) {
+      for (size_t i = 0; i < n; i++)
+        realPart[c * n + i] = buf[i] * oneOverSize;
+    } else {
+      hc_unpack(buf, n, oneOverSize, 1.0, layout == vb_fft_full,
+                realPart + c * outlen, imagPart + c * outlen);
+    }
+  }  // for c
+}  // void VB_Vector::fftBatch()
+
+/*********************************************************************
+ * This static method computes the real part of the (unscaled)        *
+ * inverse FFTs of count complex series of length n, in the layout    *
+ * given, and stores them end to end in out[]. For a single series in *
+ * vb_fft_full layout, this is the same thing complexIFFTReal()       *
+ * computes.                                                          *
+ *********************************************************************/
+void VB_Vector::ifftRealBatch(const double *realPart, const double *imagPart,
+                              size_t n, size_t count, double *out,
+                              vb_fftlayout layout) {
+  if (n == 0 || count == 0) return;
+  fftplan *plan = fftplans.get(n, true);
+  if (!plan) {
+    VB_Vector::createException(
+        "Unable to allocate gsl_fft_halfcomplex_wavetable.", __LINE__,
+        __FILE__, __FUNCTION__);
+  }  // if
+  const size_t inlen = (layout == vb_fft_r2c ? n / 2 + 1 : n);
+  double *buf = &plan->buf[0];
+  for (size_t c = 0; c < count; c++) {
+    if (layout == vb_fft_halfcomplex)
+      memcpy(buf, realPart + c * n, n * sizeof(double));
+    else
+      hc_pack(realPart + c * inlen, imagPart + c * inlen, n,
+              layout == vb_fft_full, buf);
+    int status = plan->transform(buf);
+    if (status) {
+      VB_Vector::createException(string(gsl_strerror(status) + string(".")),
+                                 __LINE__, __FILE__, __FUNCTION__);
+    }  // if
+    memcpy(out + c * n, buf, n * sizeof(double));
+  }  // for c
+}  // void VB_Vector::ifftRealBatch()
+
 /*********************************************************************
  * This method computes the FFT of this instance of VB_Vector and     *
  * stores the real and imaginary parts into the 2 input VB_Vectors.   *
@@ -3597,163 +3734,15 @@ void VB_Vector::fft(VB_Vector *realPart, VB_Vector *imagPart) const {
   }  // if
 
   /*********************************************************************
-   * halfSize will be (this->theVector->size / 2) if the length of this *
-   * instance of VB_Vector is even. Otherwise halfSize will be          *
-   * ((this->theVector->size / 2) - 1).                                 *
+   * fftBatch() does the work, using this thread's cached plan for this *
+   * length. It copies the data into the plan's scratch buffer before   *
+   * writing anything, so realPart or imagPart can be this instance.    *
+   * The result is scaled by the reciprocal of the length, to make this *
+   * implementation of the FFT identical to IDL's.                      *
    *********************************************************************/
-  const unsigned int halfSize = this->theVector->size / 2;
-
-  /*********************************************************************
-   * even will be true if the length of this instance of VB_Vector is   *
-   * even, false otherwise.                                             *
-   *********************************************************************/
-  const bool even = ((halfSize * 2) == this->theVector->size);
-
-  /*********************************************************************
-   * The data from this instance of VB_Vector is copied to FFT[].       *
-   *********************************************************************/
-  double FFT[this->theVector->size];
-  memcpy(FFT, this->theVector->data, this->theVector->size * sizeof(double));
-
-  /*********************************************************************
-   * The following 2 variables are needed by GSL's                      *
-   * gsl_fft_real_transform() function. waveTable is a lookup table for *
-   * sines and cosines while workSpace is a required work space.        *
-   *********************************************************************/
-  gsl_fft_real_wavetable *waveTable =
-      gsl_fft_real_wavetable_alloc(this->theVector->size);
-  gsl_fft_real_workspace *workSpace =
-      gsl_fft_real_workspace_alloc(this->theVector->size);
-
-  /*********************************************************************
-   * If waveTable is NULL, then an exception is thrown and then caught  *
-   * by VB_Vector::createException() to inform the user of this error.  *
-   *********************************************************************/
-  if (!waveTable) {
-    VB_Vector::createException("Unable to allocate gsl_fft_real_wavetable.",
-                               __LINE__, __FILE__, __FUNCTION__);
-  }  // if
-
-  /*********************************************************************
-   * If workSpace is NULL, then an exception is thrown and then caught  *
-   * by VB_Vector::createException() to inform the user of this error.  *
-   *********************************************************************/
-  if (!workSpace) {
-    VB_Vector::createException("Unable to allocate gsl_fft_real_workspace.",
-                               __LINE__, __FILE__, __FUNCTION__);
-  }  // if
-
-  /*********************************************************************
-   * Now computing the FFT. If the call to gsl_fft_real_transform() is  *
-   * successful, then status will be 0.                                 *
-   *********************************************************************/
-  int status = gsl_fft_real_transform(FFT, 1, this->theVector->size, waveTable,
-                                      workSpace);
-
-  /*********************************************************************
-   * If status is non-zero, then VB_Vector::createException() is called *
-   * to throw and catch an exception to inform the user of the error.   *
-   * The error message will contain the reason for the error, as        *
-   * returned by gsl_strerror(status).                                  *
-   *********************************************************************/
-  if (status) {
-    VB_Vector::createException(string(gsl_strerror(status) + string(".")),
-                               __LINE__, __FILE__, __FUNCTION__);
-  }  // if
-
-  /*********************************************************************
-   * We will need to scale FFT[] by the reciprocal of the length of     *
-   * this instance of VB_Vector to make this implementation of the FFT  *
-   * identical to IDL's. To that end, oneOverSize is used to hold the   *
-   * reciprocal of the length of this instance of VB_Vector.            *
-   *********************************************************************/
-  const double oneOverSize = 1.0 / this->theVector->size;
-
-  /*********************************************************************
-   * FFT[] now holds the discrete Fourier transform of this instance of *
-   * VB_Vector. However, the storage scheme is not straight forward and *
-   * is called "half complex." (It's advantage is that it takes the     *
-   * exact same mount of space as the origianl vector.) Here is a       *
-   * descpription of the the "half complex" storage scheme from p. 200  *
-   * of the GSL Reference Manual:                                       *
-   *                                                                    *
-   * ... the half-complex transform of a real sequence is stored with   *
-   * frequencies in increasing order, starting at zero, with the real   *
-   * and imaginary parts of each frequency in neighboring locations.    *
-   * When a value is know to be real, its imaginary part is not stored. *
-   *                                                                    *
-   * Here are 2 examples, the first is for n = 5 (odd case), the second *
-   * for n = 6 (even case):                                             *
-   *                                                                    *
-   *         complex[0].real = halfcomplex[0]                           *
-   *         complex[0].imag = 0 (always 0)                             *
-   *         complex[1].real = halfcomplex[1]                           *
-   *         complex[1].imag = halfcomplex[2]                           *
-   *         complex[2].real = halfcomplex[3]                           *
-   *         complex[2].imag = halfcomplex[4]                           *
-   *         complex[3].real = halfcomplex[3]                           *
-   *         complex[3].imag = -halfcomplex[4]                          *
-   *         complex[4].real = halfcomplex[1]                           *
-   *         complex[4].imag = -halfcomplex[2]                          *
-   *                                                                    *
-   *         complex[0].real = halfcomplex[0]                           *
-   *         complex[0].imag = 0 (always 0)                             *
-   *         complex[1].real = halfcomplex[1]                           *
-   *         complex[1].imag = halfcomplex[2]                           *
-   *         complex[2].real = halfcomplex[3]                           *
-   *         complex[2].imag = halfcomplex[4]                           *
-   *         complex[3].real = halfcomplex[5]                           *
-   *         complex[3].imag = 0 (always 0 in even case)                *
-   *         complex[4].real = halfcomplex[3]                           *
-   *         complex[4].imag = -halfcomplex[4]                          *
-   *         complex[5].real = halfcomplex[1]                           *
-   *         complex[5].imag = -halfcomplex[2]                          *
-   *                                                                    *
-   * We will have to "unpack" this half-complex storage to populate     *
-   * realPart[] and imagPart[] with the real and imaginary parts of     *
-   * FFT[]. We now set realPart[0] and imagPart[0].                     *
-   *********************************************************************/
-  (*realPart)[0] = FFT[0] * oneOverSize;
-  (*imagPart)[0] = 0.0;
-
-  /*********************************************************************
-   * The following for loop is used to populate the the reaminder of    *
-   * realPart[] and imagPart[] from FFT[]. This for loop also scales    *
-   * the entries of FFT[] by oneOverSize.                               *
-   *********************************************************************/
-  for (unsigned int i = 1; i < this->theVector->size; i++) {
-    if (i < halfSize) {
-      (*realPart)[i] = FFT[(2 * i) - 1] * oneOverSize;
-      (*imagPart)[i] = FFT[(2 * i)] * oneOverSize;
-    }  // if
-    else if (i == halfSize) {
-      if (even) {
-        (*realPart)[i] = FFT[this->theVector->size - 1] * oneOverSize;
-        (*imagPart)[i] = 0.0;
-      }  // if
-      else {
-        (*realPart)[i] = FFT[this->theVector->size - 2] * oneOverSize;
-        (*imagPart)[i] = FFT[this->theVector->size - 1] * oneOverSize;
-      }  // if
-    }    // else if
-    else {
-      /*********************************************************************
-       * NOTE: Since the index (this->theVector->size - i) is < i,          *
-       * (*realPart)[this->theVector->size - i] has already been scaled by  *
-       * oneOverSize. Similarly for (*imagPart)[this->theVector->size - i]. *
-       *********************************************************************/
-      (*realPart)[i] = (*realPart)[this->theVector->size - i];
-      (*imagPart)[i] = -1.0 * (*imagPart)[this->theVector->size - i];
-
-    }  // else
-
-  }  // for i
-
-  /*********************************************************************
-   * Now freeing waveTable and workSpace.                               *
-   *********************************************************************/
-  gsl_fft_real_wavetable_free(waveTable);
-  gsl_fft_real_workspace_free(workSpace);
+  VB_Vector::fftBatch(this->theVector->data, this->theVector->size, 1,
+                      realPart->theVector->data, imagPart->theVector->data,
+                      vb_fft_full);
 
 }  // void VB_Vector::fft(VB_Vector *realPart, VB_Vector *imagPart) const
 
@@ -3807,114 +3796,28 @@ void VB_Vector::ifft(VB_Vector *realPart, VB_Vector *imagPart) const {
     imagPart->resize(this->theVector->size);
   }  // if
 
-  /*********************************************************************
-   * status will be used to hold the return status values from the GSL  *
-   * functions.                                                         *
-   *********************************************************************/
-  int status = 0;
-
-  /*********************************************************************
-   * complexVec[] will be a complex representation of the elements of   *
-   * this instance of VB_Vector. Of course, the imaginary parts will    *
-   * all be zero. The real parts will be in the even numbered indexes   *
-   * of complexVec[] and the imaginary parts will be in the odd         *
-   * numbered indexes of complexVec[].                                  *
-   *********************************************************************/
-  double complexVec[this->theVector->size * 2];
-
-  /*********************************************************************
-   * Calling gsl_fft_real_unpack() to populate complexVec[].            *
-   *********************************************************************/
-  status = gsl_fft_real_unpack(this->theVector->data,
-                               (gsl_complex_packed_array)complexVec, 1,
-                               this->theVector->size);
+  const size_t n = this->theVector->size;
+  if (n == 0) return;
 
   /*********************************************************************
-   * If status is non-zero, then VB_Vector::createException() is called *
-   * to throw and catch an exception to inform the user of the error.   *
-   * The error message will contain the reason for the error, as        *
-   * returned by gsl_strerror(status).                                  *
+   * This instance of VB_Vector is real, so its (unscaled) inverse FFT  *
+   * is just the complex conjugate of its unscaled forward FFT, which   *
+   * only needs a real transform rather than a complex one.             *
    *********************************************************************/
-  if (status) {
-    VB_Vector::createException(string(gsl_strerror(status) + string(".")),
-                               __LINE__, __FILE__, __FUNCTION__);
-  }  // if
-
-  /*********************************************************************
-   * The following 2 variables are needed by GSL's                      *
-   * gsl_fft_complex_backward() function. waveTable is a lookup table   *
-   * for sines and cosines while workSpace is a required work space.    *
-   *********************************************************************/
-  gsl_fft_complex_wavetable *waveTable =
-      gsl_fft_complex_wavetable_alloc(this->theVector->size);
-  gsl_fft_complex_workspace *workSpace =
-      gsl_fft_complex_workspace_alloc(this->theVector->size);
-
-  /*********************************************************************
-   * If waveTable is NULL, then an exception is thrown and then caught  *
-   * by VB_Vector::createException() to inform the user of this error.  *
-   *********************************************************************/
-  if (!waveTable) {
-    VB_Vector::createException("Unable to allocate gsl_fft_complex_wavetable.",
-                               __LINE__, __FILE__, __FUNCTION__);
-  }  // if
-
-  /*********************************************************************
-   * If workSpace is NULL, then an exception is thrown and then caught  *
-   * by VB_Vector::createException() to inform the user of this error.  *
-   *********************************************************************/
-  if (!workSpace) {
-    VB_Vector::createException("Unable to allocate gsl_fft_complex_workspace.",
+  fftplan *plan = fftplans.get(n, false);
+  if (!plan) {
+    VB_Vector::createException("Unable to allocate gsl_fft_real_wavetable.",
                                __LINE__, __FILE__, __FUNCTION__);
   }  // if
-
-  /*********************************************************************
-   * Now computing the inverse FFT.                                     *
-   *********************************************************************/
-  status = gsl_fft_complex_backward(complexVec, 1, this->theVector->size,
-                                    waveTable, workSpace);
-
-  /*********************************************************************
-   * If status is non-zero, then VB_Vector::createException() is called *
-   * to throw and catch an exception to inform the user of the error.   *
-   * The error message will contain the reason for the error, as        *
-   * returned by gsl_strerror(status).                                  *
-   *********************************************************************/
+  double *buf = &plan->buf[0];
+  memcpy(buf, this->theVector->data, n * sizeof(double));
+  int status = plan->transform(buf);
   if (status) {
     VB_Vector::createException(string(gsl_strerror(status) + string(".")),
                                __LINE__, __FILE__, __FUNCTION__);
   }  // if
-
-  /*********************************************************************
-   * At this point, complexVec[] contains the inverse FFT of this       *
-   * instance of VB_Vector; its even indexed elements holds the real    *
-   * parts and its odd indexed elements holds the imaginary part. Now   *
-   * we populate realPart and imagPart appropriately with the following *
-   * for loop. i indexes complexVec[] and j indexes realPart and        *
-   * imagPart.                                                          *
-   *********************************************************************/
-  for (unsigned int i = 0, j = 0; j < this->theVector->size; j++) {
-    /*********************************************************************
-     * Assigning the real part of the the j'th complex number from        *
-     * complexVec[] to (*realPart)[j]. Note that i is even and i++ causes *
-     * i to be odd.                                                       *
-     *********************************************************************/
-    realPart->theVector->data[j] = complexVec[i++];
-
-    /*********************************************************************
-     * Assigning the imaginary part of the the j'th complex number from   *
-     * complexVec[] to (*imagPart)[j]. Note that i is odd and i++ causes  *
-     * i to be even.                                                      *
-     *********************************************************************/
-    imagPart->theVector->data[j] = complexVec[i++];
-
-  }  // for i, j
-
-  /*********************************************************************
-   * Now freeing waveTable and workSpace.                               *
-   *********************************************************************/
-  gsl_fft_complex_wavetable_free(waveTable);
-  gsl_fft_complex_workspace_free(workSpace);
+  hc_unpack(buf, n, 1.0, -1.0, true, realPart->theVector->data,
+            imagPart->theVector->data);
 
 }  // void VB_Vector::ifft(VB_Vector *realPart, VB_Vector *imagPart) const
 
@@ -3948,14 +3851,6 @@ void VB_Vector::ifft(VB_Vector &realPart, VB_Vector &imagPart) const {
  * ReturnPS function. The power spectrum will be stored in result.    *
  *********************************************************************/
 void VB_Vector::getPS(VB_Vector &result) const {
-  /*********************************************************************
-   * Since we will need the FFT of this instance of VB_Vector, realPart *
-   * is needed to hold the real part of the FFT and imagPart is need to *
-   * hold the imaginary part of the FFT.                                *
-   *********************************************************************/
-  VB_Vector realPart(this->getLength());
-  VB_Vector imagPart(this->getLength());
-
   /*********************************************************************
    * Ensuring that result is of the appropriate size.                   *
    *********************************************************************/
@@ -3963,24 +3858,40 @@ void VB_Vector::getPS(VB_Vector &result) const {
     result.resize(this->theVector->size);
   }  // if
 
-  /*********************************************************************
-   * Geting the FFT of this instance of VB_Vector.                      *
-   *********************************************************************/
-  this->fft(realPart, imagPart);
+  const size_t n = this->theVector->size;
+  if (n == 0) return;
 
   /*********************************************************************
-   * The following for loop is used to assign the power spectrum values *
-   * to result. The power spectrum values are computed from:            *
-   *                                                                    *
-   * fft(this) * conjugate(fft(this))                                   *
-   *                                                                    *
-   * where fft(this) is the FFT of this instance of VB_Vector, "*"      *
-   * denotes element-by-element multiplication of the 2 VB_Vector's,    *
-   * and conjuagte() is the complex comjugate of a VB_Vector.           *
+   * The power spectrum is fft(this) * conjugate(fft(this)), where      *
+   * fft(this) is the (scaled) FFT of this instance of VB_Vector. It's  *
+   * computed straight from the halfcomplex transform in the plan's     *
+   * scratch buffer, without unpacking it first.                        *
    *********************************************************************/
-  for (unsigned long i = 0; i < this->theVector->size; i++) {
-    result[i] = (realPart[i] * realPart[i]) + (imagPart[i] * imagPart[i]);
-  }  // for i
+  fftplan *plan = fftplans.get(n, false);
+  if (!plan) {
+    VB_Vector::createException("Unable to allocate gsl_fft_real_wavetable.",
+                               __LINE__, __FILE__, __FUNCTION__);
+  }  // if
+  double *buf = &plan->buf[0];
+  memcpy(buf, this->theVector->data, n * sizeof(double));
+  int status = plan->transform(buf);
+  if (status) {
+    VB_Vector::createException(string(gsl_strerror(status) + string(".")),
+                               __LINE__, __FILE__, __FUNCTION__);
+  }  // if
+  const double oneOverSize = 1.0 / n;
+  const size_t half = n / 2;
+  const bool even = ((half * 2) == n);
+  double *ps = result.theVector->data;
+  ps[0] = buf[0] * buf[0];
+  for (size_t k = 1; k <= half; k++) {
+    if (k == half && even)
+      ps[k] = buf[n - 1] * buf[n - 1];
+    else
+      ps[k] = buf[2 * k - 1] * buf[2 * k - 1] + buf[2 * k] * buf[2 * k];
+  }  // for k
+  for (size_t k = 0; k <= half; k++) ps[k] *= oneOverSize * oneOverSize;
+  for (size_t k = half + 1; k < n; k++) ps[k] = ps[n - k];
 
 }  // void VB_Vector::getPS(VB_Vector &result) const
 
@@ -5245,34 +5156,13 @@ void VB_Vector::complexIFFTReal(const VB_Vector &real, const VB_Vector &imag,
   }  // if
 
   /*********************************************************************
-   * realIFFTreal and realIFFTimag will hold the real and imaginary     *
-   * parts of the inverse FFT of real, respectively.                    *
+   * The real part of the inverse FFT of (real + i * imag) only depends *
+   * on the hermitian part of the input, so one halfcomplex backward    *
+   * transform does it, rather than two complex ones.                   *
    *********************************************************************/
-  VB_Vector realIFFTreal(real.getLength());
-  VB_Vector realIFFTimag(real.getLength());
-
-  /*********************************************************************
-   * imagIFFTreal and imagIFFTimag will hold the real and imaginary     *
-   * parts of the inverse FFT of imag, respectively.                    *
-   *********************************************************************/
-  VB_Vector imagIFFTreal(real.getLength());
-  VB_Vector imagIFFTimag(real.getLength());
-
-  /*********************************************************************
-   * Getting the inverse FFT of real.                                   *
-   *********************************************************************/
-  real.ifft(realIFFTreal, realIFFTimag);
-
-  /*********************************************************************
-   * Getting the inverse FFT of imag.                                   *
-   *********************************************************************/
-  imag.ifft(imagIFFTreal, imagIFFTimag);
-
-  /*********************************************************************
-   * Now realIFFT will hold the real part of the inverse FFT of         *
-   * (real + i * imag).                                                 *
-   *********************************************************************/
-  realIFFT = realIFFTreal - imagIFFTimag;
+  VB_Vector::ifftRealBatch(real.theVector->data, imag.theVector->data,
+                           real.theVector->size, 1, realIFFT.theVector->data,
+                           vb_fft_full);
 
 }  // void VB_Vector::complexIFFTReal(const VB_Vector& real,
    // const VB_Vector& imag, VB_Vector& realIFFT) throw (GenericExcep)
@@ -63,6 +63,7 @@
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include "vbio.h"
 
@@ -75,6 +76,21 @@
  *********************************************************************/
 using namespace std;
 
+/*********************************************************************
+ * Layouts for the batched FFTs. vb_fft_full is n real and n          *
+ * imaginary values per series, as from fft(). vb_fft_r2c is just the *
+ * n/2+1 non-redundant values, as in FFTW's real-to-complex           *
+ * transforms. vb_fft_halfcomplex is GSL's packed layout, n values    *
+ * per series, all in the "real" array.                               *
+ *********************************************************************/
+enum vb_fftlayout { vb_fft_full, vb_fft_r2c, vb_fft_halfcomplex };
+
+/*********************************************************************
+ * Base class for the elementwise expression templates defined after *
+ * VB_Vector.                                                         *
+ *********************************************************************/
+class vbv_expr {};
+
 class VB_Vector {
  private:
   /*********************************************************************
@@ -125,6 +141,27 @@ class VB_Vector {
    *********************************************************************/
 
   void init(const size_t length);
+
+  /*********************************************************************
+   * allocVector() allocates a zeroed gsl_vector of the given length    *
+   * whose block has room for at least cap elements. The vector owns    *
+   * its block, so gsl_vector_free() still does the right thing.        *
+   *********************************************************************/
+  static gsl_vector* allocVector(const size_t length, size_t cap);
+
+  /*********************************************************************
+   * Evaluates an elementwise expression (see below) into              *
+   * this->theVector, which must already be the right length.           *
+   *********************************************************************/
+  template <class E>
+  void evaluate(const E& expr);
+
+  /*********************************************************************
+   * Takes the data type, file format, file name, and header of V, the  *
+   * way a copy would. Used for the result of an expression, which      *
+   * gets them from its leftmost operand.                               *
+   *********************************************************************/
+  void copyMetadata(const VB_Vector& V);
   void init(const bool validFlag, const VB_datatype dType, const VBFF fType);
   void init(const bool validFlag, const VB_datatype dType,
             const string signature);
@@ -183,6 +220,7 @@ class VB_Vector {
   VB_Vector(const gsl_vector* V2);                     // QQ tested
   VB_Vector(const gsl_vector& V2);                     // QQ tested
   VB_Vector(const VB_Vector& V2);              // Copy constructor. // QQ tested
+  VB_Vector(VB_Vector&& V2);                   // Move constructor.
   VB_Vector(const VB_Vector* V);               // QQ tested
   VB_Vector(const string& vecFile);            // QQ tested
   VB_Vector(const char* vecFile);              // QQ tested
@@ -192,6 +230,10 @@ class VB_Vector {
   //  VB_Vector(const Vec& theVector);
   VB_Vector(const bitmask& bm);
   VB_Vector(const Tes& theTes, const unsigned long tSeriesIndex);
+  template <class E>
+  VB_Vector(const E& expr,
+            typename std::enable_if<std::is_base_of<vbv_expr, E>::value>::type* =
+                0);
   ~VB_Vector();  // QQ tested
 
   void clear();
@@ -352,10 +394,10 @@ class VB_Vector {
   }  // inline size_t VB_Vector::getMinElementIndex() const
 
   /*********************************************************************
-   * Overloaded "+" operator, implements ordinary vector addition.      *
+   * Overloaded "+" operator, implements ordinary vector addition. The  *
+   * VB_Vector + VB_Vector case is an expression template, below.       *
    *********************************************************************/
   VB_Vector operator+(const VB_Vector* V2) const;   // QQ tested
-  VB_Vector operator+(const VB_Vector& V2) const;   // QQ tested
   VB_Vector operator+(const gsl_vector& V2) const;  // QQ tested
   VB_Vector operator+(const gsl_vector* V2) const;  // QQ tested
 
@@ -378,10 +420,10 @@ class VB_Vector {
                              const VB_Vector* V2);  // QQ tested
 
   /*********************************************************************
-   * Overloaded "-" operator.                                           *
+   * Overloaded "-" operator. The VB_Vector - VB_Vector case is an      *
+   * expression template, below.                                        *
    *********************************************************************/
   VB_Vector operator-(const VB_Vector* V2) const;   // QQ tested
-  VB_Vector operator-(const VB_Vector& V2) const;   // QQ tested
   VB_Vector operator-(const gsl_vector& V2) const;  // QQ tested
   VB_Vector operator-(const gsl_vector* V2) const;  // QQ tested
 
@@ -412,14 +454,6 @@ class VB_Vector {
   friend double operator*(const gsl_vector& V1,
                           const VB_Vector* V2);  // QQ tested
 
-  /*********************************************************************
-   * Overloaded "*" operators that do scaling. A friend function is     *
-   * used to preserve commutativity.                                    *
-   *********************************************************************/
-  VB_Vector operator*(const double alpha) const;  // QQ tested
-  friend VB_Vector operator*(const double alpha,
-                             const VB_Vector& V);  // QQ tested
-
   /*********************************************************************
    * Overloaded "[]" and "()" operators. The overloaded "()" operator   *
    * does range checking, whereas the overloaded "[]" operator does not.*
@@ -471,6 +505,11 @@ class VB_Vector {
    *       a = b = c;                                                   *
    *********************************************************************/
   const VB_Vector& operator=(const VB_Vector& V2);  // QQ tested
+  const VB_Vector& operator=(VB_Vector&& V2);
+  template <class E>
+  typename std::enable_if<std::is_base_of<vbv_expr, E>::value,
+                          const VB_Vector&>::type
+  operator=(const E& expr);
   const VB_Vector& zero();
 
   /*********************************************************************
@@ -514,6 +553,14 @@ class VB_Vector {
   VB_Vector& operator-=(const gsl_vector& V);  // QQ tested
   VB_Vector& operator*=(const gsl_vector& V);  // QQ tested
   VB_Vector& operator/=(const gsl_vector& V);  // QQ tested
+  template <class E>
+  typename std::enable_if<std::is_base_of<vbv_expr, E>::value,
+                          VB_Vector&>::type
+  operator+=(const E& expr);
+  template <class E>
+  typename std::enable_if<std::is_base_of<vbv_expr, E>::value,
+                          VB_Vector&>::type
+  operator-=(const E& expr);
 
   /*********************************************************************
    * Inline methods to access and mutate this->fileName.                *
@@ -548,6 +595,14 @@ class VB_Vector {
    *********************************************************************/
   void resize(size_t newLength);  // QQ tested
 
+  /*********************************************************************
+   * reserve() makes room for at least n elements without changing the  *
+   * length, so that concatenate() and resize() can grow the vector up  *
+   * to capacity() without reallocating.                                *
+   *********************************************************************/
+  void reserve(size_t n);
+  size_t capacity() const;
+
   /*********************************************************************
    * Methods to read a VoxBo vector file.                               *
    *********************************************************************/
@@ -744,6 +799,17 @@ class VB_Vector {
   static void complexIFFTReal(const VB_Vector& real, const VB_Vector& imag,
                               VB_Vector& realIFFT);
 
+  /*********************************************************************
+   * Batched FFTs of count equal-length series stored end to end.       *
+   * Plans are cached per thread, keyed by length and direction.        *
+   *********************************************************************/
+  static void fftBatch(const double* in, size_t n, size_t count,
+                       double* realPart, double* imagPart,
+                       vb_fftlayout layout = vb_fft_full);
+  static void ifftRealBatch(const double* realPart, const double* imagPart,
+                            size_t n, size_t count, double* out,
+                            vb_fftlayout layout = vb_fft_full);
+
   double* begin() const;
   double* end() const;
 
@@ -760,6 +826,212 @@ class VB_Vector {
   }
 };  // class VB_Vector
 
+/*********************************************************************
+ * Expression templates for elementwise arithmetic. Something like    *
+ * a*s + b - c builds a small tree of the classes below, which isn't  *
+ * evaluated until it's assigned to (or used to construct) a          *
+ * VB_Vector. At that point it runs as a single loop, with no         *
+ * temporary vectors. The leaves are just views of their vectors'     *
+ * gsl_vector data, so the operands have to outlive the expression,   *
+ * which they always do unless the expression itself is stored.       *
+ *********************************************************************/
+class vbv_leaf : public vbv_expr {
+ public:
+  vbv_leaf(const VB_Vector& V) : src(&V) {
+    data = (V.theVector ? V.theVector->data : NULL);
+    stride = (V.theVector ? V.theVector->stride : 1);
+    n = V.size();
+  }
+  inline double operator[](const size_t i) const { return data[i * stride]; }
+  inline size_t size() const { return n; }
+  // the leftmost vector in the expression
+  inline const VB_Vector& source() const { return *src; }
+
+ private:
+  const VB_Vector* src;
+  const double* data;
+  size_t stride, n;
+};
+
+/*********************************************************************
+ * How an operand is held inside an expression: vectors by a leaf,    *
+ * sub-expressions by value.                                          *
+ *********************************************************************/
+template <class T>
+struct vbv_term {
+  typedef T type;
+};
+template <>
+struct vbv_term<VB_Vector> {
+  typedef vbv_leaf type;
+};
+
+/*********************************************************************
+ * True for anything that can be an operand of an expression.         *
+ *********************************************************************/
+template <class T>
+struct vbv_operand {
+  static const bool value =
+      std::is_base_of<vbv_expr, T>::value || std::is_same<T, VB_Vector>::value;
+};
+
+/*********************************************************************
+ * Reports mismatched operand lengths the same way the GSL-based      *
+ * operators always have, i.e., through the GSL error handler.        *
+ *********************************************************************/
+void vbv_lengtherror(const size_t len1, const size_t len2);
+
+struct vbv_add {
+  static inline double apply(double a, double b) { return a + b; }
+};
+struct vbv_sub {
+  static inline double apply(double a, double b) { return a - b; }
+};
+
+template <class A, class B, class Op>
+class vbv_binary : public vbv_expr {
+ public:
+  vbv_binary(const A& aa, const B& bb) : a(aa), b(bb) {
+    n = a.size();
+    if (b.size() != n) {
+      vbv_lengtherror(n, b.size());
+      n = min(n, b.size());
+    }
+  }
+  inline double operator[](const size_t i) const {
+    return Op::apply(a[i], b[i]);
+  }
+  inline size_t size() const { return n; }
+  inline const VB_Vector& source() const { return a.source(); }
+
+ private:
+  typename vbv_term<A>::type a;
+  typename vbv_term<B>::type b;
+  size_t n;
+};
+
+template <class A>
+class vbv_scaled : public vbv_expr {
+ public:
+  vbv_scaled(const A& aa, const double ss) : a(aa), s(ss) {}
+  inline double operator[](const size_t i) const { return a[i] * s; }
+  inline size_t size() const { return a.size(); }
+  inline const VB_Vector& source() const { return a.source(); }
+
+ private:
+  typename vbv_term<A>::type a;
+  double s;
+};
+
+template <class A, class B>
+inline typename std::enable_if<vbv_operand<A>::value && vbv_operand<B>::value,
+                               vbv_binary<A, B, vbv_add> >::type
+operator+(const A& a, const B& b) {
+  return vbv_binary<A, B, vbv_add>(a, b);
+}
+
+template <class A, class B>
+inline typename std::enable_if<vbv_operand<A>::value && vbv_operand<B>::value,
+                               vbv_binary<A, B, vbv_sub> >::type
+operator-(const A& a, const B& b) {
+  return vbv_binary<A, B, vbv_sub>(a, b);
+}
+
+template <class A>
+inline typename std::enable_if<vbv_operand<A>::value, vbv_scaled<A> >::type
+operator*(const A& a, const double s) {
+  return vbv_scaled<A>(a, s);
+}
+
+template <class A>
+inline typename std::enable_if<vbv_operand<A>::value, vbv_scaled<A> >::type
+operator*(const double s, const A& a) {
+  return vbv_scaled<A>(a, s);
+}
+
+/*********************************************************************
+ * The Euclidean inner product, when at least one side is an          *
+ * expression (VB_Vector * VB_Vector is still the member operator).   *
+ *********************************************************************/
+template <class A, class B>
+inline typename std::enable_if<
+    vbv_operand<A>::value && vbv_operand<B>::value &&
+        !(std::is_same<A, VB_Vector>::value &&
+          std::is_same<B, VB_Vector>::value),
+    double>::type
+operator*(const A& a, const B& b) {
+  typename vbv_term<A>::type aa(a);
+  typename vbv_term<B>::type bb(b);
+  size_t n = aa.size();
+  if (bb.size() != n) {
+    vbv_lengtherror(n, bb.size());
+    n = min(n, bb.size());
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++) sum += aa[i] * bb[i];
+  return sum;
+}
+
+template <class E>
+void VB_Vector::evaluate(const E& expr) {
+  double* dest = this->theVector->data;
+  size_t n = expr.size(), stride = this->theVector->stride;
+  if (stride == 1)
+    for (size_t i = 0; i < n; i++) dest[i] = expr[i];
+  else
+    for (size_t i = 0; i < n; i++) dest[i * stride] = expr[i];
+}
+
+template <class E>
+VB_Vector::VB_Vector(
+    const E& expr,
+    typename std::enable_if<std::is_base_of<vbv_expr, E>::value>::type*) {
+  this->init(false, vb_double, "ref1");
+  this->theVector = NULL;
+  this->copyMetadata(expr.source());
+  this->init(expr.size());
+  if (this->theVector) this->evaluate(expr);
+}
+
+/*********************************************************************
+ * Every element of an expression depends only on the same element of *
+ * its operands, so it's safe to evaluate in place even when this     *
+ * vector is one of the operands. If the length changes, though, the  *
+ * expression has to be evaluated into a new vector first. Either     *
+ * way, the metadata comes from the leftmost operand, as it did when  *
+ * a = b + c assigned a copy of b.                                    *
+ *********************************************************************/
+template <class E>
+typename std::enable_if<std::is_base_of<vbv_expr, E>::value,
+                        const VB_Vector&>::type
+VB_Vector::operator=(const E& expr) {
+  if (expr.size() == 0) {
+    this->clear();
+    return *this;
+  }
+  if (this->getLength() != expr.size()) {
+    VB_Vector tmp(expr);
+    *this = std::move(tmp);
+  } else
+    this->evaluate(expr);
+  this->copyMetadata(expr.source());
+  return *this;
+}
+
+template <class E>
+typename std::enable_if<std::is_base_of<vbv_expr, E>::value, VB_Vector&>::type
+VB_Vector::operator+=(const E& expr) {
+  *this = *this + expr;
+  return *this;
+}
+
+template <class E>
+typename std::enable_if<std::is_base_of<vbv_expr, E>::value, VB_Vector&>::type
+VB_Vector::operator-=(const E& expr) {
+  *this = *this - expr;
+  return *this;
+}
+
 // DYK: nonmember functions
 
 double ttest(const VB_Vector& v1, const VB_Vector& v2);
@@ -93,63 +93,27 @@ unsigned char *convertbuffer2(T1 *from, int n) {
   return (unsigned char *)to;
 }
 
+namespace {
+
+class convertkernel {
+ public:
+  convertkernel(unsigned char *pp, int nn) : ptr(pp), n(nn), out(NULL) {}
+  template <class T1, class T2>
+  void run() {
+    out = convertbuffer2<T1, T2>((T1 *)ptr, n);
+  }
+  unsigned char *ptr;
+  int n;
+  unsigned char *out;
+};
+
+}  // namespace
+
 unsigned char *convert_buffer(unsigned char *ptr, int n, VB_datatype oldtype,
                               VB_datatype newtype) {
-  if (oldtype == vb_byte && newtype == vb_byte)
-    return convertbuffer2<unsigned char, unsigned char>(ptr, n);
-  if (oldtype == vb_byte && newtype == vb_short)
-    return convertbuffer2<unsigned char, int16>(ptr, n);
-  if (oldtype == vb_byte && newtype == vb_long)
-    return convertbuffer2<unsigned char, int32>(ptr, n);
-  if (oldtype == vb_byte && newtype == vb_float)
-    return convertbuffer2<unsigned char, float>(ptr, n);
-  if (oldtype == vb_byte && newtype == vb_double)
-    return convertbuffer2<unsigned char, double>(ptr, n);
-
-  if (oldtype == vb_short && newtype == vb_byte)
-    return convertbuffer2<int16, unsigned char>((int16 *)ptr, n);
-  if (oldtype == vb_short && newtype == vb_short)
-    return convertbuffer2<int16, int16>((int16 *)ptr, n);
-  if (oldtype == vb_short && newtype == vb_long)
-    return convertbuffer2<int16, int32>((int16 *)ptr, n);
-  if (oldtype == vb_short && newtype == vb_float)
-    return convertbuffer2<int16, float>((int16 *)ptr, n);
-  if (oldtype == vb_short && newtype == vb_double)
-    return convertbuffer2<int16, double>((int16 *)ptr, n);
-
-  if (oldtype == vb_long && newtype == vb_byte)
-    return convertbuffer2<int32, unsigned char>((int32 *)ptr, n);
-  if (oldtype == vb_long && newtype == vb_short)
-    return convertbuffer2<int32, int16>((int32 *)ptr, n);
-  if (oldtype == vb_long && newtype == vb_long)
-    return convertbuffer2<int32, int32>((int32 *)ptr, n);
-  if (oldtype == vb_long && newtype == vb_float)
-    return convertbuffer2<int32, float>((int32 *)ptr, n);
-  if (oldtype == vb_long && newtype == vb_double)
-    return convertbuffer2<int32, double>((int32 *)ptr, n);
-
-  if (oldtype == vb_float && newtype == vb_byte)
-    return convertbuffer2<float, unsigned char>((float *)ptr, n);
-  if (oldtype == vb_float && newtype == vb_short)
-    return convertbuffer2<float, int16>((float *)ptr, n);
-  if (oldtype == vb_float && newtype == vb_long)
-    return convertbuffer2<float, int32>((float *)ptr, n);
-  if (oldtype == vb_float && newtype == vb_float)
-    return convertbuffer2<float, float>((float *)ptr, n);
-  if (oldtype == vb_float && newtype == vb_double)
-    return convertbuffer2<float, double>((float *)ptr, n);
-
-  if (oldtype == vb_double && newtype == vb_byte)
-    return convertbuffer2<double, unsigned char>((double *)ptr, n);
-  if (oldtype == vb_double && newtype == vb_short)
-    return convertbuffer2<double, int16>((double *)ptr, n);
-  if (oldtype == vb_double && newtype == vb_long)
-    return convertbuffer2<double, int32>((double *)ptr, n);
-  if (oldtype == vb_double && newtype == vb_float)
-    return convertbuffer2<double, float>((double *)ptr, n);
-  if (oldtype == vb_double && newtype == vb_double)
-    return convertbuffer2<double, double>((double *)ptr, n);
-  return NULL;
+  convertkernel kernel(ptr, n);
+  vbdispatch(oldtype, newtype, kernel);
+  return kernel.out;
 }
 
 VBImage::~VBImage() {}
@@ -898,7 +862,7 @@ void VBImage::addMaskSpec(int index, int r, int g, int b, string name) {
   maskspecs[index] = ms;
 }
 
-bool VBImage::dimsequal(const VBImage &im) {
+bool VBImage::dimsequal(const VBImage &im) const {
   if (dimx != im.dimx) return 0;
   if (dimy != im.dimy) return 0;
   if (dimz != im.dimz) return 0;
@@ -43,6 +43,7 @@ using namespace std;
 #include <unistd.h>
 #include <algorithm>
 #include <iostream>
+#include <limits>
 #include <string>
 #include <vector>
 #include "vbutil.h"
@@ -211,6 +212,84 @@ unsigned char *convert_buffer(unsigned char *ptr, int n, VB_datatype oldtype,
 template <class T1, class T2>
 unsigned char *convertbuffer2(T1 *from, int n);
 
+// vbdispatch() works out the C++ type for a datatype once, and then
+// calls the kernel's templated run() for that type.  whole-volume
+// operations use it so that the inner loop is over a plain typed
+// buffer, instead of switching on the datatype for every voxel.  the
+// two-type version is for operations that involve two images (or a
+// buffer conversion), and calls run<T1,T2>().
+
+template <class F>
+inline void vbdispatch(VB_datatype dt, F &kernel) {
+  switch (dt) {
+    case vb_byte:
+      kernel.template run<unsigned char>();
+      break;
+    case vb_short:
+      kernel.template run<int16>();
+      break;
+    case vb_long:
+      kernel.template run<int32>();
+      break;
+    case vb_float:
+      kernel.template run<float>();
+      break;
+    case vb_double:
+      kernel.template run<double>();
+      break;
+  }
+}
+
+template <class T1, class F>
+inline void vbdispatch_second(VB_datatype dt2, F &kernel) {
+  switch (dt2) {
+    case vb_byte:
+      kernel.template run<T1, unsigned char>();
+      break;
+    case vb_short:
+      kernel.template run<T1, int16>();
+      break;
+    case vb_long:
+      kernel.template run<T1, int32>();
+      break;
+    case vb_float:
+      kernel.template run<T1, float>();
+      break;
+    case vb_double:
+      kernel.template run<T1, double>();
+      break;
+  }
+}
+
+template <class F>
+inline void vbdispatch(VB_datatype dt1, VB_datatype dt2, F &kernel) {
+  switch (dt1) {
+    case vb_byte:
+      vbdispatch_second<unsigned char>(dt2, kernel);
+      break;
+    case vb_short:
+      vbdispatch_second<int16>(dt2, kernel);
+      break;
+    case vb_long:
+      vbdispatch_second<int32>(dt2, kernel);
+      break;
+    case vb_float:
+      vbdispatch_second<float>(dt2, kernel);
+      break;
+    case vb_double:
+      vbdispatch_second<double>(dt2, kernel);
+      break;
+  }
+}
+
+// vbconvert() stores a double the way SetValue() always has, rounding
+// for the integer types
+template <class T>
+inline T vbconvert(double val) {
+  if (numeric_limits<T>::is_integer) return (T)round(val);
+  return (T)val;
+}
+
 // built-in file formats
 
 extern "C" {
@@ -300,7 +379,7 @@ class VBImage {
   int inbounds(int x, int y, int z) const;
   void SetOrigin(float x, float y, float z);
   void setVoxSizes(float x, float y, float z, float t);
-  bool dimsequal(const VBImage &im);
+  bool dimsequal(const VBImage &im) const;
 
   int voxelposition(int x, int y, int z) const;
   void getXYZ(int32 &x, int32 &y, int32 &z, const uint32 point) const;
@@ -592,6 +671,49 @@ double voxeldistance(uint32 x1, uint32 y1, uint32 z1, uint32 x2, uint32 y2,
                      uint32 z2);
 int poscomp(VBVoxel &v1, VBVoxel &v2);
 
+// VBMaxTree is a component tree of a cube's voxels: each node is a
+// connected (26-neighbor) set of voxels above some level, and its
+// parent is the component it merges into at the next lower level.
+// it's built once, and then the clusters above any threshold that
+// are at least a given size can be pulled out without a flood fill.
+// sign is 1 for the positive values, -1 for the negative ones, and 0
+// for absolute values.  only voxels that are nonzero in that sense
+// are in the tree, so thresholds have to be non-negative.  the caller
+// supplies a key that changes whenever the cube's contents do, so
+// that checking whether the tree is still good doesn't mean looking
+// at the data.
+
+class VBMaxTree {
+ public:
+  VBMaxTree();
+  int build(Cube &cb, int sign, uint64 key);
+  bool matches(uint64 key, int sign) const;  // built for this key?
+  int mark(double thresh, uint32 minsize, Cube &out) const;
+  uint32 countclusters(double thresh, uint32 minsize) const;
+  void clear();
+
+ private:
+  int sign;
+  uint64 key;
+  bool f_built;
+  int32 dimx, dimy, dimz;
+  // positions below are into vox, which is sorted by decreasing level
+  vector<uint32> vox;     // voxel index
+  vector<double> level;   // voxel value, with sign applied
+  vector<int32> parent;   // own position for roots
+  vector<uint32> area;    // voxels in the subtree, for canonical nodes
+  vector<uint32> start;   // subtree's first entry in order
+  vector<uint32> order;   // voxels with each subtree contiguous
+  vector<uint32> nodes;   // canonical nodes, by decreasing level
+  bool above(uint32 p, double thresh) const {
+    return level[p] - thresh >= DBL_MIN;
+  }
+  bool clustertop(uint32 n, double thresh) const {
+    return above(n, thresh) &&
+           (parent[n] == (int32)n || !above(parent[n], thresh));
+  }
+};
+
 class Tes : public VBImage {
  public:
   // constructors
@@ -687,6 +809,148 @@ VBMatrix getRegionComponents(vector<string> &teslist, VBRegion &rr,
                              uint32 flags);
 VBRegion restrictRegion(vector<string> &teslist, VBRegion &rr);
 
+// VBRegionTS pulls the time series for any number of regions out of a
+// list of 4D files, reading each file only once, or out of a Tes
+// that's already in memory.  the flags (MEANSCALE, DETREND) apply to
+// each voxel's time series within each run, as in getTS().
+// extractMeans() fills in one column per region, extractSeries() one
+// matrix per region with a column per voxel (e.g., for pca()).
+// matrices that are already the right size are filled in place.  when
+// there are only a few voxels in all, each one is read with
+// ReadTimeSeries() instead of reading whole runs.
+
+class VBRegionTS {
+ public:
+  int addRegion(VBRegion &rr);
+  int addRegions(vector<VBRegion> &rlist);
+  uint32 regionCount() const { return regions.size(); }
+  void clear() { regions.clear(); }
+  int extractMeans(vector<string> &teslist, uint32 flags, VBMatrix &means,
+                   int nthreads = 0);
+  int extractMeans(Tes &ts, uint32 flags, VBMatrix &means, int nthreads = 0);
+  int extractSeries(vector<string> &teslist, uint32 flags,
+                    vector<VBMatrix> &series, int nthreads = 0);
+  int extractSeries(Tes &ts, uint32 flags, vector<VBMatrix> &series,
+                    int nthreads = 0);
+
+ private:
+  vector<vector<VBVoxel> > regions;
+  int run(vector<string> *teslist, Tes *loaded, uint32 flags,
+          VBMatrix *means, vector<VBMatrix> *series, int nthreads);
+  int checkrun(Tes &ts, bool f_mask);
+  int seekrun(Tes &ts, uint32 row, uint32 flags, VBMatrix *means,
+              vector<VBMatrix> *series);
+  void store(uint32 r, uint32 j, uint32 row, VB_Vector &vv, uint32 flags,
+             VB_Vector &sum, vector<VBMatrix> *series);
+  void runworker(Tes &ts, uint32 row, uint32 flags, VBMatrix *means,
+                 vector<VBMatrix> *series, int thread, int nthreads);
+};
+
+// VBTesStream copies volumes out of one or more 4D files into a new
+// one without ever loading a whole dataset.  everything that can be
+// checked is checked from the headers, and then the data are moved a
+// slab of voxels at a time (for tes1 output) or a range of volumes at
+// a time (for nifti), using about bufsize bytes.  addVolume() lists
+// the output volumes in order.  for a merge, the inputs all have the
+// same dimensions and each voxel comes from the last input that has
+// data there, as with Tes::MergeTes().  output() is the header that
+// will be written, initially a copy of the first input's.  to use the
+// data without writing a file, call startRead() and then readSeries()
+// for each slab of voxels, in order.
+
+class VBTesStream {
+ public:
+  VBTesStream();
+  ~VBTesStream();
+  int addInput(const string &fname);
+  int addVolume(uint32 input, uint32 t);
+  int addVolumes(uint32 input);
+  void setMerge(bool merge) { f_merge = merge; }
+  uint32 inputCount() const { return inputs.size(); }
+  uint32 volumeCount() const { return volumes.size(); }
+  Tes &output() { return hdr; }
+  int write(const string &fname);
+  int startRead();
+  int readSeries(uint32 v0, uint32 v1, unsigned char *buf);
+  bool hasData(uint32 v) const { return v < owner.size() && owner[v] >= 0; }
+  size_t bufsize;
+
+ private:
+  class input {
+   public:
+    string filename;
+    string signature;
+    int32 dimt;
+    long offset;
+    VB_byteorder filebyteorder;
+    vector<unsigned char> mask;  // only for formats that store one
+    gzFile fp;
+    uint32 nextvox;  // next voxel a tes1 read will get to
+  };
+  vector<input> inputs;
+  vector<pair<uint32, uint32> > volumes;  // input and volume
+  Tes hdr;
+  bool f_merge;
+  vector<vector<uint32> > tlists;    // volumes needed from each input
+  vector<uint32> srcindex;           // position in its input's tlist
+  vector<vector<uint32> > outlists;  // output volumes from each input
+  vector<int32> owner;               // last input with data, per voxel
+  vector<unsigned char> scratch;     // one input's block, for readSeries()
+  int plan(bool f_needmask);
+  int writetes1(const string &fname);
+  int writevolumes(const string &fname);
+  int readblock(uint32 ind, uint32 v0, uint32 v1, const vector<uint32> &tl,
+                unsigned char *buf);
+  void closeinputs();
+};
+
+string tes1_headerstring(Tes &ts);
+
+// VBQAStats does the per-run qa numbers in one pass over the data:
+// the global signal (as calcgs), the grand mean power spectrum (as
+// calcps), the snr map (as SNRMap()), and vbqa's spike and low-value
+// checks on the global signal.  a file is streamed through a
+// VBTesStream a slab at a time, and each slab is split up among
+// nthreads threads (0 for all the cores).
+
+class VBQAStats {
+ public:
+  VBQAStats();
+  void clear();
+  int run(const string &fname, int nthreads = 0);
+  int run(Tes &ts, int nthreads = 0);
+  int writeSummary(const string &fname);
+  size_t bufsize;     // for streaming, as in VBTesStream
+  double spikesd;     // spikes are this many sd from the mean gs
+  double lowthresh;   // low values are gs values below this
+  string filename;    // what we ran on
+  uint32 nvoxels;     // voxels with data
+  VB_Vector gs;       // mean of the de-meaned series
+  VB_Vector ps;       // mean of their power spectra
+  Cube snr;           // same values as SNRMap()
+  double gsmean, gssd, meansnr;
+  vector<int> spikes, lowvals;
+
+ private:
+  // each thread's running sums
+  class accum {
+   public:
+    vector<double> gs, ps;
+    double snrsum;
+    uint32 count;
+  };
+  vector<accum> parts;
+  VB_datatype datatype;
+  int dimt;
+  bool f_scaled;  // raw file data, still needs scl_slope/scl_inter
+  double slope, inter;
+  int start(Tes &hdr, int nthreads);
+  void runslab(const vector<const unsigned char *> &series, uint32 v0);
+  void slabworker(const vector<const unsigned char *> &series, uint32 v0,
+                  int thread);
+  int finish();
+};
+
 class VBMatrix {
  public:
   vector<string> header;
@@ -756,7 +1020,7 @@ class VBMatrix {
 
   // new operators
   int set(uint32 r, uint32 c, double val);
-  double operator()(uint32 r, uint32 c);
+  double operator()(uint32 r, uint32 c) const;
   // operator bool() const;
   bool valid();
   VBMatrix &operator=(const VBMatrix &mat);
@@ -184,50 +184,50 @@ int VBSequence::LoadSequence(string sdir, int jobnum) {
   return (0);  // no error!
 }
 
-int VBSequence::ParseSeqLine(string line) {
+int VBSequence::ParseSeqLine(const string &line) {
   // FIXME for some of these fields, in principle we would need to
   // update the jobs as well.  for now, not a problem since this is
   // only called either when loading a whole sequences (jobs loaded
   // later) or in the server (only non-sensitive fields affected)
-  tokenlist args;
+  tokenview args;
   args.ParseLine(line);
   if (args.size() < 2)  // everything requires an argument
     return 1;
-  else if (args[0] == "name")
+  else if (args.is(0, "name"))
     name = args.Tail();
-  else if (args[0] == "source")
+  else if (args.is(0, "source"))
     source = args.Tail();
-  else if (args[0] == "email")
+  else if (args.is(0, "email"))
     email = args[1];
-  else if (args[0] == "seqnum")
-    seqnum = strtol(args[1]);
-  else if (args[0] == "uid")
-    uid = strtol(args[1]);
+  else if (args.is(0, "seqnum"))
+    seqnum = args.num(1);
+  else if (args.is(0, "uid"))
+    uid = args.num(1);
   // FIXME make sure the following new items work!
-  else if (args[0] == "require") {
+  else if (args.is(0, "require")) {
     if (args.size() > 2)
-      requires[args[1]] = strtol(args[2]);
+      requires[args[1]] = args.num(2);
     else
       requires[args[1]] = 0;
-  } else if (args[0] == "priority")
-    priority.priority = strtol(args[1]);
-  else if (args[0] == "maxjobs")
-    priority.maxjobs = strtol(args[1]);
-  else if (args[0] == "maxperhost")
-    priority.maxperhost = strtol(args[1]);
-  else if (args[0] == "priority2")
-    priority.priority2 = strtol(args[1]);
-  else if (args[0] == "maxjobs2")
-    priority.maxjobs2 = strtol(args[1]);
-  else if (args[0] == "forcedhost")
+  } else if (args.is(0, "priority"))
+    priority.priority = args.num(1);
+  else if (args.is(0, "maxjobs"))
+    priority.maxjobs = args.num(1);
+  else if (args.is(0, "maxperhost"))
+    priority.maxperhost = args.num(1);
+  else if (args.is(0, "priority2"))
+    priority.priority2 = args.num(1);
+  else if (args.is(0, "maxjobs2"))
+    priority.maxjobs2 = args.num(1);
+  else if (args.is(0, "forcedhost"))
     forcedhosts.insert(args[1]);
-  else if (args[0] == "owner") {
+  else if (args.is(0, "owner")) {
     owner = args[1];
     if (!email[0]) email = owner;
-  } else if (args[0] == "queuedtime")
-    queuedtime = strtol(args[1]);
-  else if (args[0] == "status")
-    status = args[1][0];
+  } else if (args.is(0, "queuedtime"))
+    queuedtime = args.num(1);
+  else if (args.is(0, "status"))
+    status = *args.ptr(1);
   return 0;
 }
 
@@ -531,61 +531,60 @@ int VBJobSpec::ReadFile(string fname) {
   jnum = strtol(xfilename(fname));
 
   char line[STRINGLEN];
-  while (fgets(line, STRINGLEN, fp) != NULL) ParseJSLine((string)line);
+  while (fgets(line, STRINGLEN, fp) != NULL) ParseJSLine(line);
 
   fclose(fp);
   return 0;
 }
 
-void VBJobSpec::ParseJSLine(string str) {
-  str = xstripwhitespace(str);
-  if (str[0] == '#' || str[0] == '%' || str[0] == ';') return;
-  tokenlist args;
+void VBJobSpec::ParseJSLine(const string &str) {
+  tokenview args;
   args.SetQuoteChars("");
   args.ParseLine(str);
   if (args.size() == 0)  // skip blank lines
     return;
+  if (strchr("#%;", *args.ptr(0))) return;
   // the following lets us ignore empty arguments
-  if (args.size() < 2 && args[0] != "argument") return;
-  if (args[0] == "name")
+  if (args.size() < 2 && !args.is(0, "argument")) return;
+  if (args.is(0, "name"))
     name = args.Tail();
-  else if (args[0] == "jnum")
-    jnum = strtol(args[1]);
-  else if (args[0] == "argument") {
-    tokenlist aa;
+  else if (args.is(0, "jnum"))
+    jnum = args.num(1);
+  else if (args.is(0, "argument")) {
+    tokenview aa;
     // aa.SetSeparator("=");
-    aa.ParseLine(args.Tail());
+    aa.ParseLine(args.ptr(1));
     arguments[aa[0]] = aa.Tail();
-  } else if (args[0] == "dirname")
+  } else if (args.is(0, "dirname"))
     dirname = args[1];
-  else if (args[0] == "jobtype")
+  else if (args.is(0, "jobtype"))
     jobtype = args[1];
-  else if (args[0] == "status") {
-    status = args[1][0];
-  } else if (args[0] == "waitfor") {
+  else if (args.is(0, "status")) {
+    status = *args.ptr(1);
+  } else if (args.is(0, "waitfor")) {
     for (size_t k = 1; k < args.size(); k++) {
       vector<int> tmpl = numberlist(args[k]);
       for (int l = 0; l < (int)tmpl.size(); l++) waitfor.insert(tmpl[l]);
     }
-  } else if (args[0] == "startedtime")
-    startedtime = strtol(args[1]);
-  else if (args[0] == "finishedtime")
-    finishedtime = strtol(args[1]);
-  else if (args[0] == "serverstartedtime")
-    serverstartedtime = strtol(args[1]);
-  else if (args[0] == "serverfinishedtime")
-    serverfinishedtime = strtol(args[1]);
-  else if (args[0] == "pid")
-    pid = strtol(args[1]);
-  else if (args[0] == "childpid")
-    childpid = strtol(args[1]);
-  else if (args[0] == "percentdone")
-    percentdone = strtol(args[1]);
-  else if (args[0] == "host")
+  } else if (args.is(0, "startedtime"))
+    startedtime = args.num(1);
+  else if (args.is(0, "finishedtime"))
+    finishedtime = args.num(1);
+  else if (args.is(0, "serverstartedtime"))
+    serverstartedtime = args.num(1);
+  else if (args.is(0, "serverfinishedtime"))
+    serverfinishedtime = args.num(1);
+  else if (args.is(0, "pid"))
+    pid = args.num(1);
+  else if (args.is(0, "childpid"))
+    childpid = args.num(1);
+  else if (args.is(0, "percentdone"))
+    percentdone = args.num(1);
+  else if (args.is(0, "host"))
     hostname = args[1];
-  else if (args[0] == "magnitude")
-    magnitude = strtol(args[1]);
-  else if (args[0] == "logdir")
+  else if (args.is(0, "magnitude"))
+    magnitude = args.num(1);
+  else if (args.is(0, "logdir"))
     logdir = args[1];
 }
 
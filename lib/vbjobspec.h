@@ -169,7 +169,7 @@ class VBJobSpec {
   void init();
   int Write(string fname);
   int ReadFile(string fname);
-  void ParseJSLine(string str);
+  void ParseJSLine(const string &str);
   void SetState(JobState s);
   JobState GetState();
   void print();
@@ -218,7 +218,7 @@ class VBSequence {
   int renumber(int firstjnum);
   void init();
   int ParseSummary(string str);  // FIXME unused???
-  int ParseSeqLine(string line);
+  int ParseSeqLine(const string &line);
   string GetSummary();  // FIXME unused???
   void updatecounts();
   void print();
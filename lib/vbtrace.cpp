@@ -0,0 +1,133 @@
+// vbtrace.cpp
+// cheap timers and counters for seeing where a process's time goes
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include "vbtrace.h"
+
+namespace {
+
+class timerstat {
+ public:
+  timerstat() : calls(0), total(0), longest(0) {}
+  uint64 calls, total, longest;  // times in usecs
+};
+
+const char *countnames[vbt_ncounters] = {"opens", "bytesread", "gzseeks",
+                                         "voxels"};
+
+// everything below is set up before vbtrace_on, so that it's still
+// around when the atexit() handler runs
+
+boost::mutex tracelock;
+map<const char *, timerstat> timers;
+uint64 counters[vbt_ncounters];
+struct timeval starttime;
+
+uint64 usecs(const struct timeval &tv) {
+  return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+string progname() {
+#ifdef LINUX
+  return program_invocation_short_name;
+#else
+  return "unknown";
+#endif
+}
+
+// the summary is tab-separated, one process to a block.  a timer that
+// shows up in more than one place (the same name in two files) is
+// merged.  wall time much bigger than user plus sys time means we were
+// waiting on something, usually the disk.
+
+void dumpatexit() {
+  struct timeval now;
+  struct rusage ru;
+  gettimeofday(&now, NULL);
+  getrusage(RUSAGE_SELF, &ru);
+  map<string, timerstat> merged;
+  {
+    boost::mutex::scoped_lock lk(tracelock);
+    for (map<const char *, timerstat>::iterator tt = timers.begin();
+         tt != timers.end(); tt++) {
+      timerstat &ts = merged[tt->first];
+      ts.calls += tt->second.calls;
+      ts.total += tt->second.total;
+      ts.longest = max(ts.longest, tt->second.longest);
+    }
+  }
+  FILE *fp = stderr;
+  char *fname = getenv("VB_TRACEFILE");
+  if (fname && !(fp = fopen(fname, "a"))) fp = stderr;
+  if (fp != stderr && fseek(fp, 0, SEEK_END) == 0 && ftell(fp) == 0)
+    fprintf(fp, ";VB98\n;TXT1\n");
+  char hname[STRINGLEN];
+  if (gethostname(hname, STRINGLEN - 1)) strcpy(hname, "nohost");
+  hname[STRINGLEN - 1] = '\0';
+  fprintf(fp, ";\n; vbtrace: %s (pid %d) on %s, %s\n", progname().c_str(),
+          (int)getpid(), hname, timedate().c_str());
+  fprintf(fp, "process\twall\t%.3f\tuser\t%.3f\tsys\t%.3f\n",
+          (usecs(now) - usecs(starttime)) / 1e6, usecs(ru.ru_utime) / 1e6,
+          usecs(ru.ru_stime) / 1e6);
+  for (int i = 0; i < vbt_ncounters; i++)
+    fprintf(fp, "counter\t%s\t%llu\n", countnames[i],
+            (unsigned long long)counters[i]);
+  for (map<string, timerstat>::iterator tt = merged.begin();
+       tt != merged.end(); tt++)
+    fprintf(fp, "timer\t%s\tcalls\t%llu\ttotal\t%.3f\tmax\t%.3f\n",
+            tt->first.c_str(), (unsigned long long)tt->second.calls,
+            tt->second.total / 1e6, tt->second.longest / 1e6);
+  if (fp != stderr) fclose(fp);
+}
+
+bool traceinit() {
+  if (!getenv("VB_TRACE")) return 0;
+  gettimeofday(&starttime, NULL);
+  atexit(dumpatexit);
+  return 1;
+}
+
+}  // namespace
+
+bool vbtrace_on = traceinit();
+
+void vbtrace_add(int counter, uint64 n) {
+  __sync_fetch_and_add(&counters[counter], n);
+}
+
+void vbtrace_time(const char *name, const struct timeval &start) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  uint64 t = usecs(now) - usecs(start);
+  boost::mutex::scoped_lock lk(tracelock);
+  timerstat &ts = timers[name];
+  ts.calls++;
+  ts.total += t;
+  if (t > ts.longest) ts.longest = t;
+}
@@ -0,0 +1,87 @@
+// vbtrace.h
+// cheap timers and counters for seeing where a process's time goes
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+#ifndef VBTRACE_H
+#define VBTRACE_H
+
+#include <sys/time.h>
+#include "vbutil.h"
+
+// tracing is off unless VB_TRACE is set in the environment, in which
+// case a timer or a counter costs a test of vbtrace_on and nothing
+// else.  when it's on, the process appends a summary of its timers,
+// counters, and cpu time to $VB_TRACEFILE (or stderr) when it exits.
+// vbx sets VB_TRACEFILE for each job, so the summary ends up next to
+// the job's log, and voxq -trace will show it.
+
+enum { vbt_opens, vbt_bytesread, vbt_gzseeks, vbt_voxels, vbt_ncounters };
+
+extern bool vbtrace_on;
+
+// these do the work, and should only be called if vbtrace_on
+void vbtrace_add(int counter, uint64 n);
+void vbtrace_time(const char *name, const struct timeval &start);
+
+inline void vbtrace_count(int counter, uint64 n = 1) {
+  if (vbtrace_on) vbtrace_add(counter, n);
+}
+
+// a VBTraceTimer charges the time until it goes out of scope to the
+// named timer.  the name must be a string constant.
+
+class VBTraceTimer {
+ public:
+  VBTraceTimer(const char *nm) {
+    name = nm;
+    if (vbtrace_on) gettimeofday(&start, NULL);
+  }
+  ~VBTraceTimer() {
+    if (vbtrace_on) vbtrace_time(name, start);
+  }
+
+ private:
+  const char *name;
+  struct timeval start;
+};
+
+// counted versions of the zlib calls the image readers use
+
+inline gzFile vbt_gzopen(const char *path, const char *mode) {
+  vbtrace_count(vbt_opens);
+  return gzopen(path, mode);
+}
+
+inline int vbt_gzread(gzFile fp, voidp buf, unsigned len) {
+  int cnt = gzread(fp, buf, len);
+  if (cnt > 0) vbtrace_count(vbt_bytesread, cnt);
+  return cnt;
+}
+
+inline z_off_t vbt_gzseek(gzFile fp, z_off_t offset, int whence) {
+  vbtrace_count(vbt_gzseeks);
+  return gzseek(fp, offset, whence);
+}
+
+#endif  // VBTRACE_H
@@ -1194,11 +1194,228 @@ bool operator<(const bitmask &a, const bitmask &b) {
   return 0;
 }
 
+// zwriter compresses fixed-size blocks on a pool of threads and
+// writes each one out, in order, as a complete gzip member (rfc 1952
+// allows any number of them in a file, and gzread() reads straight
+// through).  full blocks go on a queue, and the caller only stops to
+// write out finished blocks, or to wait if it's gotten more than
+// maxqueue blocks ahead of the compressors.  the threads aren't
+// started until the first block fills, so small files are just
+// compressed inline.
+
+class zwriter {
+ public:
+  zwriter(FILE *f, int lev, int nthreads);
+  ~zwriter();
+  size_t write(const void *ptr, size_t bytes);
+  bool zeros(size_t bytes);
+  bool finish();
+  off_t tell() const { return pos; }
+
+ private:
+  class zblock {
+   public:
+    zblock() : state(0), ok(1) {}
+    vector<unsigned char> in, out;
+    int state;  // 0 waiting, 1 compressing, 2 done
+    bool ok;
+  };
+  enum { blocksize = 1024 * 1024 };
+  FILE *fp;
+  int level, nthreads;
+  size_t maxqueue;
+  off_t pos;
+  bool ok, f_done;
+  uint32 members;
+  zblock *cur;
+  deque<zblock *> queue;
+  boost::mutex lock;
+  boost::condition_variable ready, finished;
+  boost::thread_group workers;
+  void submit();
+  void writeblock(zblock *b);
+  void worker();
+  static bool compress(zblock &b, int level);
+};
+
+zwriter::zwriter(FILE *f, int lev, int nt) {
+  fp = f;
+  level = lev;
+  nthreads = nt;
+  maxqueue = 2 * nthreads;
+  pos = 0;
+  ok = 1;
+  f_done = 0;
+  members = 0;
+  cur = NULL;
+}
+
+// only used when a write is abandoned, so we don't care what's still
+// on the queue
+
+zwriter::~zwriter() {
+  {
+    boost::mutex::scoped_lock lk(lock);
+    f_done = 1;
+    vbforeach(zblock * b, queue) if (b->state == 0) b->state = 2;
+    ready.notify_all();
+  }
+  workers.join_all();
+  vbforeach(zblock * b, queue) delete b;
+  if (cur) delete cur;
+}
+
+size_t zwriter::write(const void *ptr, size_t bytes) {
+  const unsigned char *p = (const unsigned char *)ptr;
+  size_t left = bytes;
+  while (left && ok) {
+    if (!cur) {
+      cur = new zblock;
+      cur->in.reserve(blocksize);
+    }
+    size_t n = min(left, blocksize - cur->in.size());
+    cur->in.insert(cur->in.end(), p, p + n);
+    p += n;
+    left -= n;
+    pos += n;
+    if (cur->in.size() == blocksize) submit();
+  }
+  return (ok ? bytes : 0);
+}
+
+bool zwriter::zeros(size_t bytes) {
+  static const unsigned char zbuf[4096] = {0};
+  while (bytes && ok) {
+    size_t n = min(bytes, sizeof(zbuf));
+    write(zbuf, n);
+    bytes -= n;
+  }
+  return ok;
+}
+
+void zwriter::submit() {
+  zblock *b = cur;
+  cur = NULL;
+  boost::mutex::scoped_lock lk(lock);
+  if (workers.size() == 0)
+    for (int i = 0; i < nthreads; i++)
+      workers.create_thread(boost::bind(&zwriter::worker, this));
+  queue.push_back(b);
+  ready.notify_one();
+  // only this thread ever pops the queue, so it's safe to write
+  // without the lock
+  while (queue.size() &&
+         (queue.front()->state == 2 || queue.size() > maxqueue)) {
+    while (queue.front()->state != 2) finished.wait(lk);
+    zblock *f = queue.front();
+    queue.pop_front();
+    lk.unlock();
+    writeblock(f);
+    lk.lock();
+  }
+}
+
+void zwriter::writeblock(zblock *b) {
+  if (!b->ok)
+    ok = 0;
+  else if (ok && fwrite(&b->out[0], 1, b->out.size(), fp) != b->out.size())
+    ok = 0;
+  members++;
+  delete b;
+}
+
+void zwriter::worker() {
+  boost::mutex::scoped_lock lk(lock);
+  while (1) {
+    zblock *b = NULL;
+    for (size_t i = 0; i < queue.size() && !b; i++)
+      if (queue[i]->state == 0) b = queue[i];
+    if (!b) {
+      if (f_done) return;
+      ready.wait(lk);
+      continue;
+    }
+    b->state = 1;
+    lk.unlock();
+    bool res = compress(*b, level);
+    lk.lock();
+    b->ok = res;
+    b->state = 2;
+    finished.notify_all();
+  }
+}
+
+// windowbits of 15+16 gets us a gzip header and trailer
+
+bool zwriter::compress(zblock &b, int level) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK)
+    return 0;
+  b.out.resize(deflateBound(&zs, b.in.size()));
+  zs.next_in = (b.in.size() ? &b.in[0] : Z_NULL);
+  zs.avail_in = b.in.size();
+  zs.next_out = &b.out[0];
+  zs.avail_out = b.out.size();
+  int err = deflate(&zs, Z_FINISH);
+  b.out.resize(b.out.size() - zs.avail_out);
+  deflateEnd(&zs);
+  vector<unsigned char>().swap(b.in);
+  return (err == Z_STREAM_END);
+}
+
+// flush everything, including an empty member if there's no data at
+// all, so that we always write a valid gzip file
+
+bool zwriter::finish() {
+  if (!cur && members == 0 && queue.empty()) cur = new zblock;
+  if (workers.size() == 0) {
+    if (cur) {
+      cur->ok = compress(*cur, level);
+      writeblock(cur);
+      cur = NULL;
+    }
+    return ok;
+  }
+  if (cur) submit();
+  boost::mutex::scoped_lock lk(lock);
+  f_done = 1;
+  ready.notify_all();
+  while (queue.size()) {
+    while (queue.front()->state != 2) finished.wait(lk);
+    zblock *f = queue.front();
+    queue.pop_front();
+    lk.unlock();
+    writeblock(f);
+    lk.lock();
+  }
+  lk.unlock();
+  workers.join_all();
+  return ok;
+}
+
 // zfile
 
+// number of threads for compressing .gz output.  VB_ZTHREADS sets it
+// (1 or less to compress inline), otherwise it's the number of cores,
+// up to 4, so that a host full of jobs each writing a .gz file isn't
+// buried in compressor threads.  vbx sets VB_ZTHREADS to 1 for
+// scheduled jobs unless the jobtype says otherwise.
+
+int32 zthreads() {
+  const int32 maxzthreads = 4;
+  if (getenv("VB_ZTHREADS")) {
+    pair<bool, int32> n = strtolx(getenv("VB_ZTHREADS"));
+    if (!n.first) return n.second;
+  }
+  return min(ncores(), maxzthreads);
+}
+
 zfile::zfile() {
   fp = NULL;
   zfp = NULL;
+  zw = NULL;
   zflag = 0;
 }
 
@@ -1210,7 +1427,17 @@ bool zfile::open(string fname, const char *mode, int8 compressed) {
     else
       compressed = 0;
   }
-  if (compressed) {
+  int nthreads = zthreads();
+  if (compressed && mode[0] == 'w' && nthreads > 1) {
+    // gzopen()-style level, e.g., "w9"
+    int level = Z_DEFAULT_COMPRESSION;
+    for (const char *m = mode; *m; m++)
+      if (isdigit(*m)) level = *m - '0';
+    fp = fopen(fname.c_str(), "wb");
+    zflag = 1;
+    if (fp) zw = new zwriter(fp, level, nthreads);
+    return (bool)fp;
+  } else if (compressed) {
     zfp = gzopen(fname.c_str(), mode);
     zflag = 1;
     return (bool)zfp;
@@ -1222,38 +1449,60 @@ bool zfile::open(string fname, const char *mode, int8 compressed) {
 }
 
 size_t zfile::write(const void *ptr, size_t bytes) {
-  if (zflag)
+  if (zw)
+    return zw->write(ptr, bytes);
+  else if (zflag)
     return gzwrite(zfp, ptr, bytes);
   else
     return fwrite(ptr, 1, bytes, fp);
 }
 
 int zfile::seek(off_t offset, int whence) {
-  if (zflag)
+  if (zw) {
+    off_t target = (whence == SEEK_CUR ? zw->tell() + offset : offset);
+    if (whence == SEEK_END || target < zw->tell()) return -1;
+    if (!zw->zeros(target - zw->tell())) return -1;
+    return target;
+  } else if (zflag)
     return gzseek(zfp, offset, whence);
   else
     return fseek(fp, offset, whence);
 }
 
 off_t zfile::tell() {
-  if (zflag)
+  if (zw)
+    return zw->tell();
+  else if (zflag)
     return gztell(zfp);
   else
     return ftell(fp);
 }
 
-void zfile::close() {
-  if (zflag) {
-    gzclose(zfp);
+bool zfile::close() {
+  bool ok = 1;
+  if (zw) {
+    ok = zw->finish();
+    delete zw;
+    zw = NULL;
+    if (fclose(fp)) ok = 0;
+    fp = NULL;
+  } else if (zflag) {
+    if (gzclose(zfp) != Z_OK) ok = 0;
     zfp = NULL;
   } else {
-    fclose(fp);
+    if (fclose(fp)) ok = 0;
     fp = NULL;
   }
+  return ok;
 }
 
 void zfile::close_and_unlink() {
-  if (zflag) {
+  if (zw) {
+    delete zw;
+    zw = NULL;
+    fclose(fp);
+    fp = NULL;
+  } else if (zflag) {
     gzclose(zfp);
     zfp = NULL;
   } else {
@@ -1264,7 +1513,9 @@ void zfile::close_and_unlink() {
   filename = "";
 }
 
-zfile::operator bool() const { return ((zflag && zfp) || (!zflag && fp)); }
+zfile::operator bool() const {
+  return ((zw && fp) || (zflag && zfp) || (!zflag && fp));
+}
 
 // vglob
 
@@ -165,6 +165,16 @@ bool operator<(const bitmask &a, const bitmask &b);
 // consistent API.  zlib makes this easy for reading, but not writing.
 // zfile is also nice because we could eventually add bzip2 or other
 // compression algorithms.
+//
+// when zthreads() is more than 1, a compressed file opened for
+// writing is handled by a zwriter (see vbutil.cpp), which compresses
+// blocks on a pool of threads while the caller goes on computing.  the
+// result is a multi-member gzip file, which zlib reads like any other.
+// write() copies the data, so the caller can reuse its buffer right
+// away.  because compression finishes late, check close() for errors.
+// seeks must be forward, as with gzseek().
+
+class zwriter;
 
 class zfile {
  public:
@@ -173,7 +183,7 @@ class zfile {
   size_t write(const void *ptr, size_t bytes);
   int seek(off_t offset, int whence);
   off_t tell();
-  void close();
+  bool close();
   void close_and_unlink();
   operator bool() const;
 
@@ -182,6 +192,7 @@ class zfile {
   bool zflag;
   FILE *fp;
   gzFile zfp;
+  zwriter *zw;
 };
 
 // vglob abstracts glob a little
@@ -289,6 +300,7 @@ void unlockfile(FILE *fp, int pos = 0, int len = 1);
 FILE *lockfiledir(char *fname);
 void unlockfiledir(FILE *fp);
 int32 ncores();
+int32 zthreads();
 bool equali(const string &a, const string &b);
 bool dancmp(const char *a, const char *b);
 string vb_toupper(const string &str);
@@ -369,6 +381,8 @@ int safe_connect(struct sockaddr_in *addr, float secs);
 int safe_connect(struct sockaddr *addr, float secs);
 int send_file(int s, string fname);
 int receive_file(int s, string fname, int filesize);
+int send_frames(int sock, const vector<string> &msgs, float secs);
+int recv_frames(int sock, vector<string> &msgs, float secs);
 
 // convenience class for mapping two integer values onto something
 class twovals {
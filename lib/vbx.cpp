@@ -40,6 +40,7 @@ using namespace std;
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -58,6 +59,9 @@ void parse_status(VBJobSpec &js, int status);  // FIXME used?
 void do_internal(VBJobSpec &js);
 vector<string> build_script(VBJobSpec &js, int ind);
 void exec_command(VBJobSpec &js, vector<string> script, int ind);
+int tell_scheduler_socket(string qdir, string batch,
+                          const vector<string> &msgs);
+void tell_scheduler_file(string qdir, string root, string buf);
 void signal_handler(int signal);
 
 int killme = 0;
@@ -215,6 +219,23 @@ void run_command(VBJobSpec &js, int ind) {
     putenv(tmp);
   }
 
+  // the scheduler already fills each host with jobs, so a job's .gz
+  // output is compressed on its own thread unless the jobtype or
+  // environment asks for more
+  setenv("VB_ZTHREADS", "1", 0);
+
+  // if the job is to be traced (VB_TRACE in the environment), each
+  // process's summary goes next to the job's log
+  if (getenv("VB_TRACE") && !getenv("VB_TRACEFILE")) {
+    string tracefile;
+    if (js.logdir.size())
+      tracefile = js.logdir + "/" + js.basename() + ".trace";
+    else if (js.f_cluster)
+      tracefile = js.queuedir + "/" + js.seqdirname() + "/" + js.basename() +
+                  ".trace";
+    if (tracefile.size()) setenv("VB_TRACEFILE", tracefile.c_str(), 1);
+  }
+
   // run the job
 
   fprintf(stderr, "job \"%s\" (%s), type %s\n", js.name.c_str(),
@@ -536,16 +557,76 @@ void exec_command(VBJobSpec &js, vector<string> script, int ind) {
 // return/status of the child.  we check that just to detect those
 // kinds of crashes.  otherwise we should have recq
 
+// tell_scheduler() gets status messages to the scheduler.  if we're
+// on the scheduler's host, they go as one batch over its event
+// socket.  otherwise (or if the scheduler doesn't ack the batch) each
+// one is dropped into the queue directory as a .vbx file, which the
+// scheduler picks up on its next pass.  either way, message i of a
+// batch ends up in the file named by scheduler_msgname(), so the
+// scheduler can tell if it has seen it before.
+
 void tell_scheduler(string qdir, string hostname, string buf) {
+  vector<string> msgs;
+  msgs.push_back(buf);
+  tell_scheduler(qdir, hostname, msgs);
+}
+
+void tell_scheduler(string qdir, string hostname, const vector<string> &msgs) {
+  // the time keeps batch names from coming around again when pids do
+  string batch = uniquename(hostname + "_" + strnum(time(NULL)));
+  if (tell_scheduler_socket(qdir, batch, msgs) == 0) return;
+  for (size_t i = 0; i < msgs.size(); i++)
+    tell_scheduler_file(qdir, scheduler_msgname(batch, i), msgs[i]);
+}
+
+string scheduler_eventsocket(string qdir) { return qdir + "/vbevents"; }
+
+string scheduler_msgname(const string &batch, size_t ind) {
+  return (format("%s_%03d") % batch % ind).str();
+}
+
+// the batch goes out as its id followed by the messages.  the
+// scheduler only acks once it has saved the whole batch, so no ack
+// means we have to save it ourselves.  multi-line messages (email)
+// always go as files, because the scheduler reads the message body
+// back out of the file.
+
+int tell_scheduler_socket(string qdir, string batch,
+                          const vector<string> &msgs) {
+  struct sockaddr_un addr;
+  string sname = scheduler_eventsocket(qdir);
+  if (sname.size() >= sizeof(addr.sun_path)) return 101;
+  for (size_t i = 0; i < msgs.size(); i++)
+    if (msgs[i].find('\n') != string::npos) return 102;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_LOCAL;
+  strcpy(addr.sun_path, sname.c_str());
+  int s = safe_connect(&addr, 2.0);
+  if (s < 0) return 103;
+  vector<string> frames;
+  frames.push_back("batch " + batch);
+  frames.insert(frames.end(), msgs.begin(), msgs.end());
+  if (send_frames(s, frames, 5.0)) {
+    close(s);
+    return 104;
+  }
+  char buf[STRINGLEN];
+  int len = safe_recv(s, buf, STRINGLEN, 10.0);
+  close(s);
+  if (len < 1 || (string)buf != "ACK") return 105;
+  return 0;
+}
+
+// if the scheduler saved the file after all and just didn't get its
+// ack to us, it's already there (or already handled, which the
+// scheduler checks for)
+
+void tell_scheduler_file(string qdir, string root, string buf) {
   chdir_nocheck(qdir.c_str());
-  string root = uniquename(hostname);
   string name1 = root + ".vbtmp";
   string name2 = root + ".vbx";
-  struct stat st1, st2;
-  if (!(stat(name1.c_str(), &st1)) | !(stat(name2.c_str(), &st2))) {
-    fprintf(stderr, "*** serious error, duplicate msg file name\n");
-    return;
-  }
+  struct stat st;
+  if (!stat(name2.c_str(), &st)) return;
   FILE *fp = fopen(name1.c_str(), "w");
   if (fp) {
     int err = fwrite(buf.c_str(), 1, buf.size(), fp);
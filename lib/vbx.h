@@ -43,3 +43,6 @@ int runseq(VBPrefs &vbp, VBSequence &seq, uint32 njobs);
 set<int32> readyjobs(VBSequence &seq, uint16 max);
 int run_voxbo_job(VBPrefs &vbp, VBJobSpec &js);
 void tell_scheduler(string qdir, string hostname, string buf);
+void tell_scheduler(string qdir, string hostname, const vector<string> &msgs);
+string scheduler_eventsocket(string qdir);
+string scheduler_msgname(const string &batch, size_t ind);
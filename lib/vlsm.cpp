@@ -0,0 +1,367 @@
+// vlsm.cpp
+// unique-pattern engine for voxel-based lesion-symptom mapping
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <math.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include "stats.h"
+#include "vbutil.h"
+
+namespace {
+
+// set the bit for each lesioned subject in a voxel's time series.
+// values are truncated to integers first, as the per-voxel code always
+// did, so a fractional value below 1 counts as spared.
+template <class T>
+void packvoxel(const unsigned char *ts, uint32 n, uint64 *words,
+               bool &non1) {
+  const T *vals = (const T *)ts;
+  for (uint32 i = 0; i < n; i++) {
+    double val = trunc((double)vals[i]);
+    if (!val) continue;
+    words[i / 64] |= (uint64)1 << (i % 64);
+    if (val != 1) non1 = 1;
+  }
+}
+
+uint64 hashwords(const uint64 *words, uint32 nwords) {
+  uint64 h = 0x9e3779b97f4a7c15ULL;
+  for (uint32 i = 0; i < nwords; i++) {
+    h ^= words[i];
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+  }
+  return h;
+}
+
+}  // namespace
+
+VLSMEngine::VLSMEngine() {
+  f_welchs = f_flip = f_z = f_non1 = f_allvoxels = 0;
+  dimx = dimy = dimz = 0;
+  nsubjects = nwords = 0;
+  ssum = sqsum = 0.0;
+}
+
+// setLesions() packs each in-mask voxel's lesion pattern into bits and
+// looks it up in an open-addressing table of the patterns seen so far.
+// unless f_allvoxels is set, voxels with fewer than minlesions lesioned
+// or fewer than 2 spared subjects are left out, as in vbtmap.
+
+int VLSMEngine::setLesions(const Tes &lesions, const Cube &mask,
+                           int minlesions) {
+  if (!lesions.data || lesions.dimt < 1) return 101;
+  if (mask.data && (mask.dimx != lesions.dimx || mask.dimy != lesions.dimy ||
+                    mask.dimz != lesions.dimz))
+    return 102;
+  if (minlesions < 2) minlesions = 2;
+  dimx = lesions.dimx;
+  dimy = lesions.dimy;
+  dimz = lesions.dimz;
+  nsubjects = lesions.dimt;
+  f_non1 = 0;
+  voxelpos.clear();
+  voxelpattern.clear();
+  lcount.clear();
+  complement.clear();
+  moffset.clear();
+  members.clear();
+  scores.clear();
+  scores2.clear();
+
+  nwords = (nsubjects + 63) / 64;
+  words.clear();
+  vector<uint64> cur(nwords);
+  vector<uint32> table(1024, 0);  // pattern+1, 0 for empty
+  uint32 tmask = table.size() - 1;
+  uint32 nvox = dimx * dimy * dimz;
+  for (uint32 v = 0; v < nvox; v++) {
+    if (!lesions.data[v] && !f_allvoxels) continue;
+    if (mask.data && !mask.testValue(v)) continue;
+    fill(cur.begin(), cur.end(), 0);
+    // a voxel with no data is all zeros, so it's spared everywhere
+    const unsigned char *ts = lesions.data[v];
+    if (ts) {
+      switch (lesions.datatype) {
+        case vb_byte:
+          packvoxel<unsigned char>(ts, nsubjects, &cur[0], f_non1);
+          break;
+        case vb_short:
+          packvoxel<int16>(ts, nsubjects, &cur[0], f_non1);
+          break;
+        case vb_long:
+          packvoxel<int32>(ts, nsubjects, &cur[0], f_non1);
+          break;
+        case vb_float:
+          packvoxel<float>(ts, nsubjects, &cur[0], f_non1);
+          break;
+        case vb_double:
+          packvoxel<double>(ts, nsubjects, &cur[0], f_non1);
+          break;
+      }
+    }
+    int32 cnt = 0;
+    for (uint32 w = 0; w < nwords; w++) cnt += __builtin_popcountll(cur[w]);
+    if (!f_allvoxels && (cnt < minlesions || (int32)nsubjects - cnt < 2))
+      continue;
+    uint32 slot = hashwords(&cur[0], nwords) & tmask;
+    while (table[slot]) {
+      uint32 p = table[slot] - 1;
+      if (!memcmp(&words[p * nwords], &cur[0], nwords * sizeof(uint64)))
+        break;
+      slot = (slot + 1) & tmask;
+    }
+    if (!table[slot]) {
+      // new pattern, store it with its smaller group
+      uint32 p = lcount.size();
+      words.insert(words.end(), cur.begin(), cur.end());
+      lcount.push_back(cnt);
+      bool comp = (cnt > (int32)nsubjects / 2);
+      complement.push_back(comp);
+      moffset.push_back(members.size());
+      for (uint32 s = 0; s < nsubjects; s++) {
+        bool lesioned = (cur[s / 64] >> (s % 64)) & 1;
+        if (lesioned != comp) members.push_back(s);
+      }
+      table[slot] = p + 1;
+      // keep the table at most half full
+      if (lcount.size() * 2 > table.size()) {
+        table.assign(table.size() * 2, 0);
+        tmask = table.size() - 1;
+        for (uint32 q = 0; q < lcount.size(); q++) {
+          uint32 ss = hashwords(&words[q * nwords], nwords) & tmask;
+          while (table[ss]) ss = (ss + 1) & tmask;
+          table[ss] = q + 1;
+        }
+      }
+      voxelpattern.push_back(p);
+    } else
+      voxelpattern.push_back(table[slot] - 1);
+    voxelpos.push_back(v);
+  }
+  moffset.push_back(members.size());
+  return 0;
+}
+
+// tables() counts each pattern's 2x2 table against a binary variable
+// with a popcount of the packed words.  the table is set by the
+// pattern's lesion count and how many of those subjects are in the
+// group, so patterns with the same table share one test.
+
+int VLSMEngine::tables(const bitmask &group, bool f_fisher, bool f_yates,
+                       vector<x2val> &res) const {
+  if (nsubjects == 0) return 101;
+  if (group.size() != nsubjects) return 102;
+  vector<uint64> gw(nwords, 0);
+  int32 gcount = 0;
+  for (uint32 s = 0; s < nsubjects; s++) {
+    if (!group[s]) continue;
+    gw[s / 64] |= (uint64)1 << (s % 64);
+    gcount++;
+  }
+  res.resize(lcount.size());
+  map<pair<int32, int32>, x2val> memo;
+  map<pair<int32, int32>, x2val>::iterator iter;
+  for (uint32 p = 0; p < lcount.size(); p++) {
+    const uint64 *pw = &words[p * nwords];
+    int32 a = 0;
+    for (uint32 w = 0; w < nwords; w++)
+      a += __builtin_popcountll(pw[w] & gw[w]);
+    pair<int32, int32> key(lcount[p], a);
+    iter = memo.find(key);
+    if (iter != memo.end()) {
+      res[p] = iter->second;
+      continue;
+    }
+    int32 b = lcount[p] - a, c = gcount - a;
+    int32 d = nsubjects - a - b - c;
+    if (f_fisher)
+      res[p] = calc_fisher(a, b, c, d);
+    else
+      res[p] = calc_chisquared(a, b, c, d, f_yates);
+    memo[key] = res[p];
+  }
+  return 0;
+}
+
+// the scores are centered, which doesn't change any of the stats but
+// keeps the sums of squares well away from cancellation
+
+int VLSMEngine::setScores(const VB_Vector &sc) {
+  if (nsubjects == 0) return 101;
+  if (sc.size() != nsubjects) return 102;
+  double mean = 0.0;
+  for (uint32 i = 0; i < nsubjects; i++) mean += sc[i];
+  mean /= nsubjects;
+  scores.resize(nsubjects);
+  scores2.resize(nsubjects);
+  ssum = sqsum = 0.0;
+  for (uint32 i = 0; i < nsubjects; i++) {
+    scores[i] = sc[i] - mean;
+    scores2[i] = scores[i] * scores[i];
+    ssum += scores[i];
+    sqsum += scores2[i];
+  }
+  return 0;
+}
+
+// patternstat() does the same arithmetic as calc_ttest() and
+// calc_welchs(), but from sums.  a zero denominator gives t=0 rather
+// than inf/nan, so that it can't win a permutation max, unless
+// f_allvoxels is set.  groups too small for a test get just what
+// calc_ttest() and calc_welchs() return for them.
+
+tval VLSMEngine::patternstat(uint32 p, const double *sc,
+                             const double *sc2) const {
+  double sm = 0.0, qm = 0.0;
+  for (uint32 i = moffset[p]; i < moffset[p + 1]; i++) {
+    sm += sc[members[i]];
+    qm += sc2[members[i]];
+  }
+  double s1 = sm, q1 = qm;
+  if (complement[p]) {
+    s1 = ssum - sm;
+    q1 = sqsum - qm;
+  }
+  double n1 = lcount[p];
+  double n2 = nsubjects - lcount[p];
+  if (n1 < 2 || n2 < 2) {
+    if (!f_welchs && (n1 == 0 || n2 == 0)) return tval();
+    return tval(0, nsubjects - 2);
+  }
+  double s2 = ssum - s1, q2 = sqsum - q1;
+  double mean1 = s1 / n1, mean2 = s2 / n2;
+  double ss1 = max(q1 - s1 * mean1, 0.0);
+  double ss2 = max(q2 - s2 * mean2, 0.0);
+  tval ret;
+  ret.diff = mean1 - mean2;
+  if (f_welchs) {
+    double v1 = ss1 / (n1 - 1) / n1, v2 = ss2 / (n2 - 1) / n2;
+    double denom = sqrt(v1 + v2);
+    ret.t = (denom > 0.0 || f_allvoxels ? ret.diff / denom : 0.0);
+    double dfdenom = v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1);
+    ret.df = (dfdenom > 0.0 || f_allvoxels ? pow(v1 + v2, 2.0) / dfdenom
+                                           : n1 + n2 - 2);
+  } else {
+    ret.df = n1 + n2 - 2;
+    ret.sd = sqrt((ss1 + ss2) / ret.df);
+    ret.stderror = ret.sd * sqrt((1.0 / n1) + (1.0 / n2));
+    ret.t = (ret.stderror > 0.0 || f_allvoxels ? ret.diff / ret.stderror
+                                               : 0.0);
+  }
+  if (f_flip) {
+    ret.t *= -1.0;
+    ret.diff *= -1.0;
+  }
+  return ret;
+}
+
+void VLSMEngine::calc(vector<tval> &res, const int32 *order) const {
+  res.resize(lcount.size());
+  if (scores.size() != nsubjects) return;
+  vector<double> sc(scores), sc2(scores2);
+  if (order) {
+    for (uint32 i = 0; i < nsubjects; i++) {
+      sc[i] = scores[order[i]];
+      sc2[i] = scores2[order[i]];
+    }
+  }
+  for (uint32 p = 0; p < lcount.size(); p++)
+    res[p] = patternstat(p, &sc[0], &sc2[0]);
+}
+
+void VLSMEngine::scatter(const vector<double> &patvals, Cube &out) const {
+  if (!out.data || out.dimx != dimx || out.dimy != dimy || out.dimz != dimz)
+    out.SetVolume(dimx, dimy, dimz, vb_float);
+  for (uint32 i = 0; i < voxelpos.size(); i++)
+    out.setValue<double>(voxelpos[i], patvals[voxelpattern[i]]);
+}
+
+// each thread takes every nthreads'th column, so that no two threads
+// write the same slot of maxes
+
+void VLSMEngine::permworker(const VBMatrix &pmat, uint32 first,
+                            uint32 count, int thread, int nthreads,
+                            vector<double> &maxes) const {
+  vector<double> sc(nsubjects), sc2(nsubjects);
+  for (uint32 c = first + thread; c < first + count; c += nthreads) {
+    for (uint32 i = 0; i < nsubjects; i++) {
+      int32 src = (int32)pmat(i, c);
+      sc[i] = scores[src];
+      sc2[i] = scores2[src];
+    }
+    double maxval = 0.0;
+    bool f_none = 1;
+    for (uint32 p = 0; p < lcount.size(); p++) {
+      tval res = patternstat(p, &sc[0], &sc2[0]);
+      // welch's df differs by pattern, so each t needs its own z
+      if (f_z && f_welchs) {
+        t_to_p_z(res);
+        res.t = res.z;
+      }
+      if (f_allvoxels && !isfinite(res.t)) continue;
+      if (f_none || res.t > maxval) maxval = res.t;
+      f_none = 0;
+    }
+    // with pooled variance df is fixed, so z is monotonic in t
+    if (f_z && !f_welchs && !f_none) {
+      tval res(maxval, nsubjects - 2);
+      t_to_p_z(res);
+      maxval = res.z;
+    }
+    maxes[c] = maxval;
+  }
+}
+
+int VLSMEngine::permute(const VBMatrix &pmat, uint32 first, uint32 count,
+                        vector<double> &maxes, int nthreads) const {
+  if (scores.size() != nsubjects || nsubjects == 0) return 101;
+  if (pmat.rows != nsubjects || first + count > pmat.cols) return 102;
+  for (uint32 c = first; c < first + count; c++) {
+    for (uint32 i = 0; i < nsubjects; i++) {
+      double src = pmat(i, c);
+      if (src < 0 || src >= nsubjects) return 103;
+    }
+  }
+  if (maxes.size() < pmat.cols) maxes.resize(pmat.cols);
+  if (nthreads < 1) nthreads = ncores();
+  if (nthreads > (int)count) nthreads = count;
+  if (nthreads < 2) {
+    permworker(pmat, first, count, 0, 1, maxes);
+    return 0;
+  }
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(boost::bind(&VLSMEngine::permworker, this,
+                                 boost::cref(pmat), first, count, t,
+                                 nthreads, boost::ref(maxes)));
+  tg.join_all();
+  return 0;
+}
@@ -26,6 +26,8 @@ using namespace std;
 
 #include <stdio.h>
 #include <string.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include "vbfilter.hlp.h"
 #include "vbio.h"
 #include "vbutil.h"
@@ -55,6 +57,33 @@ class VBFilter {
   }
 };
 
+// FilterEngine applies a frequency mask from make_filter() to all the
+// voxels of a 4D volume.  each thread takes every nthreads'th block of
+// FBLOCK voxels, copies it out as doubles, filters it, and copies it
+// back.  when only a few frequencies are removed from float data,
+// it's cheaper to project their sines and cosines out of each series
+// than to do the forward and inverse ffts.  integer data always get
+// the ffts, since the projection's last-bit differences could round a
+// .5 the other way.
+
+const size_t FBLOCK = 64;
+
+class FilterEngine {
+ public:
+  FilterEngine(const VB_Vector &fmask);
+  void run(Tes &tes, int nthreads = 0);
+
+ private:
+  void worker(Tes &tes, int thread, int nthreads);
+  void filterblock(double *block, size_t count, double *hc);
+  size_t n;
+  vector<char> keep;     // halfcomplex slots that survive the filter
+  vector<double> basis;  // orthonormal basis for removed frequencies
+  size_t nbasis;         // 0 means use the ffts
+  bool f_project;
+  vector<uint32> voxels;
+};
+
 void vbfilter_help();
 void vbfilter_version();
 void filter_tes(Tes &tes, vector<VBFilter> filterlist, double period);
@@ -178,16 +207,128 @@ int main(int argc, char *argv[]) {
 void filter_tes(Tes &tes, vector<VBFilter> filterlist, double period) {
   tes.ReadData(tes.GetFileName());
   VB_Vector fmask = make_filter(tes.dimt, period, filterlist);
-  for (int i = 0; i < tes.dimx; i++) {
-    for (int j = 0; j < tes.dimy; j++) {
-      for (int k = 0; k < tes.dimz; k++) {
-        tes.GetTimeSeries(i, j, k);
-        filter_signal(tes.timeseries, fmask);
-        for (int m = 0; m < tes.dimt; m++)
-          tes.SetValue(i, j, k, m, tes.timeseries[m]);
+  FilterEngine fe(fmask);
+  fe.run(tes);
+}
+
+FilterEngine::FilterEngine(const VB_Vector &fmask) {
+  n = fmask.size();
+  keep.assign(n, 1);
+  vector<size_t> removed;
+  for (size_t k = 1; k <= n / 2; k++) {
+    if (fmask[k] >= 0.5) continue;
+    removed.push_back(k);
+    // in the halfcomplex layout, k's real and imaginary parts are at
+    // 2k-1 and 2k, except that the nyquist term has no imaginary part
+    keep[2 * k - 1] = 0;
+    if (2 * k < n) keep[2 * k] = 0;
+  }
+  // each frequency is a cosine and a sine (just a cosine for nyquist).
+  // the ffts cost something like 5n*log2(n) and the projection 4n per
+  // basis vector.
+  nbasis = 0;
+  f_project = 0;
+  for (size_t i = 0; i < removed.size(); i++)
+    nbasis += (2 * removed[i] < n ? 2 : 1);
+  if (nbasis == 0 || nbasis > log2((double)n)) {
+    nbasis = 0;
+    return;
+  }
+  basis.reserve(nbasis * n);
+  for (size_t i = 0; i < removed.size(); i++) {
+    double w = 2.0 * M_PI * removed[i] / n;
+    bool nyquist = (2 * removed[i] == n);
+    double norm = sqrt(nyquist ? 1.0 / n : 2.0 / n);
+    for (size_t t = 0; t < n; t++) basis.push_back(norm * cos(w * t));
+    if (nyquist) continue;
+    for (size_t t = 0; t < n; t++) basis.push_back(norm * sin(w * t));
+  }
+}
+
+// moves a block of voxels between the tes and a buffer of doubles,
+// with SetValue()'s rounding on the way back
+
+class filterio {
+ public:
+  filterio(Tes &t, const uint32 *v, size_t c, double *b, bool s)
+      : tes(t), vox(v), count(c), buf(b), f_store(s) {}
+  template <class T>
+  void run() {
+    size_t n = tes.dimt;
+    for (size_t i = 0; i < count; i++) {
+      T *series = (T *)tes.data[vox[i]];
+      double *x = buf + i * n;
+      if (f_store)
+        for (size_t t = 0; t < n; t++) series[t] = vbconvert<T>(x[t]);
+      else
+        for (size_t t = 0; t < n; t++) x[t] = series[t];
+    }
+  }
+
+ private:
+  Tes &tes;
+  const uint32 *vox;
+  size_t count;
+  double *buf;
+  bool f_store;
+};
+
+void FilterEngine::run(Tes &tes, int nthreads) {
+  if (!tes.data || n == 0 || (size_t)tes.dimt != n) return;
+  f_project = nbasis && (tes.datatype == vb_float || tes.datatype == vb_double);
+  // empty voxels filter to zeros, so they can stay empty
+  voxels.clear();
+  uint32 nvox = tes.dimx * tes.dimy * tes.dimz;
+  for (uint32 v = 0; v < nvox; v++)
+    if (tes.data[v]) voxels.push_back(v);
+  size_t nblocks = (voxels.size() + FBLOCK - 1) / FBLOCK;
+  if (nthreads < 1) nthreads = ncores();
+  if (nthreads > (int)nblocks) nthreads = nblocks;
+  if (nthreads < 2) {
+    worker(tes, 0, 1);
+    return;
+  }
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(boost::bind(&FilterEngine::worker, this,
+                                 boost::ref(tes), t, nthreads));
+  tg.join_all();
+}
+
+void FilterEngine::worker(Tes &tes, int thread, int nthreads) {
+  vector<double> block(FBLOCK * n), hc(FBLOCK * n);
+  for (size_t first = thread * FBLOCK; first < voxels.size();
+       first += nthreads * FBLOCK) {
+    size_t count = min(FBLOCK, voxels.size() - first);
+    filterio in(tes, &voxels[first], count, &block[0], 0);
+    vbdispatch(tes.datatype, in);
+    filterblock(&block[0], count, &hc[0]);
+    filterio out(tes, &voxels[first], count, &block[0], 1);
+    vbdispatch(tes.datatype, out);
+  }
+}
+
+void FilterEngine::filterblock(double *block, size_t count, double *hc) {
+  if (f_project) {
+    for (size_t i = 0; i < count; i++) {
+      double *x = block + i * n;
+      for (size_t b = 0; b < nbasis; b++) {
+        const double *e = &basis[b * n];
+        double dot = 0.0;
+        for (size_t t = 0; t < n; t++) dot += x[t] * e[t];
+        for (size_t t = 0; t < n; t++) x[t] -= dot * e[t];
       }
     }
+    return;
+  }
+  // same as filter_signal(), a block at a time
+  VB_Vector::fftBatch(block, n, count, hc, NULL, vb_fft_halfcomplex);
+  for (size_t i = 0; i < count; i++) {
+    double *h = hc + i * n;
+    for (size_t j = 0; j < n; j++)
+      if (!keep[j]) h[j] = 0.0;
   }
+  VB_Vector::ifftRealBatch(hc, NULL, n, count, block, vb_fft_halfcomplex);
 }
 
 VB_Vector make_filter(int len, double period, vector<VBFilter> filterlist) {
@@ -42,6 +42,7 @@ int main(int argc, char *argv[]) {
   arghandler ah;
   string errstr;
   ah.setArgs("-o", "--outfile", 1);
+  ah.setArgs("-s", "--bufsize", 1);
   ah.setArgs("-h", "--help", 0);
   ah.setArgs("-v", "--version", 0);
   ah.parseArgs(argc, argv);
@@ -73,6 +74,37 @@ int main(int argc, char *argv[]) {
     printf("[E] vbmerge4d: requires both an input and an output file\n");
     exit(10);
   }
+  size_t bufsize = 256;
+  args = ah.getFlaggedArgs("-s");
+  if (args.size()) {
+    int32 mb = strtol(args[0]);
+    if (mb < 0) {
+      printf("[E] vbmerge4d: invalid buffer size %s\n", args[0].c_str());
+      exit(11);
+    }
+    bufsize = mb;
+  }
+  if (bufsize < 1) bufsize = 1;
+
+  // stream the merge a slab at a time if we can.  anything the stream
+  // can't handle (mismatched datatypes or scaling, output formats other
+  // than tes1 and nifti) goes through the old in-memory merge below.
+  // only a failure writing the output is fatal.
+  VBTesStream ms;
+  ms.bufsize = bufsize * 1024 * 1024;
+  ms.setMerge(1);
+  int err = 0;
+  for (size_t i = 0; i < infilelist.size(); i++)
+    if ((err = ms.addInput(infilelist[i]))) break;
+  if (!err) err = ms.write(outfile);
+  if (err == 110) {
+    printf("[E] vbmerge4d: error writing file %s\n", outfile.c_str());
+    exit(110);
+  }
+  if (!err) {
+    printf("[I] vbmerge4d: done.\n");
+    exit(0);
+  }
 
   Tes mytes;
   for (size_t i = 0; i < infilelist.size(); i++) {
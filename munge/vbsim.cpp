@@ -24,7 +24,6 @@
 
 using namespace std;
 
-#include <assert.h>
 #include "imageutils.h"
 #include "vbio.h"
 #include "vbutil.h"
@@ -46,13 +45,7 @@ class VBSim {
   string outfile;
   VB_datatype datatype;
   Tes mytes;
-  Cube mycube;
-  int AddUniform(Cube &cb, double low, double range, double sx, double sy,
-                 double sz);
-  double gaussian_random(double sigma);
-  gsl_rng *rng;
-  int AddGaussian(Cube &cb, double mu, double variance, double sx = 0.0,
-                  double sy = 0.0, double sz = 0.0);
+  VBNoiseGen noise;
 
  public:
   int Go(int argc, char **argv);
@@ -70,7 +63,6 @@ int main(int argc, char *argv[]) {
 
 int VBSim::Go(int argc, char *argv[]) {
   tokenlist args;
-  rng = NULL;
   dimx = 0;
   dimy = 0;
   dimz = 0;
@@ -133,10 +125,9 @@ int VBSim::Go(int argc, char *argv[]) {
     return 110;
   }
 
-  // initialize RNG
-  rng = gsl_rng_alloc(gsl_rng_mt19937);
-  assert(rng);
-  gsl_rng_set(rng, rngseed);
+  // every volume's noise is drawn from its own stream off this seed
+  noise.seed = rngseed;
+  noise.setGaussian(n_mean, n_variance);
 
   // FIXME tell the user here what we're doing
 
@@ -163,8 +154,10 @@ int VBSim::Go(int argc, char *argv[]) {
     VB_Vector vv(dimx);
 
     if (!(isnan(n_mean))) {
-      for (int32 i = 0; i < dimx; i++)
-        vv[i] = n_mean + gaussian_random(sqrt(abs(n_variance)));
+      vector<double> vals(dimx);
+      noise.init(dimx, 1, 1);
+      noise.draws(0, dimx, &vals[0]);
+      for (int32 i = 0; i < dimx; i++) vv[i] = vals[i];
     }
     if (vv.WriteFile(outfile)) {
       printf("[E] vbsim: error writing 1D file %s\n", outfile.c_str());
@@ -180,8 +173,10 @@ int VBSim::Go(int argc, char *argv[]) {
            dimy, dimz, n_mean, sqrt(n_variance));
     if (outfile == "") outfile = "data.cub";
     Cube vol(dimx, dimy, dimz, vb_float);
-    if (!(isnan(n_mean)))
-      AddGaussian(vol, n_mean, n_variance, n_fwhm, n_fwhm, n_fwhm);
+    if (!(isnan(n_mean))) {
+      noise.init(dimx, dimy, dimz, n_fwhm);
+      noise.volume(0, (float *)vol.data);
+    }
     vol += anat;
     vol.setVoxSizes(vx, vy, vz, vt);
     if (vol.WriteFile(outfile)) {
@@ -197,12 +192,11 @@ int VBSim::Go(int argc, char *argv[]) {
   if (outfile == "") outfile = "data.tes";
   // CREATE FUNCTIONALS (variable images, one per time point)
   mytes.SetVolume(dimx, dimy, dimz, dimt, vb_float);
-  for (int i = 0; i < dimt; i++) {
-    Cube vol(dimx, dimy, dimz, vb_float);
-    if (!(isnan(n_mean)))
-      AddGaussian(vol, n_mean, n_variance, n_fwhm, n_fwhm, n_fwhm);
-    vol += anat;
-    mytes.SetCube(i, vol);
+  if (!(isnan(n_mean))) {
+    noise.init(dimx, dimy, dimz, n_fwhm);
+    noise.fill(mytes, &anat);
+  } else {
+    for (int i = 0; i < dimt; i++) mytes.SetCube(i, anat);
   }
   mytes.setVoxSizes(vx, vy, vz, vt);
   if (mytes.WriteFile(outfile)) {
@@ -213,53 +207,4 @@ int VBSim::Go(int argc, char *argv[]) {
   return 0;
 }
 
-int VBSim::AddUniform(Cube &cb, double low, double range, double sx, double sy,
-                      double sz) {
-  Cube cb2 = cb;
-  cb2.zero();
-  double val;
-  // build random volume
-  for (int i = 0; i < cb.dimx; i++) {
-    for (int j = 0; j < cb.dimy; j++) {
-      for (int k = 0; k < cb.dimz; k++) {
-        val = VBRandom();
-        val /= (double)0xffffffff;
-        val *= range;
-        val += low;
-        cb2.SetValue(i, j, k, val);
-      }
-    }
-  }
-  // smooth if requested
-  if (sx != 0.0 || sy != 0.0 || sz != 0.0) smoothCube(cb2, sx, sy, sz, 1);
-  ;
-  cb += cb2;
-  return 0;
-}
-
-int VBSim::AddGaussian(Cube &cb, double mu, double variance, double sx,
-                       double sy, double sz) {
-  double sigma = sqrt(abs(variance));
-  Cube cb2 = cb;
-  cb2.zero();
-  double val;
-  // build random volume
-  for (int i = 0; i < cb2.dimx; i++) {
-    for (int j = 0; j < cb2.dimy; j++) {
-      for (int k = 0; k < cb2.dimz; k++) {
-        val = mu + gaussian_random(sigma);
-        cb2.SetValue(i, j, k, val);
-      }
-    }
-  }
-  // smooth if requested
-  if (sx != 0.0 || sy != 0.0 || sz != 0.0) smoothCube(cb2, sx, sy, sz, 1);
-  cb += cb2;
-  return 0;
-}
-
-double VBSim::gaussian_random(double sigma) {
-  return gsl_ran_gaussian(rng, sigma);
-}
-
 void vbsim_help() { cout << boost::format(myhelp) % vbversion; }
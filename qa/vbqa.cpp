@@ -571,7 +571,7 @@ void VBQA::ExamineTesFiles(vector<string> dirlist) {
   for (i = 0; i < vg.size(); i++) {
     Tes mytes;
     vector<string> mysteps;
-    mytes.ReadFile(vg[i]);  // FIXME should be readheader probably
+    mytes.ReadHeader(vg[i]);
     // make a list of all the characteristics of mytes, start with
     // some basic header info
     sprintf(tmp, "dim(%d,%d,%d)", mytes.dimx, mytes.dimy, mytes.dimz);
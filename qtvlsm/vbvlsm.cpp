@@ -122,6 +122,7 @@ class VSetup : public QObject {
   void run_regression();
   int do_regression_volume(int permindex);
   int do_ttest_volume(int permindex);
+  int do_ttest_patterns();
   int do_regression_single(int permindex);
   int do_ttest_single(int permindex);
   // stat config and data
@@ -722,6 +723,13 @@ void VSetup::run_ttest() {
   int permindex = -1;  // -1 means don't permute
   if (permcount > 1)
     pmat = createPermMatrix(permcount, critsize, vb_orderperm, 0);
+  // lesion maps against a score vector is the usual vlsm case, which
+  // can be done all at once on the unique lesion patterns
+  if (f_volume && ivmap.begin()->second.dims.size() == 4 &&
+      dvmap.begin()->second.dims.size() != 4) {
+    do_ttest_patterns();
+    return;
+  }
   format progformat("Calculating statmaps (%d of %d completed) ...");
   QProgressDialog prog((progformat % 0 % permcount).str().c_str(), "Abort", 0,
                        permcount);
@@ -763,21 +771,99 @@ void VSetup::run_regression() {
   // otherwise, save the output
 }
 
+// do_ttest_patterns() loads the lesion data once, hashes the voxels
+// into unique lesion patterns, and then does the original order and
+// all the permutations on the patterns (in parallel for the latter).
+// the engine is set to keep every voxel (f_allvoxels) and there's no
+// mask, so the maps and permutation maxima are the ones the per-voxel
+// do_ttest_volume() produced.
+
+int VSetup::do_ttest_patterns() {
+  ModelItem &ivitem = ivmap.begin()->second;
+  ModelItem &dvitem = dvmap.begin()->second;
+  if (!ivitem.tdata.data && ivitem.tdata.ReadFile(ivitem.filename)) {
+    setstatus("couldn't read lesion data", t_error);
+    return 101;
+  }
+  VLSMEngine vlsm;
+  vlsm.f_welchs = (mystat == id_welchs);
+  vlsm.f_z = vlsm.f_welchs;
+  vlsm.f_allvoxels = 1;
+  if (vlsm.setLesions(ivitem.tdata, Cube())) {
+    setstatus("couldn't collect lesion patterns", t_error);
+    return 102;
+  }
+  if (vlsm.setScores(dvitem.vdata)) {
+    setstatus("dependent variable must be a single vector", t_error);
+    return 103;
+  }
+  setstatus((format("%d voxels in %d unique lesion patterns") %
+             vlsm.voxels() % vlsm.patterns())
+                .str(),
+            t_status);
+
+  if (permcount < 2) {
+    vector<tval> res;
+    vlsm.calc(res);
+    vector<double> tv(res.size()), pv(res.size()), zv(res.size());
+    for (size_t i = 0; i < res.size(); i++) {
+      t_to_p_z(res[i]);
+      tv[i] = res[i].t;
+      pv[i] = res[i].p;
+      zv[i] = res[i].z;
+    }
+    tmap.SetVolume(dimx, dimy, dimz, vb_double);
+    pmap.SetVolume(dimx, dimy, dimz, vb_double);
+    zmap.SetVolume(dimx, dimy, dimz, vb_double);
+    vlsm.scatter(tv, tmap);
+    vlsm.scatter(pv, pmap);
+    vlsm.scatter(zv, zmap);
+    tmap.WriteFile("tmap.cub.gz");
+    pmap.WriteFile("pmap.cub.gz");
+    zmap.WriteFile("zmap.cub.gz");
+    return 0;
+  }
+
+  // permutations go in chunks so that the progress dialog gets updated
+  const int chunk = 100;
+  vector<double> maxes;
+  format progformat("Calculating permutations (%d of %d completed) ...");
+  QProgressDialog prog((progformat % 0 % permcount).str().c_str(), "Abort", 0,
+                       permcount);
+  prog.setWindowModality(Qt::WindowModal);
+  prog.show();
+  for (int i = 0; i < permcount; i += chunk) {
+    prog.setLabelText((progformat % i % permcount).str().c_str());
+    prog.setValue(i);
+    app->processEvents();
+    if (prog.wasCanceled()) return 0;
+    if (vlsm.permute(pmat, i, min(chunk, permcount - i), maxes)) {
+      setstatus("bad permutation matrix", t_error);
+      return 104;
+    }
+  }
+  prog.setValue(permcount);
+  for (int i = 0; i < permcount; i++) permdist[i] = maxes[i];
+  permdist.WriteFile("permdist.ref");
+  return 0;
+}
+
 int VSetup::do_ttest_volume(int permindex) {
   VB_Vector dv, pvec;
   tmap.SetVolume(dimx, dimy, dimz, vb_double);
   pmap.SetVolume(dimx, dimy, dimz, vb_double);
   zmap.SetVolume(dimx, dimy, dimz, vb_double);
   // vec and single-column matrix data are already in there as vecs
-  ModelItem ivitem = ivmap.begin()->second;
-  ModelItem dvitem = dvmap.begin()->second;
+  ModelItem &ivitem = ivmap.begin()->second;
+  ModelItem &dvitem = dvmap.begin()->second;
   int order = ivitem.criticaldim;
   bitmask bm;
   bm.resize(order);
-  // read any 4d data, otherwise copy to iv/dv
+  // read any 4d data (just the first time through), otherwise copy to
+  // iv/dv
   if (ivitem.dims.size() == 4) {
     // FIXME test error
-    ivitem.tdata.ReadFile(ivitem.filename);
+    if (!ivitem.tdata.data) ivitem.tdata.ReadFile(ivitem.filename);
   } else {
     for (int t = 0; t < order; t++) {
       if (fabs(ivitem.vdata[t]) > FLT_MIN)
@@ -786,9 +872,9 @@ int VSetup::do_ttest_volume(int permindex) {
         bm.unset(t);
     }
   }
-  if (dvitem.dims.size() == 4)
-    dvitem.tdata.ReadFile(dvitem.filename);
-  else
+  if (dvitem.dims.size() == 4) {
+    if (!dvitem.tdata.data) dvitem.tdata.ReadFile(dvitem.filename);
+  } else
     dv = dvitem.vdata;
 
   // FIXME right now we only offer the option of order-permuting the
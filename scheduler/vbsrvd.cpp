@@ -429,26 +429,19 @@ void do_errornotify(VBJobSpec &js) {
 }
 
 void cleanup_update(VBJobSpec &js) {
-  // send local finished time and new status to scheduler
+  // send local finished time and new status to scheduler, as one batch
+  vector<string> msgs;
+  string jj = strnum(js.snum) + " " + strnum(js.jnum);
   if (js.GetState() == XGood || js.GetState() == XWarn) {
-    tell_scheduler(vbp.queuedir, vbp.thishost.nickname,
-                   (string) "setjobinfo " + strnum(js.snum) + " " +
-                       strnum(js.jnum) + " status D");
-    tell_scheduler(vbp.queuedir, vbp.thishost.nickname,
-                   (string) "jobdone " + strnum(js.snum) + " " +
-                       strnum(js.jnum) + " " + strnum(time(NULL)));
+    msgs.push_back("setjobinfo " + jj + " status D");
+    msgs.push_back("jobdone " + jj + " " + strnum(time(NULL)));
   } else if (js.GetState() == XRetry) {
-    tell_scheduler(vbp.queuedir, vbp.thishost.nickname,
-                   (string) "retry " + strnum(js.snum) + " " + strnum(js.jnum) +
-                       " " + strnum(js.retrycount));
+    msgs.push_back("retry " + jj + " " + strnum(js.retrycount));
   } else {  // XBad, XSignal, and XNone
-    tell_scheduler(vbp.queuedir, vbp.thishost.nickname,
-                   (string) "setjobinfo " + strnum(js.snum) + " " +
-                       strnum(js.jnum) + " status B");
-    tell_scheduler(vbp.queuedir, vbp.thishost.nickname,
-                   (string) "jobdone " + strnum(js.snum) + " " +
-                       strnum(js.jnum) + " " + strnum(time(NULL)));
+    msgs.push_back("setjobinfo " + jj + " status B");
+    msgs.push_back("jobdone " + jj + " " + strnum(time(NULL)));
   }
+  tell_scheduler(vbp.queuedir, vbp.thishost.nickname, msgs);
 }
 
 void vbsrvd_phone_home() {
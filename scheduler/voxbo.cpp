@@ -24,15 +24,18 @@
 //
 // original version written by Dan Kimberg
 
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/signal.h>
 #include <sys/un.h>
+#include <boost/thread.hpp>
 #include <list>
 #include <map>
 #include "schedlib.h"
 #include "vbjobspec.h"
 #include "vbprefs.h"
 #include "vbutil.h"
+#include "vbx.h"
 
 using namespace std;
 using boost::format;
@@ -55,6 +58,11 @@ int server_sleep(int s);
 int server_create();
 int server_create_inet();
 int server_create_unix();
+int events_create();
+void events_destroy(int es);
+void events_listen(int es);
+int events_save(const string &batch, const vector<string> &msgs);
+void handle_events();
 int getvoxbolock();
 void returnvoxbolock();
 int reassignstdio(string &fname);
@@ -72,6 +80,7 @@ void check_sent();
 void setjobinfo_update_hostlist(VBJobSpec *newjs);
 
 void process_vbx();
+int process_message(tokenlist &line, string fname);
 void process_dropbox();
 int process_jobrunning(string hostname, int snum, int jnum, pid_t pid,
                        pid_t childpid, long stime);
@@ -133,9 +142,22 @@ class VBevent {
 deque<VBevent> dayevents;
 deque<VBevent> hourevents;
 
+// the event socket's listener thread saves each batch of status
+// messages as .vbx files and pokes eventpipe, so that the main loop
+// handles them right away.  vbxseen is the .vbx files we've handled
+// in the last 10 minutes, in case a client that missed our ack saves
+// a batch we've already had.
+
+boost::mutex eventlock;
+int f_eventsdone = 0;
+int eventpipe[2] = {-1, -1};
+boost::thread *eventthread = NULL;
+set<string> vbxseen;
+deque<pair<time_t, string> > vbxseenorder;
+
 int main(int argc, char *argv[]) {
   string logfile, pidfile;
-  int newpid, mysocket, err;
+  int newpid, mysocket, eventsocket, err;
   struct stat st;
   FILE *fp;
   int f_detach = 0;
@@ -241,6 +263,7 @@ int main(int argc, char *argv[]) {
   }
 
   mysocket = server_create();
+  eventsocket = events_create();
   if (f_debug) printf("[D] voxbo: reading queue\n");
   read_queue(vbp.queuedir, seqlist);
   if (f_debug) printf("[D] voxbo: populating hostlist with running jobs\n");
@@ -257,7 +280,8 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    // process vbx notices, dropbox, update the hostlist, and clean up the queue
+    // process events, vbx notices, dropbox, update the hostlist, and clean
+    // up the queue
     process_vbx();
     process_dropbox();
     update_hostlist();
@@ -272,10 +296,12 @@ int main(int argc, char *argv[]) {
       run_jobs();
     }
     if (mysocket < 0) mysocket = server_create();
+    if (eventsocket < 0) eventsocket = events_create();
     err = server_sleep(mysocket);
     if (err == SERVER_DIE) break;
   }
   if (mysocket > -1) close(mysocket);
+  if (eventsocket > -1) events_destroy(eventsocket);
   unlink(pidfile.c_str());
   fprintf(stderr, "[I] %s voxbo scheduler terminated normally on host %s\n",
           timedate().c_str(), vbp.thishost.nickname.c_str());
@@ -379,10 +405,142 @@ int server_create_unix() {
   return s;
 }
 
+// events_create() sets up the unix domain socket in the queue
+// directory that local clients use to send us status messages (see
+// tell_scheduler()).  the socket gets the queue directory's
+// permissions, so it's no more open than dropping a .vbx file there.
+// a separate thread services it, so that clients aren't kept waiting
+// while we're in the middle of a pass.
+
+int events_create() {
+  struct sockaddr_un addr;
+  struct stat st;
+  string sname = scheduler_eventsocket(vbp.queuedir);
+  if (sname.size() >= sizeof(addr.sun_path)) return -1;
+  if (stat(vbp.queuedir.c_str(), &st)) return -1;
+  unlink(sname.c_str());
+  int s = socket(PF_LOCAL, SOCK_STREAM, 0);
+  if (s < 0) return s;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = PF_LOCAL;
+  strcpy(addr.sun_path, sname.c_str());
+  if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(s);
+    return -2;
+  }
+  chmod(sname.c_str(), st.st_mode & 0777);
+  if (listen(s, 64) == -1) {
+    close(s);
+    unlink(sname.c_str());
+    return -3;
+  }
+  if (pipe(eventpipe)) {
+    close(s);
+    unlink(sname.c_str());
+    return -4;
+  }
+  fcntl(s, F_SETFL, O_NONBLOCK);
+  fcntl(eventpipe[0], F_SETFL, O_NONBLOCK);
+  f_eventsdone = 0;
+  eventthread = new boost::thread(events_listen, s);
+  printf("[I] %s listening for events on %s\n", timedate().c_str(),
+         sname.c_str());
+  return s;
+}
+
+void events_destroy(int es) {
+  {
+    boost::mutex::scoped_lock lk(eventlock);
+    f_eventsdone = 1;
+  }
+  if (eventthread) {
+    eventthread->join();
+    delete eventthread;
+    eventthread = NULL;
+  }
+  close(es);
+  close(eventpipe[0]);
+  close(eventpipe[1]);
+  eventpipe[0] = eventpipe[1] = -1;
+  unlink(scheduler_eventsocket(vbp.queuedir).c_str());
+}
+
+// events_listen() runs in its own thread.  it takes batches of
+// status messages from local clients and saves them, and only then
+// acks.  a client that doesn't get the ack saves the batch itself,
+// under the same names.
+
+void events_listen(int es) {
+  fd_set ff;
+  struct timeval tv;
+  while (1) {
+    {
+      boost::mutex::scoped_lock lk(eventlock);
+      if (f_eventsdone) return;
+    }
+    FD_ZERO(&ff);
+    FD_SET(es, &ff);
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if (select(es + 1, &ff, NULL, NULL, &tv) < 1) continue;
+    int ns = accept(es, NULL, NULL);
+    if (ns == -1) continue;
+    vector<string> msgs;
+    int err = recv_frames(ns, msgs, 5.0);
+    tokenlist bline;
+    if (!err && msgs.size()) bline.ParseLine(msgs[0]);
+    if (err || bline.size() != 2 || bline[0] != "batch" ||
+        bline[1].find('/') != string::npos ||
+        events_save(bline[1], vector<string>(msgs.begin() + 1, msgs.end()))) {
+      close(ns);
+      continue;
+    }
+    send(ns, "ACK", 4, MSG_NOSIGNAL);
+    close(ns);
+    if (write(eventpipe[1], "e", 1) < 0) continue;
+  }
+}
+
+// events_save() writes each message of a batch to the .vbx file the
+// client would have used, so a batch survives us going down before
+// we get to it
+
+int events_save(const string &batch, const vector<string> &msgs) {
+  for (size_t i = 0; i < msgs.size(); i++) {
+    string root = vbp.queuedir + "/" + scheduler_msgname(batch, i);
+    string tmpname = root + ".vbevtmp";
+    FILE *fp = fopen(tmpname.c_str(), "w");
+    if (!fp) return 101;
+    size_t cnt = fwrite(msgs[i].c_str(), 1, msgs[i].size(), fp);
+    if (fclose(fp) || cnt != msgs[i].size()) {
+      unlink(tmpname.c_str());
+      return 102;
+    }
+    if (rename(tmpname.c_str(), (root + ".vbx").c_str())) {
+      unlink(tmpname.c_str());
+      return 103;
+    }
+  }
+  return 0;
+}
+
+// handle_events() is called from server_sleep() when the listener
+// pokes us.  the batch is already on disk, so all we do is pick it
+// up.
+
+void handle_events() {
+  char buf[STRINGLEN];
+  if (eventpipe[0] > -1)
+    while (read(eventpipe[0], buf, STRINGLEN) > 0)
+      ;
+  process_vbx();
+}
+
 // server_sleep() -- this cute little function waits for someone to
 // connect to the socket and send a message.  it currently is a bit
 // lacking in the security department.  but it will eventually be
-// rewritten to do cryptographic authentication.
+// rewritten to do cryptographic authentication.  status messages
+// queued up from the event socket are handled as they come in.
 
 int server_sleep(int s) {
   struct timeval tv;
@@ -398,8 +556,10 @@ int server_sleep(int s) {
   ssize = sizeof(struct sockaddr_in);
   start_time = time(NULL);
 
+  int es = eventpipe[0];
+
   // if no socket, complain
-  if (s < 0) {
+  if (s < 0 && es < 0) {
     sleep(vbp.queuedelay);
     printf("error: couldn't create server port, waiting without listening\n");
     return SERVER_OK;
@@ -407,14 +567,17 @@ int server_sleep(int s) {
 
   while (time(NULL) - start_time < vbp.queuedelay) {
     FD_ZERO(&ff);
-    FD_SET(s, &ff);
+    if (s > -1) FD_SET(s, &ff);
+    if (es > -1) FD_SET(es, &ff);
     tv.tv_sec = vbp.queuedelay;
     tv.tv_usec = 0;
-    err = select(s + 1, &ff, NULL, NULL, &tv);  // can we receive?
+    err = select(max(s, es) + 1, &ff, NULL, NULL, &tv);  // can we receive?
     if (err < 1) {
       sleep(1);
       continue;
     }
+    if (es > -1 && FD_ISSET(es, &ff)) handle_events();
+    if (s < 0 || !FD_ISSET(s, &ff)) continue;
     ns = accept(s, (struct sockaddr *)&addr, &ssize);
     if (ns == -1) {
       sleep(1);
@@ -1096,34 +1259,29 @@ void read_serverlist() {
   vbforeach(ss, vbp.servers) server_add(ss.first);
 }
 
+// process_vbx() handles the status messages that come in as .vbx
+// files, from clients on other hosts, from clients that couldn't use
+// the event socket, and saved by the event socket's listener.  a
+// file we've handled before is a batch that both we and the client
+// saved, and is skipped.
+
 void process_vbx() {
   tokenlist line;
+  while (vbxseenorder.size() && time(NULL) - vbxseenorder.front().first > 600) {
+    vbxseen.erase(vbxseenorder.front().second);
+    vbxseenorder.pop_front();
+  }
   vglob vg("*.vbx");
   if (!vg.size()) return;
   for (size_t i = 0; i < vg.size(); i++) {
+    if (vbxseen.count(vg[i])) {
+      unlink(vg[i].c_str());
+      continue;
+    }
+    vbxseen.insert(vg[i]);
+    vbxseenorder.push_back(make_pair(time(NULL), vg[i]));
     line.ParseFirstLine(vg[i]);
-    if (line[0] == "setjobinfo")
-      process_setjobinfo(strtol(line[1]), strtol(line[2]), line.Tail(3));
-    else if (line[0] == "jobrunning")
-      process_jobrunning(line[1], strtol(line[2]), strtol(line[3]),
-                         strtol(line[4]), strtol(line[5]), strtol(line[6]));
-    else if (line[0] == "jobdone")
-      process_jobdone(strtol(line[1]), strtol(line[2]), strtol(line[3]));
-    else if (line[0] == "setseqinfo")
-      process_setseqinfo(strtol(line[1]), line.Tail(2));
-    else if (line[0] == "killsequence")
-      process_killsequence(strtol(line[1]), line[2]);
-    else if (line[0] == "email")
-      process_email(line[1], vg[i]);
-    else if (line[0] == "adminemail")
-      process_adminemail(vg[i]);
-    else if (line[0] == "hostupdate")
-      process_hostupdate(line.Tail());
-    else if (line[0] == "retry")
-      process_retry(line.Tail());
-    else if (line[0] == "saveline")
-      process_saveline(line.Tail());
-    else {
+    if (process_message(line, vg[i])) {
       printf("[E] %s invalid vbx file %s\n", timedate().c_str(), vg[i].c_str());
       // FIXME put it somewhere?
     }
@@ -1132,6 +1290,38 @@ void process_vbx() {
   }
 }
 
+// process_message() dispatches one status message, however it came
+// in.  email messages need the file they came in, since the body is
+// the rest of the file.
+
+int process_message(tokenlist &line, string fname) {
+  if (line.size() == 0) return 101;
+  if (line[0] == "setjobinfo")
+    process_setjobinfo(strtol(line[1]), strtol(line[2]), line.Tail(3));
+  else if (line[0] == "jobrunning")
+    process_jobrunning(line[1], strtol(line[2]), strtol(line[3]),
+                       strtol(line[4]), strtol(line[5]), strtol(line[6]));
+  else if (line[0] == "jobdone")
+    process_jobdone(strtol(line[1]), strtol(line[2]), strtol(line[3]));
+  else if (line[0] == "setseqinfo")
+    process_setseqinfo(strtol(line[1]), line.Tail(2));
+  else if (line[0] == "killsequence")
+    process_killsequence(strtol(line[1]), line[2]);
+  else if (line[0] == "email" && fname.size())
+    process_email(line[1], fname);
+  else if (line[0] == "adminemail" && fname.size())
+    process_adminemail(fname);
+  else if (line[0] == "hostupdate")
+    process_hostupdate(line.Tail());
+  else if (line[0] == "retry")
+    process_retry(line.Tail());
+  else if (line[0] == "saveline")
+    process_saveline(line.Tail());
+  else
+    return 102;
+  return 0;
+}
+
 // FIXME in process_dropbox, we call loadsequence twice to make sure
 // that the seq structure and all the jobs have the right info.  job
 // fields affected include basename, email, seqname, logfile, uid,
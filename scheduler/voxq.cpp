@@ -42,6 +42,7 @@ list<VBSequence> seqlist;
 int voxq_sequences(tokenlist &args, set<string> flags);
 void voxq_sequencedetail(tokenlist &args);
 void voxq_debug(tokenlist &args);
+void voxq_trace(tokenlist &args);
 void voxq_dumpconfig(tokenlist &args);
 void voxq_dumpjobtypes(tokenlist &args);
 void voxq_marksequence(tokenlist &args, string status);
@@ -132,6 +133,8 @@ int main(int argc, char *argv[]) {
     voxq_changejobs(args, '*', 'W');
   else if (modename == "d")
     voxq_debug(args);
+  else if (modename == "trace")
+    voxq_trace(args);
   // pri/max stuff
   else if (modename == "sched")
     voxq_sched(args);
@@ -471,6 +474,45 @@ void voxq_debug(tokenlist &args) {
   }
 }
 
+// show the trace summaries (see vbtrace.h) for a sequence's jobs, or
+// just one job.  they're next to the job's log, wherever that is.
+
+void voxq_trace(tokenlist &args) {
+  if (args.size() != 2 && args.size() != 3) {
+    voxq_help();
+    return;
+  }
+  int seqnum = strtol(args[1]);
+  int jobnum = -1;
+  if (args.size() == 3) jobnum = strtol(args[2]);
+  VBSequence seq(vbp, seqnum);
+  if (!seq.valid) {
+    printf("No such valid sequence %d.\n", seqnum);
+    return;
+  }
+  int found = 0;
+  for (SMI js = seq.specmap.begin(); js != seq.specmap.end(); js++) {
+    if (jobnum > -1 && js->second.jnum != jobnum) continue;
+    vector<string> fnames;
+    fnames.push_back(vbp.queuedir + "/" + js->second.seqdirname() + "/" +
+                     js->second.basename() + ".trace");
+    if (js->second.logdir.size())
+      fnames.push_back(js->second.logdir + "/" + js->second.basename() +
+                       ".trace");
+    vbforeach(string fname, fnames) {
+      if (!vb_fileexists(fname)) continue;
+      printf("JOB %d - %s (%s)\n", js->second.jnum, js->second.name.c_str(),
+             fname.c_str());
+      system(str(format("cat %s") % fname).c_str());
+      printf("\n");
+      found++;
+      break;
+    }
+  }
+  if (!found)
+    printf("[I] voxq: no trace files found (was VB_TRACE set for the job?)\n");
+}
+
 void voxq_whynot(tokenlist &) {
   printf("[E] voxq: whynot is temporarily out of commission\n");
 }
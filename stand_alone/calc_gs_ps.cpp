@@ -48,13 +48,15 @@ CalcGs::CalcGs(const CalcGs& c) {
   this->oldStdDev = c.oldStdDev;
   this->sigArr = c.sigArr;
   this->gsTes = c.gsTes;
-  this->gsTSeries = c.gsTSeries;
   this->timeStr = c.timeStr;
 }
 
 void CalcGs::init(const string& tFile) {
-  this->gsTes = Tes(tFile);
-  if (!this->gsTes.data_valid) {
+  /*********************************************************************
+   * Only the header is read here. The data are streamed through once,  *
+   * by VBQAStats, when the signals are computed.                       *
+   *********************************************************************/
+  if (this->gsTes.ReadHeader(tFile)) {
     ostringstream errorMsg;
     errorMsg << "Line Number [" << __LINE__ << "]  The input 4D data file ["
              << tFile << "] has invalid data.";
@@ -115,7 +117,6 @@ void CalcGs::init(const string& tFile) {
   this->gsFile =
       xdirname(tFile) + "/" + xfilename(xrootname(tFile)) + "_GS.ref";
   this->unitVar = false;
-  this->gsTSeries = Tes(this->gsTes.filename);
   this->oldMean = 0.0;
   this->oldStdDev = 0.0;
 }
@@ -127,7 +128,6 @@ string CalcGs::getTesFile() const { return this->gsTes.filename; }
 string CalcGs::getGsFile() const { return this->gsFile; }
 
 void CalcGs::getSignals() {
-  this->sigArr.resize(this->gsTes.dimt);
   /*********************************************************************
    * Say we have:                                                       *
    *                                                                    *
@@ -179,38 +179,30 @@ void CalcGs::getSignals() {
    * sigArr[1] = s1 + s4 + s7 + s10 + s13 + s16 + s19 + s22             *
    * sigArr[2] = s2 + s5 + s8 + s11 + s14 + s17 + s20 + s23             *
    *                                                                    *
-   * Each time series will be read in (for example, the signal values   *
-   * {s0, s1, s2} comprise the time series t0) and then added to the    *
-   * array this->sigArr. NOTE: This class' TimeSeries data member is    *
-   * used to read in the time series values.                            *
-   *********************************************************************/
-
-  /*********************************************************************
-   * A time series will be read into tempSigArr. We need to do some     *
-   * manipulation to the time series before it is added to this->sigArr *
-   * and the manipulations will be carried out in signal. NOTE: The     *
-   * logic for processing time series is derived from the IDL           *
-   * procedure CalcGSPS, found in VoxBo_DataPrep.pro. Both tempSigArr   *
-   * and signal are now declared and their elements will all be zero.   *
+   * Each time series is made to have zero mean before it is added in. *
+   * NOTE: The logic for processing time series is derived from the IDL *
+   * procedure CalcGSPS, found in VoxBo_DataPrep.pro. The sum is then   *
+   * divided by the number of (brain) voxels. VBQAStats does all of     *
+   * this in a single pass over the 4D data file, a slab of voxels at a *
+   * time, and computes the power spectrum and SNR map along the way.   *
    *********************************************************************/
-  VB_Vector tempSigArr(this->gsTes.dimt);
-  VB_Vector signal(this->gsTes.dimt);
-
-  /*********************************************************************
-   * The following while loop is used to retrieve each time series into *
-   * tempSigArr and then the body of the while loop processes the       *
-   * signal values. The while loop will exit when zero is returned by   *
-   * this->gsTSeries.getCurrentTimeSeries().                            *
-   *********************************************************************/
-  while (this->gsTSeries.getCurrentTimeSeries(tempSigArr.getData())) {
-    signal += tempSigArr;
-    double total = signal.getVectorSum() / (double)this->gsTes.dimt;
-    signal -= total;
+  VBQAStats qa;
+  if (qa.run(this->gsTes.filename)) {
+    ostringstream errorMsg;
+    errorMsg << "Line Number [" << __LINE__
+             << "]  Unable to read the time series from ["
+             << this->gsTes.filename << "].";
+    printErrorMsgAndExit(VB_ERROR, errorMsg.str(), 1);
   }
-  signal /= this->gsTes.realvoxels;
-  sigArr += signal;
+  this->useStats(qa);
 }
 
+/*********************************************************************
+ * This method takes the GS from a VBQAStats object that has already  *
+ * been run, so that other outputs can come from the same pass.       *
+ *********************************************************************/
+void CalcGs::useStats(const VBQAStats& qa) { this->sigArr = qa.gs; }
+
 /*********************************************************************
  * This method writes the *_GS.ref file. If for some reason, the time *
  * series signal values fail to be read from the 4D data file, 0 is   *
@@ -287,13 +279,11 @@ CalcPs::CalcPs(const CalcPs& c) {
   this->sigArr = c.sigArr;
   this->timeStr = c.timeStr;
   this->psTes = c.psTes;
-  this->psTSeries = c.psTSeries;
 }
 
 void CalcPs::init(const string& tFile) {
   this->tesFile = tFile;
-  this->psTes = Tes(tFile);
-  if (!this->psTes.data_valid) {
+  if (this->psTes.ReadHeader(tFile)) {
     ostringstream errorMsg;
     errorMsg << "Line Number [" << __LINE__ << "]  The input 4D data file ["
              << tFile << "] could not be read.";
@@ -354,7 +344,6 @@ void CalcPs::init(const string& tFile) {
    *********************************************************************/
   this->psFile =
       xdirname(tFile) + "/" + xfilename(xrootname(tFile)) + "_PS.ref";
-  this->psTSeries = TimeSeries(this->tesFile);
 }
 
 CalcPs::~CalcPs() {}
@@ -365,37 +354,34 @@ string CalcPs::getPsFile() const { return this->psFile; }
 
 void CalcPs::getSignals() {
   /*********************************************************************
-   * Now resizing the vector that will hold the Grand Mean Power        *
-   * Spectrum. Then the array is initialized to all zeros.              *
-   *********************************************************************/
-  this->sigArr.resize(this->psTes.dimt);
-  /*********************************************************************
-   * A time series will be read into tempSigArr. We need to do some     *
-   * manipulation to the time series before it is added to              *
-   * this->sigArr and the manipulations will be carried out in          *
-   * signal. NOTE: The logic for processing time series is derived      *
-   * from the IDL procedure CalcPSPS, found in VoxBo_DataPrep.pro. The  *
-   * data member this->psTSeries is used to retrieve each of the time   *
-   * series. Both tempSigArr and signal are declared and all of their   *
-   * elements will be zero.                                             *
-   *********************************************************************/
-  VB_Vector tempSigArr(this->psTes.dimt);
-  VB_Vector signal(this->psTes.dimt);
-  /*********************************************************************
-   * The following while loop is used to retrieve each time series. The *
-   * body of the while loop processes the signal values in a time       *
-   * series.                                                            *
+   * The Grand Mean Power Spectrum is the average, over all the (brain) *
+   * voxels, of:                                                        *
+   *                                                                    *
+   *        FFT(x) * ComplexConjugate(FFT(x))                           *
+   *                                                                    *
+   * where x is the voxel's time series made to have zero mean. NOTE:   *
+   * The logic for processing time series is derived from the IDL       *
+   * procedure CalcPSPS, found in VoxBo_DataPrep.pro. VBQAStats does    *
+   * the whole computation in a single pass over the 4D data file,      *
+   * handing batches of time series to the FFT.                         *
    *********************************************************************/
-  while (this->psTSeries.getCurrentTimeSeries(tempSigArr.getData())) {
-    double total = tempSigArr.getVectorSum() / (double)this->psTes.dimt;
-    tempSigArr -= total;
-    signal = tempSigArr;
-    this->getPowerSpectrum(signal);
-    signal /= (double)this->psTes.realvoxels;
-    this->sigArr += signal;
+  VBQAStats qa;
+  if (qa.run(this->tesFile)) {
+    ostringstream errorMsg;
+    errorMsg << "Line Number [" << __LINE__
+             << "]  Unable to read the time series from [" << this->tesFile
+             << "].";
+    printErrorMsgAndExit(VB_ERROR, errorMsg.str(), 1);
   }
+  this->useStats(qa);
 }
 
+/*********************************************************************
+ * This method takes the PS from a VBQAStats object that has already  *
+ * been run, so that other outputs can come from the same pass.       *
+ *********************************************************************/
+void CalcPs::useStats(const VBQAStats& qa) { this->sigArr = qa.ps; }
+
 /*********************************************************************
  * This method writes the *_PS.ref file. If for some reason, the time *
  * series signal values fail to be read from the 4D data file, 0 is   *
@@ -428,57 +414,44 @@ int CalcPs::printPsData() {
 }
 
 /*********************************************************************
- * This method places the results from the computation:               *
- *                                                                    *
- *        FFT(inputArr) * ComplexConjugate(FFT(inputArr))             *
- *                                                                    *
- * (where "*" represents multiplication of corresponding elements     *
- * from the two arrays) into inputArr[]. The above computation is     *
- * carried out by the following steps:                                *
- *                                                                    *
- * 1. FFT of inputArr[] which equals a vector of the form:            *
- *                                                                    *
- *        a(1) + ib(1)                                                *
- *        a(2) + ib(2)                                                *
- *        a(3) + ib(3)                                                *
- *             .                                                      *
- *             .                                                      *
- *             .                                                      *
- *        a(n) + ib(n), where i = sqrt(-1).                           *
- *                                                                    *
- * 2. Note that the complex conjugate of the above vector is:         *
- *                                                                    *
- *        a(1) - ib(1)                                                *
- *        a(2) - ib(2)                                                *
- *        a(3) - ib(3)                                                *
- *             .                                                      *
- *             .                                                      *
- *             .                                                      *
- *        a(n) - ib(n)                                                *
- *                                                                    *
- * 3. Now element by element multiplication of the vector from (1)    *
- *    and the vector from (2) is simply:                              *
- *                                                                    *
- *        a(1)^2 + b(1)^2                                             *
- *        a(2)^2 + b(2)^2                                             *
- *        a(3)^2 + b(3)^2                                             *
- *               .                                                    *
- *               .                                                    *
- *               .                                                    *
- *        a(n)^2 + b(n)^2                                             *
- *                                                                    *
- *    Each element is the square of the modulus of each complex       *
- *    number found in the vector from step (1).                       *
- *                                                                    *
- * INPUTS:                                                            *
- * -------------------------------------------------------------------*
- * inputArr - pointer to an array of floats.                          *
+ * This function writes the *_GS.ref, *_PS.ref, *_SNR.cub, and        *
+ * *_QA.txt files for a 4D data file. The 4D data file is read only   *
+ * once, no matter how many outputs there are. If unitVar is true,    *
+ * the GS is normalized to have unit variance. Returns 1 on success,  *
+ * 0 otherwise.                                                       *
  *********************************************************************/
-void CalcPs::getPowerSpectrum(VB_Vector& inputArr) {
-  VB_Vector realPart(inputArr.getLength());
-  VB_Vector imagPart(inputArr.getLength());
-  inputArr.fft(realPart, imagPart);
-  realPart.elementByElementMult(realPart);
-  imagPart.elementByElementMult(imagPart);
-  inputArr = realPart + imagPart;
+int writeQABundle(const string& tFile, bool unitVar) {
+  VBQAStats qa;
+  if (qa.run(tFile)) {
+    ostringstream errorMsg;
+    errorMsg << "Line Number [" << __LINE__
+             << "]  Unable to read the time series from [" << tFile << "].";
+    printErrorMsgAndExit(VB_ERROR, errorMsg.str(), 1);
+  }
+  CalcGs myGs(tFile);
+  myGs.useStats(qa);
+  if (unitVar) myGs.normalizeVariance();
+  if (!myGs.printGsData()) return 0;
+  CalcPs myPs(tFile);
+  myPs.useStats(qa);
+  if (!myPs.printPsData()) return 0;
+
+  /*********************************************************************
+   * The SNR map and the summary of the GS checks use the same stem as  *
+   * the *_GS.ref and *_PS.ref files.                                   *
+   *********************************************************************/
+  string stem = xdirname(tFile) + "/" + xfilename(xrootname(tFile));
+  if (qa.snr.WriteFile(stem + "_SNR.cub")) {
+    ostringstream errorMsg;
+    errorMsg << "Line Number [" << __LINE__ << "]  Unable to write ["
+             << stem << "_SNR.cub].";
+    printErrorMsgAndExit(VB_ERROR, errorMsg.str(), 7);
+  }
+  if (qa.writeSummary(stem + "_QA.txt")) {
+    ostringstream errorMsg;
+    errorMsg << "Line Number [" << __LINE__ << "]  Unable to write ["
+             << stem << "_QA.txt].";
+    printErrorMsgAndExit(VB_ERROR, errorMsg.str(), 7);
+  }
+  return 1;
 }
@@ -38,7 +38,6 @@
 #include <iomanip>
 #include <iostream>
 #include <string>
-#include "timeseries.h"
 #include "vb_common_incs.h"
 
 const int FIELD_WIDTH = 13;
@@ -57,8 +56,6 @@ class CalcGs {
    *          values.                                                   *
    * unitVar - if true, then the user has chosen for this->sigArr to    *
    *           have unit variance.                                      *
-   * gsTSeries - a TimeSeries object; used to process the signal values *
-   *             from the 4D data file.                                 *
    * oldMean - if the user chose for the global spectrum to have unit   *
    *           variance, then the mean prior to making the power        *
    *           spectrum have unit variance will be stored in oldMean.   *
@@ -75,7 +72,6 @@ class CalcGs {
   string timeStr;
   VB_Vector sigArr;
   bool unitVar;
-  TimeSeries gsTSeries;
   double oldMean;
   double oldStdDev;
 
@@ -112,9 +108,12 @@ class CalcGs {
    * normalizeVariance() - normalizes this->sigArr to have unit         *
    *                       variance.                                    *
    * printGsData() - prints out the GS information to a file.           *
+   * useStats() - takes the GS from a VBQAStats object that has already *
+   *              been run on the 4D data file.                         *
    *********************************************************************/
   int normalizeVariance();
   int printGsData();
+  void useStats(const VBQAStats& qa);
 };
 
 class CalcPs {
@@ -130,8 +129,6 @@ class CalcPs {
    * timeStr - a C-style string, used to hold the date and time of      *
    *           when the current CalcPs object was instantiated.         *
    * sigArr - will hold the Grand Mean Power Spectrum.                  *
-   * psTSeries - A TimeSeries object; used to process the signal values *
-   *             from the 4D data file.                                 *
    * psHeader1 - first part of the header for the PS file.              *
    * psHeader2 - second part of the header for the PS file.             *
    * psHeader3 - third part of the header for the PS file.              *
@@ -141,7 +138,6 @@ class CalcPs {
   Tes psTes;
   string timeStr;
   VB_Vector sigArr;
-  TimeSeries psTSeries;
 
   static const string psHeader1;
   static const string psHeader2;
@@ -158,7 +154,6 @@ class CalcPs {
    *********************************************************************/
   void init(const string& tesFile);
   void getSignals();
-  void getPowerSpectrum(VB_Vector& inputArr);
 
  public:
   CalcPs(const string& tFile);
@@ -167,7 +162,23 @@ class CalcPs {
   ~CalcPs();
   string getTesFile() const;
   string getPsFile() const;
+
+  /*********************************************************************
+   * PUBLIC METHODS:                                                    *
+   * ------------------------------------------------------------------ *
+   *                                                                    *
+   * printPsData() - prints out the PS information to a file.           *
+   * useStats() - takes the PS from a VBQAStats object that has already *
+   *              been run on the 4D data file.                         *
+   *********************************************************************/
   int printPsData();
+  void useStats(const VBQAStats& qa);
 };
 
+/*********************************************************************
+ * writeQABundle() writes the GS, PS, SNR map, and QA summary for a   *
+ * 4D data file, all from a single pass over the data.                *
+ *********************************************************************/
+int writeQABundle(const string& tFile, bool unitVar);
+
 #endif  // CALC_GS_PS_H
@@ -41,7 +41,8 @@
  * --------                                                           *
  * The Global spectrum is written to a file called *_GS.ref where     *
  * "*" represents the input 4D data file name without the ".tes"      *
- * extension.                                                         *
+ * extension. With -a, the *_PS.ref, *_SNR.cub, and *_QA.txt files    *
+ * are written as well, from the same pass over the data.             *
  *********************************************************************/
 
 void usage(const unsigned short exitValue, char *progName);
@@ -75,8 +76,10 @@ int main(int argc, char *argv[], char *[]) {
    * -i ==> Specifies the input 4D data file.                           *
    * -u ==> The unit variance flag.                                     *
    * -v ==> Print global VoxBo version.                                 *
+   * -a ==> Write all the QA outputs, not just the GS.                  *
    *********************************************************************/
   arghandler a;
+  a.setArgs("-a", "--all", 0);
   a.setArgs("-h", "--help", 0);
   a.setArgs("-i", "--inputfile", 1);
   a.setArgs("-u", "--unitvariance", 1);
@@ -96,6 +99,7 @@ int main(int argc, char *argv[], char *[]) {
     cerr << "ERROR: Must specify the input 4D data file name." << endl;
     usage(1, argv[0]);
   }
+  if (a.flagPresent("-a")) return !writeQABundle(tesFile, unitVar);
   CalcGs myGs(tesFile);
   if (unitVar) {
     myGs.normalizeVariance();
@@ -121,8 +125,10 @@ void usage(const unsigned short, char *) {
   printf("summary: ");
   printf(" Calc GS routine for VoxBo.\n");
   printf("usage:\n");
-  printf(" calcgs -h -i[4D data file name] -u -v\n");
+  printf(" calcgs -h -i[4D data file name] -u -v -a\n");
   printf("flags:\n");
+  printf(
+      " -a                        Also write PS, SNR map, and QA summary.\n");
   printf(" -h                        Print usage information. Optional.\n");
   printf(
       " -i <4D data file>         Specify the input 4D data file. Required.\n");
@@ -39,7 +39,8 @@
  * --------                                                           *
  * The Power spectrum is written to a file called *_PS.ref where      *
  * "*" represents the input 4D data file name without the ".tes"      *
- * extension.                                                         *
+ * extension. With -a, the *_GS.ref, *_SNR.cub, and *_QA.txt files    *
+ * are written as well, from the same pass over the data.             *
  *********************************************************************/
 
 void usage(const unsigned short exitValue, char *progName);
@@ -57,8 +58,10 @@ int main(int argc, char *argv[]) {
    * -h ==> Display usage information.                                  *
    * -i ==> Specifies the input 4D data file.                           *
    * -v ==> Print global VoxBo version.                                 *
+   * -a ==> Write all the QA outputs, not just the PS.                  *
    *********************************************************************/
   arghandler a;
+  a.setArgs("-a", "--all", 0);
   a.setArgs("-h", "--help", 0);
   a.setArgs("-i", "--inputfile", 1);
   a.setArgs("-v", "--version", 0);
@@ -79,6 +82,7 @@ int main(int argc, char *argv[]) {
     printErrorMsg(VB_ERROR, errorMsg.str());
     usage(1, argv[0]);
   }
+  if (a.flagPresent("-a")) return !writeQABundle(tesFile, false);
   CalcPs myPs(tesFile);
   myPs.printPsData();
   return 0;
@@ -89,8 +93,10 @@ void usage(const unsigned short, char *) {
   printf("summary: ");
   printf(" Calc PS routine for VoxBo.\n");
   printf("usage:\n");
-  printf(" calcps -h -i[4D data file name] -v\n");
+  printf(" calcps -h -i[4D data file name] -v -a\n");
   printf("flags:\n");
+  printf(
+      " -a                        Also write GS, SNR map, and QA summary.\n");
   printf(" -h                        Print usage information. Optional.\n");
   printf(
       " -i <4D data file>         Specify the input 4D data file. Required.\n");
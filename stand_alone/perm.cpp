@@ -62,7 +62,6 @@ int permStart(permclass pc) {
   VB_permtype method = pc.method;
   if (pc.stemname.empty()) return 200;
   if (pc.permdir.empty()) return 201;
-  map<size_t, vector<gsl_permutation *> > permHash;
   Tes paramTes;
   paramTes.ReadHeader(pc.stemname + ".prm");
   if (!paramTes.header_valid) return 202;
@@ -71,182 +70,200 @@ int permStart(permclass pc) {
   VBMatrix gMatrix;
   if (gMatrix.ReadHeader(gMatrixFile)) return 204;
   const unsigned long orderG = gMatrix.m;
-  unsigned long numPerms = MAX_PERMS;
-  map<short, vector<short *> > signHash;
-  switch (method) {
-    case vb_orderperm: {
-      gsl_permutation *v = gsl_permutation_calloc(orderG);
-      if (!v) return 205;
-      if (orderG <= PERMUTATION_LIMIT) {
-        numPerms = (size_t)lrint(exp(gamma(orderG + 1)));
-        do {
-          inHash(permHash, v);
-        } while (gsl_permutation_next(v) == GSL_SUCCESS);
-      } else {
-        inHash(permHash, v);
-        initRNG(pc.rngseed);
-        for (size_t i = 1; i < numPerms; i++) {
-          randPerm(v);
-          while (inHash(permHash, v)) randPerm(v);
-        }
-        freeRNG();
-        if (v) gsl_permutation_free(v);
-      }
-    } break;
-    case vb_signperm: {
-      short *signPerm = new short[orderG];
-      if (orderG <= SIGN_PERMUTATION_LIMIT) {
-        numPerms = (1 << (orderG - 1));
-        for (size_t i = 0; i < numPerms; i++) {
-          for (size_t j = 0; j < orderG; j++)
-            signPerm[j] = (utils::getBit(i, j) * -2) + 1;
-          inSignHash(signHash, signPerm, orderG);
-        }
-      } else {
-        initRNG(pc.rngseed);
-        for (size_t i = 0; i < numPerms; i++) {
-          randSignPerm(signPerm, orderG);
-          while (inSignHash(signHash, signPerm, orderG))
-            randSignPerm(signPerm, orderG);
-        }
-        freeRNG();
-      }
-      if (signPerm) delete signPerm;
-      signPerm = 0;
-    } break;
-    default:
-      return 206;
-      break;
-  }
-  VBMatrix permMat(orderG, numPerms);
-  if (!permMat.rowdata) return 208;
-  VB_Vector vec(orderG);
-  size_t colIndex = 0;
-  switch (method) {
-    case vb_orderperm: {
-      map<size_t, vector<gsl_permutation *> >::iterator mItr;
-      for (mItr = permHash.begin(); mItr != permHash.end(); mItr++) {
-        for (size_t i = 0; i < mItr->second.size(); i++) {
-          for (size_t k = 0; k < orderG; k++) vec[k] = mItr->second[i]->data[k];
-          permMat.SetColumn(colIndex, vec);
-          colIndex++;
-        }
-      }
-      freePermHash(permHash);
-    } break;
-    case vb_signperm: {
-      map<short, vector<short *> >::iterator mItr;
-      for (mItr = signHash.begin(); mItr != signHash.end(); mItr++) {
-        for (size_t i = 0; i < mItr->second.size(); i++) {
-          for (size_t k = 0; k < orderG; k++) vec[k] = mItr->second[i][k];
-          if (orderG <= SIGN_PERMUTATION_LIMIT)
-            permMat.SetColumn(rankSignPerm(mItr->second[i], orderG), vec);
-          else {
-            permMat.SetColumn(colIndex, vec);
-            colIndex++;
-          }
-        }
-      }
-      freeSignHash(signHash);
-    } break;
-    default:
-      break;
-  }
+  if (method != vb_orderperm && method != vb_signperm) return 206;
+  VBMatrix permMat = createPermMatrix(MAX_PERMS, orderG, method, pc.rngseed);
+  if (!permMat.rowdata || permMat.m != orderG) return 208;
   permMat.filename = mypermdir + "/permutations.mat";
   if (permMat.WriteFile()) return 210;
   permMat.clear();
   return 0;
 }
 
+// the permutation matrix generator.  sign permutations are kept as
+// packed bitsets (32 signs to a word, bit set for -1) and order
+// permutations as arrays of indices.  uniqueness is checked against
+// an open-addressing table of 64-bit fingerprints, falling back to a
+// full compare only when fingerprints match.  each column draws from
+// its own counter-based random stream (seed, column, attempt), and
+// duplicates are resolved in column order, so the matrix depends only
+// on the seed and not on the number of threads.
+
+namespace {
+
+inline uint64 permmix(uint64 x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+class permstream {
+ public:
+  permstream(uint64 seed, uint64 col, uint64 attempt) {
+    key = permmix(seed ^ permmix(col ^ permmix(attempt)));
+    counter = 0;
+  }
+  uint64 next() { return permmix(key + 0x9e3779b97f4a7c15ULL * counter++); }
+
+ private:
+  uint64 key, counter;
+};
+
+class permgen {
+ public:
+  permgen(VB_permtype m, int n, uint64 s);
+  int generate(int nperms);
+  int count() const { return ncols; }
+  double value(int col, int row) const;
+
+ private:
+  VB_permtype method;
+  int ndata, ncols;
+  uint64 seed;
+  size_t width;          // words per column
+  vector<uint32> words;  // the columns, width words each
+  vector<uint64> slots;  // fingerprints, 0 for empty
+  vector<uint32> slotcols;
+  void make(int col, uint32 attempt);
+  void makerange(const vector<int> *pending, const vector<uint32> *attempts,
+                 int first, int step);
+  bool insert(int col);
+};
+
+permgen::permgen(VB_permtype m, int n, uint64 s) {
+  method = m;
+  ndata = n;
+  seed = s;
+  ncols = 0;
+  if (method == vb_signperm)
+    width = (ndata + 31) / 32;
+  else
+    width = ndata;
+}
+
+double permgen::value(int col, int row) const {
+  const uint32 *w = &words[col * width];
+  if (method == vb_signperm) return ((w[row / 32] >> (row % 32)) & 1) ? -1 : 1;
+  return w[row];
+}
+
+void permgen::make(int col, uint32 attempt) {
+  uint32 *w = &words[col * width];
+  permstream rr(seed, col, attempt);
+  if (method == vb_signperm) {
+    for (size_t i = 0; i < width; i++) w[i] = rr.next();
+    if (ndata % 32) w[width - 1] &= (1u << (ndata % 32)) - 1;
+    return;
+  }
+  // fisher-yates shuffle
+  for (int i = 0; i < ndata; i++) w[i] = i;
+  for (int i = ndata - 1; i > 0; i--) swap(w[i], w[rr.next() % (i + 1)]);
+}
+
+void permgen::makerange(const vector<int> *pending,
+                        const vector<uint32> *attempts, int first, int step) {
+  for (size_t i = first; i < pending->size(); i += step)
+    make((*pending)[i], (*attempts)[(*pending)[i]]);
+}
+
+bool permgen::insert(int col) {
+  const uint32 *w = &words[col * width];
+  uint64 fp = permmix(width);
+  for (size_t i = 0; i < width; i++) fp = permmix(fp ^ w[i]);
+  if (fp == 0) fp = 1;
+  uint64 mask = slots.size() - 1;
+  for (uint64 s = fp & mask;; s = (s + 1) & mask) {
+    if (slots[s] == 0) {
+      slots[s] = fp;
+      slotcols[s] = col;
+      return true;
+    }
+    if (slots[s] == fp &&
+        !memcmp(w, &words[slotcols[s] * width], width * sizeof(uint32)))
+      return false;
+  }
+}
+
+int permgen::generate(int nperms) {
+  // small enough to do exhaustively
+  if (method == vb_orderperm && ndata <= PERMUTATION_LIMIT) {
+    ncols = factorial(ndata);
+    words.resize(ncols * width);
+    gsl_permutation *v = gsl_permutation_calloc(ndata);
+    if (!v) return 101;
+    int col = 0;
+    do {
+      for (int i = 0; i < ndata; i++) words[col * width + i] = v->data[i];
+      col++;
+    } while (gsl_permutation_next(v) == GSL_SUCCESS);
+    gsl_permutation_free(v);
+    return 0;
+  }
+  if (method == vb_signperm && ndata <= SIGN_PERMUTATION_LIMIT) {
+    ncols = 1 << (ndata - 1);
+    words.resize(ncols * width);
+    for (int i = 0; i < ncols; i++) words[i] = i;
+    return 0;
+  }
+
+  if (nperms < 1) return 102;
+  ncols = nperms;
+  words.resize(ncols * width);
+  size_t nslots = 1024;
+  while (nslots < (size_t)ncols * 2) nslots *= 2;
+  slots.assign(nslots, 0);
+  slotcols.resize(nslots);
+
+  vector<uint32> attempts(ncols, 0);
+  vector<int> pending;
+  // order permutations always include the unpermuted order first
+  if (method == vb_orderperm) {
+    for (int i = 0; i < ndata; i++) words[i] = i;
+    insert(0);
+  } else
+    pending.push_back(0);
+  for (int i = 1; i < ncols; i++) pending.push_back(i);
+
+  while (pending.size()) {
+    int nthreads = min(ncores(), (int)(pending.size() / 256) + 1);
+    if (nthreads < 2)
+      makerange(&pending, &attempts, 0, 1);
+    else {
+      boost::thread_group tg;
+      for (int t = 0; t < nthreads; t++)
+        tg.create_thread(boost::bind(&permgen::makerange, this, &pending,
+                                     &attempts, t, nthreads));
+      tg.join_all();
+    }
+    vector<int> retry;
+    vbforeach(int col, pending) {
+      if (insert(col)) continue;
+      // give up if we're clearly out of distinct permutations
+      if (++attempts[col] > 1000) return 103;
+      retry.push_back(col);
+    }
+    pending.swap(retry);
+  }
+  return 0;
+}
+
+}  // namespace
+
 VBMatrix createPermMatrix(int nperms, int ndata, VB_permtype method,
                           uint32 rngseed) {
-  VBMatrix permMat(ndata, nperms);
   VBMatrix errormat(1, 1);
+  if (method != vb_orderperm && method != vb_signperm) return errormat;
+  if (ndata < 1) return errormat;
+  if (rngseed == 0) rngseed = VBRandom();
+  permgen pg(method, ndata, rngseed);
+  if (pg.generate(nperms)) return errormat;
+  VBMatrix permMat(ndata, pg.count());
   if (!permMat.valid()) {
     permMat.clear();
     return permMat;
   }
-  map<size_t, vector<gsl_permutation *> > permHash;
-
-  map<short, vector<short *> > signHash;
-  gsl_permutation *v;
-  short *signPerm;
-
-  switch (method) {
-    case vb_orderperm:
-      v = gsl_permutation_calloc(ndata);
-      if (!v) return errormat;
-      if (ndata <= PERMUTATION_LIMIT) {
-        nperms = (size_t)lrint(exp(gamma(ndata + 1)));
-        do {
-          inHash(permHash, v);
-        } while (gsl_permutation_next(v) == GSL_SUCCESS);
-      } else {
-        inHash(permHash, v);
-        initRNG(rngseed);
-        for (int i = 1; i < nperms; i++) {
-          randPerm(v);
-          while (inHash(permHash, v)) randPerm(v);
-        }
-        freeRNG();
-      }
-      if (v) gsl_permutation_free(v);
-      break;
-    case vb_signperm:
-      signPerm = new short[ndata];
-      if (ndata <= SIGN_PERMUTATION_LIMIT) {
-        nperms = (1 << (ndata - 1));
-        for (int i = 0; i < nperms; i++) {
-          for (int j = 0; j < ndata; j++)
-            signPerm[j] = (utils::getBit(i, j) * -2) + 1;
-          inSignHash(signHash, signPerm, ndata);
-        }
-      } else {
-        initRNG(rngseed);
-        for (int i = 0; i < nperms; i++) {
-          randSignPerm(signPerm, ndata);
-          while (inSignHash(signHash, signPerm, ndata))
-            randSignPerm(signPerm, ndata);
-        }
-        freeRNG();
-      }
-      if (signPerm) delete signPerm;
-      signPerm = 0;
-      break;
-    default:
-      return errormat;
-      break;
-  }
-  VB_Vector vec(ndata);
-  size_t colIndex = 0;
-  switch (method) {
-    case vb_orderperm: {
-      map<size_t, vector<gsl_permutation *> >::iterator mItr;
-      for (mItr = permHash.begin(); mItr != permHash.end(); mItr++) {
-        for (size_t i = 0; i < mItr->second.size(); i++) {
-          for (int k = 0; k < ndata; k++) vec[k] = mItr->second[i]->data[k];
-          permMat.SetColumn(colIndex, vec);
-          colIndex++;
-        }
-      }
-      freePermHash(permHash);
-    } break;
-    default:
-      map<short, vector<short *> >::iterator mItr;
-      for (mItr = signHash.begin(); mItr != signHash.end(); mItr++) {
-        for (size_t i = 0; i < mItr->second.size(); i++) {
-          for (int k = 0; k < ndata; k++) vec[k] = mItr->second[i][k];
-          if (ndata <= SIGN_PERMUTATION_LIMIT)
-            permMat.SetColumn(rankSignPerm(mItr->second[i], ndata), vec);
-          else {
-            permMat.SetColumn(colIndex, vec);
-            colIndex++;
-          }
-        }
-      }
-      freeSignHash(signHash);
-      break;
-  }
+  for (int j = 0; j < pg.count(); j++)
+    for (int i = 0; i < ndata; i++) permMat.set(i, j, pg.value(j, i));
   return permMat;
 }
 
@@ -310,12 +327,6 @@ void printGSLPerm(const gsl_permutation *pi) {
   cout << endl;
 }  // void printGSLPerm(const gsl_permutation *pi)
 
-// pick a random permutation
-
-void randPerm(gsl_permutation *pi) {
-  gsl_ran_shuffle(theRNG, pi->data, pi->size, sizeof(size_t));
-}
-
 /*********************************************************************
  * This function simply increments the elements of the input          *
  * permutation.                                                       *
@@ -520,47 +531,6 @@ size_t rank1(const size_t n, gsl_permutation *pi, gsl_permutation *piInv) {
 }  // size_t rank1(const size_t n, gsl_permutation *pi,
    // gsl_permutation *piInv)
 
-/*********************************************************************
- * This function checks to see if the input permutation already       *
- * exists in the input permutation hash table or not. If the          *
- * is not yet in the hash table, it is added to the hash table.       *
- *                                                                    *
- * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
- * ----------------   -----           ------------                    *
- * permHash           map<size_t, vector<const gsl_permutation *> >   *
- *                                    The input permutation hash      *
- *                                    table.                          *
- * pi                 const gsl_permutation * The input permutation.  *
- *                                                                    *
- * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
- * -----------------   -----          ------------                    *
- * If the input permutation is not in the input permutation hash      *
- * table, then false is returned. Otherwise, true is returned.        *
- *                                                                    *
- * EXCEPTIONS THROWN:                                                 *
- * ------------------                                                 *
- * None.                                                              *
- *********************************************************************/
-bool inHash(map<size_t, vector<gsl_permutation *> > &permHash,
-            gsl_permutation *pi) {
-  gsl_permutation *rho = NULL;
-  if (permHash.count(pi->data[0]) == 0) {
-    vector<gsl_permutation *> permVec;
-    rho = gsl_permutation_alloc(pi->size);
-    gsl_permutation_memcpy(rho, pi);
-    permVec.push_back(rho);
-    permHash.insert(
-        pair<size_t, vector<gsl_permutation *> >(pi->data[0], permVec));
-    return false;
-  }
-  for (size_t i = 0; i < permHash[pi->data[0]].size(); i++)
-    if (arePermsEqual(pi, permHash[pi->data[0]][i], 1)) return true;
-  rho = gsl_permutation_alloc(pi->size);
-  gsl_permutation_memcpy(rho, pi);
-  permHash[pi->data[0]].push_back(rho);
-  return false;
-}
-
 void initRNG(uint32 rngseed) {
   gsl_rng_env_setup();
   const gsl_rng_type *T;
@@ -587,294 +557,6 @@ void availableGSLRNGs() {
 
 }  // void availableGSLRNGs()
 
-/*********************************************************************
- * This function prints out the contents of the input map container,  *
- * which is used has a hash table for a set of GSL permutations.      *
- *                                                                    *
- * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
- * ----------------   -----           ------------                    *
- * theHash   map<size_t, vector<gsl_permutation *> >&                 *
- *                                    The input map container.        *
- *                                                                    *
- * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
- * -----------------   -----          ------------                    *
- * None.                                                              *
- *                                                                    *
- * EXCEPTIONS THROWN:                                                 *
- * ------------------                                                 *
- * None.                                                              *
- *********************************************************************/
-void printHash(map<size_t, vector<gsl_permutation *> > &theHash) {
-  /*********************************************************************
-   * An iterator is instantiated to the beginning of the map.           *
-   *********************************************************************/
-  map<size_t, vector<gsl_permutation *> >::iterator mItr;
-
-  /*********************************************************************
-   * hashSize is initialized to 0. It will be used to cound up the      *
-   * number of GSL permutations in the input map.                       *
-   *********************************************************************/
-  size_t hashSize = 0;
-
-  /*********************************************************************
-   * Printing out a separator line.                                     *
-   *********************************************************************/
-  cout << "+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++"
-       << endl;
-
-  /*********************************************************************
-   * The following for loop iterates through the map container.         *
-   *********************************************************************/
-  for (mItr = theHash.begin(); mItr != theHash.end(); mItr++) {
-    /*********************************************************************
-     * Incrementing hashSize.                                             *
-     *********************************************************************/
-    hashSize += mItr->second.size();
-
-    /*********************************************************************
-     * This for loop iterates through the vector container pointed to by  *
-     * mItr.                                                              *
-     *********************************************************************/
-    for (size_t i = 0; i < mItr->second.size(); i++) {
-      /*********************************************************************
-       * Now printing out the GSL permutation.                              *
-       *********************************************************************/
-      printGSLPerm(mItr->second[i]);
-
-    }  // for i
-
-  }  // for mItr
-
-  /*********************************************************************
-   * Printing out the map size, hashSize, and a separator line to       *
-   * "close off" the printing of the map container.                     *
-   *********************************************************************/
-  cout << "MAP SIZE  = [" << theHash.size() << "]" << endl;
-  cout << "HASH SIZE = [" << hashSize << "]" << endl;
-  cout << "+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++"
-       << endl;
-
-}  // void printHash(map<size_t, vector<gsl_permutation *> >& theHash)
-
-/*********************************************************************
- * This function frees the memory allocated to the gsl_permutation    *
- * structs contained in the input map container.                      *
- *                                                                    *
- * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
- * ----------------   -----           ------------                    *
- * theHash    map<size_t, vector<gsl_permutation *> >&                *
- *                                    The input map container.        *
- *                                                                    *
- * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
- * -----------------   -----          ------------                    *
- * None.                                                              *
- *                                                                    *
- * EXCEPTIONS THROWN:                                                 *
- * ------------------                                                 *
- * None.                                                              *
- *********************************************************************/
-void freePermHash(map<size_t, vector<gsl_permutation *> > &theHash) {
-  map<size_t, vector<gsl_permutation *> >::iterator mItr;
-  for (mItr = theHash.begin(); mItr != theHash.end(); mItr++)
-    for (size_t i = 0; i < mItr->second.size(); i++)
-      if (mItr->second[i]) gsl_permutation_free(mItr->second[i]);
-}
-
-/*********************************************************************
- * This function returns true if the two input sign permutations are  *
- * equal. Otherwise, false is returned.                               *
- *                                                                    *
- * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
- * ----------------   -----           ------------                    *
- * p1                 const short *   The first of the two sign       *
- *                                    permutations to be compared.    *
- * p2                 const short *   The second of the two sign      *
- *                                    permutations to be compared.    *
- * len                const size_t    The length of both input sign   *
- *                                    permutations.                   *
- *                                                                    *
- * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
- * -----------------   -----          ------------                    *
- * If the two permutations are equal, then true is returned.          *
- * Otherwise, false is returned.                                      *
- *                                                                    *
- * EXCEPTIONS THROWN:                                                 *
- * ------------------                                                 *
- * None.                                                              *
- *********************************************************************/
-bool areSignsEqual(const short *arr1, const short *arr2, const size_t len) {
-  /*********************************************************************
-   * If both arr1 and arr2 contain the same address, then true is       *
-   * returned.                                                          *
-   *********************************************************************/
-  if (arr1 == arr2) {
-    return true;
-  }  // if
-
-  /*********************************************************************
-   * The following for loop is used to compare the corresponding        *
-   * elements of the two sign permutations.                             *
-   *********************************************************************/
-  for (size_t i = 0; i < len; i++) {
-    /*********************************************************************
-     * If the two corresponding elements are not equal, then false is     *
-     * returned.                                                          *
-     *********************************************************************/
-    if (arr1[i] != arr2[i]) {
-      return false;
-    }  // if
-
-  }  // for i
-
-  /*********************************************************************
-   * If program flow ends up here, then no differences were found       *
-   * between the two input sign permutations. Therefore, true is        *
-   * is returned.                                                       *
-   *********************************************************************/
-  return true;
-
-}  // bool areSignsEqual(const short *arr1, const short *arr2, const size_t len)
-
-/*********************************************************************
- * This function checks to see if the input short array of 1's and    *
- * -1's (a sign permutation array) already  exists in the input sign  *
- * permutation hash table or not. If the short array is not yet in    *
- * the hash table, it is added to the hash table. NOTE: The key used  *
- * in the input map container, i.e., the input sign permutation hash  *
- * table, is the sum of the elements of the sign permutation.         *
- *                                                                    *
- * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
- * ----------------   -----           ------------                    *
- * signHash           map<short, vector<short *> > The input sign     *
- *                                                 permutation hash   *
- *                                                 table.             *
- *                                                                    *
- * pi                 short *         The input sign permutation.     *
- *                                                                    *
- * len                const size_t    The length of the input sign    *
- *                                    permutation.                    *
- *                                                                    *
- * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
- * -----------------   -----          ------------                    *
- * If the input sign permutation is not in the input permutation hash *
- * table, then false is returned. Otherwise, true is returned.        *
- *                                                                    *
- * EXCEPTIONS THROWN:                                                 *
- * ------------------                                                 *
- * None.                                                              *
- *********************************************************************/
-bool inSignHash(map<short, vector<short *> > &signHash, short *pi,
-                const size_t len) {
-  /*********************************************************************
-   * rho will be used to copy pi, if the need arises.                   *
-   *********************************************************************/
-  short *rho = NULL;
-
-  long sum = 0;
-  for (size_t i = 0; i < len; i++) sum += pi[i];
-
-  /*********************************************************************
-   * If signHash.count() returns 0, then the input sign permutation is  *
-   * not yet in signHash. Therefore, it is added to signHash and false  *
-   * is returned.                                                       *
-   *********************************************************************/
-  if (signHash.count(sum) == 0) {
-    vector<short *> permVec;
-    rho = new short[len];
-    if (!rho) {
-      ostringstream errorMsg;
-      errorMsg << "Unable to allocate memory for size [" << len
-               << "] sign permutation.";
-      printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
-                           __FILE__, 1);
-    }  // if
-    memcpy(rho, pi, sizeof(short) * len);
-    permVec.push_back(rho);
-    signHash.insert(pair<short, vector<short *> >(sum, permVec));
-    return false;
-  }  // if
-
-  /*********************************************************************
-   * The following for loop is used to check each element of the        *
-   * signHash map container. The sum of the elements of pi is used as   *
-   * the key for the signHash map. So using the map's [] operator, we   *
-   * compare pi to each sign permutation in the map whose first element *
-   * is the same as the sum of the elements of pi.                      *
-   *********************************************************************/
-  for (size_t i = 0; i < signHash[sum].size(); i++) {
-    /*********************************************************************
-     * If pi equals the sign permutation itr->second[i], then true is     *
-     * returned.                                                          *
-     *********************************************************************/
-    if (areSignsEqual(pi, signHash[sum][i], len)) {
-      return true;
-    }  // if
-
-  }  // for
-
-  /*********************************************************************
-   * If program flow ends up here, then pi is not in the hash table. So *
-   * we add pi to the hash table (at hash slot itr) and return false.   *
-   *********************************************************************/
-  rho = new short[len];
-  if (!rho) {
-    ostringstream errorMsg;
-    errorMsg << "Unable to allocate memory for size [" << len
-             << "] sign permutation.";
-    printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
-                         __FILE__, 1);
-  }  // if
-  memcpy(rho, pi, sizeof(short) * len);
-  signHash[sum].push_back(rho);
-  return false;
-
-}  // bool inSignHash(map<short, vector<short *> > &signHash,
-   // short *pi, const size_t len)
-
-/*********************************************************************
- * This function frees the memory allocated to the sign permutations  *
- * contained in the input map container.                              *
- *                                                                    *
- * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
- * ----------------   -----           ------------                    *
- * theHash    map<short, vector<short *> >&                           *
- *                                    The input map container.        *
- *                                                                    *
- * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
- * -----------------   -----          ------------                    *
- * None.                                                              *
- *                                                                    *
- * EXCEPTIONS THROWN:                                                 *
- * ------------------                                                 *
- * None.                                                              *
- *********************************************************************/
-void freeSignHash(map<short, vector<short *> > &theHash) {
-  /*********************************************************************
-   * An iterator is instantiated to the beginning of the map.           *
-   *********************************************************************/
-  map<short, vector<short *> >::iterator mItr;
-
-  /*********************************************************************
-   * The following for loop iterates through the map container.         *
-   *********************************************************************/
-  for (mItr = theHash.begin(); mItr != theHash.end(); mItr++) {
-    /*********************************************************************
-     * This for loop iterates through the vector container pointed to by  *
-     * mItr.                                                              *
-     *********************************************************************/
-    for (size_t i = 0; i < mItr->second.size(); i++) {
-      /*********************************************************************
-       * Now freeing the previously allocated memory.                       *
-       *********************************************************************/
-      delete mItr->second[i];
-      mItr->second[i] = 0;
-
-    }  // for i
-
-  }  // for mItr
-
-}  // void freeSignHash(map<short, vector<short *> >& theHash)
-
 /*********************************************************************
  * This function prints out the contents of the input map container,  *
  * which is used has a hash table for a set of sign permutations.     *
@@ -115,11 +115,6 @@ size_t factorial(const size_t n);
  *********************************************************************/
 void printGSLPerm(const gsl_permutation *pi);
 
-/*********************************************************************
- * This function computes a random permutation.                       *
- *********************************************************************/
-void randPerm(gsl_permutation *pi);
-
 /*********************************************************************
  * This function increments the elements of the input permutation.    *
  *********************************************************************/
@@ -152,50 +147,12 @@ void unrank1(const size_t n, const size_t r, gsl_permutation *pi);
  *********************************************************************/
 size_t rank1(const size_t n, gsl_permutation *pi, gsl_permutation *piInv);
 
-/*********************************************************************
- * This function determines if the permutation pi is already in the   *
- * the permutation hash table or not.                                 *
- *********************************************************************/
-bool inHash(map<size_t, vector<gsl_permutation *> > &permHash,
-            gsl_permutation *pi);
-
 /*********************************************************************
  * This function prints out a list of the available GSL random number *
  * generators.                                                        *
  *********************************************************************/
 void availableGSLRNGs();
 
-/*********************************************************************
- * This function prints out the contents of the input map container.  *
- *********************************************************************/
-void printHash(map<size_t, vector<gsl_permutation *> > &theHash);
-
-/*********************************************************************
- * This function frees the memory allocated to the gsl_permutation    *
- * structs contained in the map.                                      *
- *********************************************************************/
-void freePermHash(map<size_t, vector<gsl_permutation *> > &theHash);
-
-/*********************************************************************
- * This function returns true if the 2 input sign permutation arrays  *
- * are equal. Otherwise, false is returned.                           *
- *********************************************************************/
-bool areSignsEqual(const short *arr1, const short *arr2, const size_t len);
-
-/*********************************************************************
- * This function retutns true if the input sign permutation is already*
- * in the input sign permutation hash table. Otherwise, the input     *
- * permutation is added to the hash table and false is returned.      *
- *********************************************************************/
-bool inSignHash(map<short, vector<short *> > &signHash, short *pi,
-                const size_t len);
-
-/*********************************************************************
- * This function frees the memory allocated to the elements in the    *
- * input map container (which are sign permutation arrays).           *
- *********************************************************************/
-void freeSignHash(map<short, vector<short *> > &theHash);
-
 /*********************************************************************
  * This function prints the elements in the input map container       *
  * (which are sign permutation arrays).                               *
@@ -39,6 +39,9 @@
  *   3) firstSliceTime is set to 0 and sliceTime to TR/dimZ.          *
  *********************************************************************/
 #include "sliceacq.h"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <limits>
 
 /*********************************************************************
  * Need a global VBPrefs object named vbp. vbp is used to determine   *
@@ -64,14 +67,12 @@ int main(int argc, char* argv[]) {
    *        default is to not recorrect a 4D data file.                 *
    * alreadyCorrected - will be set to true if the input 4D data file   *
    *                    has already been corrected.                     *
-   * dimT - the maximum value of the time dimension in the 4D data file.*
    * dimZ - the maximum value of the Z dimension in the 4D data file.   *
    * sliceTime - used to hold the user specified value of slice time.   *
    * firstSliceTime - time when the first slice was taken in ms.        *
    *********************************************************************/
   bool redo = false;
   bool alreadyCorrected = false;
-  unsigned int dimT = 0;
   unsigned int dimZ = 0;
   double sliceTime = 0.0;
   double firstSliceTime = -1.0;
@@ -279,9 +280,8 @@ int main(int argc, char* argv[]) {
   }  // if
 
   /*********************************************************************
-   * Now assigning dimT, and dimZ.
+   * Now assigning dimZ.
    *********************************************************************/
-  dimT = theTes.dimt;
   dimZ = theTes.dimz;
 
   /*********************************************************************
@@ -404,52 +404,9 @@ int main(int argc, char* argv[]) {
   }  // for i
 
   /*********************************************************************
-   * totalSpatialVoxels will hold the number of spatial voxels.         *
+   * Phase shifting every in-mask time series, a slice at a time.       *
    *********************************************************************/
-  unsigned long totalSpatialVoxels = theTes.voxels;
-
-  /*********************************************************************
-   * tempX, tempY, and tempZ will hold spatial coordinates.             *
-   *********************************************************************/
-  int32 tempX, tempY, tempZ;
-
-  /*********************************************************************
-   * The following for loop isued to processes the non-zero time series.*
-   *********************************************************************/
-  for (unsigned int i = 0; i < totalSpatialVoxels; i++) {
-    /*********************************************************************
-     * Converting the index i (which should be viewed as an index of      *
-     * Tes::data[]) into its coresponding spatial coordinates.            *
-     *********************************************************************/
-    theTes.getXYZ(tempX, tempY, tempZ, i);
-
-    /*********************************************************************
-     * If the mask value at (tempX, tempY, tempZ) is not zero, then we    *
-     * need to process the time series.                                   *
-     *********************************************************************/
-    if (theTes.GetMaskValue(tempX, tempY, tempZ) != (int)0) {
-      /*********************************************************************
-       * shiftedSeries will hold the phase shifted time series.             *
-       *********************************************************************/
-      VB_Vector shiftedSeries(dimT);
-
-      theTes.GetTimeSeries(tempX, tempY, tempZ);
-
-      /*********************************************************************
-       * Phase shifting the time series.                                    *
-       *********************************************************************/
-      phaseShift(theTes.timeseries, shiftAmount[tempZ], shiftedSeries);
-
-      /*********************************************************************
-       * Setting the new values.                                            *
-       *********************************************************************/
-      for (unsigned int j = 0; j < dimT; j++) {
-        theTes.SetValue(tempX, tempY, tempZ, j, shiftedSeries[j]);
-      }  // for j
-
-    }  // if
-
-  }  // for i
+  phaseShiftSlices(theTes, shiftAmount);
 
   /*********************************************************************
    * Now building up the header line that is to be added.               *
@@ -1151,3 +1108,145 @@ void makePhi(VB_Vector& phi, const double timeShift) {
   }  // else
 
 }  // void makePhi(VB_Vector& phi, const double timeShift)
+
+/*********************************************************************
+ * Slice-batched phase shifting. The shift depends only on the slice, *
+ * so every voxel in a slice is multiplied by the same complex phase  *
+ * ramp. For each slice, the in-mask time series are gathered into a  *
+ * contiguous panel, transformed together with VB_Vector::fftBatch(), *
+ * multiplied by the ramp, transformed back, and written back into    *
+ * the Tes in place. Slices are divided among threads.                *
+ *                                                                    *
+ * Only the n/2+1 non-redundant frequencies are kept. The shifted     *
+ * signal is the real part of the inverse transform, which is all     *
+ * phaseShift() ever kept, and the real part only depends on those.   *
+ *********************************************************************/
+namespace {
+
+template <class T>
+void gatherSeries(const unsigned char* src, unsigned int n, double* dest) {
+  const T* vals = (const T*)src;
+  for (unsigned int t = 0; t < n; t++) dest[t] = (double)vals[t];
+}  // gatherSeries()
+
+template <class T>
+void scatterSeries(const double* src, unsigned int n, unsigned char* dest) {
+  T* vals = (T*)dest;
+  for (unsigned int t = 0; t < n; t++) {
+    if (numeric_limits<T>::is_integer)
+      vals[t] = (T)round(src[t]);
+    else
+      vals[t] = (T)src[t];
+  }  // for t
+}  // scatterSeries()
+
+void shiftSlice(Tes& theTes, int z, double timeShift) {
+  const unsigned int n = theTes.dimt;
+  const unsigned int nfreq = n / 2 + 1;
+  const int slicesize = theTes.dimx * theTes.dimy;
+
+  /*********************************************************************
+   * The voxels to do are the ones in the mask that have data (voxels   *
+   * with no data are all zero, and stay that way).                     *
+   *********************************************************************/
+  vector<int> voxels;
+  for (int i = z * slicesize; i < (z + 1) * slicesize; i++)
+    if (theTes.mask[i] && theTes.data[i]) voxels.push_back(i);
+  if (voxels.empty()) return;
+  const size_t count = voxels.size();
+
+  /*********************************************************************
+   * The phase ramp for this slice, as cos() and sin() of phi.          *
+   *********************************************************************/
+  VB_Vector phi(n);
+  makePhi(phi, timeShift);
+  vector<double> rampCos(nfreq), rampSin(nfreq);
+  for (unsigned int k = 0; k < nfreq; k++) {
+    rampCos[k] = cos(phi[k]);
+    rampSin[k] = sin(phi[k]);
+  }  // for k
+
+  vector<double> panel(count * n);
+  vector<double> realPart(count * nfreq), imagPart(count * nfreq);
+  for (size_t v = 0; v < count; v++) {
+    unsigned char* src = theTes.data[voxels[v]];
+    double* dest = &panel[v * n];
+    switch (theTes.datatype) {
+      case vb_byte:
+        gatherSeries<unsigned char>(src, n, dest);
+        break;
+      case vb_short:
+        gatherSeries<int16>(src, n, dest);
+        break;
+      case vb_long:
+        gatherSeries<int32>(src, n, dest);
+        break;
+      case vb_float:
+        gatherSeries<float>(src, n, dest);
+        break;
+      case vb_double:
+        gatherSeries<double>(src, n, dest);
+        break;
+    }  // switch
+  }    // for v
+
+  VB_Vector::fftBatch(&panel[0], n, count, &realPart[0], &imagPart[0],
+                      vb_fft_r2c);
+  for (size_t v = 0; v < count; v++) {
+    double* re = &realPart[v * nfreq];
+    double* im = &imagPart[v * nfreq];
+    for (unsigned int k = 0; k < nfreq; k++) {
+      double r = re[k], i = im[k];
+      re[k] = (rampCos[k] * r) - (rampSin[k] * i);
+      im[k] = (rampCos[k] * i) + (rampSin[k] * r);
+    }  // for k
+  }    // for v
+  VB_Vector::ifftRealBatch(&realPart[0], &imagPart[0], n, count, &panel[0],
+                           vb_fft_r2c);
+
+  for (size_t v = 0; v < count; v++) {
+    unsigned char* dest = theTes.data[voxels[v]];
+    const double* src = &panel[v * n];
+    switch (theTes.datatype) {
+      case vb_byte:
+        scatterSeries<unsigned char>(src, n, dest);
+        break;
+      case vb_short:
+        scatterSeries<int16>(src, n, dest);
+        break;
+      case vb_long:
+        scatterSeries<int32>(src, n, dest);
+        break;
+      case vb_float:
+        scatterSeries<float>(src, n, dest);
+        break;
+      case vb_double:
+        scatterSeries<double>(src, n, dest);
+        break;
+    }  // switch
+  }    // for v
+}  // shiftSlice()
+
+void shiftSliceWorker(Tes* theTes, const VB_Vector* shiftAmount, int first,
+                      int step) {
+  for (int z = first; z < theTes->dimz; z += step)
+    shiftSlice(*theTes, z, (*shiftAmount)[z]);
+}  // shiftSliceWorker()
+
+}  // namespace
+
+void phaseShiftSlices(Tes& theTes, const VB_Vector& shiftAmount,
+                      int nthreads) {
+  if (!theTes.data || theTes.dimt < 1) return;
+  if (nthreads < 1) nthreads = ncores();
+  if (nthreads > theTes.dimz) nthreads = theTes.dimz;
+  if (nthreads < 2) {
+    shiftSliceWorker(&theTes, &shiftAmount, 0, 1);
+    return;
+  }  // if
+  boost::thread_group tg;
+  for (int t = 0; t < nthreads; t++)
+    tg.create_thread(
+        boost::bind(shiftSliceWorker, &theTes, &shiftAmount, t, nthreads));
+  tg.join_all();
+}  // phaseShiftSlices()
@@ -64,6 +64,9 @@ void phaseShift(const VB_Vector& tSeries, const double timeShift,
 
 void makePhi(VB_Vector& phi, const double timeShift);
 
+void phaseShiftSlices(Tes& theTes, const VB_Vector& shiftAmount,
+                      int nthreads = 0);
+
 // qq get rid of getMaskValueByIndex?
 int getMaskValueByIndex(const Tes& myTes, const unsigned int ind,
                         const unsigned int dimX, const unsigned int dimY,
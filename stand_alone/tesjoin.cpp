@@ -39,6 +39,9 @@ void getVec(const string &tesFile, const int dimT, VB_Vector &pVec);
 void writeMoveParamsFile(const double *paramValues, const string &outputFile,
                          const int origDimT, const string &firstSplitFile);
 string getLastTesSplitLine(const Tes &theTes);
+void joinInMemory(Tes *splitTes, const vector<string> &inputFiles,
+                  const vector<int> &srcFile, const vector<int> &srcIndex,
+                  Tes &outputTes);
 
 /*********************************************************************
  * This program joins a set of Tes files previously split by tesplit. *
@@ -63,6 +66,7 @@ int main(int argc, char *argv[]) {
    *        enclosed by doubles quotes and space delimited.             *
    * -o ==> Specifies the output file name.                             *
    * -m ==> Also join the corresponding "_MoveParams.ref" files.        *
+   * -s ==> How many MB of data to hold at once.                        *
    * -v ==> Print out the gobal VoxBo version number.                   *
    *                                                                    *
    * VARIABLES:                                                         *
@@ -73,14 +77,17 @@ int main(int argc, char *argv[]) {
    * deleteFiles - a flag, if used then the input files will be deleted.*
    * moveParams - a flag, if used then join the "_MoveParams.ref" files *
    *              as well.                                              *
+   * bufSize - used to hold the buffer size in MB.                      *
    *********************************************************************/
   bool printHelp = false;
   bool printVersion = false;
   bool deleteFiles = false;
   bool moveParams = false;
-  processOpts(argc, argv, ":hd:f:l:o:vrm", "bZZZZbbb", &printHelp,
+  int bufSize = 256;
+  processOpts(argc, argv, ":hd:f:l:o:vrms:", "bZZZZbbbi", &printHelp,
               &directoryName, &fileName, &fileList, &outputFile, &printVersion,
-              &deleteFiles, &moveParams);
+              &deleteFiles, &moveParams, &bufSize);
+  if (bufSize < 1) bufSize = 1;
   if (printHelp) usage(0, argv[0]);
 
   if (printVersion) printf("\nVoxBo v%s\n", vbversion.c_str());
@@ -244,8 +251,11 @@ int main(int argc, char *argv[]) {
   memset(origOrigin, 0, sizeof(int) * 3);
   string headerSplitLine = string("");
   for (unsigned int i = 0; i < inputFiles.size(); i++) {
-    splitTes[i].ReadFile(inputFiles[i]);
-    if (!splitTes[i].data_valid) {
+    /*********************************************************************
+     * Only the headers are read here. The data are streamed straight     *
+     * from the input files to the output file once the join is planned.  *
+     *********************************************************************/
+    if (splitTes[i].ReadHeader(inputFiles[i])) {
       ostringstream errorMsg;
       errorMsg << "Unable to read input Tes file: [" << inputFiles[i] << "].";
       printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
@@ -530,8 +540,12 @@ int main(int argc, char *argv[]) {
       }
     }
   }
-  Tes outputTes = Tes();
-  outputTes.SetVolume(dimX, dimY, dimZ, origDimT, origDataType);
+  /*********************************************************************
+   * srcFile[] and srcIndex[] record, for each time series of the       *
+   * joined file, which input file it comes from and where it is in     *
+   * that file.                                                         *
+   *********************************************************************/
+  vector<int> srcFile(origDimT, -1), srcIndex(origDimT, -1);
   short tSeriesCheck[origDimT];
   memset(tSeriesCheck, 0, origDimT * sizeof(short));
   double *paramValues = NULL;
@@ -551,27 +565,30 @@ int main(int argc, char *argv[]) {
       tokenlist S2(range, "-");
       int beginRange = (int)strtol(S2[0]);
       int endRange = (int)strtol(S2[1]);
-      OPEN_SPATIAL_LOOPS(splitTes[i])
+      if (beginRange < 0 || endRange >= origDimT ||
+          endRange - beginRange + 1 != splitTes[i].dimt) {
+        ostringstream errorMsg;
+        errorMsg << " The range [" << range << "] of the file ["
+                 << splitTes[i].filename << "] is invalid.";
+        printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
+                             __FILE__, 1);
+      }
       /*********************************************************************
-       * The following for loop is used to traverse the current input file, *
-       * splitTes[i], and outputTes, the output Tes object. This for loop   *
-       * copies the time series from the current input file to outputTes so *
-       * the "joined" Tes file can be created. rangeIndex indexes the time  *
-       * dimension in outputTes and splitDimTIndex indexes the time         *
-       * dimension for splitTes[i].                                         *
+       * The following for loop is used to map the time series of the      *
+       * current input file, splitTes[i], onto the joined file. rangeIndex  *
+       * indexes the time dimension of the joined file and splitDimTIndex   *
+       * indexes the time dimension for splitTes[i].                        *
        *********************************************************************/
       for (int rangeIndex = beginRange, splitDimTIndex = 0;
            rangeIndex <= endRange; rangeIndex++, splitDimTIndex++) {
         /*********************************************************************
          * The appropriate element of tSeriesCheck[] is set to 1 to indicate  *
-         * that we have retrieved time series number rangeIndex for outputTes.*
+         * that we have found time series number rangeIndex.                 *
          *********************************************************************/
         tSeriesCheck[rangeIndex] = 1;
-        outputTes.SetValue(
-            indexX, indexY, indexZ, rangeIndex,
-            splitTes[i].GetValue(indexX, indexY, indexZ, splitDimTIndex));
+        srcFile[rangeIndex] = i;
+        srcIndex[rangeIndex] = splitDimTIndex;
       }
-      CLOSE_SPATIAL_LOOPS
       if (moveParams) {
         /*********************************************************************
          * A Vec object is created from the split movement parameter file     *
@@ -584,13 +601,12 @@ int main(int argc, char *argv[]) {
       }
     } else if (splitType == "Binned") {
       int numBins = strtol(S[4]);
-      OPEN_SPATIAL_LOOPS(splitTes[i])
       /*********************************************************************
-       * The following for loop is used copy the time series values from    *
-       * the current input file (a "split Tes" file) into outputTes, the    *
-       * "joined" Tes object. Say that the original 4D data file had dimT   *
-       * equal to 6 and that numBins is 2. Then we have the following       *
-       * situation for the split Tes files:                                 *
+       * The following for loop is used to map the time series of the      *
+       * current input file (a "split Tes" file) onto the "joined" file.    *
+       * Say that the original 4D data file had dimT equal to 6 and that    *
+       * numBins is 2. Then we have the following situation for the split  *
+       * Tes files:                                                         *
        *                                                                    *
        * FILE:                  TIME SERIES:                                *
        * -----------------------------------------------------              *
@@ -602,7 +618,7 @@ int main(int argc, char *argv[]) {
        * second time series it received is (0 + numBins) = 2. The number    *
        * of the third (and final) time series it received is                *
        * (2 + numBins) = 4. Similarly for split_file2.tes. Therefore, the   *
-       * time dimension index in outputTes begins with the number of the    *
+       * time dimension index in the joined file begins with the number of  *
        * first time series that the split Tes file received (from the       *
        * original unsplit 4D data file) and then is incremented by numBins  *
        * in each iteration of the following for loop.                       *
@@ -615,17 +631,21 @@ int main(int argc, char *argv[]) {
       for (int splitIndex = 0, startSeries = strtol(S[6]);
            splitIndex < splitTes[i].dimt;
            splitIndex++, startSeries += numBins) {
+        if (startSeries < 0 || startSeries >= origDimT) {
+          ostringstream errorMsg;
+          errorMsg << " The file [" << splitTes[i].filename
+                   << "] has more time series than its bin allows.";
+          printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__,
+                               __FUNCTION__, __FILE__, 1);
+        }
         /*********************************************************************
          * The appropriate element of tSeriesCheck[] is set to 1 to indicate  *
-         * that we have retrieved time series number startSeries for          *
-         * outputTes.                                                         *
+         * that we have found time series number startSeries.                 *
          *********************************************************************/
         tSeriesCheck[startSeries] = 1;
-        outputTes.SetValue(
-            indexX, indexY, indexZ, startSeries,
-            splitTes[i].GetValue(indexX, indexY, indexZ, splitIndex));
+        srcFile[startSeries] = i;
+        srcIndex[startSeries] = splitIndex;
       }
-      CLOSE_SPATIAL_LOOPS
       if (moveParams) {
         VB_Vector pVec;
         getVec(inputFiles[i], splitTes[i].dimt, pVec);
@@ -680,7 +700,7 @@ int main(int argc, char *argv[]) {
   }
 
   /*********************************************************************
-   * As each time series was copied from a input file to outputTes, the *
+   * As each time series was mapped from an input file, the             *
    * corresponding element in tSeriesCheck[] was set to 1. The following*
    * for loop traverses tSeriesCheck[] looking for zeroes. If a zero    *
    * is found, then an error message is printed, and then this program  *
@@ -695,16 +715,57 @@ int main(int argc, char *argv[]) {
                            __FILE__, 1);
     }
   }
-  copyHeader(&(splitTes[inputFiles.size() - 1]), &outputTes);
-  addHeaderLine(&outputTes, "Sfff", "VoxSizes(XYZ):", splitTes[0].voxsize[0],
-                splitTes[0].voxsize[1], splitTes[0].voxsize[2]);
-  addHeaderLine(&outputTes, "Siii", "Origin(XYZ):", splitTes[0].origin[0],
-                splitTes[0].origin[1], splitTes[0].origin[2]);
-  string timeStr;
-  addHeaderLine(&outputTes, "SSS", "TesJoin:", timedate().c_str(),
-                splitType.c_str());
-  outputTes.SetFileName(outputFile);
-  if (outputTes.WriteFile()) {
+
+  /*********************************************************************
+   * The joined file is written through a VBTesStream, which reads the  *
+   * input files a block at a time, so that no more than bufSize MB of  *
+   * data are held in memory at once. The voxel sizes, origin, and TR   *
+   * come along with the first input file's header. Inputs the stream   *
+   * can't copy raw (scaled data in formats other than TES1 and NIfTI)  *
+   * and output formats other than TES1 and NIfTI are joined in memory  *
+   * instead, as they always used to be.                                *
+   *********************************************************************/
+  VBTesStream join;
+  join.bufsize = (size_t)bufSize * 1024 * 1024;
+  bool inMemory = false;
+  for (unsigned int i = 0; i < inputFiles.size(); i++) {
+    int err = join.addInput(inputFiles[i]);
+    if (err == 104 || err == 105) {
+      inMemory = true;
+      break;
+    } else if (err) {
+      ostringstream errorMsg;
+      errorMsg << "Unable to read input Tes file: [" << inputFiles[i] << "].";
+      printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
+                           __FILE__, 1);
+    }
+  }
+  int writeErr = 0;
+  if (!inMemory) {
+    for (int i = 0; i < origDimT; i++) join.addVolume(srcFile[i], srcIndex[i]);
+    Tes &outputTes = join.output();
+    outputTes.header.clear();
+    copyHeader(&(splitTes[inputFiles.size() - 1]), &outputTes);
+    addHeaderLine(&outputTes, "SSS", "TesJoin:", timedate().c_str(),
+                  splitType.c_str());
+    writeErr = join.write(outputFile);
+    if (writeErr == 103) inMemory = true;
+  }
+  if (inMemory) {
+    Tes outputTes;
+    outputTes.SetVolume(dimX, dimY, dimZ, origDimT, origDataType);
+    joinInMemory(splitTes, inputFiles, srcFile, srcIndex, outputTes);
+    copyHeader(&(splitTes[inputFiles.size() - 1]), &outputTes);
+    addHeaderLine(&outputTes, "SSS", "TesJoin:", timedate().c_str(),
+                  splitType.c_str());
+    addHeaderLine(&outputTes, "Sfff", "VoxSizes(XYZ):", splitTes[0].voxsize[0],
+                  splitTes[0].voxsize[1], splitTes[0].voxsize[2]);
+    addHeaderLine(&outputTes, "Siii", "Origin(XYZ):", splitTes[0].origin[0],
+                  splitTes[0].origin[1], splitTes[0].origin[2]);
+    outputTes.SetFileName(outputFile);
+    writeErr = outputTes.WriteFile();
+  }
+  if (writeErr) {
     ostringstream errorMsg;
     errorMsg << " Unable to write file [" << outputFile << "].";
     printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
@@ -747,7 +808,7 @@ void usage(const unsigned short exitValue, char *progName) {
   genusage(
       exitValue, progName, "- Tes file joining routine for VoxBo.",
       "-h -d[directory] -f[file name] -l[file list] -o[output file name] -m -r "
-      "-v",
+      "-s[MB] -v",
       "-h                        Print usage information. Optional.",
       "-d <directory>            Specify the directory containing the *.tes",
       "                          files to be joined.",
@@ -765,6 +826,9 @@ void usage(const unsigned short exitValue, char *progName) {
       "Optional.",
       "-r                        If used, then remove the input files. "
       "Optional.",
+      "-s <MB>                   How many MB of data to hold in memory at "
+      "once.",
+      "                          Default is 256. Optional.",
       "-v                        Global VoxBo version number. Optional.", "");
 }
 
@@ -942,3 +1006,47 @@ string getLastTesSplitLine(const Tes &theTes) {
 
   return tesSplitLine;
 }
+
+/*********************************************************************
+ * This function copies the time series of the joined file out of    *
+ * the input files, loading one input file at a time. srcFile[] and   *
+ * srcIndex[] say which input file and which time point each output   *
+ * time series comes from.                                            *
+ *                                                                    *
+ * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
+ * ----------------   -----           ------------                    *
+ * splitTes           Tes *           The input headers.              *
+ * inputFiles         vector<string>  The input file names.           *
+ * srcFile            vector<int>     Input file per output series.   *
+ * srcIndex           vector<int>     Input time point per output     *
+ *                                    series.                         *
+ *                                                                    *
+ * OUTPUT VARIABLES:   TYPE:          DESCRIPTION:                    *
+ * -----------------   -----          ------------                    *
+ * outputTes           Tes&           The joined data, which must     *
+ *                                    already be allocated.           *
+ *                                                                    *
+ * EXCEPTIONS THROWN:                                                 *
+ * ------------------                                                 *
+ * None.                                                              *
+ *********************************************************************/
+void joinInMemory(Tes *splitTes, const vector<string> &inputFiles,
+                  const vector<int> &srcFile, const vector<int> &srcIndex,
+                  Tes &outputTes) {
+  for (unsigned int i = 0; i < inputFiles.size(); i++) {
+    Tes inputTes;
+    if (inputTes.ReadFile(inputFiles[i])) {
+      ostringstream errorMsg;
+      errorMsg << "Unable to read input Tes file: [" << inputFiles[i] << "].";
+      printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
+                           __FILE__, 1);
+    }
+    for (int t = 0; t < outputTes.dimt; t++) {
+      if (srcFile[t] != (int)i) continue;
+      OPEN_SPATIAL_LOOPS(splitTes[i])
+      double val = inputTes.GetValue(indexX, indexY, indexZ, srcIndex[t]);
+      outputTes.SetValue(indexX, indexY, indexZ, t, val);
+      CLOSE_SPATIAL_LOOPS
+    }
+  }
+}
@@ -33,8 +33,11 @@ using namespace std;
 /* >>>>>>>>>>>>           FUNCTION PROTOTYPES          <<<<<<<<<<<< */
 
 void usage(const unsigned short exitValue, char* progName);
-void cr8SubSeries(int begin, int end, const Tes& inputTes, Tes& outputTes,
-                  const string& outFileName);
+void cr8SubSeries(int begin, int end, const Tes& inputTes,
+                  vector<int>& series);
+int writeSubSeries(Tes& inputTes, const vector<int>& series,
+                   const Tes& splitTes, const string& outFileName,
+                   int bufSize);
 
 /* >>>>>>>>>>>>         END FUNCTION PROTOTYPES        <<<<<<<<<<<< */
 
@@ -78,6 +81,7 @@ int main(int argc, char* argv[]) {
    *        the last sub-time series.                                   *
    * -b ==> Allot out consecutive time series into bins, as if dealing  *
    *        cards.                                                      *
+   * -s ==> How many MB of data to hold at once.                        *
    * -v ==> Print out the global VoxBo version number.                  *
    *                                                                    *
    * VARIABLES:                                                         *
@@ -94,6 +98,7 @@ int main(int argc, char* argv[]) {
    *             opposed to the current directory).                     *
    * divSize - used to hold the divisor. Must be in [1, dimT].          *
    * numBins - used to hold the number of bins.                         *
+   * bufSize - used to hold the buffer size in MB.                      *
    *********************************************************************/
   bool printHelp = false;
   bool printVersion = false;
@@ -102,12 +107,14 @@ int main(int argc, char* argv[]) {
   string outputDir;
   int divSize = -1;
   int numBins = 0;
+  int bufSize = 256;
   string extractedName;
   string extractedDir;
 
-  processOpts(argc, argv, ":hi:o:re:d:b:f:v", "bZZbZiiZb", &printHelp, &tesFile,
-              &outFileStem, &deleteInputFile, &extractionRange, &divSize,
-              &numBins, &outputDir, &printVersion);
+  processOpts(argc, argv, ":hi:o:re:d:b:f:s:v", "bZZbZiiZib", &printHelp,
+              &tesFile, &outFileStem, &deleteInputFile, &extractionRange,
+              &divSize, &numBins, &outputDir, &bufSize, &printVersion);
+  if (bufSize < 1) bufSize = 1;
 
   if (outputDir.size()) extractedDir = outputDir;
   if (outFileStem.size()) extractedName = outFileStem;
@@ -300,16 +307,17 @@ int main(int argc, char* argv[]) {
   }  // if
 
   /*********************************************************************
-   * Now instantiating a Tes object so the input 4D data file can be    *
-   * processed.                                                         *
+   * Now reading the header of the input 4D data file. The data are     *
+   * never loaded as a whole, each output file is streamed out of the   *
+   * input by a VBTesStream.                                            *
    *********************************************************************/
-  Tes inputTes(tesFile);
+  Tes inputTes;
 
   /*********************************************************************
    * If we were unable to read the 4D data file, an error message is    *
    * printed out and this program exits.                                *
    *********************************************************************/
-  if (!inputTes.data_valid) {
+  if (inputTes.ReadHeader(tesFile)) {
     ostringstream errorMsg;
     errorMsg << "Unable to read file: [" << tesFile << "].";
     printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
@@ -456,14 +464,15 @@ int main(int argc, char* argv[]) {
 
     /*********************************************************************
      * Now that we have finished checking beginExt and endExt, we can go  *
-     * ahead and extract the desired time series. Instantiating outTes,   *
-     * a Tes object that will consist of the desired sub-set of the time  *
-     * series from inputTes.                                              *
+     * ahead and extract the desired time series. series will hold the   *
+     * indices of the desired sub-set of the time series, and outTes the  *
+     * header line for this split (see writeSubSeries()).                 *
      *********************************************************************/
-    Tes outTes = Tes();
+    vector<int> series;
+    Tes outTes;
 
     /*********************************************************************
-     * Assembling the file name for outTes.                               *
+     * Assembling the output file name.                                   *
      *********************************************************************/
     // this code is so complex that this is the best way not to mess us anything
     // else, short of a re-write
@@ -481,25 +490,9 @@ int main(int argc, char* argv[]) {
       outFileName += "extracted.tes";
     }
     /*********************************************************************
-     * Calling cr8SubSeries() to populate outTes.                         *
+     * Calling cr8SubSeries() to fill in series.                          *
      *********************************************************************/
-    cr8SubSeries(beginExt, endExt, inputTes, outTes, outFileName);
-
-    /*********************************************************************
-     * Now adding all the header lines from the input 4D data file to     *
-     * outTes' header.                                                    *
-     *********************************************************************/
-    copyHeader(inputTes, outTes);
-
-    /*********************************************************************
-     * Now adding the "VoxSizes(XYZ)" and "Origin(XYZ)" header lines from *
-     * inputTes to outTes because these two header lines are  not stored  *
-     * in the Tes::header data member.                                    *
-     *********************************************************************/
-    addHeaderLine(outTes, "Sfff", "VoxSizes(XYZ):", inputTes.voxsize[0],
-                  inputTes.voxsize[1], inputTes.voxsize[2]);
-    addHeaderLine(outTes, "Siii", "Origin(XYZ):", inputTes.origin[0],
-                  inputTes.origin[1], inputTes.origin[2]);
+    cr8SubSeries(beginExt, endExt, inputTes, series);
 
     /*********************************************************************
      * Now adding the header line to outTes for the extraction process    *
@@ -533,13 +526,13 @@ int main(int argc, char* argv[]) {
                   dimT);
 
     /*********************************************************************
-     * Now writing out the output file. Upon success, Tes::WriteFile()    *
+     * Now writing out the output file. Upon success, writeSubSeries()    *
      * returns 0. If that is not the case, then an error message is       *
      * written out and then this program exits.                           *
      *********************************************************************/
-    if (outTes.WriteFile()) {
+    if (writeSubSeries(inputTes, series, outTes, outFileName, bufSize)) {
       ostringstream errorMsg;
-      errorMsg << "Unable to write Tes file [" << outTes.filename << "].";
+      errorMsg << "Unable to write Tes file [" << outFileName << "].";
       printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
                            __FILE__, 1);
     }  // if
@@ -587,10 +580,12 @@ int main(int argc, char* argv[]) {
     for (int i = 0; (i + divSize) <= dimT; i += divSize, numFile++) {
       /*********************************************************************
        * Now that we have verified that divSize has a valid value, we can   *
-       * go ahead and process the input 4D data file. An output Tes object  *
-       * is instantiated.                                                   *
+       * go ahead and process the input 4D data file. series will hold the  *
+       * indices of this division's time series, and outTes the header line *
+       * for it (see writeSubSeries()).                                     *
        *********************************************************************/
-      Tes outTes = Tes();
+      vector<int> series;
+      Tes outTes;
 
       /*********************************************************************
        * Assembling the output file name. First, numFile is turned into a   *
@@ -602,25 +597,9 @@ int main(int argc, char* argv[]) {
 
       /*********************************************************************
        * Calling cr8SubSeries() to extract the appropriate sub-set of the   *
-       * time series and populate outTes.                                   *
+       * time series into series.                                           *
        *********************************************************************/
-      cr8SubSeries(i, i + divSize - 1, inputTes, outTes, outFileName);
-
-      /*********************************************************************
-       * Now adding all the header lines from the input 4D data file to     *
-       * outTes' header.                                                    *
-       *********************************************************************/
-      copyHeader(inputTes, outTes);
-
-      /*********************************************************************
-       * Now adding the "VoxSizes(XYZ)" and "Origin(XYZ)" header lines from *
-       * inputTes to outTes because these two header lines are  not stored  *
-       * in the Tes::header data member.                                    *
-       *********************************************************************/
-      addHeaderLine(outTes, "Sfff", "VoxSizes(XYZ):", inputTes.voxsize[0],
-                    inputTes.voxsize[1], inputTes.voxsize[2]);
-      addHeaderLine(outTes, "Siii", "Origin(XYZ):", inputTes.origin[0],
-                    inputTes.origin[1], inputTes.origin[2]);
+      cr8SubSeries(i, i + divSize - 1, inputTes, series);
 
       /*********************************************************************
        * Now adding the header line to outTes for the extraction process    *
@@ -658,13 +637,13 @@ int main(int argc, char* argv[]) {
                     timedate().c_str(), tesFile.c_str(), numString, dimT);
 
       /*********************************************************************
-       * Now writing out the output file. Upon success, Tes::WriteFile()    *
+       * Now writing out the output file. Upon success, writeSubSeries()    *
        * returns 0. If that is not the case, then an error message is       *
        * written out and then this program exits.                           *
        *********************************************************************/
-      if (outTes.WriteFile()) {
+      if (writeSubSeries(inputTes, series, outTes, outFileName, bufSize)) {
         ostringstream errorMsg;
-        errorMsg << "Unable to write Tes file [" << outTes.filename << "].";
+        errorMsg << "Unable to write Tes file [" << outFileName << "].";
         printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
                              __FILE__, 1);
       }  // if
@@ -680,10 +659,12 @@ int main(int argc, char* argv[]) {
     if ((leftOver = (dimT % divSize)) != 0) {
       /*********************************************************************
        * Now that we have verified that divSize has a valid value, we can   *
-       * go ahead and process the input 4D data file. An output Tes object  *
-       * is instantiated.                                                   *
+       * go ahead and process the input 4D data file. series will hold the  *
+       * indices of this division's time series, and outTes the header line *
+       * for it (see writeSubSeries()).                                     *
        *********************************************************************/
-      Tes outTes = Tes();
+      vector<int> series;
+      Tes outTes;
 
       /*********************************************************************
        * Assembling the output file name.                                   *
@@ -697,25 +678,9 @@ int main(int argc, char* argv[]) {
 
       /*********************************************************************
        * Calling cr8SubSeries() to extract the appropriate sub-set of the   *
-       * time series and populate outTes.                                   *
-       *********************************************************************/
-      cr8SubSeries(dimT - leftOver, dimT - 1, inputTes, outTes, outFileName);
-
-      /*********************************************************************
-       * Now adding all the header lines from the input 4D data file to     *
-       * outTes' header.                                                    *
-       *********************************************************************/
-      copyHeader(inputTes, outTes);
-
-      /*********************************************************************
-       * Now adding the "VoxSizes(XYZ)" and "Origin(XYZ)" header lines from *
-       * inputTes to outTes because these two header lines are  not stored  *
-       * in the Tes::header data member.                                    *
+       * time series into series.                                           *
        *********************************************************************/
-      addHeaderLine(outTes, "Sfff", "VoxSizes(XYZ):", inputTes.voxsize[0],
-                    inputTes.voxsize[1], inputTes.voxsize[2]);
-      addHeaderLine(outTes, "Siii", "Origin(XYZ):", inputTes.origin[0],
-                    inputTes.origin[1], inputTes.origin[2]);
+      cr8SubSeries(dimT - leftOver, dimT - 1, inputTes, series);
 
       /*********************************************************************
        * Now adding the header line to outTes for the extraction process    *
@@ -753,13 +718,13 @@ int main(int argc, char* argv[]) {
                     timedate().c_str(), tesFile.c_str(), numString, dimT);
 
       /*********************************************************************
-       * Now writing out the output file. Upon success, Tes::WriteFile()    *
+       * Now writing out the output file. Upon success, writeSubSeries()    *
        * returns 0. If that is not the case, then an error message is       *
        * written out and then this program exits.                           *
        *********************************************************************/
-      if (outTes.WriteFile()) {
+      if (writeSubSeries(inputTes, series, outTes, outFileName, bufSize)) {
         ostringstream errorMsg;
-        errorMsg << "Unable to write Tes file [" << outTes.filename << "].";
+        errorMsg << "Unable to write Tes file [" << outFileName << "].";
         printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
                              __FILE__, 1);
       }  // if
@@ -784,12 +749,6 @@ int main(int argc, char* argv[]) {
                            __FILE__, 1);
     }  // if
 
-    /*********************************************************************
-     * The array outTesArr[] is used to hold the required number of Tes   *
-     * objects (from which the output files will be written).             *
-     *********************************************************************/
-    Tes outTesArr[numBins];
-
     /*********************************************************************
      * leftOver holds the number of time series that are "extra".         *
      *********************************************************************/
@@ -799,7 +758,7 @@ int main(int argc, char* argv[]) {
      * Integer division is carried out to determine the number of time    *
      * series in each output file. This number plus 1 (numSeries + 1)     *
      * will be the number of time series in each output file whose index  *
-     * in outTesArr[] is less than leftOver.                              *
+     * is less than leftOver.                                             *
      *********************************************************************/
     int numSeries = dimT / numBins;
 
@@ -809,9 +768,8 @@ int main(int argc, char* argv[]) {
     ostringstream indexBinStr;
 
     /*********************************************************************
-     * The following for loop is used to traverse outTesArr[], populating *
-     * each Tes object with the appropriate time series from the input 4D *
-     * data file.                                                         *
+     * The following for loop is used to write out each bin in turn, so   *
+     * that only bufSize MB of data are held in memory at once.           *
      *********************************************************************/
     for (int indexBin = 0; indexBin < numBins; indexBin++) {
       /*********************************************************************
@@ -823,31 +781,24 @@ int main(int argc, char* argv[]) {
       string outFileName = outFileStem + "Bin_" + indexBinStr.str() + ".tes";
 
       /*********************************************************************
-       * Assigning an empty Tes object to outTesArr[indexBin] and then      *
-       * setting its output file name.                                      *
+       * series will hold the indices of this bin's time series, and outTes *
+       * the header line for it (see writeSubSeries()).                     *
        *********************************************************************/
-      outTesArr[indexBin] = Tes();
-      outTesArr[indexBin].SetFileName(outFileName);
+      vector<int> series;
+      Tes outTes;
 
       /*********************************************************************
-       * If indexBin < leftOver, then outTesArr[indexBin] gets an "extra"   *
-       * time series. Otherwise, outTesArr[indexBin] gets numSeries time    *
-       * series.                                                            *
+       * If indexBin < leftOver, then this bin gets an "extra" time series. *
+       * Otherwise, it gets numSeries time series.                          *
        *********************************************************************/
+      int binDimT = numSeries;
       if (indexBin < leftOver) {
-        outTesArr[indexBin].SetVolume(inputTes.dimx, inputTes.dimy,
-                                      inputTes.dimz, numSeries + 1,
-                                      inputTes.datatype);
+        binDimT++;
       }  // if
-      else {
-        outTesArr[indexBin].SetVolume(inputTes.dimx, inputTes.dimy,
-                                      inputTes.dimz, numSeries,
-                                      inputTes.datatype);
-      }  // else
 
       /*********************************************************************
-       * j is used to index the time series from the Tes object instantiated*
-       * with the input 4D data file. Say the input 4D data file has:       *
+       * j is used to index the time series from the input 4D data file.    *
+       * Say the input 4D data file has:                                    *
        *                                                                    *
        * VoxDims(TXYZ):  180     40      64      21                         *
        *                                                                    *
@@ -868,51 +819,15 @@ int main(int argc, char* argv[]) {
       int startSeries = indexBin;
 
       /*********************************************************************
-       * The following for loop is used to populate the time series in      *
-       * outTesArr[indexBin].                                               *
+       * The following for loop is used to collect this bin's time series.  *
        *********************************************************************/
-      for (int indexOut = 0; indexOut < outTesArr[indexBin].dimt;
-           indexOut++, j += numBins) {
-        /*********************************************************************
-         * OPEN_SPATIAL_LOOPS is a macro used to index the (x, y, z)          *
-         * coordinates of a time series.                                      *
-         *********************************************************************/
-        // qq Can make this faster !
-        OPEN_SPATIAL_LOOPS(inputTes)
-
-        outTesArr[indexBin].SetValue(
-            indexX, indexY, indexZ, indexOut,
-            inputTes.GetValue(indexX, indexY, indexZ, j));
-
-        /*********************************************************************
-         * CLOSE_SPATIAL_LOOPS is a macro used to close the for loops opened  *
-         * by OPEN_SPATIAL_LOOPS.                                             *
-         *********************************************************************/
-        CLOSE_SPATIAL_LOOPS
-
+      for (int indexOut = 0; indexOut < binDimT; indexOut++, j += numBins) {
+        series.push_back(j);
       }  // for indexOut
 
       /*********************************************************************
-       * Now adding all the header lines from the input 4D data file to     *
-       * outTes' header.                                                    *
-       *********************************************************************/
-      copyHeader(inputTes, outTesArr[indexBin]);
-
-      /*********************************************************************
-       * Now adding the "VoxSizes(XYZ)" and "Origin(XYZ)" header lines from *
-       * inputTes to outTesArr[indexBin] because these two header lines are *
-       * not stored in the Tes::header data member.                         *
-       *********************************************************************/
-      addHeaderLine(outTesArr[indexBin], "Sfff",
-                    "VoxSizes(XYZ):", inputTes.voxsize[0], inputTes.voxsize[1],
-                    inputTes.voxsize[2]);
-      addHeaderLine(outTesArr[indexBin], "Siii",
-                    "Origin(XYZ):", inputTes.origin[0], inputTes.origin[1],
-                    inputTes.origin[2]);
-
-      /*********************************************************************
-       * Now adding the header line to outTesArr[indexBin] for this         *
-       * splitting process. The line will resemble:                         *
+       * Now adding the header line to outTes for this splitting process.   *
+       * The line will resemble:                                            *
        *                                                                    *
        * Indicates a                  The first time series from the input  *
        * Tes "split".                 4D data file to appear in this output *
@@ -937,19 +852,18 @@ int main(int argc, char* argv[]) {
        *                                                                    *
        * NOTE: Each of the above fields will be delimited by tabs.          *
        *********************************************************************/
-      addHeaderLine(outTesArr[indexBin], "SSSSiii", "TesSplit:", "Binned",
+      addHeaderLine(outTes, "SSSSiii", "TesSplit:", "Binned",
                     timedate().c_str(), tesFile.c_str(), numBins, dimT,
                     startSeries);
 
       /*********************************************************************
-       * Now writing out the output file. Upon success, Tes::WriteFile()    *
+       * Now writing out the output file. Upon success, writeSubSeries()    *
        * returns 0. If that is not the case, then an error message is       *
        * written out and then this program exits.                           *
        *********************************************************************/
-      if (outTesArr[indexBin].WriteFile()) {
+      if (writeSubSeries(inputTes, series, outTes, outFileName, bufSize)) {
         ostringstream errorMsg;
-        errorMsg << "Unable to write Tes file [" << outTesArr[indexBin].filename
-                 << "].";
+        errorMsg << "Unable to write Tes file [" << outFileName << "].";
         printErrorMsgAndExit(VB_ERROR, errorMsg.str(), __LINE__, __FUNCTION__,
                              __FILE__, 1);
       }  // if
@@ -1006,7 +920,7 @@ void usage(const unsigned short exitValue, char* progName) {
   genusage(
       exitValue, progName, "- 4D data file splitting routine for VoxBo.",
       "-h -i[4D data file name] -o[output stem name] -r -e[range]\n            "
-      "   -d[divisor] -b[bins] -v",
+      "   -d[divisor] -b[bins] -s[MB] -v",
       "-h                        Print usage information. Optional.",
       "-i <4D data file>         Specify the input 4D data file. Required.",
       "-o <output stem name>     Specify the output stem file name. Optional.",
@@ -1036,6 +950,9 @@ void usage(const unsigned short exitValue, char* progName) {
       "                          of the directory containing the input 4D data "
       "file.",
       "                          NOTE: This option overrides -o.",
+      "-s <MB>                   How many MB of data to hold in memory at "
+      "once.",
+      "                          Default is 256. Optional.",
       "-v                        Global VoxBo version number. Optional.",
       "                          NOTE: Previously split files are not allowed "
       "to",
@@ -1044,8 +961,8 @@ void usage(const unsigned short exitValue, char* progName) {
 }  // void usage(const unsigned short exitValue, char *progName)
 
 /*********************************************************************
- * This function extracts a sub-time series from the input Tes object *
- * and populates the output Tes object.                               *
+ * This function collects the indices of a sub-time series of the     *
+ * input 4D data file. Nothing is read here.                          *
  *                                                                    *
  * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
  * ----------------   -----           ------------                    *
@@ -1054,21 +971,17 @@ void usage(const unsigned short exitValue, char* progName) {
  * end                int             The end point of the extraction.*
  *                                    NOTE: The extraction is         *
  *                                    inclusive.                      *
- * inputTes           Tes *           Pointer to the Tes object from  *
- *                                    which the extraction takes      *
+ * inputTes           Tes &           The Tes object (header only)    *
+ *                                    from which the extraction takes *
  *                                    place.                          *
- * outputTes          Tes *           Pointer to the output Tes       *
- *                                    object.                         *
- * outFileName        string          The output Tes object's file    *
- *                                    name.                           *
  *                                                                    *
  * OUTPUT VARIABLES:   TYPE:           DESCRIPTION:                   *
  * -----------------   -----           ------------                   *
- * None.                                                              *
+ * series              vector<int>&    The time series indices.       *
  *                                                                    *
  *********************************************************************/
-void cr8SubSeries(int begin, int end, const Tes& inputTes, Tes& outputTes,
-                  const string& outFileName) {
+void cr8SubSeries(int begin, int end, const Tes& inputTes,
+                  vector<int>& series) {
   /*********************************************************************
    * If the begin point of the extraction is < 0, then an error message *
    * is printed and then this program exits.                            *
@@ -1094,53 +1007,106 @@ void cr8SubSeries(int begin, int end, const Tes& inputTes, Tes& outputTes,
   }  // if
 
   /*********************************************************************
-   * newDimT - holds the number of time series we need to extract.      *
+   * This for loop adds the desired sub-set of time series, inclusively.*
    *********************************************************************/
-  int newDimT = end - begin + 1;
+  for (int indexT = begin; indexT <= end; indexT++) {
+    series.push_back(indexT);
+  }  // for indexT
 
-  /*********************************************************************
-   * Constructing the output Tes object with the proper dimensions and  *
-   * data type.                                                         *
-   *********************************************************************/
-  outputTes.SetVolume(inputTes.dimx, inputTes.dimy, inputTes.dimz, newDimT,
-                      inputTes.datatype);
+}  // void cr8SubSeries(int begin, int end, const Tes& inputTes,
+   // vector<int>& series)
 
+/*********************************************************************
+ * This function writes the given time series of the input 4D data    *
+ * file out to a new file. The data are streamed through a            *
+ * VBTesStream, holding only bufSize MB at once, and the output       *
+ * header is a copy of the input's plus the lines in splitTes. If the *
+ * stream can't handle the data (scaled data in formats other than    *
+ * TES1 and NIfTI, or an output format other than TES1 and NIfTI),    *
+ * the input is loaded as a whole, once, and the output built in      *
+ * memory instead.                                                    *
+ *                                                                    *
+ * INPUT VARIABLES:   TYPE:           DESCRIPTION:                    *
+ * ----------------   -----           ------------                    *
+ * inputTes           Tes &           The input 4D data file. Its     *
+ *                                    data are loaded only if the     *
+ *                                    stream can't be used.           *
+ * series             vector<int>     The time series to write out.   *
+ * splitTes           Tes &           Holds the header lines to add.  *
+ * outFileName        string          The output file name.           *
+ * bufSize            int             How many MB to hold at once.    *
+ *                                                                    *
+ * OUTPUT VARIABLES:   TYPE:           DESCRIPTION:                   *
+ * -----------------   -----           ------------                   *
+ * N/A                 int             0 on success, non-zero on      *
+ *                                     failure.                       *
+ *********************************************************************/
+int writeSubSeries(Tes& inputTes, const vector<int>& series,
+                   const Tes& splitTes, const string& outFileName,
+                   int bufSize) {
   /*********************************************************************
-   * The following series of nested for loops are used to get the       *
-   * appropriate signal value from inputTes and assign in to outputTes. *
+   * First trying the stream. addInput() returns 104 or 105 for scaled  *
+   * data it can't copy raw, and write() returns 103 for output formats *
+   * it can't write. Any other error is passed back to the caller.      *
    *********************************************************************/
-  OPEN_SPATIAL_LOOPS(inputTes)
+  VBTesStream outStream;
+  outStream.bufsize = (size_t)bufSize * 1024 * 1024;
+  int err = outStream.addInput(inputTes.filename);
+  if (!err) {
+    for (size_t i = 0; i < series.size(); i++) {
+      outStream.addVolume(0, series[i]);
+    }  // for i
+    Tes& outTes = outStream.output();
+    for (size_t i = 0; i < splitTes.header.size(); i++) {
+      outTes.AddHeader(splitTes.header[i]);
+    }  // for i
+    err = outStream.write(outFileName);
+  }  // if
+  if (err != 103 && err != 104 && err != 105) {
+    return err;
+  }  // if
 
   /*********************************************************************
-   * outIndexT is used to index the T dimension of outputTes.           *
+   * Loading the input data, if that hasn't already been done for an    *
+   * earlier output file.                                               *
    *********************************************************************/
-  int outIndexT = 0;
+  if (!inputTes.data_valid) {
+    string fname = inputTes.filename;
+    if (inputTes.ReadFile(fname)) {
+      return 101;
+    }  // if
+  }  // if
 
   /*********************************************************************
-   * This for loop indexes the desired sub-set of time series,          *
-   * inclusively.                                                       *
+   * Constructing the output Tes object with the proper dimensions and  *
+   * data type, and copying the time series into it.                    *
    *********************************************************************/
-  for (int indexT = begin; indexT <= end; indexT++) {
-    /*********************************************************************
-     * Now getting the appropriate value from inputTes and assigning it to*
-     * output Tes.                                                        *
-     *********************************************************************/
-    outputTes.SetValue(indexX, indexY, indexZ, outIndexT,
-                       inputTes.GetValue(indexX, indexY, indexZ, indexT));
-
-    /*********************************************************************
-     * Incrementing outIndexT.                                            *
-     *********************************************************************/
-    outIndexT++;
-
-  }  // for indexT
-
+  Tes outTes;
+  outTes.SetVolume(inputTes.dimx, inputTes.dimy, inputTes.dimz,
+                   series.size(), inputTes.datatype);
+  OPEN_SPATIAL_LOOPS(inputTes)
+  for (size_t i = 0; i < series.size(); i++) {
+    outTes.SetValue(indexX, indexY, indexZ, i,
+                    inputTes.GetValue(indexX, indexY, indexZ, series[i]));
+  }  // for i
   CLOSE_SPATIAL_LOOPS
 
   /*********************************************************************
-   * Now setting the file name for the outputTes object.                *
+   * Now adding all the header lines from the input 4D data file, the   *
+   * "VoxSizes(XYZ)" and "Origin(XYZ)" header lines (which are not      *
+   * stored in the Tes::header data member), and the split lines.       *
    *********************************************************************/
-  outputTes.SetFileName(outFileName);
+  copyHeader(inputTes, outTes);
+  addHeaderLine(outTes, "Sfff", "VoxSizes(XYZ):", inputTes.voxsize[0],
+                inputTes.voxsize[1], inputTes.voxsize[2]);
+  addHeaderLine(outTes, "Siii", "Origin(XYZ):", inputTes.origin[0],
+                inputTes.origin[1], inputTes.origin[2]);
+  for (size_t i = 0; i < splitTes.header.size(); i++) {
+    outTes.AddHeader(splitTes.header[i]);
+  }  // for i
 
-}  // void cr8SubSeries(int begin, int end, const Tes& inputTes,
-   // Tes& outputTes, const string& outFileName)
+  outTes.SetFileName(outFileName);
+  return outTes.WriteFile();
+
+}  // int writeSubSeries(Tes& inputTes, const vector<int>& series,
+   // const Tes& splitTes, const string& outFileName, int bufSize)
@@ -166,22 +166,48 @@ int main(int argc, char *argv[]) {
         (tsflags & DETREND ? "yes" : "no"));
 
     // FIXME CHECK MASK DIMENSION MATCH
+    // get all the regions' time series (or voxel series, for
+    // components) in one pass through the data.  if that fails, we go
+    // region by region, as before.
+    VBRegionTS rts;
+    vector<VBRegion> restricted(regionlist.size());
+    vector<int> columns;
     for (int j = 0; j < (int)regionlist.size(); j++) {
-      VBRegion tmpregion;
-      tmpregion = glmi.restrictRegion(regionlist[j]);
+      restricted[j] = glmi.restrictRegion(regionlist[j]);
+      columns.push_back(restricted[j].size() ? rts.regionCount() : -1);
+      if (restricted[j].size()) rts.addRegion(restricted[j]);
+    }
+    VBMatrix means;
+    vector<VBMatrix> series;
+    bool f_batch = 0;
+    if (rts.regionCount() && q_component > -1)
+      f_batch = !rts.extractSeries(glmi.teslist, tsflags, series);
+    else if (rts.regionCount())
+      f_batch = !rts.extractMeans(glmi.teslist, tsflags, means);
+    for (int j = 0; j < (int)regionlist.size(); j++) {
+      VBRegion &tmpregion = restricted[j];
       printf("[I] vbdumpstats: region %s (%d voxel%s)\n",
              regionlist[j].name.c_str(), tmpregion.size(),
              (tmpregion.size() == 1 ? "" : "s"));
+      bool f_mine = (f_batch && columns[j] > -1);
       // load time series
       if (q_component > -1) {
-        VBMatrix tmp = glmi.getRegionComponents(tmpregion, tsflags);
+        VBMatrix tmp;
+        if (f_mine) {
+          VBMatrix E;
+          VB_Vector lambdas;
+          if (pca(series[columns[j]], lambdas, tmp, E)) tmp.clear();
+        } else
+          tmp = glmi.getRegionComponents(tmpregion, tsflags);
         if ((int)tmp.n <= q_component) {
           printf("[E] vbdumpstats: couldn't extract requested component (%d)\n",
                  q_component);
           exit(166);
         }
         vv = tmp.GetColumn(q_component);
-      } else
+      } else if (f_mine)
+        vv = means.GetColumn(columns[j]);
+      else
         vv = glmi.getRegionTS(tmpregion, tsflags);
       // NOTE: filtering gets done in the regression routine
       // do the regression
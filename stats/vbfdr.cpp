@@ -41,7 +41,7 @@ int main(int argc, char *argv[]) {
   tokenlist args;
   vector<string> filelist;
   args.Transfer(argc - 1, argv + 1);
-  float q = 0;
+  float q = 0.01;
 
   for (size_t i = 0; i < args.size(); i++) {
     if (args[i] == "-v")
@@ -62,34 +62,49 @@ int main(int argc, char *argv[]) {
     exit(112);
   }
 
-  if (filelist.size() != 1) {
-    vbfdr_help();
-    exit(110);
-  }
-
-  Tes ts;
-  if (ts.ReadFile(filelist[0])) {
-    cout << format("[E] vbfdr: couldn't find 4D data in %s\n") % filelist[0];
-    exit(150);
-  }
-  Cube cb;
-  ts.getCube(0, cb);
-
-  if (cb.get_minimum() < 0 || cb.get_maximum() > 1) {
-    cout << format("[I] vbfdr: invalid range for p map\n");
+  // load everything first, so that all the maps can be done at once
+  vector<Tes> maps(filelist.size());
+  vector<Tes *> mapptrs;
+  for (size_t i = 0; i < filelist.size(); i++) {
+    Tes &ts = maps[i];
+    if (ts.ReadFile(filelist[i])) {
+      Cube cb;
+      if (cb.ReadFile(filelist[i])) {
+        cout << format("[E] vbfdr: couldn't read p values from %s\n") %
+                    filelist[i];
+        exit(150);
+      }
+      // a 3D map has no mask, so leave out the empty voxels
+      ts.SetVolume(cb.dimx, cb.dimy, cb.dimz, 1, cb.datatype);
+      ts.SetCube(0, cb);
+      ts.Remask();
+    }
+    mapptrs.push_back(&ts);
   }
 
-  VBVoxel vv = find_fdr_thresh(ts, q);
-  if (vv.cool()) {
-    for (int i = 1; i < ts.dimt; i++) {
-      cout << format(
-                  "[I] vbfdr: FDR value %g (must be equalled or exceeded)\n") %
-                  ts.GetValue(vv.x, vv.y, vv.z, i);
+  vector<VBVoxel> vvs = find_fdr_thresh(mapptrs, q);
+  for (size_t f = 0; f < maps.size(); f++) {
+    Tes &ts = maps[f];
+    VBVoxel &vv = vvs[f];
+    if (maps.size() > 1) cout << format("[I] vbfdr: %s\n") % filelist[f];
+    Cube cb;
+    ts.getCube(0, cb);
+    if (cb.get_minimum() < 0 || cb.get_maximum() > 1) {
+      cout << format("[I] vbfdr: invalid range for p map\n");
+    }
+    if (vv.cool()) {
+      cout << format("[I] vbfdr: FDR p threshold %g\n") % vv.val;
+      for (int i = 1; i < ts.dimt; i++) {
+        cout << format(
+                    "[I] vbfdr: FDR value %g (must be equalled or "
+                    "exceeded)\n") %
+                    ts.GetValue(vv.x, vv.y, vv.z, i);
+      }
+      cout << format("[I] vbfdr: this value found at %d,%d,%d\n") % vv.x %
+                  vv.y % vv.z;
+    } else {
+      cout << format("[I] vbfdr: no FDR value could be identified\n");
     }
-    cout << format("[I] vbfdr: this value found at %d,%d,%d\n") % vv.x % vv.y %
-                vv.z;
-  } else {
-    cout << format("[I] vbfdr: no FDR value could be identified\n");
   }
 
   exit(0);
@@ -108,27 +108,41 @@ int main(int argc, char *argv[]) {
 
   resid.SetVolume(prm.dimx, prm.dimy, prm.dimz, nresids, vb_double);
   resid.print();
-  for (int k = 0; k < prm.dimz; k++) {
-    cout << "[I] vbmakeresid: calculating residuals for slice " << k << endl;
-    for (int i = 0; i < prm.dimx; i++) {
-      for (int j = 0; j < prm.dimy; j++) {
-        if (!(prm.GetMaskValue(i, j, k))) continue;
-        // cout << 2 << endl;
-        sig = gi.getResid(i, j, k, gi.glmflags);
-        if (sig.size() < ntimepoints) {
-          printf("[I] vbmakeresid: couldn't get residuals\n");
-          exit(110);
-        }
-        // cout << 3 << endl;
-        int tt = 0;
-        // cout << sig.size() << endl;
-        // printf("%d %d %d %d\n",i,j,k,nresids);
-        for (int ind = 0; ind < nresids; ind++) {
-          // cout << tt << endl;
-          resid.SetValue(i, j, k, ind, sig[tt]);
-          tt += stride;
-        }
-        // cout << 4 << endl;
+  // pull the voxels' time series out in batches, each batch in one pass
+  // through the data, with the batches sized to keep the matrix of time
+  // series to about 256MB
+  uint32 batchsize = (32 * 1024 * 1024) / ntimepoints;
+  if (batchsize < 1) batchsize = 1;
+  vector<VBVoxel> voxels;
+  for (int k = 0; k < prm.dimz; k++)
+    for (int i = 0; i < prm.dimx; i++)
+      for (int j = 0; j < prm.dimy; j++)
+        if (prm.GetMaskValue(i, j, k)) voxels.push_back(VBVoxel(i, j, k));
+  VBMatrix signals;
+  for (size_t first = 0; first < voxels.size(); first += batchsize) {
+    size_t last = min(first + batchsize, voxels.size());
+    cout << "[I] vbmakeresid: calculating residuals for voxels " << first
+         << " to " << last - 1 << " of " << voxels.size() << endl;
+    VBRegionTS rts;
+    for (size_t v = first; v < last; v++) {
+      VBRegion rr;
+      rr.add(voxels[v]);
+      rts.addRegion(rr);
+    }
+    if (rts.extractMeans(gi.teslist, gi.glmflags, signals)) {
+      printf("[I] vbmakeresid: couldn't get residuals\n");
+      exit(110);
+    }
+    for (size_t v = first; v < last; v++) {
+      sig = gi.getResid(signals.GetColumn(v - first));
+      if (sig.size() < ntimepoints) {
+        printf("[I] vbmakeresid: couldn't get residuals\n");
+        exit(110);
+      }
+      int tt = 0;
+      for (int ind = 0; ind < nresids; ind++) {
+        resid.SetValue(voxels[v].x, voxels[v].y, voxels[v].z, ind, sig[tt]);
+        tt += stride;
       }
     }
   }
@@ -48,7 +48,7 @@ int main(int argc, char *argv[]) {
   string dvname, ivname, outfile, maskfile, pfile;
   args.Transfer(argc - 1, argv + 1);
   int part = 1, nparts = 1;
-  string perm_mat;
+  string perm_mat, perms_mat;
   int perm_index = -1;
   int minlesions = 2;
   bool f_welchs = 0;
@@ -94,6 +94,8 @@ int main(int argc, char *argv[]) {
     } else if (args[i] == "-op" && i < args.size() - 2) {
       perm_mat = args[++i];
       perm_index = strtol(args[++i]);
+    } else if (args[i] == "-perms" && i < args.size() - 1) {
+      perms_mat = args[++i];
     } else if (args[i] == "-p" && i < args.size() - 2) {
       part = strtol(args[++i]);
       nparts = strtol(args[++i]);
@@ -148,6 +150,47 @@ int main(int argc, char *argv[]) {
     mask.intersect(tmask);
   }
 
+  // full permutation test, done on the unique lesion patterns
+  if (perms_mat.size()) {
+    VBMatrix pm;
+    if (pm.ReadFile(perms_mat)) {
+      printf("[E] vbtmap: couldn't read permutation matrix %s\n",
+             perms_mat.c_str());
+      exit(105);
+    }
+    VLSMEngine vlsm;
+    vlsm.f_welchs = f_welchs;
+    vlsm.f_flip = f_flip;
+    vlsm.f_z = f_zscore;
+    if (vlsm.setLesions(ts, mask, minlesions)) {
+      printf("[E] vbtmap: couldn't collect lesion patterns from %s\n",
+             ivname.c_str());
+      exit(108);
+    }
+    if (vlsm.f_non1)
+      cout << "[W] vbtmap: non-0/1 values found in lesion map" << endl;
+    if (vlsm.setScores(depvar)) {
+      printf("[E] vbtmap: dependent variable doesn't match lesion maps\n");
+      exit(106);
+    }
+    vector<double> maxes;
+    if (vlsm.permute(pm, 0, pm.cols, maxes)) {
+      printf("[E] vbtmap: bad permutation matrix %s\n", perms_mat.c_str());
+      exit(107);
+    }
+    VB_Vector dist(pm.cols);
+    for (uint32 i = 0; i < pm.cols; i++) dist[i] = maxes[i];
+    printf("[I] vbtmap: unique lesion patterns: %d\n", vlsm.patterns());
+    if (dist.WriteFile(outfile)) {
+      printf("[E] vbtmap: couldn't write permutation distribution to %s\n",
+             outfile.c_str());
+      exit(111);
+    }
+    printf("[I] vbtmap: wrote %d permutation maxima to %s\n", pm.cols,
+           outfile.c_str());
+    exit(0);
+  }
+
   // permute order of dv if requested
   VB_Vector perm_order;
   if (perm_index > -1) {
@@ -269,6 +269,7 @@ int main(int argc, char *argv[]) {
   for (int i = 0; i < (int)ivnames.size(); i++) ilist.push_back(i);
 
   cout << "[I] vbvolregress: the following contrasts were specified:\n";
+  vector<VBContrast> clist;
   vbforeach(string & ccs, contrastlist) {
     VBContrast cc;
     tokenlist cspec;
@@ -277,6 +278,19 @@ int main(int argc, char *argv[]) {
     printf("[I] contrast %s (%s):\n", cc.name.c_str(), cc.scale.c_str());
     for (uint32 i = 0; i < cc.contrast.size(); i++)
       printf("      %s: %.1f\n", ivnames[i].c_str() + 1, cc.contrast[i]);
+    clist.push_back(cc);
+  }
+
+  // the volume data are read just once, and each permutation is run
+  // against the copy in memory
+  if (f_volume) {
+    int err =
+        glmi.VolumeRegressLoad(tmask, part, nparts, ivnames, dvname, ivmats);
+    if (err) {
+      printf("[E] vbvolregress (vol): failed with %s (%d)!\n",
+             glmi.stemname.c_str(), err);
+      exit(err);
+    }
   }
 
   string w_mapname, w_prmname, w_resname;
@@ -290,28 +304,26 @@ int main(int argc, char *argv[]) {
       else
         glmi.perm_signs = vm.GetColumn(perminds[permi]);
     }
+    // do the volume regression, once for all the contrasts
+    if (f_volume) {
+      glmi.rescount = 0;
+      int err = glmi.VolumeRegressRun(clist);
+      if (err) {
+        printf("[E] vbvolregress (vol): failed with %s (%d)!\n",
+               glmi.stemname.c_str(), err);
+        exit(err);
+      }
+    }
     // now iterate over contrasts
     for (int c = 0; c < (int)contrastlist.size(); c++) {
-      VBContrast cc;
-      tokenlist cspec;
-      cspec.ParseLine(contrastlist[c]);
-      glmi.contrast.parsemacro(cspec, ilist.size(), ilist);
+      glmi.contrast = clist[c];
 
       if (f_volume) {
-        // do the volume regression
-        glmi.rescount = 0;
-        int err =
-            glmi.VolumeRegress(tmask, part, nparts, ivnames, dvname, ivmats);
-        if (err) {
-          printf("[E] vbvolregress (vol): failed with %s (%d)!\n",
-                 glmi.stemname.c_str(), err);
-          exit(err);
-        }
-
+        Cube &statcube = glmi.statcubes[c];
         // print out FDR thresh if requested
         if (f_fdr) {
           vector<fdrstat> ffs =
-              calc_multi_fdr_thresh(glmi.rawcube, glmi.statcube, tmask, q);
+              calc_multi_fdr_thresh(glmi.rawcubes[c], statcube, tmask, q);
           if (ffs.size()) {
             cout << (format("[I] vbvolregress: FDR calculation included %d "
                             "voxels with p values from %.4f to %.4f\n") %
@@ -348,16 +360,15 @@ int main(int argc, char *argv[]) {
 
         // write stat values to dist file
         if (distname.size()) {
-          if (appendline(
-                  distname,
-                  (format("%.20g") % glmi.statcube.get_maximum()).str())) {
+          if (appendline(distname,
+                         (format("%.20g") % statcube.get_maximum()).str())) {
             printf("[E] vbvolregress: couldn't write dist file\n");
             exit(101);
           }
         }
         // write stat map
         if (mapname.size()) {
-          if (glmi.statcube.WriteFile(w_mapname)) {
+          if (statcube.WriteFile(w_mapname)) {
             printf("[E] vbvolregress: error writing file %s\n",
                    w_mapname.c_str());
             exit(171);
@@ -158,14 +158,26 @@ int main(int argc, char *argv[]) {
   string partstring;
   if (nparts > 1) partstring = "_part_" + strnum(part);
 
-  bitmask bm;
-  bm.resize(ts.dimt);
-  map<bitmask, x2val> statlookup;
-  map<bitmask, x2val>::iterator iter;
+  // pack up the unique lesion patterns and test each one once
+  VLSMEngine vlsm;
+  if (vlsm.setLesions(ts, mask, minlesions)) {
+    printf("[E] vbcmap: couldn't collect lesion patterns from %s\n",
+           ivname.c_str());
+    exit(105);
+  }
+  vector<x2val> patres;
+  if (vlsm.tables(dvbm, f_fisher, f_yates, patres)) {
+    printf("[E] vbcmap: lesion maps and dependent variable don't match\n");
+    exit(106);
+  }
+  // pattern for each voxel, -1 for excluded voxels
+  vector<int32> voxpattern(ts.dimx * ts.dimy * ts.dimz, -1);
+  for (uint32 i = 0; i < vlsm.voxels(); i++)
+    voxpattern[vlsm.voxelpos[i]] = vlsm.voxelpattern[i];
+  vector<char> seen(vlsm.patterns(), 0);
+
   Cube statmap(ts.dimx, ts.dimy, ts.dimz, vb_float);
   Cube pmap;
-  Tes cimap;
-  x2val res;
   Cube fdrmask;
   if (f_fdr || pmapname.size()) {
     pmap.SetVolume(ts.dimx, ts.dimy, ts.dimz, vb_float);
@@ -173,30 +185,17 @@ int main(int argc, char *argv[]) {
     fdrmask.zero();
   }
   vector<double> pvals;  // all p vals used in fdr calculation
-  bool f_non1 = 0;
-  int16 val;
+  bool f_non1 = vlsm.f_non1;
   for (int i = 0; i < ts.dimx; i++) {
     for (int j = 0; j < ts.dimy; j++) {
       for (int k = 0; k < ts.dimz; k++) {
-        if (!mask.testValue(i, j, k)) continue;
-        for (int m = 0; m < ts.dimt; m++) {
-          val = ts.getValue<int16>(i, j, k, m);
-          if (val) {
-            bm.set(m);
-            if (val != 1) f_non1 = 1;
-          } else
-            bm.unset(m);
-        }
-        if (bm.count() < minlesions) continue;
-        if (ts.dimt - bm.count() < 2) continue;
-        iter = statlookup.find(bm);
-        if (iter == statlookup.end()) {
+        int32 pat = voxpattern[ts.voxelposition(i, j, k)];
+        if (pat < 0) continue;
+        x2val &res = patres[pat];
+        if (!seen[pat]) {
           // this is a new pattern
+          seen[pat] = 1;
           if (f_fdr) fdrmask.SetValue(i, j, k, 1);
-          if (f_fisher)
-            res = calc_fisher(bm, dvbm);
-          else
-            res = calc_chisquared(bm, dvbm, f_yates);
           if (f_twotailed) res.p *= 2.0;
           // FIXME??? if we need the p value or z score, get it
           // if doing fdr, stash the p value
@@ -209,15 +208,14 @@ int main(int argc, char *argv[]) {
             statmap.SetValue(i, j, k, res.z);
           else
             statmap.SetValue(i, j, k, res.x2);
-          statlookup[bm] = res;
         } else {
           // this is a previously encountered pattern
           if (f_fdr && !f_nodup) {
             fdrmask.SetValue(i, j, k, 1);
-            pvals.push_back(iter->second.p);
+            pvals.push_back(res.p);
           }
-          statmap.SetValue(i, j, k, iter->second.x2);
-          if (f_fdr || pmapname.size()) pmap.SetValue(i, j, k, iter->second.p);
+          statmap.SetValue(i, j, k, res.x2);
+          if (f_fdr || pmapname.size()) pmap.SetValue(i, j, k, res.p);
         }
       }
     }
@@ -250,7 +248,7 @@ int main(int argc, char *argv[]) {
       }
     }
   }
-  printf("[I] vbcmap: unique lesion patterns: %d\n", (int)statlookup.size());
+  printf("[I] vbcmap: unique lesion patterns: %d\n", (int)vlsm.patterns());
   if (statmap.WriteFile(outfile)) {
     printf("[E] vbcmap: couldn't write stat map to %s\n", outfile.c_str());
     exit(111);
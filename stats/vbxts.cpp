@@ -174,13 +174,29 @@ int main(int argc, char *argv[]) {
          (tsflags & DETREND ? "yes" : "no"));
 
   // FIXME CHECK MASK DIMENSION MATCH
+  // restrict all the regions, then get all their time series in one
+  // pass through the data.  if that fails, we go region by region, so
+  // that only the bad regions come back empty, as they always have.
+  VBRegionTS rts;
+  vector<VBRegion> restricted(regionlist.size());
+  vector<int> columns;
   for (int j = 0; j < (int)regionlist.size(); j++) {
-    VBRegion tmpregion;
-    tmpregion = restrictRegion(teslist, regionlist[j]);
+    restricted[j] = restrictRegion(teslist, regionlist[j]);
+    columns.push_back(restricted[j].size() ? rts.regionCount() : -1);
+    if (restricted[j].size()) rts.addRegion(restricted[j]);
+  }
+  VBMatrix means;
+  bool f_batch =
+      (rts.regionCount() && rts.extractMeans(teslist, tsflags, means) == 0);
+  for (int j = 0; j < (int)regionlist.size(); j++) {
+    VBRegion &tmpregion = restricted[j];
     printf("[I] vbxts: region %s (%d voxel%s)\n", regionlist[j].name.c_str(),
            tmpregion.size(), (tmpregion.size() > 1 ? "s" : ""));
     // load time series
-    vv = getRegionTS(teslist, tmpregion, tsflags);
+    if (f_batch && columns[j] > -1)
+      vv = means.GetColumn(columns[j]);
+    else
+      vv = getRegionTS(teslist, tmpregion, tsflags);
     // things you can only do with GLM data
     if (glmname.size()) {
       if (q_filterflag) glmi.filterTS(vv);
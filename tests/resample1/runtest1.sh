@@ -0,0 +1,40 @@
+#!/bin/sh
+
+# sinc resample with an output box that runs well past the source
+# volume on every side, at non-integer coordinates.  this used to die
+# with a length_error.  voxels outside the source should come out 0.
+
+vbim -newvol 20 20 10 1 float -addnoise 100 10 -write src.nii.gz
+if ! resample src.nii.gz out.nii.gz -xx -30.5 1 80 -yy -12.25 0.5 90 \
+    -zz -8.5 1 30; then
+  echo "resample1: FAILED (resample exited with an error)"
+  exit 1
+fi
+if ! vbhdr out.nii.gz | grep -q "80x90x30 voxels"; then
+  echo "resample1: FAILED (wrong output dimensions)"
+  exit 1
+fi
+
+# maxval prints the max of out.nii.gz after zeroing everything but
+# the block given by the -zero args
+maxval() {
+  vbim out.nii.gz "$@" -info | grep "max=" | sed 's/.*max=\([^ ]*\).*/\1/'
+}
+
+# output voxels 0-19 in x and y and 0-4 in z sit at source
+# coordinates <= -11.5, -2.75 and -4.5, well outside the source
+corner=`maxval -zero x last 60 -zero y last 70 -zero z last 25`
+if [ -z "$corner" ] || ! awk "BEGIN{exit !($corner == 0)}"; then
+  echo "resample1: FAILED (voxels outside the source aren't 0: $corner)"
+  exit 1
+fi
+
+# output voxels 35-44 in x, 35-54 in y and 11-15 in z sit at source
+# coordinates 4.5-13.5, 5.25-14.75 and 2.5-6.5, inside the source
+interior=`maxval -zero x first 35 -zero x last 35 -zero y first 35 \
+  -zero y last 35 -zero z first 11 -zero z last 14`
+if [ -z "$interior" ] || ! awk "BEGIN{exit !($interior > 50)}"; then
+  echo "resample1: FAILED (voxels inside the source are empty: $interior)"
+  exit 1
+fi
+echo "resample1: passed"
@@ -0,0 +1,11 @@
+#!/bin/sh
+
+# checks VB_Vector's move semantics, reserve()/capacity(), growth in
+# concatenate(), and expression templates, including aliased operands
+# and mismatched lengths.  build vbvectest first (make vbvectest).
+
+if ! ./vbvectest; then
+  echo "vbvector1: FAILED"
+  exit 1
+fi
+echo "vbvector1: passed"
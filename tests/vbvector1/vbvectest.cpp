@@ -0,0 +1,140 @@
+// vbvectest.cpp
+// checks on VB_Vector's move semantics, storage, and expressions
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utility>
+#include "vbio.h"
+#include "vb_vector.h"
+
+int nfailed = 0;
+int ngslerrors = 0;
+
+void check(bool ok, const char *what) {
+  printf("[%s] %s\n", (ok ? "I" : "E"), what);
+  if (!ok) nfailed++;
+}
+
+// a vector's elements are 1..n times scale
+VB_Vector makevec(size_t n, double scale) {
+  VB_Vector v(n);
+  for (size_t i = 0; i < n; i++) v[i] = (i + 1) * scale;
+  return v;
+}
+
+bool isvec(const VB_Vector &v, size_t n, double scale) {
+  if (v.getLength() != n) return 0;
+  for (size_t i = 0; i < n; i++)
+    if (fabs(v[i] - (i + 1) * scale) > 1e-12) return 0;
+  return 1;
+}
+
+// counts the length errors instead of aborting
+void counthandler(const char *, const char *, int, int) { ngslerrors++; }
+
+int main() {
+  // move construction takes the data and leaves the source empty
+  VB_Vector a = makevec(5, 1.0);
+  double *adata = a.getData();
+  VB_Vector b(std::move(a));
+  check(isvec(b, 5, 1.0) && b.getData() == adata, "move constructor");
+  check(a.getLength() == 0 && !a.getState(), "moved-from vector is empty");
+
+  // move assignment frees the old data and takes the new
+  VB_Vector c = makevec(3, 2.0);
+  c = std::move(b);
+  check(isvec(c, 5, 1.0) && c.getData() == adata, "move assignment");
+  check(b.getLength() == 0 && !b.getState(), "moved-from vector is empty");
+  b = makevec(4, 3.0);
+  check(isvec(b, 4, 3.0), "moved-from vector can be reused");
+
+  // reserve() keeps the contents and lets concatenate() grow in place
+  VB_Vector r = makevec(3, 1.0);
+  r.reserve(100);
+  check(isvec(r, 3, 1.0) && r.capacity() >= 100, "reserve");
+  double *rdata = r.getData();
+  r.concatenate(makevec(50, 1.0));
+  check(r.getLength() == 53 && r.getData() == rdata,
+        "concatenate within capacity doesn't reallocate");
+  r.reserve(10);
+  check(r.getLength() == 53 && r.getData() == rdata,
+        "reserve never shrinks");
+
+  // growing past capacity at least doubles it
+  VB_Vector g = makevec(10, 1.0);
+  g.concatenate(makevec(1, 1.0));
+  check(g.getLength() == 11 && g.capacity() >= 20, "concatenate doubles");
+  g.concatenate(g);
+  check(g.getLength() == 22 && g[10] == 1.0 && g[21] == 1.0,
+        "concatenate with itself");
+
+  // expressions, including ones whose operands alias the target
+  VB_Vector x = makevec(6, 1.0);
+  VB_Vector y = makevec(6, 10.0);
+  VB_Vector z = x + y;
+  check(isvec(z, 6, 11.0), "z = x + y");
+  x = x + y;
+  check(isvec(x, 6, 11.0), "x = x + y");
+  x = y - x * 2.0;
+  check(isvec(x, 6, -12.0), "x = y - x * 2");
+  x = 0.5 * x + x;
+  check(isvec(x, 6, -18.0), "x = 0.5 * x + x");
+  x += y;
+  check(isvec(x, 6, -8.0), "x += y");
+  x -= x;
+  check(isvec(x, 6, 0.0), "x -= x");
+
+  // the result of an expression gets the leftmost operand's metadata,
+  // just as a copy of it would
+  y.setFileName("y.ref");
+  y.AddHeader("from y");
+  VB_Vector w = y + z;
+  check(w.getFileName() == "y.ref" && w.header.size() == 1,
+        "expression result keeps the leftmost operand's metadata");
+  check(w.getState(), "expression result is valid");
+  z = y * 3.0;
+  check(z.getFileName() == "y.ref" && isvec(z, 6, 30.0),
+        "assigned expression keeps the leftmost operand's metadata");
+
+  // mismatched lengths go through the gsl error handler, and the
+  // result is as long as the shorter operand
+  gsl_error_handler_t *oldhandler = gsl_set_error_handler(counthandler);
+  VB_Vector s = makevec(4, 1.0);
+  VB_Vector m = y + s;
+  check(ngslerrors == 1 && isvec(m, 4, 11.0), "mismatched lengths in +");
+  double dot = s * (y + y);
+  check(ngslerrors == 2 && dot == 600.0, "mismatched lengths in *");
+  gsl_set_error_handler(oldhandler);
+
+  if (nfailed) {
+    printf("[E] vbvectest: %d check(s) failed\n", nfailed);
+    exit(1);
+  }
+  printf("[I] vbvectest: all checks passed\n");
+  exit(0);
+}
@@ -0,0 +1,12 @@
+#!/bin/sh
+
+# checks that the unique-lesion-pattern engine, set up the way vbvlsm
+# uses it, gives the same t/p/z maps and permutation maxima as the old
+# per-voxel code, for pooled and welch's t tests.  build vlsmtest
+# first (make vlsmtest).
+
+if ! ./vlsmtest; then
+  echo "vlsm1: FAILED"
+  exit 1
+fi
+echo "vlsm1: passed"
@@ -0,0 +1,205 @@
+// vlsmtest.cpp
+// checks the unique-lesion-pattern engine against per-voxel t tests
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "stats.h"
+#include "vbio.h"
+
+const int dimx = 5, dimy = 4, dimz = 3, nsubjects = 11, nperms = 40;
+int nfailed = 0;
+
+// a small lcg, so the data are the same everywhere
+uint32 lcgstate = 12345;
+double lcg() {
+  lcgstate = lcgstate * 1664525 + 1013904223;
+  return (lcgstate >> 8) / 16777216.0;
+}
+
+// the lesion set has voxels with no data at all, with one lesioned or
+// one spared subject, with everyone lesioned, and with values other
+// than 0/1 (including fractions, which count as spared)
+void makelesions(Tes &ts) {
+  ts.SetVolume(dimx, dimy, dimz, nsubjects, vb_float);
+  int v = 0;
+  for (int k = 0; k < dimz; k++) {
+    for (int j = 0; j < dimy; j++) {
+      for (int i = 0; i < dimx; i++, v++) {
+        if (v % 7 == 0) continue;
+        double prob = 0.15 + 0.7 * lcg();
+        for (int s = 0; s < nsubjects; s++) {
+          double val = (lcg() < prob ? 1.0 : 0.0);
+          if (v % 11 == 0) val = (s == v % nsubjects ? 1.0 : 0.0);
+          if (v % 13 == 0) val = (s == v % nsubjects ? 0.0 : 1.0);
+          if (v == 17) val = 1.0;
+          if (val && v % 5 == 0) val = 2.0;
+          if (!val && v % 9 == 0) val = 0.6;
+          ts.SetValue(i, j, k, s, val);
+        }
+      }
+    }
+  }
+}
+
+// this is the per-voxel t test vbvlsm used to do (do_ttest_volume()),
+// with the scores in the order given by pvec if there is one
+void pervoxel(Tes &ts, VB_Vector &scores, bool f_welchs, VB_Vector *pvec,
+              Cube &tmap, Cube &pmap, Cube &zmap) {
+  tmap.SetVolume(dimx, dimy, dimz, vb_double);
+  pmap.SetVolume(dimx, dimy, dimz, vb_double);
+  zmap.SetVolume(dimx, dimy, dimz, vb_double);
+  VB_Vector dv(scores);
+  if (pvec)
+    for (int s = 0; s < nsubjects; s++) dv[s] = scores[(int)(*pvec)[s]];
+  bitmask bm;
+  bm.resize(nsubjects);
+  tval res;
+  for (int i = 0; i < dimx; i++) {
+    for (int j = 0; j < dimy; j++) {
+      for (int k = 0; k < dimz; k++) {
+        for (int t = 0; t < nsubjects; t++) {
+          if (ts.getValue<int16>(i, j, k, t))
+            bm.set(t);
+          else
+            bm.unset(t);
+        }
+        if (f_welchs)
+          res = calc_welchs(dv, bm);
+        else
+          res = calc_ttest(dv, bm);
+        if (!pvec) {
+          tmap.SetValue(i, j, k, res.t);
+          t_to_p_z(res);
+          pmap.SetValue(i, j, k, res.p);
+          zmap.SetValue(i, j, k, res.z);
+        } else if (f_welchs) {
+          t_to_p_z(res);
+          zmap.SetValue(i, j, k, res.z);
+        } else
+          tmap.SetValue(i, j, k, res.t);
+      }
+    }
+  }
+}
+
+bool same(double a, double b) {
+  if (isnan(a) || isnan(b)) return isnan(a) && isnan(b);
+  if (isinf(a) || isinf(b)) return a == b;
+  return fabs(a - b) <= 1e-8 * (1.0 + fabs(a));
+}
+
+void checkmaps(Cube &c1, Cube &c2, const char *what) {
+  int bad = 0;
+  for (int i = 0; i < dimx * dimy * dimz; i++)
+    if (!same(c1.getValue<double>(i), c2.getValue<double>(i))) bad++;
+  printf("[%s] %s: %d mismatched voxels\n", (bad ? "E" : "I"), what, bad);
+  if (bad) nfailed++;
+}
+
+void runcheck(Tes &ts, VB_Vector &scores, VBMatrix &pmat, bool f_welchs) {
+  const char *name = (f_welchs ? "welch's" : "pooled");
+  // set up the engine as vbvlsm does
+  VLSMEngine vlsm;
+  vlsm.f_welchs = f_welchs;
+  vlsm.f_z = f_welchs;
+  vlsm.f_allvoxels = 1;
+  if (vlsm.setLesions(ts, Cube()) || vlsm.setScores(scores)) {
+    printf("[E] %s: couldn't set up the engine\n", name);
+    nfailed++;
+    return;
+  }
+  if (vlsm.voxels() != (uint32)(dimx * dimy * dimz)) {
+    printf("[E] %s: engine kept %d of %d voxels\n", name, vlsm.voxels(),
+           dimx * dimy * dimz);
+    nfailed++;
+  }
+
+  // the unpermuted maps
+  Cube tmap, pmap, zmap;
+  pervoxel(ts, scores, f_welchs, NULL, tmap, pmap, zmap);
+  vector<tval> res;
+  vlsm.calc(res);
+  vector<double> tv(res.size()), pv(res.size()), zv(res.size());
+  for (size_t i = 0; i < res.size(); i++) {
+    t_to_p_z(res[i]);
+    tv[i] = res[i].t;
+    pv[i] = res[i].p;
+    zv[i] = res[i].z;
+  }
+  Cube t2(dimx, dimy, dimz, vb_double), p2(dimx, dimy, dimz, vb_double),
+      z2(dimx, dimy, dimz, vb_double);
+  vlsm.scatter(tv, t2);
+  vlsm.scatter(pv, p2);
+  vlsm.scatter(zv, z2);
+  checkmaps(tmap, t2, (string(name) + " t map").c_str());
+  checkmaps(pmap, p2, (string(name) + " p map").c_str());
+  checkmaps(zmap, z2, (string(name) + " z map").c_str());
+
+  // the permutation maxima
+  vector<double> maxes;
+  if (vlsm.permute(pmat, 0, nperms, maxes)) {
+    printf("[E] %s: permute() failed\n", name);
+    nfailed++;
+    return;
+  }
+  int bad = 0;
+  for (int c = 0; c < nperms; c++) {
+    VB_Vector pvec = pmat.GetColumn(c);
+    pervoxel(ts, scores, f_welchs, &pvec, tmap, pmap, zmap);
+    double oldmax = (f_welchs ? zmap.get_maximum() : tmap.get_maximum());
+    if (!same(oldmax, maxes[c])) bad++;
+  }
+  printf("[%s] %s permutation maxima: %d mismatched\n", (bad ? "E" : "I"),
+         name, bad);
+  if (bad) nfailed++;
+}
+
+int main() {
+  Tes ts;
+  makelesions(ts);
+  VB_Vector scores(nsubjects);
+  for (int s = 0; s < nsubjects; s++) scores[s] = floor(lcg() * 40.0);
+  // column 0 is the original order, the rest are shuffles
+  VBMatrix pmat(nsubjects, nperms);
+  vector<int> order(nsubjects);
+  for (int c = 0; c < nperms; c++) {
+    for (int s = 0; s < nsubjects; s++) order[s] = s;
+    for (int s = nsubjects - 1; c && s > 0; s--)
+      swap(order[s], order[(int)(lcg() * (s + 1))]);
+    for (int s = 0; s < nsubjects; s++) pmat.set(s, c, order[s]);
+  }
+  runcheck(ts, scores, pmat, 0);
+  runcheck(ts, scores, pmat, 1);
+  if (nfailed) {
+    printf("[E] vlsmtest: %d check(s) failed\n", nfailed);
+    exit(1);
+  }
+  printf("[I] vlsmtest: all checks passed\n");
+  exit(0);
+}
@@ -0,0 +1,456 @@
+// vbbench.cpp
+// time the library's hot paths on synthetic data
+// Copyright (c) 2011 by The VoxBo Development Team
+
+// This file is part of VoxBo
+//
+// VoxBo is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// VoxBo is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with VoxBo.  If not, see <http://www.gnu.org/licenses/>.
+//
+// For general information on VoxBo, including the latest complete
+// source code and binary distributions, manual, and associated files,
+// see the VoxBo home page at: http://www.voxbo.org/
+//
+// original version written by Dan Kimberg
+
+using namespace std;
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <fstream>
+#include <set>
+#include "glmutil.h"
+#include "imageutils.h"
+#include "makestatcub.h"
+#include "vbio.h"
+#include "vbutil.h"
+
+void vbbench_help();
+
+// VBBench holds the synthetic data, which are made once from a fixed
+// seed so that every run (and every machine) times the same work.
+// each kernel does whatever per-repetition setup it needs and brackets
+// the part being timed with start() and stop().
+
+class VBBench {
+ public:
+  VBBench();
+  int setup();
+  int runall();
+  int writeResults(const string &fname);
+  int dimx, dimy, dimz, dimt;
+  int reps, nthreads, nseries;
+  uint64 seed;
+  string dir;
+  set<string> only;  // if not empty, the kernels to run
+
+ private:
+  typedef int (VBBench::*kernel)();
+  struct result {
+    string name;
+    int reps, err;
+    double best, total;
+  };
+  void run(const string &name, kernel kk);
+  void start();
+  void stop();
+  void getseries(vector<VB_Vector> &series);
+  int k_noisegen();
+  int k_smoothcube();
+  int k_findregions();
+  int k_fdr();
+  int k_calcbetas_nocor();
+  int k_calcbetas();
+  int k_tesregress();
+  int k_tes1_read_ts();
+  int k_nifti_read_ts();
+  int k_readts(const string &fname);
+  int k_write_tes1();
+  int k_write_nifti4d();
+  int k_write_nifti4d_gz();
+  int k_write_cub1();
+  int k_write_nifti3d();
+  VBNoiseGen noise;
+  Tes ts;              // the synthetic run
+  Cube statcube;       // smoothed z values
+  Cube pcube, mask;    // one-tailed p values for statcube, all-ones mask
+  VBMatrix gmat;       // the design: intercept, linear, and two sinusoids
+  GLMInfo glm;         // set up in memory for calcbetas
+  struct timeval t0;
+  double elapsed;
+  vector<result> results;
+};
+
+int main(int argc, char *argv[]) {
+  tokenlist args;
+  string outfile = "vbbench.txt";
+  VBBench bb;
+
+  args.Transfer(argc - 1, argv + 1);
+  for (size_t i = 0; i < args.size(); i++) {
+    if (args[i] == "-h") {
+      vbbench_help();
+      exit(0);
+    } else if (args[i] == "-o" && i < args.size() - 1)
+      outfile = args[++i];
+    else if (args[i] == "-d" && i < args.size() - 4) {
+      bb.dimx = strtol(args[i + 1]);
+      bb.dimy = strtol(args[i + 2]);
+      bb.dimz = strtol(args[i + 3]);
+      bb.dimt = strtol(args[i + 4]);
+      i += 4;
+    } else if (args[i] == "-r" && i < args.size() - 1)
+      bb.reps = strtol(args[++i]);
+    else if (args[i] == "-n" && i < args.size() - 1)
+      bb.nthreads = strtol(args[++i]);
+    else if (args[i] == "-s" && i < args.size() - 1)
+      bb.seed = strtol(args[++i]);
+    else if (args[i] == "-t" && i < args.size() - 1)
+      bb.dir = args[++i];
+    else if (args[i] == "-k" && i < args.size() - 1)
+      bb.only.insert(args[++i]);
+    else {
+      printf("[E] vbbench: unrecognized argument %s\n", args[i].c_str());
+      exit(101);
+    }
+  }
+  if (bb.dimx < 1 || bb.dimy < 1 || bb.dimz < 1 || bb.dimt < 8 ||
+      bb.reps < 1) {
+    printf("[E] vbbench: bad dimensions or repetitions\n");
+    exit(102);
+  }
+  bb.dir = uniquename(bb.dir + "/vbbench");
+  if (createfullpath(bb.dir)) {
+    printf("[E] vbbench: couldn't create scratch directory %s\n",
+           bb.dir.c_str());
+    exit(103);
+  }
+  int err = bb.setup();
+  if (!err) err = bb.runall();
+  rmdir_force(bb.dir);
+  if (err) {
+    printf("[E] vbbench: error %d setting up synthetic data\n", err);
+    exit(104);
+  }
+  if (bb.writeResults(outfile)) {
+    printf("[E] vbbench: couldn't write %s\n", outfile.c_str());
+    exit(105);
+  }
+  printf("[I] vbbench: wrote %s\n", outfile.c_str());
+  exit(0);
+}
+
+VBBench::VBBench() {
+  dimx = dimy = 48;
+  dimz = 24;
+  dimt = 100;
+  reps = 3;
+  nthreads = 0;
+  nseries = 2000;
+  seed = 1;
+  dir = "/tmp";
+}
+
+int VBBench::setup() {
+  noise.seed = seed;
+  noise.init(dimx, dimy, dimz, 2.0);
+  noise.setGaussian(1000.0, 400.0);
+  if (ts.init(dimx, dimy, dimz, dimt, vb_float)) return 101;
+  if (noise.fill(ts, NULL, nthreads)) return 102;
+  ts.voxsize[0] = ts.voxsize[1] = ts.voxsize[2] = 3.0;
+  // the stat map is one more smoothed volume, rescaled to unit variance
+  statcube.SetVolume(dimx, dimy, dimz, vb_float);
+  if (!statcube.data) return 103;
+  noise.volume(dimt, (float *)statcube.data);
+  float *zz = (float *)statcube.data;
+  int nvox = dimx * dimy * dimz;
+  double mean = 0.0, ss = 0.0;
+  for (int i = 0; i < nvox; i++) mean += zz[i];
+  mean /= nvox;
+  for (int i = 0; i < nvox; i++) ss += (zz[i] - mean) * (zz[i] - mean);
+  double sd = sqrt(ss / (nvox - 1));
+  for (int i = 0; i < nvox; i++) zz[i] = (zz[i] - mean) / sd;
+  pcube.SetVolume(dimx, dimy, dimz, vb_float);
+  mask.SetVolume(dimx, dimy, dimz, vb_byte);
+  if (!pcube.data || !mask.data) return 103;
+  for (int i = 0; i < nvox; i++) {
+    pcube.setValue<float>(i, 0.5 * erfc(zz[i] / M_SQRT2));
+    mask.setValue<char>(i, 1);
+  }
+  // the design
+  gmat.init(dimt, 4);
+  for (int i = 0; i < dimt; i++) {
+    gmat.set(i, 0, 1.0);
+    gmat.set(i, 1, (double)i / dimt - 0.5);
+    gmat.set(i, 2, sin(2.0 * M_PI * i / 20.0));
+    gmat.set(i, 3, cos(2.0 * M_PI * i / 20.0));
+  }
+  // calcbetas wants F1, R, the exofilt, and traces.  a gaussian
+  // exofilt will do, and R=I-G*F1 is the right size if not quite the
+  // right matrix.
+  glm.glmflags = AUTOCOR;
+  glm.gMatrix = gmat;
+  glm.f1Matrix.init(4, dimt);
+  if (pinv(gmat, glm.f1Matrix)) return 104;
+  VBMatrix gf1(gmat);
+  gf1 *= glm.f1Matrix;
+  glm.rMatrix.init(dimt, dimt);
+  glm.rMatrix.ident();
+  glm.rMatrix -= gf1;
+  glm.exoFilt.resize(dimt);
+  for (int i = 0; i < dimt; i++) {
+    double d = min(i, dimt - i);
+    glm.exoFilt[i] = exp(-d * d / 2.0);
+  }
+  glm.traceRV.resize(3);
+  glm.traceRV[0] = glm.traceRV[1] = glm.traceRV[2] = dimt - 4;
+  // Regress() makes the exokernel for us
+  VB_Vector signal(dimt);
+  if (glm.Regress(signal)) return 105;
+  // files for the readers and tesregress
+  if (ts.WriteFile(dir + "/bench.tes")) return 106;
+  if (ts.WriteFile(dir + "/bench.nii")) return 107;
+  if (gmat.WriteFile(dir + "/bench.G")) return 108;
+  return 0;
+}
+
+int VBBench::runall() {
+  printf("[I] vbbench: %dx%dx%d, %d timepoints, seed %llu, %d reps\n", dimx,
+         dimy, dimz, dimt, (unsigned long long)seed, reps);
+  run("noisegen", &VBBench::k_noisegen);
+  run("smoothCube", &VBBench::k_smoothcube);
+  run("findregions", &VBBench::k_findregions);
+  run("calc_multi_fdr_thresh", &VBBench::k_fdr);
+  run("calcbetas_nocor", &VBBench::k_calcbetas_nocor);
+  run("calcbetas", &VBBench::k_calcbetas);
+  run("TesRegress", &VBBench::k_tesregress);
+  run("tes1_read_ts", &VBBench::k_tes1_read_ts);
+  run("nifti_read_ts", &VBBench::k_nifti_read_ts);
+  run("tes1_write", &VBBench::k_write_tes1);
+  run("nifti_write_4D", &VBBench::k_write_nifti4d);
+  run("nifti_write_4D_gz", &VBBench::k_write_nifti4d_gz);
+  run("cub1_write", &VBBench::k_write_cub1);
+  run("nifti_write_3D", &VBBench::k_write_nifti3d);
+  return 0;
+}
+
+void VBBench::run(const string &name, kernel kk) {
+  if (only.size() && !only.count(name)) return;
+  result rr;
+  rr.name = name;
+  rr.reps = 0;
+  rr.err = 0;
+  rr.best = rr.total = 0.0;
+  for (int i = 0; i < reps; i++) {
+    elapsed = 0.0;
+    if ((rr.err = (this->*kk)())) break;
+    if (i == 0 || elapsed < rr.best) rr.best = elapsed;
+    rr.total += elapsed;
+    rr.reps++;
+  }
+  if (rr.err)
+    printf("[E] vbbench: %-24s error %d\n", name.c_str(), rr.err);
+  else
+    printf("[I] vbbench: %-24s best %.4fs mean %.4fs\n", name.c_str(),
+           rr.best, rr.total / rr.reps);
+  fflush(stdout);
+  results.push_back(rr);
+}
+
+void VBBench::start() { gettimeofday(&t0, NULL); }
+
+void VBBench::stop() {
+  struct timeval t1;
+  gettimeofday(&t1, NULL);
+  elapsed += (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+}
+
+// the results file is tab-separated, with the usual comment header.
+// times are in seconds.
+
+int VBBench::writeResults(const string &fname) {
+  ofstream ofile(fname.c_str());
+  if (!ofile) return 101;
+  ofile << ";VB98\n;TXT1\n;\n; vbbench results\n;   on " << timedate()
+        << "\n;   dims " << dimx << " " << dimy << " " << dimz << " " << dimt
+        << "\n;   seed " << seed << "\n;   threads "
+        << (nthreads < 1 ? ncores() : nthreads) << "\n;\n";
+  ofile << ";kernel\treps\tbest\tmean\terror\n";
+  vbforeach(result & rr, results) {
+    ofile << rr.name << "\t" << rr.reps << "\t" << rr.best << "\t"
+          << (rr.reps ? rr.total / rr.reps : 0.0) << "\t" << rr.err << "\n";
+  }
+  if (!ofile.good()) return 102;
+  return 0;
+}
+
+// nseries voxels, spread through the volume by a stride that's
+// prime to its size
+
+void VBBench::getseries(vector<VB_Vector> &series) {
+  int nvox = dimx * dimy * dimz;
+  int n = min(nseries, nvox);
+  series.resize(n);
+  for (int i = 0; i < n; i++) {
+    int v = ((uint64)i * 7919) % nvox;
+    series[i].resize(dimt);
+    for (int t = 0; t < dimt; t++) series[i][t] = ((float *)ts.data[v])[t];
+  }
+}
+
+int VBBench::k_noisegen() {
+  Tes tmp(dimx, dimy, dimz, dimt, vb_float);
+  if (!tmp.data) return 101;
+  start();
+  int err = noise.fill(tmp, NULL, nthreads);
+  stop();
+  return err;
+}
+
+int VBBench::k_smoothcube() {
+  Cube cb = statcube;
+  start();
+  int err = smoothCube(cb, 2.0, 2.0, 2.0);
+  stop();
+  return err;
+}
+
+int VBBench::k_findregions() {
+  start();
+  vector<VBRegion> rr = findregions(statcube, vb_agt, 2.0);
+  stop();
+  return (rr.size() ? 0 : 101);
+}
+
+int VBBench::k_fdr() {
+  start();
+  vector<fdrstat> ff = calc_multi_fdr_thresh(statcube, pcube, mask, 0.0);
+  stop();
+  return (ff.size() ? 0 : 101);
+}
+
+int VBBench::k_calcbetas_nocor() {
+  vector<VB_Vector> series;
+  getseries(series);
+  start();
+  for (size_t i = 0; i < series.size(); i++)
+    if (glm.calcbetas_nocor(series[i])) return 101;
+  stop();
+  return 0;
+}
+
+int VBBench::k_calcbetas() {
+  vector<VB_Vector> series;
+  getseries(series);
+  start();
+  for (size_t i = 0; i < series.size(); i++)
+    if (glm.calcbetas(series[i])) return 101;
+  stop();
+  return 0;
+}
+
+// the whole vbregress path, from the files written in setup().  a
+// fresh GLMInfo each time so that nothing is cached.
+
+int VBBench::k_tesregress() {
+  GLMInfo gi;
+  gi.stemname = dir + "/bench";
+  gi.teslist.push_back(dir + "/bench.tes");
+  gi.dependentindex = -1;
+  for (int i = 0; i < (int)gmat.n; i++) gi.keeperlist.push_back(i);
+  // TesRegress() is chatty
+  fflush(stdout);
+  start();
+  int err = gi.TesRegress(1, 1, 0);
+  stop();
+  fflush(stdout);
+  GLMCache::flush();
+  return err;
+}
+
+int VBBench::k_tes1_read_ts() { return k_readts(dir + "/bench.tes"); }
+
+int VBBench::k_nifti_read_ts() { return k_readts(dir + "/bench.nii"); }
+
+int VBBench::k_readts(const string &fname) {
+  Tes tmp;
+  int nvox = dimx * dimy * dimz;
+  int n = min(nseries, nvox);
+  start();
+  for (int i = 0; i < n; i++) {
+    int v = ((uint64)i * 7919) % nvox;
+    int x = v % dimx, y = (v / dimx) % dimy, z = v / (dimx * dimy);
+    if (tmp.ReadTimeSeries(fname, x, y, z)) return 101;
+  }
+  stop();
+  return 0;
+}
+
+int VBBench::k_write_tes1() {
+  start();
+  int err = ts.WriteFile(dir + "/out.tes");
+  stop();
+  return err;
+}
+
+int VBBench::k_write_nifti4d() {
+  start();
+  int err = ts.WriteFile(dir + "/out.nii");
+  stop();
+  return err;
+}
+
+int VBBench::k_write_nifti4d_gz() {
+  start();
+  int err = ts.WriteFile(dir + "/out.nii.gz");
+  stop();
+  return err;
+}
+
+int VBBench::k_write_cub1() {
+  start();
+  int err = statcube.WriteFile(dir + "/out.cub");
+  stop();
+  return err;
+}
+
+int VBBench::k_write_nifti3d() {
+  start();
+  int err = statcube.WriteFile(dir + "/out3d.nii");
+  stop();
+  return err;
+}
+
+void vbbench_help() {
+  printf("\nVoxBo vbbench (v%s)\n", vbversion.c_str());
+  printf("summary: times some of the library's hot paths on synthetic data\n");
+  printf("usage:\n");
+  printf("  vbbench [flags]\n");
+  printf("flags:\n");
+  printf("  -o <file>      results file (default vbbench.txt)\n");
+  printf("  -d <x y z t>   dims of the synthetic run (default 48 48 24 100)\n");
+  printf("  -r <n>         repetitions of each kernel (default 3)\n");
+  printf("  -n <n>         threads for threaded kernels (default all cores)\n");
+  printf("  -s <n>         seed for the synthetic data (default 1)\n");
+  printf("  -t <dir>       where to put scratch files (default /tmp)\n");
+  printf("  -k <name>      run just this kernel (can be repeated)\n");
+  printf("  -h             show help\n");
+  printf("notes:\n");
+  printf("  The synthetic data are made from the seed, so results from runs\n");
+  printf("  with the same flags can be compared directly.  The results file\n");
+  printf("  has one tab-separated line per kernel, with the kernel name,\n");
+  printf("  repetitions, best and mean times in seconds, and an error code\n");
+  printf("  (0 for none).  The readers and calcbetas are timed over 2000\n");
+  printf("  time series, everything else over the whole run or volume.\n");
+  printf("\n");
+}
@@ -878,6 +878,7 @@ void VBView::deletelayer() {
 
 void VBView::fliplayer() {
   currentlayer->cube *= -1;
+  currentlayer->cubegen++;
   RenderAll();
 }
 
@@ -1139,6 +1140,7 @@ int VBView::NewXSlice(int newval) {
 
 void VBView::LayerInfo() {
   if (currentlayer == layers.end()) return;
+  currentlayer->syncRenderCube();
   Cube cb = currentlayer->cube;
   cb.intersect(currentlayer->rendercube);
   vector<VBRegion> rlist;
@@ -1244,6 +1246,7 @@ int VBView::NewTSlice(int newval) {
   tposedit->setText(strnum(nv).c_str());
   q_volume = nv;
   layers.begin()->tes.getCube(q_volume, layers.begin()->cube);
+  layers.begin()->cubegen++;
   layers.begin()->render();
   RenderAll();
   return (0);
@@ -1252,7 +1255,7 @@ int VBView::NewTSlice(int newval) {
 int VBView::NewBrightness(int newval) {
   if (layers.size() == 0) return 0;
   layers.begin()->q_brightness = newval;
-  layers.begin()->render();
+  layers.begin()->renderLUT();
   RenderAll();
   return 0;
 }
@@ -1260,7 +1263,7 @@ int VBView::NewBrightness(int newval) {
 int VBView::NewContrast(int newval) {
   if (layers.size() == 0) return 0;
   layers.begin()->q_contrast = newval;
-  layers.begin()->render();
+  layers.begin()->renderLUT();
   RenderAll();
   return 0;
 }
@@ -1702,6 +1705,7 @@ int VBView::SaveVisibleMap() {
   QString s = Q3FileDialog::getSaveFileName("Filename for map", "All (*.*)",
                                             this, "save map", "Map filename");
   if (s == QString::null) return 0;
+  ll->syncRenderCube();
   Cube tmp = ll->cube;
   tmp.intersect(ll->rendercube);
   QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
@@ -1724,6 +1728,7 @@ int VBView::SaveRegionMask() {
   QString s = Q3FileDialog::getSaveFileName("Filename for map", "All (*.*)",
                                             this, "save map", "Map filename");
   if (s == QString::null) return 0;
+  ll->syncRenderCube();
   Cube tmp = ll->rendercube;
   tmp.quantize(1);
   QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
@@ -1841,6 +1846,7 @@ void VBView::ByteSwap() {
   if (currentlayer == layers.end()) return;
   if (currentlayer->cube) currentlayer->cube.byteswap();
   if (currentlayer->tes) currentlayer->tes.byteswap();
+  currentlayer->cubegen++;
   currentlayer->render();
   RenderAll();
 }
@@ -1914,6 +1920,7 @@ int VBView::Cut() {
 
 int VBView::Copy() {
   if (currentlayer == layers.end()) return 1;
+  currentlayer->syncRenderCube();
   Cube &rc = currentlayer->rendercube;
   if (!q_mask.dimsequal(rc))
     q_mask.SetVolume(rc.dimx, rc.dimy, rc.dimz, vb_byte);
@@ -1927,6 +1934,7 @@ int VBView::Copy() {
 
 int VBView::Paste() {
   if (currentlayer == layers.end()) return 1;
+  currentlayer->syncRenderCube();
   Cube &rc = currentlayer->rendercube;
   Cube &rm = currentlayer->mask;
   if (!q_mask.dimsequal(rc)) {
@@ -1940,6 +1948,8 @@ int VBView::Paste() {
   for (int i = 0; i < rc.dimx * rc.dimy * rc.dimz; i++) {
     if (!(rm.testValue(i))) rc.setValue(i, 0);
   }
+  currentlayer->q_lutmask = rm.dimsequal(currentlayer->cube);
+  currentlayer->gen++;
   updateLayerTable();
   RenderAll();
   UpdateTS();
@@ -1954,6 +1964,7 @@ int VBView::ApplyMask() {
   if (currentlayer->type != VBLayer::vb_glm &&
       currentlayer->type != VBLayer::vb_stat)
     return 1;
+  previouslayer->syncRenderCube();
   Cube *pc = &(previouslayer->rendercube);
   Cube *cc = &(currentlayer->rendercube);
   if (pc->dimx != cc->dimx || pc->dimy != cc->dimy || pc->dimz != cc->dimz)
@@ -1965,6 +1976,7 @@ int VBView::ApplyMask() {
       }
     }
   }
+  currentlayer->gen++;
   RenderAll();
   UpdateTS();
   return 0;
@@ -1992,6 +2004,7 @@ int VBView::FindCurrentRegion() {
   coord.set(3, 0, 1);
   coord ^= currentlayer->transform;
   // set up stuff for the growregion
+  currentlayer->syncRenderCube();
   Cube *rc = &(currentlayer->rendercube);
   Cube mask;
   mask.SetVolume(rc->dimx, rc->dimy, rc->dimz, vb_byte);
@@ -2014,6 +2027,7 @@ int VBView::FindCurrentRegion() {
         }
       }
     }
+    currentlayer->gen++;
     RenderAll();
     UpdateTS();
   }
@@ -2032,6 +2046,7 @@ int VBView::FindCurrentRegion() {
         }
       }
     }
+    currentlayer->gen++;
     RenderAll();
     UpdateTS();
   }
@@ -2078,6 +2093,7 @@ void VBView::CreateCorrelationMap() {
       }
     }
   }
+  cl->cubegen++;
   // panel_stats->show();
 
   q_update = 0;
@@ -2218,6 +2234,7 @@ void VBView::PopMask() {
     currentlayer->cube.SetValue(vox->second.x, vox->second.y, vox->second.z,
                                 vox->second.val);
   }
+  currentlayer->cubegen++;
   currentlayer->render();
   currentlayer->undo.pop_front();
   RenderAll();
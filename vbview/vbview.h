@@ -90,6 +90,28 @@ class VBV_Mask {
   QTMaskWidget *f_widget;  // pointer to relevant widget
 };
 
+// VBLayerID hands out a new id whenever it's created, copied, or
+// assigned to, so that a copy of a layer never shares cache entries
+// with the original.
+
+class VBLayerID {
+ public:
+  VBLayerID() { val = next(); }
+  VBLayerID(const VBLayerID &) { val = next(); }
+  VBLayerID &operator=(const VBLayerID &) {
+    val = next();
+    return *this;
+  }
+  operator uint32() const { return val; }
+
+ private:
+  uint32 val;
+  static uint32 next() {
+    static uint32 nextid = 0;
+    return nextid++;
+  }
+};
+
 class VBLayer {
  public:
   VBLayer();
@@ -117,6 +139,7 @@ class VBLayer {
 
   // stuff for stat map layers only
   int q_clustersize;
+  VBMaxTree clustertrees[3];  // negative, absolute, and positive values
   QColor q_poscolor1, q_poscolor2, q_negcolor1, q_negcolor2, q_nscolor1,
       q_nscolor2;
 
@@ -133,12 +156,58 @@ class VBLayer {
   // resolutions, in one of several ways:
   void render();
   void renderStruct();
+  void renderLUT();
   void renderMask();
   void renderStat();
   void renderCorr();
   void setScale();
   uint32 overlayvalue(double val, double aval);
   QString tooltipinfo();
+
+  // struct layers don't fill in rendercube as they go.  each voxel
+  // gets an index into lut (the exact value for integer data with a
+  // modest range, otherwise one of about 4096 levels placed from the
+  // data's distribution), so brightness and contrast changes only have
+  // to rebuild the 4096 or so entries of lut.  lutvals holds the value
+  // each level is drawn as.  rendercube is brought up to date only
+  // when someone asks for it with syncRenderCube().
+  vector<uint16> lutcode;
+  vector<uint32> lut;
+  vector<float> lutvals;
+  bool q_rcstale;  // rendercube is behind lut
+  bool q_lutmask;  // mask applies to this layer
+  void buildLUTCodes();
+  void syncRenderCube();
+  inline uint32 renderedValue(int32 xx, int32 yy, int32 zz) const {
+    if (type != vb_struct || !q_rcstale)
+      return rendercube.getValue<int32>(xx, yy, zz);
+    if (xx < 0 || yy < 0 || zz < 0) return 0;
+    if (xx >= cube.dimx || yy >= cube.dimy || zz >= cube.dimz) return 0;
+    int32 ind = xx + cube.dimx * (yy + cube.dimy * zz);
+    if (q_lutmask && !mask.testValue(ind)) return 0;
+    return lut[lutcode[ind]];
+  }
+  // id identifies the layer to the views' caches, and gen is bumped
+  // every time what the layer would draw changes.  copies get their
+  // own id.  cubegen is bumped only when cube's contents change, and
+  // keys the cluster trees.
+  VBLayerID id;
+  uint32 gen;
+  uint32 cubegen;
+  uint64 cubekey() const { return ((uint64)id << 32) | cubegen; }
+};
+
+// MyView keeps the last pixels it sampled from each layer, so that
+// changing one layer (or moving the crosshairs) doesn't mean
+// resampling all the others.  key is everything that determines which
+// voxel lands on which pixel.
+
+class VBLayerSlice {
+ public:
+  uint32 gen;
+  vector<double> key;
+  vector<uint32> pixels;
+  vector<pair<int, int> > origin;  // pixels on the layer's origin voxel
 };
 
 class MyView {
@@ -152,6 +221,7 @@ class MyView {
   int position;  // x, y, or z position as needed
   enum { vb_xy, vb_yz, vb_xz, vb_zy } orient;
   float xscale, yscale, zscale;
+  map<uint32, VBLayerSlice> slicecache;  // by layer id
   // new methods and stuff
 };
 
@@ -149,6 +149,7 @@ void VBView::NewOutline() {
   }
   list<VBLayer> newlayers;
   newlayers.push_back(VBLayer());
+  currentlayer->syncRenderCube();
   Cube tmpc = currentlayer->rendercube;
   tmpc.quantize(1);
   tmpc.convert_type(vb_byte);
@@ -24,6 +24,7 @@
 
 using namespace std;
 
+#include <algorithm>
 #include "vbview.h"
 
 // prototypes for purely local functions
@@ -46,6 +47,10 @@ VBLayer::VBLayer() {
   q_ns = 0;
   type = vb_struct;
   q_dirty = 0;
+  q_rcstale = 0;
+  q_lutmask = 0;
+  gen = 0;
+  cubegen = 0;
   transform.resize(4, 4);
   transform.ident();
   full.resize(4, 4);
@@ -107,11 +112,13 @@ void VBLayer::setAlignment(VBLayerI base) {
 }
 
 void VBLayer::render() {
+  gen++;
+  q_rcstale = 0;
   switch (type) {
     case vb_struct:
-      setScale();
       renderStruct();
-      break;
+      // the mask is applied as we sample
+      return;
     case vb_mask:
       renderMask();
       break;
@@ -132,25 +139,138 @@ void VBLayer::render() {
   }
 }
 
-// FIXME renderStruct() is slow, and has to be called every time we
-// adjust the contrast or brightness, not to mention initial load
+// renderStruct() is called when the cube itself may have changed, so
+// it recalculates the lut codes.  renderLUT() is all that's needed
+// for a change in brightness or contrast.
 
 void VBLayer::renderStruct() {
-  if (!rendercube.data)
+  if (!rendercube.data || !rendercube.dimsequal(cube))
     rendercube.SetVolume(cube.dimx, cube.dimy, cube.dimz, vb_long);
   rendercube.origin[0] = cube.origin[0];
   rendercube.origin[1] = cube.origin[1];
   rendercube.origin[2] = cube.origin[2];
-  int32 val;
-  int32 tmp;
-  for (int i = 0; i < cube.dimx * cube.dimy * cube.dimz; i++) {
-    tmp = scaledvalue(cube.getValue<float>(i), q_thresh, q_high, q_factor);
-    val = tmp;
+  buildLUTCodes();
+  q_lutmask = (mask && mask.dimsequal(cube));
+  renderLUT();
+}
+
+// buildLUTCodes() assigns every voxel a level.  integer data with
+// fewer than 64K distinct values gets exact levels, so it renders just
+// as it did voxel by voxel.  anything else gets about 4096 levels: half
+// placed at quantiles of the data, so that wherever the voxels are
+// dense the levels are fine, and half spread evenly between the 0.5th
+// and 99.5th percentiles, so that a few outliers can't squeeze the
+// useful range into a handful of grays.  each level is drawn at the
+// mean of the voxels in it.
+
+void VBLayer::buildLUTCodes() {
+  const int nsplit = 2048;
+  int nvox = cube.dimx * cube.dimy * cube.dimz;
+  lutcode.resize(nvox);
+  double minval = 0.0, maxval = 0.0;
+  bool first = 1;
+  for (int i = 0; i < nvox; i++) {
+    float val = cube.getValue<float>(i);
+    if (!isfinite(val)) continue;
+    if (first || val < minval) minval = val;
+    if (first || val > maxval) maxval = val;
+    first = 0;
+  }
+  int nlevels;
+  if (cube.datatype != vb_float && cube.datatype != vb_double &&
+      maxval - minval < 65535) {
+    nlevels = (int)(maxval - minval) + 1;
+    // the extra entry at the end of lut is for non-finite values
+    lut.resize(nlevels + 1);
+    lutvals.resize(nlevels);
+    for (int i = 0; i < nlevels; i++) lutvals[i] = minval + i;
+    for (int i = 0; i < nvox; i++) {
+      float val = cube.getValue<float>(i);
+      if (!isfinite(val))
+        lutcode[i] = nlevels;
+      else
+        lutcode[i] = lround(val - minval);
+    }
+    return;
+  }
+  // quantiles come from at most about a million voxels
+  vector<float> sample;
+  int stride = max(1, nvox / 1048576);
+  for (int i = 0; i < nvox; i += stride) {
+    float val = cube.getValue<float>(i);
+    if (isfinite(val)) sample.push_back(val);
+  }
+  sort(sample.begin(), sample.end());
+  // edges[k] is the lowest value in level k+1
+  vector<float> edges;
+  if (sample.size()) {
+    size_t ns = sample.size();
+    for (int k = 1; k < nsplit; k++)
+      edges.push_back(sample[(ns * k) / nsplit]);
+    double lo = sample[(size_t)(ns * 0.005)];
+    double hi = sample[min(ns - 1, (size_t)(ns * 0.995))];
+    if (hi > lo) {
+      for (int k = 1; k < nsplit; k++)
+        edges.push_back(lo + ((hi - lo) * k) / nsplit);
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+  }
+  nlevels = edges.size() + 1;
+  vector<double> sums(nlevels, 0.0);
+  vector<uint32> counts(nlevels, 0);
+  for (int i = 0; i < nvox; i++) {
+    float val = cube.getValue<float>(i);
+    if (!isfinite(val)) {
+      lutcode[i] = nlevels;
+      continue;
+    }
+    int code = upper_bound(edges.begin(), edges.end(), val) - edges.begin();
+    lutcode[i] = code;
+    sums[code] += val;
+    counts[code]++;
+  }
+  lut.resize(nlevels + 1);
+  lutvals.resize(nlevels);
+  for (int i = 0; i < nlevels; i++) {
+    if (counts[i])
+      lutvals[i] = sums[i] / counts[i];
+    else
+      lutvals[i] = (i ? edges[i - 1] : minval);
+  }
+}
+
+void VBLayer::renderLUT() {
+  if (type != vb_struct || lut.empty()) {
+    render();
+    return;
+  }
+  gen++;
+  setScale();
+  int nlevels = lut.size() - 1;
+  for (int i = 0; i <= nlevels; i++) {
+    int32 tmp = 0;
+    if (i < nlevels)
+      tmp = scaledvalue(lutvals[i], q_thresh, q_high, q_factor);
+    int32 val = tmp;
     val |= tmp << 8;
     val |= tmp << 16;
     val |= 100 << 25;
-    rendercube.setValue(i, val);
+    lut[i] = val;
   }
+  q_rcstale = 1;
+}
+
+void VBLayer::syncRenderCube() {
+  if (type != vb_struct || !q_rcstale) return;
+  int32 *ptr = (int32 *)rendercube.data;
+  for (int i = 0; i < cube.dimx * cube.dimy * cube.dimz; i++) {
+    if (q_lutmask && !mask.testValue(i))
+      ptr[i] = 0;
+    else
+      ptr[i] = lut[lutcode[i]];
+  }
+  q_rcstale = 0;
 }
 
 // unnamed float below used to be high.  now that's rolled into
@@ -189,21 +309,30 @@ void VBLayer::renderStat() {
   int32 *ptr = (int32 *)rendercube.data;
   // bool f_all=fabs(q_thresh)<FLT_MIN;
   float val, aval;
-  // if we're using a cluster size criterion, find the clusters now
+  // if we're using a cluster size criterion, find the clusters now.
+  // the component tree for the current sign convention is built the
+  // first time we need it, after which moving the threshold or the
+  // cluster size is just a query.
   if (q_clustersize > 1) {
     rendercube.zero();
-    vector<VBRegion> regions;
-    if (q_twotailed)
-      regions = findregions(cube, vb_agt, q_thresh);
-    else if (q_flip)
-      regions = findregions(cube, vb_lt, 0 - q_thresh);
-    else
-      regions = findregions(cube, vb_gt, q_thresh);
-    vbforeach(VBRegion & rr, regions) {
-      if (rr.size() < q_clustersize) continue;
-      for (VI myvox = rr.begin(); myvox != rr.end(); myvox++) {
-        rendercube.setValue(myvox->second.x, myvox->second.y, myvox->second.z,
-                            1);
+    int sign = (q_twotailed ? 0 : (q_flip ? -1 : 1));
+    VBMaxTree &mt = clustertrees[sign + 1];
+    if (!mt.matches(cubekey(), sign)) mt.build(cube, sign, cubekey());
+    // negative thresholds fall back to the flood fill
+    if (mt.mark(q_thresh, q_clustersize, rendercube)) {
+      vector<VBRegion> regions;
+      if (q_twotailed)
+        regions = findregions(cube, vb_agt, q_thresh);
+      else if (q_flip)
+        regions = findregions(cube, vb_lt, 0 - q_thresh);
+      else
+        regions = findregions(cube, vb_gt, q_thresh);
+      vbforeach(VBRegion & rr, regions) {
+        if (rr.size() < q_clustersize) continue;
+        for (VI myvox = rr.begin(); myvox != rr.end(); myvox++) {
+          rendercube.setValue(myvox->second.x, myvox->second.y,
+                              myvox->second.z, 1);
+        }
       }
     }
   }
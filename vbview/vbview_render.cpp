@@ -24,12 +24,16 @@
 
 using namespace std;
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include "vbview.h"
 
 // prototypes for purely local functions
 inline QRgb alphablend(QRgb oldval, QRgb newval, int alpha);
 void inline affine_add1x(VBMatrix &pos, VBMatrix &trans);
 void inline affine_cr(VBMatrix &pos, VBMatrix &trans, int nx);
+void sampleLayerSlice(VBLayerSlice &ls, const VBLayer &layer, vbrect rrect,
+                      const vector<double> &key);
 
 void VBView::RenderAll() {
   if (!q_update) return;
@@ -71,11 +75,21 @@ void VBView::UniRender(MyView &view) {
 void VBView::UniRenderView(MyView &view) {
   if (!q_update) return;
   if (!layers.size()) return;
+  set<uint32> ids;
   for (VBLayerI l = layers.begin(); l != layers.end(); l++) {
+    ids.insert(l->id);
     if (l == layers.begin() || (l->q_visible && l->alpha > 0))
       UniRenderLayer(view, l,
                      vbrect(view.xoff, view.yoff, view.width, view.height));
   }
+  // forget about layers that have been closed
+  map<uint32, VBLayerSlice>::iterator ci = view.slicecache.begin();
+  while (ci != view.slicecache.end()) {
+    if (ids.count(ci->first))
+      ci++;
+    else
+      view.slicecache.erase(ci++);
+  }
 }
 
 void VBView::UniRenderLayer(MyView &view, VBLayerI layer, vbrect rrect) {
@@ -83,7 +97,7 @@ void VBView::UniRenderLayer(MyView &view, VBLayerI layer, vbrect rrect) {
   if (!layer->q_visible) return;
 
   uint32 *p;
-  VBMatrix traverse_x, traverse_cr, full;
+  VBMatrix full;
   // calculate the transformation from window coordinates to this
   // layer's rendercube coordinates
   int pos = view.position;
@@ -99,31 +113,6 @@ void VBView::UniRenderLayer(MyView &view, VBLayerI layer, vbrect rrect) {
                            view.width, view.height, view.orient, pos, q_fliph,
                            q_flipv);
   full = layer->full;  // for convenience
-  // grab corner (0,0,0) voxel
-  VBMatrix position(4, 1);
-  position.set(0, 0, rrect.x);
-  position.set(1, 0, rrect.y);
-  position.set(2, 0, 0);
-  position.set(3, 0, 1);
-  // now premultiply to get corresponding coord in rendercube
-  // position^=layer->full;
-  position ^= full;
-  traverse_x.init(4, 1);
-  traverse_x.set(0, 0, full(0, 0));
-  traverse_x.set(1, 0, full(1, 0));
-  traverse_x.set(2, 0, full(2, 0));
-  traverse_x.set(3, 0, 0);
-  traverse_cr.init(4, 1);
-
-  // the below replaced with the even more below, because we're
-  // sometimes not drawing the entire width of the view
-  traverse_cr.set(0, 0, full(0, 1) - (full(0, 0) * rrect.w));
-  traverse_cr.set(1, 0, full(1, 1) - (full(1, 0) * rrect.w));
-  traverse_cr.set(2, 0, full(2, 1) - (full(2, 0) * rrect.w));
-
-  traverse_cr.set(3, 0, 0);
-  // voila!  now, each time we increment x or y, we can do it without
-  // matrix multiplication
 
   // let's figure out which values of i and j below should get
   // crosshairs.  find the coord in image space and map backwards.
@@ -151,37 +140,29 @@ void VBView::UniRenderLayer(MyView &view, VBLayerI layer, vbrect rrect) {
     ycross = (int)(tmp2(1, 0));
   }
 
-  double xpos[3], xtx[3], xtcr[3];
-  xpos[0] = position(0, 0);
-  xpos[1] = position(1, 0);
-  xpos[2] = position(2, 0);
-  xtx[0] = traverse_x(0, 0);
-  xtx[1] = traverse_x(1, 0);
-  xtx[2] = traverse_x(2, 0);
-  xtcr[0] = traverse_cr(0, 0);
-  xtcr[1] = traverse_cr(1, 0);
-  xtcr[2] = traverse_cr(2, 0);
+  // resample the layer only if it's changed or we're looking at a
+  // different part of it
+  vector<double> key;
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 4; c++) key.push_back(full(r, c));
+  key.push_back(rrect.x);
+  key.push_back(rrect.y);
+  key.push_back(rrect.w);
+  key.push_back(rrect.h);
+  key.push_back(q_showorigin);
+  VBLayerSlice &ls = view.slicecache[layer->id];
+  if (ls.gen != layer->gen || ls.key != key || ls.pixels.empty())
+    sampleLayerSlice(ls, *layer, rrect, key);
+
   QRgb newval, oldval;
   bool f_blend = (layer != layers.begin());
-  int32 xx, yy, zz;
-  VBRegion myorigin;
+  const uint32 *src = ls.pixels.size() ? &ls.pixels[0] : NULL;
   for (int j = rrect.y; j < rrect.y + rrect.h; j++) {
     p = (uint32 *)currentimage.scanLine(j);
     p += (rrect.x);
     for (int i = rrect.x; i < rrect.x + rrect.w; i++) {
       oldval = *p;
-      // we truncate these floating point coordinates, because when
-      // you're magnifying a voxel, you don't start using the next
-      // voxel's value until you cross the border.
-      xx = (int)xpos[0];
-      yy = (int)xpos[1];
-      zz = (int)xpos[2];
-      newval = layer->rendercube.getValue<int32>(xx, yy, zz);
-      if (q_showorigin && xx == layer->rendercube.origin[0] &&
-          yy == layer->rendercube.origin[1] &&
-          zz == layer->rendercube.origin[2]) {
-        myorigin.add(i, j, 0, 0);
-      }
+      newval = *src++;
       if (f_blend) {
         if (newval >> 24) {
           newval = alphablend(oldval, newval, layer->alpha);
@@ -193,14 +174,11 @@ void VBView::UniRenderLayer(MyView &view, VBLayerI layer, vbrect rrect) {
         *p = qRgb(255, 0, 0);
       }
       p++;
-      xpos[0] += xtx[0];
-      xpos[1] += xtx[1];
-      xpos[2] += xtx[2];
     }
-    xpos[0] += xtcr[0];
-    xpos[1] += xtcr[1];
-    xpos[2] += xtcr[2];
   }
+  VBRegion myorigin;
+  for (size_t i = 0; i < ls.origin.size(); i++)
+    myorigin.add(ls.origin[i].first, ls.origin[i].second, 0, 0);
   if (myorigin.size()) {
     double x, y, z;
     myorigin.GeometricCenter(x, y, z);
@@ -226,6 +204,90 @@ void VBView::UniRenderLayer(MyView &view, VBLayerI layer, vbrect rrect) {
   drawarea->update();
 }
 
+// a slicejob samples one layer for one view.  each thread takes every
+// nthreads'th row, so no two threads write the same pixels, and keeps
+// its own list of origin pixels.
+
+class slicejob {
+ public:
+  const VBLayer *layer;
+  int w, h, x0, y0;
+  double corner[3], colstep[3], rowstep[3];
+  bool f_origin;
+  uint32 *pixels;
+  vector<vector<pair<int, int> > > origins;
+  void run(int thread, int nthreads);
+};
+
+void slicejob::run(int thread, int nthreads) {
+  const Cube &rc = layer->rendercube;
+  int32 xx, yy, zz;
+  for (int r = thread; r < h; r += nthreads) {
+    double xpos[3];
+    for (int d = 0; d < 3; d++) xpos[d] = corner[d] + r * rowstep[d];
+    uint32 *p = pixels + r * w;
+    for (int c = 0; c < w; c++) {
+      // we truncate these floating point coordinates, because when
+      // you're magnifying a voxel, you don't start using the next
+      // voxel's value until you cross the border.
+      xx = (int)xpos[0];
+      yy = (int)xpos[1];
+      zz = (int)xpos[2];
+      p[c] = layer->renderedValue(xx, yy, zz);
+      if (f_origin && xx == rc.origin[0] && yy == rc.origin[1] &&
+          zz == rc.origin[2])
+        origins[thread].push_back(make_pair(x0 + c, y0 + r));
+      xpos[0] += colstep[0];
+      xpos[1] += colstep[1];
+      xpos[2] += colstep[2];
+    }
+  }
+}
+
+// sampleLayerSlice() fills in ls with the layer's rendered values for
+// the pixels in rrect.  key is the first 12 entries of the layer's
+// full transform, followed by the rectangle and the origin flag.
+
+void sampleLayerSlice(VBLayerSlice &ls, const VBLayer &layer, vbrect rrect,
+                      const vector<double> &key) {
+  ls.key = key;
+  ls.gen = layer.gen;
+  ls.origin.clear();
+  ls.pixels.resize(rrect.w * rrect.h);
+  if (ls.pixels.empty()) return;
+  slicejob job;
+  job.layer = &layer;
+  job.w = rrect.w;
+  job.h = rrect.h;
+  job.x0 = rrect.x;
+  job.y0 = rrect.y;
+  // the corner is full * (x,y,0,1), and each step in x or y just adds
+  // the corresponding column of full
+  for (int d = 0; d < 3; d++) {
+    job.colstep[d] = key[d * 4];
+    job.rowstep[d] = key[d * 4 + 1];
+    job.corner[d] =
+        key[d * 4] * rrect.x + key[d * 4 + 1] * rrect.y + key[d * 4 + 3];
+  }
+  job.f_origin = key[16];
+  job.pixels = &ls.pixels[0];
+  // not worth starting threads for a handful of rows
+  int nthreads = min(ncores(), rrect.h / 32);
+  if (nthreads < 2) nthreads = 1;
+  job.origins.resize(nthreads);
+  if (nthreads == 1)
+    job.run(0, 1);
+  else {
+    boost::thread_group tg;
+    for (int t = 0; t < nthreads; t++)
+      tg.create_thread(boost::bind(&slicejob::run, &job, t, nthreads));
+    tg.join_all();
+  }
+  for (int t = 0; t < nthreads; t++)
+    ls.origin.insert(ls.origin.end(), job.origins[t].begin(),
+                     job.origins[t].end());
+}
+
 void inline affine_add1x(VBMatrix &pos, VBMatrix &trans) {
   pos.set(0, 0, pos(0, 0) + trans(0, 0));
   pos.set(1, 0, pos(1, 0) + trans(1, 0));
@@ -351,6 +413,8 @@ int32 VBView::fillmask(MyView &view, VBVoxel loc, VBLayerI masklayer,
     masklayer->rendercube.SetValue(mv->second.x, mv->second.y, mv->second.z,
                                    maskcolor);
   }
+  masklayer->gen++;
+  masklayer->cubegen++;
   VBVoxel cvox(xx, yy, zz);
   vbforeach(MyView & view, viewlist) {
     colorpixels(view, cvox, maskreg, masklayer);
@@ -421,6 +485,8 @@ int32 VBView::colormask(MyView &view, VBVoxel loc, VBLayerI masklayer,
     masklayer->rendercube.SetValue(mv->second.x, mv->second.y, mv->second.z,
                                    maskcolor);
   }
+  masklayer->gen++;
+  masklayer->cubegen++;
   VBVoxel cvox(xx, yy, zz);
   vbforeach(MyView & view, viewlist) {
     colorpixels(view, cvox, maskreg, masklayer);
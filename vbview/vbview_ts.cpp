@@ -54,6 +54,7 @@ void VBView::UpdateTS(bool clearflag) {
   // mask coordinates.  something like that.
   VBRegion myregion;
   if (ts_maskbox->isChecked()) {
+    li->syncRenderCube();
     Cube &cb = li->rendercube;
     for (int i = 0; i < cb.dimx; i++) {
       for (int j = 0; j < cb.dimy; j++) {
@@ -79,17 +80,13 @@ void VBView::UpdateTS(bool clearflag) {
     ts_removebox->hide();
     ts_scalebox->hide();
     // do PCA
-    VBMatrix components(li->tes.dimt, myregion.size());
-    int ind = 0;
-    for (VI vox = myregion.begin(); vox != myregion.end(); vox++) {
-      li->tes.GetTimeSeries(vox->second.x, vox->second.y, vox->second.z);
-      if (ts_meanscalebox->isChecked()) li->tes.timeseries.meanNormalize();
-      if (ts_detrendbox->isChecked()) li->tes.timeseries.removeDrift();
-      components.SetColumn(ind++, li->tes.timeseries);
-    }
+    VBRegionTS rts;
+    vector<VBMatrix> components;
+    rts.addRegion(myregion);
+    if (rts.extractSeries(li->tes, flags, components)) return;
     VBMatrix pcax, E;
     VB_Vector lambdas, vv;
-    if (pca(components, lambdas, pcax, E)) return;
+    if (pca(components[0], lambdas, pcax, E)) return;
     if (pcax.n > 0) {
       vv = pcax.GetColumn(0);
       tspane->addVector(vv, "red");
@@ -112,19 +109,11 @@ void VBView::UpdateTS(bool clearflag) {
     ts_removebox->hide();
     ts_scalebox->hide();
     // now build the time series
-    VB_Vector vv;
-    for (VI myvox = myregion.begin(); myvox != myregion.end(); myvox++) {
-      if (li->tes.GetTimeSeries(myvox->second.x, myvox->second.y,
-                                myvox->second.z))
-        continue;
-      if (ts_meanscalebox->isChecked()) li->tes.timeseries.meanNormalize();
-      if (ts_detrendbox->isChecked()) li->tes.timeseries.removeDrift();
-      if (vv.getLength() != li->tes.timeseries.getLength())
-        vv = li->tes.timeseries;
-      else
-        vv += li->tes.timeseries;
-    }
-    vv /= myregion.size();
+    VBRegionTS rts;
+    VBMatrix means;
+    rts.addRegion(myregion);
+    if (rts.extractMeans(li->tes, flags, means)) return;
+    VB_Vector vv = means.GetColumn(0);
     if (ts_powerbox->isChecked()) {
       vv = fftnyquist(vv);
       vv[0] = 0;
@@ -144,6 +133,13 @@ void VBView::UpdateTS(bool clearflag) {
   ts_scalebox->show();
 
   li->glmi.loadcombinedmask();
+  // the raw region time series is needed for the raw, fitted, and
+  // residual plots, but we only want to read it once
+  VB_Vector rawts;
+  bool f_raw = (tslist->item(1)->isSelected() ||
+                tslist->item(2)->isSelected() ||
+                (tslist->item(0)->isSelected() && !ts_pcabox->isChecked()));
+  if (f_raw) rawts = li->glmi.getRegionTS(myregion, flags);
 
   // average time series and residuals
   // RAW TIME SERIES
@@ -164,8 +160,7 @@ void VBView::UpdateTS(bool clearflag) {
         tspane->addVector(vv, "blue");
       }
     } else {
-      VB_Vector vv;
-      vv = li->glmi.getRegionTS(myregion, flags);
+      VB_Vector vv = rawts;
       if (vv.size() == 0) return;
       if (ts_filterbox->isChecked()) li->glmi.filterTS(vv);
       if (ts_removebox->isChecked()) li->glmi.adjustTS(vv);
@@ -183,8 +178,7 @@ void VBView::UpdateTS(bool clearflag) {
   // FITTED VALUES
   if (tslist->item(1)->isSelected()) {
     // first, let's get the betas.  easiest just to regress
-    VB_Vector vv;
-    vv = li->glmi.getRegionTS(myregion, flags);
+    VB_Vector vv = rawts;
     if (vv.size() == 0) return;
     if (li->glmi.Regress(vv)) return;
     // now grab the KG (or just G) matrix
@@ -237,7 +231,7 @@ void VBView::UpdateTS(bool clearflag) {
   // RESIDUALS
   if (tslist->item(2)->isSelected()) {
     VB_Vector vv;
-    vv = li->glmi.getResid(myregion, flags);
+    if (rawts.size()) vv = li->glmi.getResid(rawts);
     if (myaverage) vv = myaverage->getTrialAverage(vv);
     if (ts_powerbox->isChecked()) {
       vv = fftnyquist(vv);